@@ -34,9 +34,11 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <stdarg.h>
 #include <stdlib.h>
+#include "e86trace.h"
 
-typedef unsigned long DWORD;
+typedef unsigned int DWORD;     // 32 bits, as on the DOS compilers
 typedef unsigned short WORD;
 typedef unsigned char BYTE;
 
@@ -83,13 +85,20 @@ typedef struct {
 char SourceBuffer[MAXLEN];
 FILE* SourceFile;
 
+BOOL   ShowStats = FALSE;
+char * TraceName = 0;
+
 //////////////////////////////////////////////////////////////////////////
 // ErrExit() prints an error message and exits the program.
 //
 void ErrExit(char * s,...)
 {
     char Buffer[400];
-    vsprintf(Buffer,s,(LPVOID)(&s+1));
+    va_list Args;
+
+    va_start(Args,s);
+    vsnprintf(Buffer,sizeof(Buffer),s,Args);
+    va_end(Args);
     printf("\nEditMon Error -- %s\n\n",Buffer);
     exit(2);
 }
@@ -105,12 +114,17 @@ void ShowHelp(void)
 "    EditMon -- AMD 186 EMon editor version 3.10.\n"
 "                      Copyright (C) 1996, Advanced Micro Devices.\n"
 "    Syntax:\n"
-"         EditMon <filename>  [string value]\n"
+"         EditMon [options] <filename>  [string value]\n"
                                                                       "\n"
 "    EditMon will show the permanent variables stored in <filename>.exe.\n"
                                                                       "\n"
 "    If the string and value are also given, EditMon will alter and\n"
 "    save the .EXE file with new parameters.\n"
+                                                                      "\n"
+"    Options:\n"
+"         --stats           Print time and bytes for each phase\n"
+"         --trace=<file>    Write each phase to <file> as Chrome trace\n"
+"                           events (chrome://tracing, Perfetto)\n"
     );
     exit(1);
 }
@@ -142,22 +156,44 @@ void main(int argc, char* argv[])
 
     ExeHdrPtr ep = (ExeHdrPtr)SourceBuffer;
     LPPERM    PermArray;
+    char *    Args[3];
+    int       NumArgs = 0;
+    int       i;
+    double    Start;
+
+
+    for (i = 1; i < argc; i++)
+        if (strcmp(argv[i],"--stats") == 0)
+            ShowStats = TRUE;
+        else if ((strncmp(argv[i],"--trace=",8) == 0) && (argv[i][8] != 0))
+            TraceName = argv[i]+8;
+        else if ((strncmp(argv[i],"--",2) == 0) || (NumArgs == 3))
+            ShowHelp();
+        else
+            Args[NumArgs++] = argv[i];
 
-
-    if ((argc != 2) && (argc != 4))
+    if (((NumArgs != 1) && (NumArgs != 3)) ||
+        (strlen(Args[0]) + 5 > sizeof(ExeName)))
         ShowHelp();
 
-    strcpy(ExeName,argv[1]);
+    if ((ShowStats || (TraceName != 0)) &&
+        (E86TraceOpen(TraceName, ShowStats) != 0))
+        ErrExit("Cannot create trace file %s",TraceName);
+
+    strcpy(ExeName,Args[0]);
     strcat(ExeName,".exe");
 
+    Start = E86TraceNow();
     if ((SourceFile=fopen(ExeName,"r+b")) == 0)
         ErrExit("Cannot open source file %s",ExeName);
 
 
     Length = fread(SourceBuffer,1,MAXLEN,SourceFile);
+    E86TracePhase("read", ExeName, Start, E86TraceNow(), Length, 0, 0);
     if (Length < 1024)
         ErrExit("File read error");
 
+    Start = E86TraceNow();
     if (ep->MagicNumber != 0x5A4D)
         ErrExit("Invalid EXE signature");
 
@@ -166,7 +202,7 @@ void main(int argc, char* argv[])
 
     FileLength = ep->PagesInFile*512-((512-ep->BytesLastPg)%512);
     if (Length <  FileLength)
-        ErrExit("File Read Error: expected %lu, got %u",
+        ErrExit("File Read Error: expected %u, got %u",
                  FileLength, Length);
 
     Length =  FileLength;
@@ -179,20 +215,22 @@ void main(int argc, char* argv[])
          (ep->EntryOffset != 0) ||
          (memcmp(DataPtr+2,"AMD LPD 01",10) != 0) )
         ErrExit("Not a valid E86MON executable");
+    E86TracePhase("header", ExeName, Start, E86TraceNow(), sizeof(*ep), 0, 0);
 
-    if (argc == 4)
+    if (NumArgs == 3)
     {
+        Start = E86TraceNow();
         PermArray = (LPPERM)(DataPtr + *(LPWORD)(DataPtr+12));
 
         if (PermArray->Name == 0)
             PermArray++;
 
         while ((PermArray->Name != 0) &&
-            (strcmp((char *)(DataPtr+PermArray->Name),argv[2]) != 0) )
+            (strcmp((char *)(DataPtr+PermArray->Name),Args[1]) != 0) )
             PermArray++;
 
         if (PermArray->Name != 0)
-            if (ParseDecimal(argv[3],(LPDWORD)(DataPtr+PermArray->Ptr)))
+            if (ParseDecimal(Args[2],(LPDWORD)(DataPtr+PermArray->Ptr)))
             {
                 if ((fseek(SourceFile,0,SEEK_SET) != 0) ||
                     (fwrite(SourceBuffer,1,(WORD)FileLength,SourceFile)
@@ -200,11 +238,15 @@ void main(int argc, char* argv[])
                     ErrExit("File write failed");
             }
             else
-                ErrExit("'%s' is not a valid decimal value",argv[3]);
+                ErrExit("'%s' is not a valid decimal value",Args[2]);
         else
-            ErrExit("Cannot find variable '%s'!",argv[2]);
+            ErrExit("Cannot find variable '%s'!",Args[1]);
+        E86TracePhase("update", ExeName, Start, E86TraceNow(), 0, FileLength,
+                      1);
     }
 
+    Start = E86TraceNow();
+    i = 0;
 
     PermArray = (LPPERM)(DataPtr + *(LPWORD)(DataPtr+12));
 
@@ -214,12 +256,15 @@ void main(int argc, char* argv[])
     printf("\n\nCurrent permanent variable values:\n\n");
     while (PermArray->Name != 0)
     {
-        printf("    %-10s = %lu\n",DataPtr+PermArray->Name,
+        printf("    %-10s = %u\n",DataPtr+PermArray->Name,
                *(LPDWORD)(DataPtr+PermArray->Ptr));
         if (PermArray->Default != 0xFFFFFFFF)
             printf("           WARNING!  Default is not -1!!!!!\n");
         PermArray++;
+        i++;
     }
+    E86TracePhase("list", ExeName, Start, E86TraceNow(), 0, 0, i);
+    E86TraceClose(stdout);
     exit(0);
 }
 
@@ -38,8 +38,13 @@
 #include <stdio.h>
 //#include <dos.h>
 #include <string.h>
+#include <stdarg.h>
 #include <stdlib.h>
 #include <sys/stat.h>
+#include <pthread.h>
+#include "e86cache.h"
+#include "e86trace.h"
+#include "hexkern.h"
 
 typedef unsigned long DWORD;
 typedef unsigned short WORD;
@@ -56,6 +61,13 @@ typedef char *    LPSTR;
 #define FALSE 0
 #define TRUE 1
 
+//
+// Cache entries are keyed on this, so change it whenever the same input
+// gives different ROM images.
+//
+#define TOOLVERSION  "MakeBin 1.0/2"
+#define NUMROMS      5
+
 //
 // ExeHeader structure from Microsoft's MS-DOS programmer's manual,
 // version 5.0
@@ -75,11 +87,36 @@ typedef struct {
    WORD EntrySegment;
    WORD ReloTableAddr;
 } ExeHdr;
+
+//
+// One ROM image, made by a writer thread.  The NumRoms images of a set
+// take every NumRoms'th byte of the program, starting with WhichRom;
+// main() splits them out before the threads start.
+//
+typedef struct {
+    char * Name;
+    DWORD  RomSize;
+    DWORD  BootSize;
+    DWORD  NumRoms;
+    DWORD  WhichRom;
+    DWORD  SrcFileLoc;
+    DWORD  SrcLength;
+    LPBYTE Lane;                // The program bytes this ROM holds
+    DWORD  LaneSum;
+    DWORD  Checksum;
+} ROMJOB;
  
 char ExeName[128];
 
-FILE* SourceFile;
-FILE* DestFile;
+LPBYTE Source;                  // The whole .exe, read once
+DWORD  SourceLength;
+
+char * CacheDir = 0;
+DWORD  CacheMB = 0;
+BOOL   UseCache = FALSE;
+BOOL   ShowStats = FALSE;
+BOOL   Verify = FALSE;
+char * TraceName = 0;
 
 //////////////////////////////////////////////////////////////////////////
 // ErrExit() prints an error message and exits the program.
@@ -87,7 +124,11 @@ FILE* DestFile;
 void ErrExit(char * s,...)
 {
     char Buffer[400];
-    vsprintf(Buffer,s,(LPVOID)(&s+1));
+    va_list Args;
+
+    va_start(Args,s);
+    vsnprintf(Buffer,sizeof(Buffer),s,Args);
+    va_end(Args);
     printf("\nMakeBin Error -- %s\n\n",Buffer);
     exit(2);
 }
@@ -103,7 +144,18 @@ void ShowHelp(void)
 "    MakeBin -- AMD E86Mon ROM image generator version 1.0.\n"
 "                      Copyright (C) 1997, Advanced Micro Devices.\n"
 "    Syntax:\n"
-"         MakeBin <filename>\n"
+"         MakeBin [options] <filename>\n"
+                                                                      "\n"
+"    Options:\n"
+"         --cache[=<dir>]   Reuse earlier images made from the same file\n"
+"                           ($E86_CACHE, or ~/.cache/e86mon)\n"
+"         --cache-size=<MB> Size the cache is trimmed to ($E86_CACHE_SIZE,\n"
+"                           or 256)\n"
+"         --verify          Read the images back once made, and check\n"
+"                           they hold the program and their checksums\n"
+"         --stats           Print time, bytes and records for each phase\n"
+"         --trace=<file>    Write each phase to <file> as Chrome trace\n"
+"                           events (chrome://tracing, Perfetto)\n"
                                                                       "\n"
 "    MakeBin will take <filename>.exe, and generate the following files:\n\n"
 "        F010_ALL.BIN     -- Used in 188ES, 188EM boards\n"
@@ -118,111 +170,200 @@ void ShowHelp(void)
 
 
 //////////////////////////////////////////////////////////////////////////
-// ReadFile reads from the source file and returns a pointer to data
-// which has been read.  It always physically reads on sector (512 byte)
-// boundaries, and its buffer is 16K + 512 bytes, so that the maximum
-// size read it can return is 16K.
+// ReadSource() reads the whole source file into memory, in one read, so
+// that every image can be made from it at once.
 //
-void * ReadFile(DWORD offset, WORD size)
+void ReadSource(DWORD FileLength)
 {
-    static char SourceBuffer[0x4200];
-    static DWORD CurOffset = 0;
-    static WORD  CurSize = 0;
+    FILE * SourceFile;
+    double Start = E86TraceNow();
 
-    if ((offset < CurOffset) || (offset + size > CurOffset + CurSize))
-    {
-        CurOffset = offset & 0xFFFFFE00;
-        if (fseek(SourceFile,CurOffset, SEEK_SET))
-            ErrExit("File seek failed");
-        CurSize = fread(SourceBuffer,1,sizeof(SourceBuffer),SourceFile);
+    if ((SourceFile=fopen(ExeName,"rb")) == 0)
+        ErrExit("Cannot open source file %s",ExeName);
+    if ((Source = malloc(FileLength + 1)) == 0)
+        ErrExit("Out of memory");
+    SourceLength = fread(Source,1,FileLength,SourceFile);
+    fclose(SourceFile);
+    E86TracePhase("read", ExeName, Start, E86TraceNow(), SourceLength, 0, 0);
+}
 
-        if ((offset < CurOffset) || (offset + size > CurOffset + CurSize))
-            ErrExit("file read failed");
-    };
-    return SourceBuffer + (WORD)(offset-CurOffset);
+//////////////////////////////////////////////////////////////////////////
+// ImageEnd() returns the offset in the source file just past the last
+// byte an image takes from it.
+//
+DWORD ImageEnd(ROMJOB * Job)
+{
+    DWORD DestLength = (Job->SrcLength + Job->WhichRom) / Job->NumRoms;
+
+    if (DestLength == 0)
+        return 0;
+    return Job->SrcFileLoc + Job->WhichRom + (DestLength-1)*Job->NumRoms + 1;
 }
 
-void WriteFile(LPVOID Data, WORD Size)
+//////////////////////////////////////////////////////////////////////////
+// ImageFits() tells whether an image's share of the program fits in the
+// boot block, below the paragraph holding the reset vector.
+//
+BOOL ImageFits(ROMJOB * Job)
 {
-    if (fwrite(Data,1,Size,DestFile) != Size)
-        ErrExit("File Write Error");
+    return (Job->SrcLength + Job->WhichRom) / Job->NumRoms <=
+           (Job->BootSize - 0x10) / Job->NumRoms;
 }
 
-void CreateFile(LPSTR FName, DWORD RomSize, DWORD BootSize,
-                    DWORD NumRoms, DWORD WhichRom,
-                    DWORD SrcFileLoc, DWORD SrcLength)
+//////////////////////////////////////////////////////////////////////////
+// CreateFile() makes one ROM image, and leaves its checksum in the job.
+// It runs on a writer thread of its own.  The image is built whole in
+// memory, filled with 0xFF in one go, with the lane main() split out for
+// it and the reset vector copied in, and then written with one call.
+// The 0xFF padding is counted into the checksum by multiplying.
+//
+void * CreateFile(void * Arg)
 {
-    DWORD DestLength    = (SrcLength + WhichRom) / NumRoms;
+    ROMJOB * Job        = Arg;
+    LPSTR FName         = Job->Name;
+    DWORD RomSize       = Job->RomSize;
+    DWORD BootSize      = Job->BootSize;
+    DWORD NumRoms       = Job->NumRoms;
+    DWORD WhichRom      = Job->WhichRom;
+    DWORD DestLength    = (Job->SrcLength + WhichRom) / NumRoms;
     DWORD FirstFFLength = (RomSize - BootSize/NumRoms);
     DWORD LastFFLength  = (BootSize - 0x10)/NumRoms - DestLength;
     BYTE  FarJump       = 0xEA;
     WORD  AddrOffset    = 0;
     WORD  AddrSegment   = 0 - (WORD)(BootSize/16);
 
-    DWORD Checksum      = 0xFFL * (FirstFFLength+LastFFLength);
+    DWORD Checksum      = 0xFFL * (FirstFFLength+LastFFLength) +
+                          Job->LaneSum;
 
-    static BYTE FileBuffer[8192];  // Half the size of FileRead's buffer
-    WORD  Chunk;
-    LPBYTE SrcPtr;
+    BYTE  Reset[16];            // The last paragraph of the 1M space
+    LPBYTE Image;
+    LPBYTE Tail;
+    FILE* DestFile;
     WORD i;
-
+    double Start = E86TraceNow();
+    DWORD ImageIn = DestLength * NumRoms;
+
+    if (!ImageFits(Job))
+        ErrExit("Program is %lX bytes, too big for %s",Job->SrcLength,FName);
+    if ((Image = malloc(RomSize)) == 0)
+        ErrExit("Out of memory");
+    memset(Image,0xFF,RomSize);
+    memcpy(Image+FirstFFLength,Job->Lane,DestLength);
+
+    memset(Reset,0xFF,sizeof(Reset));
+    Reset[0] = FarJump;
+    Reset[1] = (BYTE)AddrOffset;
+    Reset[2] = (BYTE)(AddrOffset >> 8);
+    Reset[3] = (BYTE)AddrSegment;
+    Reset[4] = (BYTE)(AddrSegment >> 8);
+    Tail = Image + FirstFFLength + DestLength + LastFFLength;
+    for (i=0; i<16/NumRoms; i++)
+        Checksum+= (Tail[i] = Reset[i*NumRoms+WhichRom]);
 
     if ((DestFile=fopen(FName,"wb")) == 0)
         ErrExit("Cannot create destination file %s",FName);
+    if ((fwrite(Image,1,RomSize,DestFile) != RomSize) ||
+        (fclose(DestFile) != 0))
+        ErrExit("File Write Error");
+    free(Image);
 
-    memset(FileBuffer,0xFF,sizeof(FileBuffer));
+    E86TracePhase("image", FName, Start, E86TraceNow(), ImageIn, RomSize, 0);
+    Job->Checksum = Checksum;
+    return 0;
+}
 
-    while (FirstFFLength > 0)
-    {
-        Chunk = sizeof(FileBuffer);
-        if (Chunk > FirstFFLength)
-            Chunk = FirstFFLength;
-        WriteFile(FileBuffer,Chunk);
-        FirstFFLength  -= Chunk;
-    }
 
-    while (DestLength>0)
-    {
-        Chunk = sizeof(FileBuffer);
-        if (Chunk > DestLength)
-            Chunk = DestLength;
+//////////////////////////////////////////////////////////////////////////
+// ReadImage() reads back a ROM image MakeBin wrote, and checks its size
+// and checksum.  Returns a pointer to its program bytes.
+//
+LPBYTE ReadImage(ROMJOB * Job)
+{
+    FILE * f;
+    LPBYTE Image;
+    DWORD  Got;
+
+    if ((Image = malloc(Job->RomSize + 1)) == 0)
+        ErrExit("Out of memory");
+    if ((f = fopen(Job->Name,"rb")) == 0)
+        ErrExit("Cannot open %s to verify it",Job->Name);
+    Got = fread(Image,1,Job->RomSize + 1,f);
+    fclose(f);
+
+    if ((Got != Job->RomSize) || (HexSum(Image,Got) != Job->Checksum))
+        ErrExit("%s does not read back as written",Job->Name);
+    return Image + Job->RomSize - Job->BootSize/Job->NumRoms;
+}
 
-        SrcPtr = ReadFile(SrcFileLoc+WhichRom, (WORD)(Chunk*NumRoms));
+//////////////////////////////////////////////////////////////////////////
+// VerifyImages() reads back all the images, and checks that the program
+// comes out of each of them as it went in.  The two halves of a 16 bit
+// pair are put back together to compare them with the program.
+//
+void VerifyImages(ROMJOB * Jobs)
+{
+    LPBYTE Program = Source + Jobs[0].SrcFileLoc;
+    DWORD  Length  = Jobs[0].SrcLength;
+    LPBYTE Image[NUMROMS];
+    LPBYTE Pair;
+    int    i;
+    double Start = E86TraceNow();
+
+    for (i = 0; i < NUMROMS; i++)
+    {
+        Image[i] = ReadImage(&Jobs[i]);
+        if ((Jobs[i].NumRoms == 1) && (memcmp(Image[i],Program,Length) != 0))
+            ErrExit("%s does not hold the program",Jobs[i].Name);
+    }
 
-        for (i=0;i<Chunk;i++)
-        {
-            Checksum += (FileBuffer[i] = *SrcPtr);
-            SrcPtr += NumRoms;
-        }
+    //
+    // With an odd length the high ROM also holds the byte after the
+    // program, and the low ROM stops a byte short of it.
+    //
+    if ((Pair = malloc(Length + 1)) == 0)
+        ErrExit("Out of memory");
+    HexInterleave(Image[1], Image[2], Length/2, Pair);
+    if ((memcmp(Pair,Program,Length & ~1L) != 0) ||
+        ((Length & 1) && (Image[2][Length/2] != Program[Length])))
+        ErrExit("%s and %s do not hold the program",
+                Jobs[1].Name,Jobs[2].Name);
+    free(Pair);
+
+    for (i = 0; i < NUMROMS; i++)
+        free(Image[i] - (Jobs[i].RomSize - Jobs[i].BootSize/Jobs[i].NumRoms));
+    E86TracePhase("verify", 0, Start, E86TraceNow(), 0, 0, 0);
+    printf("Images verified.\n");
+}
 
-        WriteFile(FileBuffer,Chunk);
+//////////////////////////////////////////////////////////////////////////
+// ParseOption() handles one --option.  Returns FALSE if it is not valid.
+//
+BOOL ParseOption(char * Opt)
+{
+    char * End;
 
-        SrcFileLoc += Chunk*NumRoms;
-        DestLength  -= Chunk;
+    if (strcmp(Opt,"cache") == 0)
+        UseCache = TRUE;
+    else if ((strncmp(Opt,"cache=",6) == 0) && (Opt[6] != 0))
+    {
+        UseCache = TRUE;
+        CacheDir = Opt+6;
     }
-
-    memset(FileBuffer,0xFF,sizeof(FileBuffer));
-
-    while (LastFFLength > 0)
+    else if ((strncmp(Opt,"cache-size=",11) == 0) && (Opt[11] != 0))
     {
-        Chunk = sizeof(FileBuffer);
-        if (Chunk > LastFFLength)
-            Chunk = LastFFLength;
-        WriteFile(FileBuffer,Chunk);
-        LastFFLength  -= Chunk;
+        CacheMB = strtoul(Opt+11,&End,10);
+        if ((*End != 0) || (CacheMB == 0))
+            return FALSE;
     }
-
-    FileBuffer[16] = FarJump;
-    *((LPWORD)(FileBuffer+17)) = AddrOffset;
-    *((LPWORD)(FileBuffer+19)) = AddrSegment;
-    for (i=0; i<16/NumRoms; i++)
-        Checksum+= (FileBuffer[i] = FileBuffer[16+i*NumRoms+WhichRom]);
-
-    WriteFile(FileBuffer,(16/(WORD)NumRoms));
-
-    fclose(DestFile);
-    printf("File %s written successfully, checksum = %lX.\n",
-           FName,Checksum);
+    else if (strcmp(Opt,"verify") == 0)
+        Verify = TRUE;
+    else if (strcmp(Opt,"stats") == 0)
+        ShowStats = TRUE;
+    else if ((strncmp(Opt,"trace=",6) == 0) && (Opt[6] != 0))
+        TraceName = Opt+6;
+    else
+        return FALSE;
+    return TRUE;
 }
 
 
@@ -238,22 +379,88 @@ int main(int argc, char* argv[])
 //    WORD      ProgAddress;
 	struct stat sr;
     ExeHdr    eh;
+    char *    Name = 0;
+    int       i;
+
+    static char * RomName[NUMROMS] = {
+        "F010_ALL.BIN", "F010_LOW.BIN", "F010_HI.BIN",
+        "F200_ALL.BIN", "F400_ALL.BIN" };
+    DWORD     Checksum[NUMROMS];
+    ROMJOB    Jobs[NUMROMS];
+    pthread_t Threads[NUMROMS];
+    LPBYTE    Lanes;
+    DWORD     Pairs;
+    unsigned long Sums[2];
+    E86CACHE * Cache = 0;
+    char      Key[E86CACHE_KEYLEN];
+    char      Note[E86CACHE_NOTELEN];
+    double    Start;
+
+    for (i = 1; i < argc; i++)
+        if (strncmp(argv[i],"--",2) == 0)
+        {
+            if (!ParseOption(argv[i]+2))
+                ShowHelp();
+        }
+        else if (Name == 0)
+            Name = argv[i];
+        else
+            ShowHelp();
 
-    if (argc != 2)
+    if ((Name == 0) || (strlen(Name) + 5 > sizeof(ExeName)))
         ShowHelp();
 
-    strcpy(ExeName,argv[1]);
+    strcpy(ExeName,Name);
     strcat(ExeName,".exe");
 
-    if ((SourceFile=fopen(ExeName,"rb")) == 0)
-        ErrExit("Cannot open source file %s",ExeName);
+    if ((ShowStats || (TraceName != 0)) &&
+        (E86TraceOpen(TraceName, ShowStats) != 0))
+        ErrExit("Cannot create trace file %s",TraceName);
+
+    //
+    // The images depend on nothing but the .exe, so when it has been
+    // seen before they come straight from the cache.
+    //
+    if ((UseCache || (getenv("E86_CACHE") != 0)) &&
+        ((Cache = E86CacheOpen(CacheDir, CacheMB)) == 0))
+        printf("MakeBin Warning -- cannot use the cache directory, "
+               "building without it.\n");
+
+    Start = E86TraceNow();
+    if ((Cache != 0) &&
+        (E86CacheKey(Key, TOOLVERSION, "", ExeName) == 0))
+    {
+        if (E86CacheFetch(Cache, Key, (const char * const *)RomName,
+                          NUMROMS, Note) &&
+            (sscanf(Note, "%lX %lX %lX %lX %lX", &Checksum[0], &Checksum[1],
+                    &Checksum[2], &Checksum[3], &Checksum[4]) == NUMROMS))
+        {
+            E86TracePhase("cache", ExeName, Start, E86TraceNow(), 0, 0, 0);
+            for (i = 0; i < NUMROMS; i++)
+                printf("File %s written successfully, checksum = %lX.\n",
+                       RomName[i],Checksum[i]);
+            E86CacheReport(Cache, stdout);
+            E86CacheClose(Cache);
+            E86TraceClose(stdout);
+            exit(0);
+        }
+        E86TracePhase("cache", ExeName, Start, E86TraceNow(), 0, 0, 0);
+    }
+    else
+        Key[0] = 0;
 
-	stat(ExeName, &sr);
-	FileLength = sr.st_size;
+    if (stat(ExeName, &sr) != 0)
+        ErrExit("Cannot open source file %s",ExeName);
+    FileLength = sr.st_size;
 
     //FileLength = _filelength(_fileno(SourceFile));
 
-    memcpy(&eh,ReadFile(0,sizeof(eh)),sizeof(eh));
+    ReadSource(FileLength);
+
+    Start = E86TraceNow();
+    if (SourceLength < sizeof(eh))
+        ErrExit("file read failed");
+    memcpy(&eh,Source,sizeof(eh));
 
     if (eh.MagicNumber != 0x5A4D)
         ErrExit("Invalid EXE signature");
@@ -270,12 +477,89 @@ int main(int argc, char* argv[])
 
     SrcFileLoc = eh.ParsInHdr*16;
     Length -= eh.ParsInHdr*16;
+    E86TracePhase("header", ExeName, Start, E86TraceNow(), sizeof(eh), 0, 0);
+
+    //
+    // All five images come from the one copy of the file, each written
+    // by a thread of its own.  The program must fit every image, and the
+    // source must hold every byte any of them takes, before any is
+    // started, so that a bad file leaves no images half made.
+    //
+    for (i = 0; i < NUMROMS; i++)
+    {
+        static const DWORD RomSize[NUMROMS] = {
+            0x20000L, 0x20000L, 0x20000L, 0x40000L, 0x80000L };
+        static const BYTE NumRoms[NUMROMS]  = { 1, 2, 2, 1, 1 };
+        static const BYTE WhichRom[NUMROMS] = { 0, 0, 1, 0, 0 };
+
+        Jobs[i].Name       = RomName[i];
+        Jobs[i].RomSize    = RomSize[i];
+        Jobs[i].BootSize   = 0x8000L;
+        Jobs[i].NumRoms    = NumRoms[i];
+        Jobs[i].WhichRom   = WhichRom[i];
+        Jobs[i].SrcFileLoc = SrcFileLoc;
+        Jobs[i].SrcLength  = Length;
+        if (!ImageFits(&Jobs[i]))
+            ErrExit("Program is %lX bytes, too big for %s (at most %lX)",
+                    Length,RomName[i],Jobs[i].BootSize - 0x10);
+        if (ImageEnd(&Jobs[i]) > SourceLength)
+            ErrExit("file read failed");
+    }
+
+    //
+    // The program is split into the two lanes of the 16 bit pair, with
+    // both their sums, in one pass.  The low ROM takes one byte less than
+    // the high one of a program of odd length.
+    //
+    Start = E86TraceNow();
+    Pairs = (Length + 1) / 2;
+    if ((Lanes = malloc(2 * Pairs + 1)) == 0)
+        ErrExit("Out of memory");
+    HexSplitLanes(Source+SrcFileLoc, Pairs, Lanes, Lanes+Pairs, Sums);
+    if ((Length & 1) != 0)
+        Sums[0] -= Lanes[Pairs-1];
+
+    for (i = 0; i < NUMROMS; i++)
+        if (Jobs[i].NumRoms == 1)
+            Jobs[i].Lane = Source+SrcFileLoc;
+        else
+            Jobs[i].Lane = Lanes + Jobs[i].WhichRom*Pairs;
+    Jobs[0].LaneSum = HexSum(Source+SrcFileLoc, Length);
+    Jobs[1].LaneSum = Sums[0];
+    Jobs[2].LaneSum = Sums[1];
+    Jobs[3].LaneSum = Jobs[4].LaneSum = Jobs[0].LaneSum;
+    E86TracePhase("lanes", ExeName, Start, E86TraceNow(), Length, 2*Pairs, 0);
+
+    for (i = 1; i < NUMROMS; i++)
+        if (pthread_create(&Threads[i], 0, CreateFile, &Jobs[i]) != 0)
+            ErrExit("Cannot start writer thread");
+    CreateFile(&Jobs[0]);
+    for (i = 1; i < NUMROMS; i++)
+        pthread_join(Threads[i], 0);
+
+    for (i = 0; i < NUMROMS; i++)
+    {
+        Checksum[i] = Jobs[i].Checksum;
+        printf("File %s written successfully, checksum = %lX.\n",
+               RomName[i],Checksum[i]);
+    }
+    if (Verify)
+        VerifyImages(Jobs);
+    free(Lanes);
 
-    CreateFile("F010_ALL.BIN",0x20000L, 0x8000L, 1, 0, SrcFileLoc, Length);
-    CreateFile("F010_LOW.BIN",0x20000L, 0x8000L, 2, 0, SrcFileLoc, Length);
-    CreateFile("F010_HI.BIN", 0x20000L, 0x8000L, 2, 1, SrcFileLoc, Length);
-    CreateFile("F200_ALL.BIN",0x40000L, 0x8000L, 1, 0, SrcFileLoc, Length);
-    CreateFile("F400_ALL.BIN",0x80000L, 0x8000L, 1, 0, SrcFileLoc, Length);
+    if (Cache != 0)
+    {
+        if (Key[0] != 0)
+        {
+            sprintf(Note, "%lX %lX %lX %lX %lX\n", Checksum[0], Checksum[1],
+                    Checksum[2], Checksum[3], Checksum[4]);
+            E86CacheStore(Cache, Key, (const char * const *)RomName,
+                          NUMROMS, Note);
+        }
+        E86CacheReport(Cache, stdout);
+        E86CacheClose(Cache);
+    }
+    E86TraceClose(stdout);
 
     exit(0);
 }
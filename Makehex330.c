@@ -43,66 +43,56 @@
  * Austin, TX 78741                                                           *
  *****************************************************************************/
 
-//#include <io.h>
 #include <stdio.h>
-//#include <dos.h>
 #include <sys/stat.h>
 #include <string.h>
+#include <strings.h>
 #include <stdlib.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include "e86hex.h"
+#include "e86cache.h"
+#include "e86trace.h"
+#include "hexkern.h"
+
+#define NAMELEN  128
+#define MAXFORMATTERS  64   // Threads formatting one image
 
-typedef unsigned long DWORD;
-typedef unsigned short WORD;
-typedef unsigned char BYTE;
-
-typedef WORD BOOL;
-
-typedef void *    LPVOID;
-typedef DWORD *   LPDWORD;
-typedef WORD *    LPWORD;
-typedef BYTE *    LPBYTE;
+//
+// Cache entries are keyed on this, so change it whenever the same input
+// and options give different output.
+//
+#define TOOLVERSION  "MakeHex 3.30/2"
 
-#define FALSE 0
-#define TRUE 1
-#define BYTESPERLINE  32    // MUST Be power of 2!!!
+//
+// Command line options.  Opts holds those passed on to libe86hex.
+//
+E86HEXOPTIONS Opts;
+BOOL  BatchMode = FALSE;
+BOOL  SegOption = FALSE;
+DWORD SegOptionValue = 0;
+DWORD NumThreads = 0;
+int   StreamFd = -1;
+int   StreamType = E86HEX_AUTO;
+BOOL  BinaryOut = FALSE;
+char * SidecarName = 0;
+BOOL  UseCache = FALSE;
+char * CacheDir = 0;
+DWORD CacheMB = 0;
+char * DeltaName = 0;
+BOOL  ShowStats = FALSE;
+char * TraceName = 0;
+
+E86CACHE * Cache = 0;
 
 //
-// ExeHeader structure from Microsoft's MS-DOS programmer's manual,
-// version 5.0
+// Messages go to stderr when the hex records go to stdout.
 //
-typedef struct {
-   WORD MagicNumber;
-   WORD BytesLastPg;        // NOTE!  Modulo-512
-   WORD PagesInFile;
-   WORD Relocations;
-   WORD ParsInHdr;
-   WORD ExtraParsNeeded;
-   WORD ExtraParsWanted;
-   WORD InitStackSegment;
-   WORD InitStackOffset;
-   WORD WordXsum;
-   WORD EntryOffset;
-   WORD EntrySegment;
-   WORD ReloTableAddr;
-} ExeHdr;
-
-//
-// E86Mon library extension definition:
-struct {
-    WORD    ShortJmp;          // Jump around the rest of this
-    BYTE    Signature[22];
-} LibSig = {0x16EB,"E86Mon Lib Extension 1"};
- 
-char ExeName[128];
-char ComName[128];
-char BinName[128];
-char DestName[128];
-
-FILE* SourceFile;
-FILE* DestFile;
-BYTE CheckSum;
-BOOL WholeFileInMemory = FALSE;
-WORD  OutputAddress = 0;
-WORD  OutputSegment = 0;
+FILE * Msgs;
 
 //////////////////////////////////////////////////////////////////////////
 // ErrExit() prints an error message and exits the program.
@@ -110,8 +100,12 @@ WORD  OutputSegment = 0;
 void ErrExit(char * s,...)
 {
     char Buffer[400];
-    vsprintf(Buffer,s,(LPVOID)(&s+1));
-    printf("\nMakeHex Error -- %s\n\n",Buffer);
+    va_list Args;
+
+    va_start(Args,s);
+    vsnprintf(Buffer,sizeof(Buffer),s,Args);
+    va_end(Args);
+    fprintf(Msgs,"\nMakeHex Error -- %s\n\n",Buffer);
     exit(2);
 }
 
@@ -127,7 +121,9 @@ void ShowHelp(void)
 "                      Copyright (C) 1996, Advanced Micro Devices.\n"
 "                                    2017, Nils Stec\n"
 "    Syntax:\n"
-"         MakeHex <filename>  [<segment address>]\n"
+"         MakeHex [options] <filename>  [<segment address>]\n"
+"         MakeHex --batch [options] <file|@listfile|directory> ...\n"
+"         MakeHex [options] - [<segment address>]  < image > hexfile\n"
                                                                       "\n"
 "    MakeHex will take <filename>.exe, and generate <filename>.hex.\n"
                                                                       "\n"
@@ -139,39 +135,43 @@ void ShowHelp(void)
 "    If no <segment address> parameter is given, MakeHex will generate\n"
 "    a special hex file with relocation records which EMON understands.\n"
                                                                  "\n"
-"    This hex file will be loaded into RAM and relocated by EMON.\n\n"
+"    This hex file will be loaded into RAM and relocated by EMON.\n"
+                                                                 "\n"
+"    Options:\n"
+"         --record=<n>      Data bytes per hex record, 1 to 255 (32)\n"
+"         --record=auto     Pick the length with the fastest download\n"
+"         --baud=<n>        Serial rate used for estimates (19200)\n"
+"         --line-cost=<us>  E86Mon processing time per record (1000)\n"
+"         --skip-fill[=00|FF]  Leave out records holding only 00 or FF\n"
+"                           bytes (absolute mode only, default both)\n"
+"         --batch           Convert every file named, listed in a response\n"
+"                           file, or found in a directory, in one run\n"
+"         --segment=<seg>   Segment address for batch conversions\n"
+"         --threads=<n>     Batch worker threads, or threads formatting a\n"
+"                           single large image (one per CPU)\n"
+"         --fd=<n>          Stream from descriptor n, like - does stdin\n"
+"         --type=<t>        Streamed image is bin, com or exe (exe if it\n"
+"                           starts with MZ, otherwise bin)\n"
+"         --binary          Write the raw image to <filename>.img and its\n"
+"                           relocations to <filename>.rel, not hex\n"
+"         --sidecar=<file>  Name for the relocation file (needed when\n"
+"                           streaming)\n"
+"         --cache[=<dir>]   Reuse earlier output for the same input and\n"
+"                           options ($E86_CACHE, or ~/.cache/e86mon)\n"
+"         --cache-size=<MB> Size the cache is trimmed to ($E86_CACHE_SIZE,\n"
+"                           or 256)\n"
+"         --delta=<file>    Only write the records which differ from the\n"
+"                           .hex file, or image, the board was last loaded\n"
+"                           from\n"
+"         --stats           Print time, bytes and records for each phase\n"
+"         --trace=<file>    Write each phase to <file> as Chrome trace\n"
+"                           events (chrome://tracing, Perfetto)\n\n"
 
     );
     exit(1);
 }
 
 
-//////////////////////////////////////////////////////////////////////////
-// ReadFile() reads from the source file
-//
-void * ReadFile(DWORD offset, WORD size)
-{
-    static char SourceBuffer[0xA000];
-    static DWORD CurOffset = 0;
-    static WORD  CurSize = 0;
-
-    if ((offset < CurOffset) || (offset + size > CurOffset + CurSize))
-    {
-        if (WholeFileInMemory)
-            ErrExit("previous read failed to return full set of bytes");
-        CurOffset = offset & 0xFFFFFE00;
-        if (fseek(SourceFile,CurOffset, SEEK_SET))
-            ErrExit("File seek failed");
-        CurSize = fread(SourceBuffer,1,sizeof(SourceBuffer),SourceFile);
-
-        if ((offset < CurOffset) || (offset + size > CurOffset + CurSize))
-            ErrExit("file read failed");
-
-        WholeFileInMemory = (CurOffset == 0) && (CurSize < sizeof(SourceBuffer));
-    };
-    return SourceBuffer + (WORD)(offset-CurOffset);
-}
-
 //////////////////////////////////////////////////////////////////////////
 // ParseHex() parses hexadecimal numbers. Only returns TRUE if no non-hex
 // characters are encountered (unlike builtins such as scanf).
@@ -183,7 +183,7 @@ BOOL ParseHex(char* t,DWORD* value)
     while(isxdigit(*t))
     {
         *value *= 16;
-        if (*t < '9')
+        if (*t <= '9')
             *value += *t - '0';
         else
             *value += toupper(*t) - 'A' + 10;
@@ -193,409 +193,900 @@ BOOL ParseHex(char* t,DWORD* value)
 }
 
 //////////////////////////////////////////////////////////////////////////
-// PrintByte() prints a byte, and adds it to the line checksum.
+// ParseDecimal() parses decimal numbers. Only returns TRUE if no non-decimal
+// characters are encountered (unlike builtins such as scanf).
 //
-void PrintByte(BYTE what)
+BOOL ParseDecimal(char* t,DWORD* value)
 {
-    fprintf(DestFile, "%02X", what);
-    CheckSum += what;
-}
+    *value = 0;
 
-//////////////////////////////////////////////////////////////////////////
-// PrintWord() prints a word, and adds it to the line checksum.
-//
-void PrintWord(WORD what)
-{
-    PrintByte((BYTE)(what >> 8));
-    PrintByte((BYTE)what);
+    while(isdigit(*t))
+        *value  = *value * 10 + *(t++) - '0';
+
+    return (*t == 0);
 }
 
 //////////////////////////////////////////////////////////////////////////
-// PrintDWord() prints a double word, and adds it to the line checksum.
+// ParseOption() handles one --name=value command line option.  Returns
+// FALSE if the option is not understood.
 //
-void PrintDWord(DWORD what)
+BOOL ParseOption(char* Opt)
 {
-    PrintWord((WORD)(what >> 16));
-    PrintWord((WORD)what);
+    DWORD Value;
+
+    if (strcmp(Opt,"record=auto") == 0)
+        Opts.RecordLength = 0;
+    else if (strncmp(Opt,"record=",7) == 0)
+    {
+        if (!ParseDecimal(Opt+7,&Value) || (Value < 1) || (Value > MAXRECLEN))
+            return FALSE;
+        Opts.RecordLength = (WORD)Value;
+    }
+    else if (strncmp(Opt,"baud=",5) == 0)
+    {
+        if (!ParseDecimal(Opt+5,&Opts.Baud) || (Opts.Baud == 0))
+            return FALSE;
+    }
+    else if (strcmp(Opt,"skip-fill") == 0)
+        Opts.SkipFill = E86HEX_SKIP00 | E86HEX_SKIPFF;
+    else if (strcmp(Opt,"skip-fill=00") == 0)
+        Opts.SkipFill |= E86HEX_SKIP00;
+    else if ((strcmp(Opt,"skip-fill=FF") == 0) ||
+             (strcmp(Opt,"skip-fill=ff") == 0))
+        Opts.SkipFill |= E86HEX_SKIPFF;
+    else if (strncmp(Opt,"line-cost=",10) == 0)
+    {
+        if (!ParseDecimal(Opt+10,&Opts.LineCost))
+            return FALSE;
+    }
+    else if (strcmp(Opt,"batch") == 0)
+        BatchMode = TRUE;
+    else if (strncmp(Opt,"segment=",8) == 0)
+    {
+        if (!ParseHex(Opt+8,&SegOptionValue) || (SegOptionValue >= 0x10000))
+            return FALSE;
+        SegOption = TRUE;
+    }
+    else if (strncmp(Opt,"fd=",3) == 0)
+    {
+        if (!ParseDecimal(Opt+3,&Value) || (Opt[3] == 0) ||
+            (Value > 0x7FFFFFFF))
+            return FALSE;
+        StreamFd = (int)Value;
+    }
+    else if (strcmp(Opt,"binary") == 0)
+        BinaryOut = TRUE;
+    else if ((strncmp(Opt,"sidecar=",8) == 0) && (Opt[8] != 0))
+        SidecarName = Opt+8;
+    else if (strcmp(Opt,"cache") == 0)
+        UseCache = TRUE;
+    else if ((strncmp(Opt,"cache=",6) == 0) && (Opt[6] != 0))
+    {
+        UseCache = TRUE;
+        CacheDir = Opt+6;
+    }
+    else if (strncmp(Opt,"cache-size=",11) == 0)
+    {
+        if (!ParseDecimal(Opt+11,&CacheMB) || (CacheMB == 0))
+            return FALSE;
+    }
+    else if ((strncmp(Opt,"delta=",6) == 0) && (Opt[6] != 0))
+        DeltaName = Opt+6;
+    else if (strcmp(Opt,"stats") == 0)
+        ShowStats = TRUE;
+    else if ((strncmp(Opt,"trace=",6) == 0) && (Opt[6] != 0))
+        TraceName = Opt+6;
+    else if (strcmp(Opt,"type=bin") == 0)
+        StreamType = E86HEX_BIN;
+    else if (strcmp(Opt,"type=com") == 0)
+        StreamType = E86HEX_COM;
+    else if (strcmp(Opt,"type=exe") == 0)
+        StreamType = E86HEX_EXE;
+    else if (strncmp(Opt,"threads=",8) == 0)
+    {
+        if (!ParseDecimal(Opt+8,&NumThreads) || (NumThreads == 0))
+            return FALSE;
+    }
+    else
+        return FALSE;
+
+    return TRUE;
 }
 
 //////////////////////////////////////////////////////////////////////////
-// StartLine() initializes the checksum and prints the start
-//             of a line record
+// KnownExtension() returns the extension of Name if it is one MakeHex
+// converts (.bin, .com or .exe, in either case), or 0.
 //
-void StartLine(BYTE DataLen, WORD DataAddr, BYTE DataType)
+char * KnownExtension(char * Name)
 {
-    CheckSum = 0;
-    fprintf(DestFile, ":");
-    PrintByte(DataLen);
-    PrintWord(DataAddr);
-    PrintByte(DataType);
+    char * Ext = strrchr(Name,'.');
+
+    if ((Ext == 0) || (strchr(Ext,'/') != 0))
+        return 0;
+    if ((strcasecmp(Ext,".bin") == 0) || (strcasecmp(Ext,".com") == 0) ||
+        (strcasecmp(Ext,".exe") == 0))
+        return Ext;
+    return 0;
 }
 
 //////////////////////////////////////////////////////////////////////////
-// FinishLine() prints the checksum and end of line
+// Failed() reports a conversion that went wrong.  In batch mode only
+// that file is abandoned; otherwise the program ends.
 //
-void FinishLine(void)
+int Failed(char * Name, const char * Msg)
 {
-    CheckSum = 0 - CheckSum;
-    fprintf(DestFile, "%02X\n",CheckSum);
+    if (!BatchMode)
+        ErrExit("%s",Msg);
+
+    printf("%s: MakeHex Error -- %s\n", Name, Msg);
+    return 2;
 }
 
 //////////////////////////////////////////////////////////////////////////
-// SegRecord() prints a segment record
+// WriteSidecar() writes the relocation sidecar of a binary conversion.
+// Returns FALSE if it cannot.
 //
-void SegRecord(WORD SegNum)
+BOOL WriteSidecar(E86HEX * Ctx, const char * Name)
 {
-    StartLine(2,0,2);
-    PrintWord(SegNum);
-    FinishLine();
+    DWORD        Length;
+    const char * Data = E86HexSidecar(Ctx, &Length);
+    int          File;
+    BOOL         Ok;
+
+    if ((File = open(Name,O_WRONLY|O_CREAT|O_TRUNC,0666)) < 0)
+        return FALSE;
+    Ok = (write(File, Data, Length) == (ssize_t)Length);
+    return (close(File) == 0) && Ok;
 }
 
 //////////////////////////////////////////////////////////////////////////
-// DataRecord() prints a entire data record
+// LoadBaseline() gives Ctx the baseline for --delta: the named file if
+// it is a hex file, or else the hex file its image converts to with
+// the options in ConvOpts.  Returns 0, or an E86HEX_ error code with
+// the reason in Msg.
 //
-void DataRecord(LPBYTE Data, BYTE DataLen)
+int LoadBaseline(E86HEX * Ctx, E86HEXOPTIONS * ConvOpts, char * Msg,
+                 size_t MsgLen)
 {
-    StartLine(DataLen,OutputAddress,0);
+    E86HEX *     Base;
+    const char * Hex;
+    char *       Ext = KnownExtension(DeltaName);
+    char *       Text;
+    DWORD        Len;
+    FILE *       f;
+    long         Size;
+    int          Result;
+
+    if ((f = fopen(DeltaName,"rb")) == 0)
+    {
+        snprintf(Msg,MsgLen,"Cannot open baseline file %s",DeltaName);
+        return E86HEX_EOPEN;
+    }
 
-    for ( ; DataLen>0; DataLen--)
-        PrintByte(*(Data++));
+    if (fgetc(f) == ':')
+    {
+        Result = E86HEX_EREAD;
+        Text   = 0;
+        if ((fseek(f,0,SEEK_END) == 0) && ((Size = ftell(f)) > 0) &&
+            (fseek(f,0,SEEK_SET) == 0) && ((Text = malloc(Size)) != 0) &&
+            (fread(Text,1,Size,f) == (size_t)Size))
+            Result = E86HexBaseline(Ctx, Text, (DWORD)Size);
+        fclose(f);
+        free(Text);
+
+        if (Result == E86HEX_EREAD)
+            snprintf(Msg,MsgLen,"Cannot read baseline file %s",DeltaName);
+        else if (Result != E86HEX_OK)
+            snprintf(Msg,MsgLen,"%s: %s",DeltaName,E86HexError(Ctx));
+        return Result;
+    }
+    fclose(f);
 
-    FinishLine();
+    if ((Base = E86HexCreate(ConvOpts)) == 0)
+    {
+        snprintf(Msg,MsgLen,"Out of memory");
+        return E86HEX_ENOMEM;
+    }
 
-    OutputAddress += BYTESPERLINE;
-    if (OutputAddress == 0)
+    if (((Result = E86HexInputFile(Base, DeltaName, (Ext == 0) ? E86HEX_AUTO :
+              (strcasecmp(Ext,".bin") == 0) ? E86HEX_BIN :
+              (strcasecmp(Ext,".com") == 0) ? E86HEX_COM : E86HEX_EXE))
+             != E86HEX_OK) ||
+        ((Result = E86HexConvert(Base)) != E86HEX_OK))
+        snprintf(Msg,MsgLen,"%s: %s",DeltaName,E86HexError(Base));
+    else
     {
-        OutputSegment += 0x1000;
-        SegRecord (OutputSegment);
+        Hex = E86HexOutput(Base, &Len);
+        if ((Result = E86HexBaseline(Ctx, Hex, Len)) != E86HEX_OK)
+            snprintf(Msg,MsgLen,"%s",E86HexError(Ctx));
     }
+
+    E86HexDestroy(Base);
+    return Result;
 }
 
 //////////////////////////////////////////////////////////////////////////
-// OutputDataFromFile() uses DataRecord() to output the bulk of the
-// program data.
+// CacheLookup() works out the cache key for a conversion and, if its
+// output is cached, makes the output files from the cache.  Returns
+// TRUE on a hit, with Stats filled in from the entry.  Key is left
+// empty when there is no cache to use.
 //
-void OutputDataFromFile(DWORD FileLoc, DWORD Length)
+BOOL CacheLookup(char * Key, const char * Source, int Type,
+                 BOOL Relocatable, DWORD SegAddress,
+                 const char * const * Files, E86HEXSTATS * Stats)
 {
-    BYTE RecLen;
-    LPBYTE Data;
-
-    while (Length>0)
+    char Params[200];
+    char Note[E86CACHE_NOTELEN];
+
+    Key[0] = 0;
+    if ((Cache == 0) || (DeltaName != 0))
+        return FALSE;
+
+    //
+    // Baud and line cost only change the output when they pick the
+    // record length.
+    //
+    snprintf(Params, sizeof(Params),
+             "%s type=%d %s=%04X record=%u baud=%u cost=%u skip=%u",
+             BinaryOut ? "binary" : "hex", Type,
+             Relocatable ? "relocatable" : "segment", SegAddress,
+             BinaryOut ? 0 : Opts.RecordLength,
+             (BinaryOut || Opts.RecordLength) ? 0 : Opts.Baud,
+             (BinaryOut || Opts.RecordLength) ? 0 : Opts.LineCost,
+             BinaryOut ? 0 : Opts.SkipFill);
+
+    if (E86CacheKey(Key, TOOLVERSION, Params, Source) != 0)
     {
-        RecLen = BYTESPERLINE;
-        if (RecLen > Length)
-            RecLen = (BYTE)(Length);
-
-        Data = ReadFile(FileLoc,RecLen);
-
-        DataRecord(Data,RecLen);
-        FileLoc += RecLen;
-        Length -= RecLen;
+        Key[0] = 0;
+        return FALSE;
     }
+
+    return E86CacheFetch(Cache, Key, Files, BinaryOut ? 2 : 1, Note) &&
+           (sscanf(Note, "%u %hu %u %u %u %u %u", &Stats->InputLength,
+                   &Stats->RecordLength, &Stats->Lines, &Stats->Chars,
+                   &Stats->SkippedBytes, &Stats->SkippedLines,
+                   &Stats->SkippedChars) == 7);
 }
 
 //////////////////////////////////////////////////////////////////////////
-// OutputMiscData() uses DataRecord() to output miscellaneous data
+// CacheAdd() stores the output of a conversion under its key.
 //
-void OutputMiscData(LPBYTE Data, WORD DataLen)
+void CacheAdd(const char * Key, const char * const * Files,
+              E86HEXSTATS * Stats)
 {
-    static WORD BufLen = 0;
-    static BYTE Buffer[BYTESPERLINE];
-
-    if (DataLen+BufLen > sizeof(Buffer))
-        ErrExit("Unaligned data passed to OutputMiscData");
+    char Note[E86CACHE_NOTELEN];
 
-    //_f
-    memcpy(Buffer+BufLen,Data,DataLen);
+    if ((Cache == 0) || (Key[0] == 0))
+        return;
 
+    snprintf(Note, sizeof(Note), "%u %u %u %u %u %u %u\n",
+             Stats->InputLength, Stats->RecordLength, Stats->Lines,
+             Stats->Chars, Stats->SkippedBytes, Stats->SkippedLines,
+             Stats->SkippedChars);
+    E86CacheStore(Cache, Key, Files, BinaryOut ? 2 : 1, Note);
+}
 
-    BufLen += DataLen;
+//////////////////////////////////////////////////////////////////////////
+// OpenCache() opens the cache if --cache or $E86_CACHE asks for it.
+// Streamed conversions have no input file to key on, so never use it.
+//
+void OpenCache(void)
+{
+    if (!UseCache && (getenv("E86_CACHE") == 0))
+        return;
+    if ((Cache = E86CacheOpen(CacheDir, CacheMB)) == 0)
+        printf("MakeHex Warning -- cannot use the cache directory, "
+               "converting without it.\n");
+}
 
-    if (BufLen == sizeof(Buffer))
+//////////////////////////////////////////////////////////////////////////
+// Finish() prints the cache counters and phase timings, trims the cache
+// and closes the trace, on the way out of the program.
+//
+int Finish(int Result)
+{
+    if (Cache != 0)
     {
-        DataRecord(Buffer,(BYTE)sizeof(Buffer));
-        BufLen = 0;
+        E86CacheReport(Cache, Msgs);
+        E86CacheClose(Cache);
+        Cache = 0;
     }
+    E86TraceClose(Msgs);
+    return Result;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// TraceHook() passes the library's phases on to the trace, labelled
+// with the input file.
+//
+void TraceHook(void * User, const char * Phase, double Start, double End,
+               DWORD BytesIn, DWORD BytesOut, DWORD Records)
+{
+    E86TracePhase(Phase, (const char *)User, Start, End, BytesIn, BytesOut,
+                  Records);
 }
 
 //////////////////////////////////////////////////////////////////////////
-// RelocationRecord() stores relocation items.  These records
-// *must* appear *after* the actual data records.
+// WriteOutput() converts the input in Ctx to DestName, and for binary
+// output the relocations to ReloName.  Returns 0, or 2 if the
+// conversion failed (batch mode only; otherwise the program ends).
 //
-RelocationRecords(ExeHdr * eh)
+int WriteOutput(E86HEX * Ctx, char * Name, char * DestName, char * ReloName)
 {
-    LPDWORD DataPtr = ReadFile(eh->ReloTableAddr,eh->Relocations * 4);
-    DWORD   EndProgram = OutputSegment * 16L + OutputAddress;
-    WORD i;
+    char Msg[NAMELEN + 40];
+    int  DestFile;
+    int  Result;
 
-    for (i = eh->Relocations; i > 0; i--)
+    if ((DestFile=open(DestName,O_WRONLY|O_CREAT|O_TRUNC,0666)) < 0)
     {
-        DWORD value = *(DataPtr++);
-        value = ((value & 0xFFFF0000L) >> 12) + (value & 0xFFFF);
-        OutputMiscData((LPVOID)&value,4);
+        snprintf(Msg,sizeof(Msg),
+                 "Cannot create destination file %s",DestName);
+        return Failed(Name, Msg);
     }
 
-    for (i = BYTESPERLINE/4-1; i > 0; i--)
-        OutputMiscData((LPVOID)&EndProgram,4);
-
-	return 0;
+    E86HexOutputFd(Ctx, DestFile);
+    Result = BinaryOut ? E86HexConvertBinary(Ctx) : E86HexConvert(Ctx);
+    if ((close(DestFile) != 0) && (Result == E86HEX_OK))
+        return Failed(Name, "File write failed");
+    if (Result != E86HEX_OK)
+        return Failed(Name, E86HexError(Ctx));
+    if (BinaryOut && !WriteSidecar(Ctx, ReloName))
+    {
+        snprintf(Msg,sizeof(Msg),
+                 "Cannot write relocation file %s",ReloName);
+        return Failed(Name, Msg);
+    }
+    return 0;
 }
 
 //////////////////////////////////////////////////////////////////////////
-// DGROUPRelocations() stores relocation records for DGROUP only,
-// in a special format, after the main program.
+// Convert() converts one file.  Name is either a base name, in which
+// case <Name>.bin, <Name>.com and <Name>.exe are tried in turn, or the
+// name of the source file itself.  Returns 0, or 2 if the conversion
+// failed (batch mode only; otherwise the program ends).
 //
-void DGROUPRelocations(ExeHdr * eh, DWORD ProgLength)
+int Convert(char * Name, BOOL Relocatable, DWORD SegAddress)
 {
-    LPBYTE FilePtr = ReadFile(0,0);
-    LPBYTE ProgPtr = FilePtr + (eh->ParsInHdr*16);
-    DWORD   DGROUPOffset = 0;
-    WORD   i;
-    WORD TargetValue;
-    DWORD  Relo;
+    char ExeName[NAMELEN];
+    char ComName[NAMELEN];
+    char BinName[NAMELEN];
+    char DestName[NAMELEN];
+    char ReloName[NAMELEN];
+    char Key[E86CACHE_KEYLEN];
+    char Msg[NAMELEN + 80];
+
+    E86HEXOPTIONS ConvOpts = Opts;
+    E86HEXSTATS   Stats;
+    E86HEX *      Ctx;
+    char *        Ext = KnownExtension(Name);
+    char *        Source = ExeName;
+    const char *  Files[2];
+    int           Type;
+    int           Result;
+    BOOL          Hit;
+    double        Start = E86TraceNow();
+    double        Lookup;
+
+    if (Relocatable && Opts.SkipFill && !BinaryOut)
+        return Failed(Name, "--skip-fill needs a segment address");
+
+    if (strlen(Name) > sizeof(ExeName) - 5)
+        return Failed(Name, "File name too long");
+
+    ConvOpts.Relocatable = Relocatable;
+    ConvOpts.Segment     = (WORD)SegAddress;
+
+    if ((Ctx = E86HexCreate(&ConvOpts)) == 0)
+        return Failed(Name, "Out of memory");
+    if (E86TraceOn())
+        E86HexHook(Ctx, TraceHook, Name);
+
+    if (Ext != 0)
+    {
+        strcpy(ExeName,Name);
+        strcpy(DestName,Name);
+        strcpy(DestName + (Ext - Name),isupper(Ext[1]) ?
+               (BinaryOut ? ".IMG" : ".HEX") : (BinaryOut ? ".img" : ".hex"));
+        Type = (strcasecmp(Ext,".bin") == 0) ? E86HEX_BIN :
+               (strcasecmp(Ext,".com") == 0) ? E86HEX_COM : E86HEX_EXE;
+        Result = E86HexInputFile(Ctx, Source, Type);
+    }
+    else
+    {
+        strcpy(ComName,Name);
+        strcat(ComName,".com");
+        strcpy(BinName,Name);
+        strcat(BinName,".bin");
+        strcpy(ExeName,Name);
+        strcat(ExeName,".exe");
+        strcpy(DestName,Name);
+        strcat(DestName,BinaryOut ? ".img" : ".hex");
+
+
+        if (!BatchMode)
+	    printf("IsBinFile %d, IsComFile %d, ComName '%s', BinName '%s', ExeName '%s', DestName '%s'\n", FALSE, FALSE, ComName, BinName, ExeName, DestName);
+
+        Source = BinName;
+        Type   = E86HEX_BIN;
+        if ((Result = E86HexInputFile(Ctx, Source, Type)) == E86HEX_EOPEN)
+        {
+            Source = ComName;
+            Type   = E86HEX_COM;
+            if ((Result = E86HexInputFile(Ctx, Source, Type)) == E86HEX_EOPEN)
+            {
+                Source = ExeName;
+                Type   = E86HEX_EXE;
+                Result = E86HexInputFile(Ctx, Source, Type);
+            }
+        }
+    }
 
-    OutputAddress = ProgLength;
+    if (Result != E86HEX_OK)
+    {
+        Result = Failed(Name, E86HexError(Ctx));
+        E86HexDestroy(Ctx);
+        return Result;
+    }
 
-    if (!WholeFileInMemory)
-        ErrExit("Relocations are only processed if file fits in memory");
-    if ((ProgLength & 0xF) != 0)
-        ErrExit("Relocations only processed if data ends"
-                " on paragraph boundary");
+    if ((DeltaName != 0) &&
+        (LoadBaseline(Ctx, &ConvOpts, Msg, sizeof(Msg)) != 0))
+    {
+        E86HexDestroy(Ctx);
+        return Failed(Name, Msg);
+    }
 
-    for (i=0; i<eh->Relocations; i++)
+    //
+    // The sidecar goes next to the image unless --sidecar names it.
+    //
+    strcpy(ReloName,DestName);
+    strcpy(ReloName + strlen(ReloName) - 4,
+           (DestName[strlen(DestName) - 1] == 'G') ? ".REL" : ".rel");
+    if ((SidecarName != 0) && !BatchMode)
+        snprintf(ReloName,sizeof(ReloName),"%s",SidecarName);
+
+    E86HexGetStats(Ctx, &Stats);
+    if (!BatchMode)
+	printf("FileSize Input File = %d\n", (int)Stats.InputLength);
+
+    Files[0] = DestName;
+    Files[1] = ReloName;
+    Lookup = E86TraceNow();
+    Hit = CacheLookup(Key, Source, Type, Relocatable, SegAddress, Files,
+                      &Stats);
+    if (Cache != 0)
+        E86TracePhase("cache", Name, Lookup, E86TraceNow(),
+                      Stats.InputLength, 0, 0);
+    if (!Hit)
     {
-        Relo = *((LPDWORD)(FilePtr+eh->ReloTableAddr) + i);
-        Relo = (Relo & 0xFFFF) + ((Relo & 0xFFFF0000L) >> 12);
-        if (Relo > 0x7FFF)
-            ErrExit("Relocation target > 32K");
+        Result = WriteOutput(Ctx, Name, DestName, ReloName);
+        E86HexGetStats(Ctx, &Stats);
+        if (Result == 0)
+            CacheAdd(Key, Files, &Stats);
+    }
+    E86HexDestroy(Ctx);
+    if (Result != 0)
+        return Result;
+
+    E86TracePhase("convert", Name, Start, E86TraceNow(), Stats.InputLength,
+                  Stats.Chars, Stats.Lines);
 
-        TargetValue = *((LPWORD)(ProgPtr+Relo));
-        if (TargetValue != 0)
-            if (DGROUPOffset == 0)
-                DGROUPOffset = TargetValue;
-            else if (TargetValue != DGROUPOffset)
-                ErrExit("more than one target data segment for relocation");
+    if (BinaryOut)
+    {
+        printf(BatchMode ? "%s written, %u bytes, relocations in %s.\n" :
+               "File %s written successfully (%u bytes), relocations "
+               "in %s.\n\n", DestName, Stats.Chars, ReloName);
+        return 0;
     }
 
-    DGROUPOffset = DGROUPOffset << 4;
-    if (DGROUPOffset == 0)
-        ErrExit("Cannot tell where DGROUP starts!");
+    if (BatchMode)
+    {
+        printf("%s written, %u lines, %.1f seconds at %u baud.\n",
+               DestName, Stats.Lines,
+               E86HexDownloadTime(&Opts, Stats.Chars, Stats.Lines),
+               Opts.Baud);
+        return 0;
+    }
 
-    Relo = eh->Relocations * 4 + 4 - 1;
-    OutputMiscData((LPBYTE)&Relo,4);
+    printf("File %s written successfully.\n",DestName);
+    printf("Estimated download time at %u baud, %u byte records: "
+           "%.1f seconds (%u lines).\n", Opts.Baud, Stats.RecordLength,
+           E86HexDownloadTime(&Opts, Stats.Chars, Stats.Lines), Stats.Lines);
+    if (Opts.SkipFill)
+        printf("Fill elision skipped %u bytes, saving %u lines "
+               "(%u characters, %.1f seconds).\n", Stats.SkippedBytes,
+               Stats.SkippedLines, Stats.SkippedChars,
+               E86HexDownloadTime(&Opts, Stats.SkippedChars,
+                                  Stats.SkippedLines));
+    if (DeltaName != 0)
+        printf("Delta against %s left out %u unchanged records "
+               "(%u characters, %.1f seconds).\n", DeltaName,
+               Stats.UnchangedLines, Stats.UnchangedChars,
+               E86HexDownloadTime(&Opts, Stats.UnchangedChars,
+                                  Stats.UnchangedLines));
+    printf("\n");
+    return 0;
+}
 
-    for (i=0; i<eh->Relocations; i++)
+//////////////////////////////////////////////////////////////////////////
+// ConvertStream() converts an image read from a descriptor, writing the
+// records to stdout as they are made, so that a downloader reading the
+// other end of a pipe can start sending at once.
+//
+int ConvertStream(int InFile, BOOL Relocatable, DWORD SegAddress)
+{
+    E86HEXOPTIONS ConvOpts = Opts;
+    E86HEXSTATS   Stats;
+    E86HEX *      Ctx;
+
+    if (Relocatable && Opts.SkipFill && !BinaryOut)
+        ErrExit("--skip-fill needs a segment address");
+    if (BinaryOut && (SidecarName == 0))
+        ErrExit("--binary needs --sidecar=<file> when streaming");
+    if (DeltaName != 0)
+        ErrExit("--delta cannot be used when streaming");
+
+    ConvOpts.Relocatable = Relocatable;
+    ConvOpts.Segment     = (WORD)SegAddress;
+
+    if ((Ctx = E86HexCreate(&ConvOpts)) == 0)
+        ErrExit("Out of memory");
+    if (E86TraceOn())
+        E86HexHook(Ctx, TraceHook, "-");
+
+    if ((E86HexInputStream(Ctx, InFile, StreamType) != E86HEX_OK) ||
+        (E86HexOutputFd(Ctx, 1) != E86HEX_OK) ||
+        ((BinaryOut ? E86HexConvertBinary(Ctx) : E86HexConvert(Ctx))
+             != E86HEX_OK))
+        ErrExit("%s", E86HexError(Ctx));
+
+    if (BinaryOut)
     {
-        Relo = *((LPDWORD)(FilePtr+eh->ReloTableAddr) + i);
-        Relo = (Relo & 0xFFFF) + ((Relo & 0xFFFF0000L) >> 12);
+        if (!WriteSidecar(Ctx, SidecarName))
+            ErrExit("Cannot write relocation file %s", SidecarName);
+        E86HexGetStats(Ctx, &Stats);
+        E86HexDestroy(Ctx);
+        fprintf(Msgs, "%u bytes streamed, relocations in %s.\n",
+                Stats.Chars, SidecarName);
+        return 0;
+    }
 
-        TargetValue = *((LPWORD)(ProgPtr+Relo));
+    E86HexGetStats(Ctx, &Stats);
+    E86HexDestroy(Ctx);
 
-        if (Relo < DGROUPOffset)
-            ErrExit("Attempt to relocate item in code segment at %4X",Relo);
+    fprintf(Msgs, "%u bytes streamed in %u lines.\n", Stats.InputLength,
+            Stats.Lines);
+    fprintf(Msgs, "Estimated download time at %u baud, %u byte records: "
+            "%.1f seconds.\n", Opts.Baud, Stats.RecordLength,
+            E86HexDownloadTime(&Opts, Stats.Chars, Stats.Lines));
+    return 0;
+}
 
-        Relo -= DGROUPOffset;
-        if (TargetValue != 0)
-            Relo += ((DWORD)TargetValue << 16L);
+//////////////////////////////////////////////////////////////////////////
+// Batch mode.  The files to convert are gathered into Jobs[], which is
+// split into one contiguous range per worker thread.  A worker runs
+// the jobs of its own range from the front; once it runs dry it steals
+// the back half of another worker's remaining range.
+//
+typedef struct {
+    pthread_mutex_t Lock;
+    int             Head;       // Next job to run
+    int             Tail;       // One past the last job in this range
+} JOBQUEUE;
+
+char **    Jobs = 0;
+int        NumJobs = 0;
+int        MaxJobs = 0;
+JOBQUEUE * Queues;
+int        NumQueues;
+int        Failures = 0;
+pthread_mutex_t FailLock = PTHREAD_MUTEX_INITIALIZER;
 
-        OutputMiscData((LPBYTE)&Relo,4);
+//////////////////////////////////////////////////////////////////////////
+// AddJob() adds a file to the batch.
+//
+void AddJob(char * Name)
+{
+    if (NumJobs == MaxJobs)
+    {
+        MaxJobs = MaxJobs ? MaxJobs * 2 : 64;
+        if ((Jobs = realloc(Jobs, MaxJobs * sizeof(char *))) == 0)
+            ErrExit("Out of memory");
     }
-
-    Relo = 0xFFFFFFFFL;
-    for (i = BYTESPERLINE/4-1; i > 0; i--)
-        OutputMiscData((LPVOID)&Relo,4);
+    if ((Jobs[NumJobs++] = strdup(Name)) == 0)
+        ErrExit("Out of memory");
 }
 
-
 //////////////////////////////////////////////////////////////////////////
-// EOFRecord() prints an end of file record
+// CompareSources() orders directory entries by base name, and for the
+// same base name in the order .bin, .com, .exe which MakeHex tries them.
 //
-void EOFRecord(void)
+int CompareSources(const void * a, const void * b)
 {
-    StartLine(0,0,1);
-    FinishLine();
+    char * n1 = *(char **)a;
+    char * n2 = *(char **)b;
+    char * e1 = KnownExtension(n1);
+    char * e2 = KnownExtension(n2);
+    int    l1 = e1 - n1;
+    int    l2 = e2 - n2;
+    int    c  = strncasecmp(n1, n2, l1 < l2 ? l1 : l2);
+
+    if (c != 0)
+        return c;
+    if (l1 != l2)
+        return l1 - l2;
+    return strcasecmp(e1, e2);
 }
 
 //////////////////////////////////////////////////////////////////////////
-// JumpRecord() prints a far jump
+// AddDirectory() adds the convertible files in a directory, one per
+// base name.
 //
-void JumpRecord(WORD SrcSeg, WORD SrcOff, WORD TargetSeg, WORD TargetOff)
+void AddDirectory(char * Dir)
 {
-    SegRecord(SrcSeg);
-
-    StartLine(5,SrcOff,0);
-    PrintByte(0xEA);
-    PrintByte((BYTE)TargetOff);
-    PrintByte((BYTE)(TargetOff >> 8));
-    PrintByte((BYTE)TargetSeg);
-    PrintByte((BYTE)(TargetSeg >> 8));
-    FinishLine();
+    DIR *           d;
+    struct dirent * de;
+    char **         Names = 0;
+    int             NumNames = 0;
+    int             i;
+    char            Path[NAMELEN];
+
+    if ((d = opendir(Dir)) == 0)
+        ErrExit("Cannot read directory %s",Dir);
+
+    while ((de = readdir(d)) != 0)
+        if (KnownExtension(de->d_name) != 0)
+        {
+            if ((Names = realloc(Names, (NumNames+1) * sizeof(char *))) == 0)
+                ErrExit("Out of memory");
+            Names[NumNames++] = strdup(de->d_name);
+        }
+    closedir(d);
+
+    qsort(Names, NumNames, sizeof(char *), CompareSources);
+
+    for (i = 0; i < NumNames; i++)
+    {
+        if ((i == 0) || (KnownExtension(Names[i]) - Names[i] !=
+                         KnownExtension(Names[i-1]) - Names[i-1]) ||
+            (strncasecmp(Names[i], Names[i-1],
+                         KnownExtension(Names[i]) - Names[i]) != 0))
+        {
+            snprintf(Path, sizeof(Path), "%s/%s", Dir, Names[i]);
+            AddJob(Path);
+        }
+    }
+
+    for (i = 0; i < NumNames; i++)
+        free(Names[i]);
+    free(Names);
 }
 
 //////////////////////////////////////////////////////////////////////////
-// StartAddressRecord() prints the starting address of the hex file
+// AddInput() adds a batch argument: a file, a directory, or @<file>
+// naming a response file with one input per line.
 //
-void StartAddressRecord(WORD Segment,WORD Offset)
+void AddInput(char * Arg)
 {
-    StartLine(4,0,3);
-    PrintWord(Segment);
-    PrintWord(Offset);
-    FinishLine();
+    struct stat sr;
+    FILE *      List;
+    char        Line[NAMELEN + 2];
+    char *      End;
+
+    if (Arg[0] == '@')
+    {
+        if ((List = fopen(Arg+1,"r")) == 0)
+            ErrExit("Cannot open response file %s",Arg+1);
+        while (fgets(Line,sizeof(Line),List) != 0)
+        {
+            End = Line + strlen(Line);
+            while ((End > Line) && isspace((BYTE)End[-1]))
+                *(--End) = 0;
+            if (Line[0] != 0)
+                AddInput(Line);
+        }
+        fclose(List);
+    }
+    else if ((stat(Arg,&sr) == 0) && S_ISDIR(sr.st_mode))
+        AddDirectory(Arg);
+    else
+        AddJob(Arg);
 }
 
 //////////////////////////////////////////////////////////////////////////
-// AMDStartRecord() prints a record which identifies this as a
-// proprietary relocatable hex file.  The total number of program
-// paragraphs, and the stack segment/offset are stored in this
-// record, as well as the normal segment identifier.
+// NextJob() finds the next job for worker Self, stealing if it must.
+// Returns FALSE when no work is left anywhere.
 //
-void AMDStartRecord(DWORD ProgLength, ExeHdr * eh)
+BOOL NextJob(int Self, int * Job)
 {
-    DWORD ReloLength;
+    JOBQUEUE * Own = &Queues[Self];
+    JOBQUEUE * Victim;
+    int        i;
+    int        Mid;
+    int        Tail;
+
+    pthread_mutex_lock(&Own->Lock);
+    if (Own->Head < Own->Tail)
+    {
+        *Job = Own->Head++;
+        pthread_mutex_unlock(&Own->Lock);
+        return TRUE;
+    }
+    pthread_mutex_unlock(&Own->Lock);
 
-    char IDString[] = "AMD LPD ";
-    WORD i;
+    for (i = 1; i < NumQueues; i++)
+    {
+        Victim = &Queues[(Self + i) % NumQueues];
+
+        pthread_mutex_lock(&Victim->Lock);
+        if (Victim->Head < Victim->Tail)
+        {
+            Mid  = Victim->Head + (Victim->Tail - Victim->Head) / 2;
+            Tail = Victim->Tail;
+            Victim->Tail = Mid;
+            pthread_mutex_unlock(&Victim->Lock);
+
+            pthread_mutex_lock(&Own->Lock);
+            Own->Head = Mid + 1;
+            Own->Tail = Tail;
+            pthread_mutex_unlock(&Own->Lock);
+
+            *Job = Mid;
+            return TRUE;
+        }
+        pthread_mutex_unlock(&Victim->Lock);
+    }
+    return FALSE;
+}
 
-    StartAddressRecord(eh->EntrySegment,eh->EntryOffset);
+//////////////////////////////////////////////////////////////////////////
+// Worker() is the body of each batch thread.
+//
+void * Worker(void * Arg)
+{
+    int Self = (int)(long)Arg;
+    int Job;
 
-    StartLine(2+8+2+4*4,0,2);
-    PrintWord(0);     // Segment offset
+    while (NextJob(Self, &Job))
+        if (Convert(Jobs[Job], !SegOption, SegOptionValue) != 0)
+        {
+            pthread_mutex_lock(&FailLock);
+            Failures++;
+            pthread_mutex_unlock(&FailLock);
+        }
+    return 0;
+}
 
-    for (i=0;i<8;i++)
-        PrintByte(IDString[i]);
+//////////////////////////////////////////////////////////////////////////
+// RunBatch() converts every job on a pool of worker threads.
+//
+int RunBatch(void)
+{
+    pthread_t * Threads;
+    int         i;
+
+    if (NumJobs == 0)
+        ErrExit("No files to convert");
+
+    if (NumThreads == 0)
+        NumThreads = sysconf(_SC_NPROCESSORS_ONLN);
+    if ((NumThreads < 1) || (NumThreads > 0x10000))
+        NumThreads = 1;
+    if (NumThreads > (DWORD)NumJobs)
+        NumThreads = NumJobs;
+
+    NumQueues = NumThreads;
+    Queues  = calloc(NumQueues, sizeof(JOBQUEUE));
+    Threads = calloc(NumQueues, sizeof(pthread_t));
+    if ((Queues == 0) || (Threads == 0))
+        ErrExit("Out of memory");
+
+    for (i = 0; i < NumQueues; i++)
+    {
+        pthread_mutex_init(&Queues[i].Lock, 0);
+        Queues[i].Head = (int)((long)NumJobs * i / NumQueues);
+        Queues[i].Tail = (int)((long)NumJobs * (i+1) / NumQueues);
+    }
 
-    ProgLength = (ProgLength+BYTESPERLINE-1)&(0L-BYTESPERLINE);
-    ReloLength = ((eh->Relocations * 4L) + BYTESPERLINE-1) & (0L-BYTESPERLINE);
+    for (i = 1; i < NumQueues; i++)
+        if (pthread_create(&Threads[i], 0, Worker, (void *)(long)i) != 0)
+            ErrExit("Cannot start worker thread");
+    Worker(0);
+    for (i = 1; i < NumQueues; i++)
+        pthread_join(Threads[i], 0);
 
-    PrintWord((WORD)(ProgLength >> 4) + 2 + eh->ExtraParsNeeded);
-    PrintWord(eh->InitStackSegment);
-    PrintWord(eh->InitStackOffset);
-    PrintDWord(ProgLength);
-    PrintDWord(ProgLength + ReloLength);
-    PrintDWord(ProgLength + ReloLength);
-    FinishLine();
+    printf("\n%d file(s) converted, %d failed.\n\n",
+           NumJobs - Failures, Failures);
+    return Failures ? 2 : 0;
 }
 
 //////////////////////////////////////////////////////////////////////////
 // Main program.  Parse command line, and then show the help message,
-// or copy a file.
+// or convert the file(s).
 //
 int main(int argc, char* argv[])
 {
-    BOOL      IsLibrary = FALSE;
-    BOOL      IsComFile = FALSE;
-    BOOL      IsBinFile = FALSE;
-    DWORD     Length;
-    DWORD     FileLength;
-    DWORD     DataPtr;
     DWORD     SegAddress = 0;
+    BOOL      Relocatable;
+    char *    Args[2];
+    int       NumArgs = 0;
+    int       i;
 
-    ExeHdr    eh;
-    BOOL      Relocatable = (argc == 2);
-
-    struct    stat sr;
+    Msgs = stdout;
+    E86HexDefaults(&Opts);
 
-    if ((argc < 2) || (argc > 3))
-        ShowHelp();
-
-    if (!Relocatable && (!ParseHex(argv[2],&SegAddress) ||
-        (SegAddress >= 0x10000)))
-       ShowHelp();
-
-    strcpy(ComName,argv[1]);
-    strcat(ComName,".com");
-    strcpy(BinName,argv[1]);
-    strcat(BinName,".bin");
-    strcpy(ExeName,argv[1]);
-    strcat(ExeName,".exe");
-    strcpy(DestName,argv[1]);
-    strcat(DestName,".hex");
-
-
-	printf("IsBinFile %d, IsComFile %d, ComName '%s', BinName '%s', ExeName '%s', DestName '%s'\n", IsBinFile, IsComFile, ComName, BinName, ExeName, DestName);
-
-    if ((SourceFile=fopen(BinName,"rb")) != 0)
-        IsBinFile = TRUE;
-    else if ((SourceFile=fopen(ComName,"rb")) != 0)
-        IsComFile = TRUE;
-    else if ((SourceFile=fopen(ExeName,"rb")) == 0)
-        ErrExit("Cannot open source file %s",ExeName);
-
-    if ((DestFile=fopen(DestName,"w")) == 0)
-        ErrExit("Cannot create destination file %s",DestName);
-
-	if(IsBinFile == TRUE) {
-		stat(BinName, &sr);
-	} else if(IsComFile == TRUE) {
-		stat(ComName, &sr);
-	} else {
-		stat(ExeName, &sr);
-	}
-	FileLength = sr.st_size;
-	printf("FileSize Input File = %d\n", (int)FileLength);
-
-    if (IsComFile || IsBinFile)
-    {
-        DataPtr = 0;
-
-        eh.ExtraParsNeeded  = 0x10;  // Min. .COM stack is 256 bytes
-        eh.InitStackSegment = 0;
-        eh.InitStackOffset  = 0;
-        eh.EntrySegment     = 0;
-        eh.EntryOffset      = 0;
-        eh.Relocations      = 0;
-        if (IsComFile)
+    for (i = 1; i < argc; i++)
+        if (strncmp(argv[i],"--",2) == 0)
         {
-            eh.EntrySegment -= 0x10;
-            eh.EntryOffset  += 0x100;
+            if (!ParseOption(argv[i]+2))
+                ShowHelp();
         }
-        Length = FileLength;
-    }
-    else   // .EXE file encountered
-    {
-        //_f
-	memcpy(&eh,ReadFile(0,sizeof(eh)),sizeof(eh));
 
-        if (eh.MagicNumber != 0x5A4D)
-            ErrExit("Invalid EXE signature");
+    HexKernelLevel();
 
-        Length = eh.PagesInFile*512L-((512-eh.BytesLastPg)%512);
-        if (Length >  FileLength)
-            ErrExit("File Read Error");
+    if ((ShowStats || (TraceName != 0)) &&
+        (E86TraceOpen(TraceName, ShowStats) != 0))
+        ErrExit("Cannot create trace file %s", TraceName);
 
-        DataPtr = eh.ParsInHdr*16;
+    if ((DeltaName != 0) && (BatchMode || BinaryOut))
+        ErrExit("--delta only works on a single hex conversion");
 
-        Length -= eh.ParsInHdr*16;
+    if (BatchMode)
+    {
+        OpenCache();
+        for (i = 1; i < argc; i++)
+            if (strncmp(argv[i],"--",2) != 0)
+                AddInput(argv[i]);
+        exit(Finish(RunBatch()));
     }
 
-    if (Relocatable)
-        AMDStartRecord(Length, &eh);
-    else
-        SegRecord((WORD)SegAddress);
+    for (i = 1; i < argc; i++)
+        if (strncmp(argv[i],"--",2) == 0)
+            continue;
+        else if (NumArgs < 2)
+            Args[NumArgs++] = argv[i];
+        else
+            ShowHelp();
 
-    IsLibrary = !Relocatable &&
-     // (_f
-	(memcmp(&LibSig,ReadFile(DataPtr,sizeof(LibSig)),sizeof(LibSig)) == 0);
+    //
+    // With --fd the only argument is the segment address.
+    //
+    if (StreamFd >= 0)
+    {
+        if (NumArgs == 2)
+            ShowHelp();
+        if (NumArgs == 1)
+            Args[1] = Args[0];
+        Args[0] = "-";
+        NumArgs++;
+    }
+    else if ((NumArgs >= 1) && (strcmp(Args[0],"-") == 0))
+        StreamFd = 0;
 
-    OutputSegment    = (WORD)SegAddress;
-    eh.EntrySegment += OutputSegment;
+    if (NumArgs < 1)
+        ShowHelp();
 
-    OutputDataFromFile(DataPtr,Length);
-    if (Relocatable)
-        RelocationRecords(&eh);
-    else
+    Relocatable = (NumArgs == 1) && !SegOption;
+    SegAddress  = SegOptionValue;
+
+    if ((NumArgs == 2) && (!ParseHex(Args[1],&SegAddress) ||
+        (SegAddress >= 0x10000)))
+       ShowHelp();
+
+    //
+    // A single large image is formatted by several threads.
+    //
+    if (NumThreads == 0)
+        NumThreads = sysconf(_SC_NPROCESSORS_ONLN);
+    if ((NumThreads < 1) || (NumThreads > MAXFORMATTERS))
+        NumThreads = (NumThreads < 1) ? 1 : MAXFORMATTERS;
+    Opts.Threads = (WORD)NumThreads;
+
+    if (StreamFd >= 0)
     {
-        if (eh.Relocations != 0)
-            DGROUPRelocations(&eh,Length);
-        if (SegAddress >= 0xF800)
-            JumpRecord(0xFFFF,0,eh.EntrySegment,eh.EntryOffset);
-        else if (!IsLibrary)
-            StartAddressRecord(eh.EntrySegment,eh.EntryOffset);
+        Msgs = stderr;
+        exit(Finish(ConvertStream(StreamFd, Relocatable, SegAddress)));
     }
 
-    EOFRecord();
-
-    fclose(DestFile);
-    printf("File %s written successfully.\n\n",DestName);
-    exit(0);
+    OpenCache();
+    exit(Finish(Convert(Args[0], Relocatable, SegAddress)));
 }
@@ -0,0 +1,527 @@
+/******************************************************************************
+ *                                                                            *
+ *     CORPUSGEN.C                                                            *
+ *                                                                            *
+ *     Builds synthetic input files for MakeHex, MakeBin and EditMon, of      *
+ *     any size the formats allow, so that the tools can be stress tested     *
+ *     and timed far beyond the sample programs in hex_files.                 *
+ *                                                                            *
+ *     An EXE gets a relocation table of the asked for size, with its         *
+ *     entries laid out in one of several ways.  With --dgroup, every         *
+ *     entry points into DGROUP below 32K at a word holding DGROUP's          *
+ *     paragraph, which is the one layout MakeHex can convert to absolute     *
+ *     hex.  --lpd puts an E86Mon "AMD LPD 01" header and permanent           *
+ *     variable table at the start of the program, as EditMon expects,       *
+ *     and --libsig a library extension signature instead.                    *
+ *                                                                            *
+ *     The same options and seed always give the same file.                   *
+ *                                                                            *
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdarg.h>
+#include "e86hex.h"
+
+#define HEADERLEN   0x1C        // MZ header fields before the table
+#define MAXEXE      (0xFFFFL * 512) // Largest file an MZ header describes
+#define MAXCOM      0xFF00L     // COM files load at 100h in one segment
+#define MAXBIN      0x10000000L
+#define DEFSIZE     0x10000L
+#define DEFVARS     4
+#define MAXVARS     200
+#define VARNAME     12          // Room for each name, with its NUL
+#define CLUSTER     16          // Entries in each cluster of --spread=cluster
+#define MIXBLOCK    0x1000      // Run length of --fill=mixed
+
+enum { SPREAD_RANDOM, SPREAD_SORTED, SPREAD_CLUSTER, SPREAD_DENSE };
+enum { FILL_RANDOM, FILL_FF, FILL_ZERO, FILL_MIXED };
+
+static const char * const SpreadNames[] = {
+    "random", "sorted", "cluster", "dense"
+};
+static const char * const FillNames[] = {
+    "random", "ff", "zero", "mixed"
+};
+
+//
+// E86Mon library extension signature, as libe86hex looks for it.
+//
+static const BYTE LibSig[24] = {
+    0xEB, 0x16, 'E','8','6','M','o','n',' ','L','i','b',' ',
+    'E','x','t','e','n','s','i','o','n',' ','1'
+};
+
+int    FileType = E86HEX_AUTO;
+DWORD  ProgSize = DEFSIZE;
+DWORD  Relocs = 0;
+int    Spread = SPREAD_RANDOM;
+WORD   DGROUP = 0;
+int    Vars = -1;               // No LPD table
+BOOL   WantLibSig = FALSE;
+int    Fill = FILL_RANDOM;
+DWORD  Seed = 1;
+DWORD  Count = 1;
+
+DWORD  RandState;
+
+//////////////////////////////////////////////////////////////////////////
+// ErrExit() shows an error message and exits.
+//
+static void ErrExit(const char * s, ...)
+{
+    va_list ap;
+
+    va_start(ap, s);
+    fputs("corpusgen: ", stderr);
+    vfprintf(stderr, s, ap);
+    fputc('\n', stderr);
+    va_end(ap);
+    exit(1);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// ShowHelp() lists the options.
+//
+static void ShowHelp(void)
+{
+    printf(
+"\nUsage: corpusgen [options] <output file>\n\n"
+"    Builds a synthetic EXE, COM or BIN file for testing the E86Mon tools.\n\n"
+"    --type=exe|com|bin   File type (default from the extension, else exe)\n"
+"    --size=<n>[K|M]      Program size in bytes (default 64K)\n"
+"    --relocs=<n>         Relocation table entries, EXE only (default 0)\n"
+"    --spread=<how>       Where the entries point: random, sorted (random,\n"
+"                         in ascending order as linkers write them),\n"
+"                         cluster (runs of %d words) or dense (one run)\n"
+"    --dgroup=<para>      Point every entry into DGROUP, which starts at\n"
+"                         hex paragraph <para>, as absolute MakeHex needs\n"
+"    --lpd[=<vars>]       Add an E86Mon \"AMD LPD 01\" header with <vars>\n"
+"                         permanent variables (default %d)\n"
+"    --libsig             Start with an E86Mon library extension signature\n"
+"    --fill=<how>         Program bytes: random, ff, zero, or mixed (4K\n"
+"                         runs of random bytes and of FF)\n"
+"    --seed=<n>           Seed of the random numbers (default 1)\n"
+"    --count=<n>          Make <n> files, named <name>-001.<ext> and up,\n"
+"                         each with the next seed\n\n",
+        CLUSTER, DEFVARS);
+    exit(1);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Rand() returns the next number of a xorshift generator.
+//
+static DWORD Rand(void)
+{
+    RandState ^= RandState << 13;
+    RandState ^= RandState >> 17;
+    RandState ^= RandState << 5;
+    return RandState;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// PutWord() and PutDWord() store little endian values.
+//
+static void PutWord(LPBYTE Ptr, WORD Value)
+{
+    Ptr[0] = (BYTE)Value;
+    Ptr[1] = (BYTE)(Value >> 8);
+}
+
+static void PutDWord(LPBYTE Ptr, DWORD Value)
+{
+    PutWord(Ptr, (WORD)Value);
+    PutWord(Ptr + 2, (WORD)(Value >> 16));
+}
+
+//////////////////////////////////////////////////////////////////////////
+// ParseSize() reads a number with an optional K or M suffix.  Returns
+// FALSE if it is not one.
+//
+static BOOL ParseSize(const char * Text, DWORD * Value)
+{
+    char *        End;
+    unsigned long v = strtoul(Text, &End, 0);
+
+    if (End == Text)
+        return FALSE;
+    if ((*End == 'K') || (*End == 'k'))
+        v <<= 10, End++;
+    else if ((*End == 'M') || (*End == 'm'))
+        v <<= 20, End++;
+    if ((*End != 0) || (v > 0xFFFFFFFFUL))
+        return FALSE;
+    *Value = (DWORD)v;
+    return TRUE;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// ParseName() finds Text among Count Names.  Returns its index, or -1.
+//
+static int ParseName(const char * Text, const char * const * Names,
+                     int Count)
+{
+    int i;
+
+    for (i = 0; i < Count; i++)
+        if (strcmp(Text, Names[i]) == 0)
+            return i;
+    return -1;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// ParseOption() handles one --option.  Returns FALSE if it is not valid.
+//
+static BOOL ParseOption(char * Opt)
+{
+    char * End;
+    DWORD  Value;
+
+    if (strcmp(Opt,"type=exe") == 0)
+        FileType = E86HEX_EXE;
+    else if (strcmp(Opt,"type=com") == 0)
+        FileType = E86HEX_COM;
+    else if (strcmp(Opt,"type=bin") == 0)
+        FileType = E86HEX_BIN;
+    else if (strncmp(Opt,"size=",5) == 0)
+        return ParseSize(Opt+5, &ProgSize) && (ProgSize != 0);
+    else if (strncmp(Opt,"relocs=",7) == 0)
+        return ParseSize(Opt+7, &Relocs) && (Relocs <= 0xFFFF);
+    else if (strncmp(Opt,"spread=",7) == 0)
+        return (Spread = ParseName(Opt+7, SpreadNames, 4)) >= 0;
+    else if (strncmp(Opt,"fill=",5) == 0)
+        return (Fill = ParseName(Opt+5, FillNames, 4)) >= 0;
+    else if ((strncmp(Opt,"dgroup=",7) == 0) && (Opt[7] != 0))
+    {
+        Value = strtoul(Opt+7,&End,16);
+        if ((*End != 0) || (Value == 0) || (Value >= 0x800))
+            return FALSE;
+        DGROUP = (WORD)Value;
+    }
+    else if (strcmp(Opt,"lpd") == 0)
+        Vars = DEFVARS;
+    else if ((strncmp(Opt,"lpd=",4) == 0) && (Opt[4] != 0))
+    {
+        Vars = strtol(Opt+4,&End,10);
+        if ((*End != 0) || (Vars < 0) || (Vars > MAXVARS))
+            return FALSE;
+    }
+    else if (strcmp(Opt,"libsig") == 0)
+        WantLibSig = TRUE;
+    else if (strncmp(Opt,"seed=",5) == 0)
+        return ParseSize(Opt+5, &Seed);
+    else if (strncmp(Opt,"count=",6) == 0)
+        return ParseSize(Opt+6, &Count) && (Count != 0) && (Count <= 999);
+    else
+        return FALSE;
+    return TRUE;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// FillProgram() fills the program bytes as --fill asked.
+//
+static void FillProgram(LPBYTE Prog, DWORD Size)
+{
+    DWORD i;
+    BOOL  Random = (Fill == FILL_RANDOM);
+
+    for (i = 0; i < Size; i++)
+    {
+        if ((Fill == FILL_MIXED) && ((i % MIXBLOCK) == 0))
+            Random = Rand() & 1;
+        if (Random)
+            Prog[i] = (BYTE)(Rand() >> 24);
+        else
+            Prog[i] = (Fill == FILL_ZERO) ? 0 : 0xFF;
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+// LPDHeader() lays out an E86Mon header at the start of the program:
+// a short jump over it, "AMD LPD 01", and the offset of a table of
+// permanent variables, each with a name, a pointer to its value and a
+// default of -1.  A zero name ends the table; it is followed by a second
+// one, as EditMon skips a zero first entry.  Returns the bytes used.
+//
+static DWORD LPDHeader(LPBYTE Prog, DWORD Size)
+{
+    DWORD Table = 0x10;
+    DWORD Names = Table + 8 * (Vars + 2);
+    DWORD Values = Names + VARNAME * Vars;
+    DWORD End = (Values + 4 * Vars + 15) & ~15L;
+    char  Name[VARNAME];
+    int   i;
+
+    if (End > Size)
+        ErrExit("--lpd=%d needs a program of at least %lu bytes", Vars,
+                (unsigned long)End);
+
+    memset(Prog, 0, End);
+    Prog[0] = 0xEB;                     // jmp short 10h
+    Prog[1] = 0x0E;
+    memcpy(Prog + 2, "AMD LPD 01", 10);
+    PutWord(Prog + 12, (WORD)Table);
+
+    for (i = 0; i < Vars; i++)
+    {
+        if (i == 0)
+            strcpy(Name, "BAUD");
+        else if (i == 1)
+            strcpy(Name, "CPU");
+        else
+            sprintf(Name, "VAR%u", (BYTE)i);
+        strcpy((char *)Prog + Names + VARNAME * i, Name);
+
+        PutWord(Prog + Table + 8 * i, (WORD)(Names + VARNAME * i));
+        PutWord(Prog + Table + 8 * i + 2, (WORD)(Values + 4 * i));
+        PutDWord(Prog + Table + 8 * i + 4, 0xFFFFFFFFL);
+        PutDWord(Prog + Values + 4 * i, (i == 0) ? 19200 : Rand() % 1000);
+    }
+    return End;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// CompareDWord() orders relocation targets for qsort().
+//
+static int CompareDWord(const void * a, const void * b)
+{
+    DWORD x = *(const DWORD *)a;
+    DWORD y = *(const DWORD *)b;
+
+    return (x > y) - (x < y);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// PickTargets() chooses Relocs different words between Lo and Hi as
+// --spread asked, and stores their offsets in Targets.
+//
+static void PickTargets(LPDWORD Targets, DWORD Lo, DWORD Hi)
+{
+    DWORD  Slots = (Hi - Lo) / 2;
+    LPBYTE Taken;
+    DWORD  Done = 0;
+    DWORD  Slot;
+    DWORD  Run;
+
+    if (Relocs > Slots)
+        ErrExit("%lu relocations do not fit in the %lu words between "
+                "%lX and %lX", (unsigned long)Relocs, (unsigned long)Slots,
+                (unsigned long)Lo, (unsigned long)Hi);
+
+    if (Spread == SPREAD_DENSE)
+    {
+        Slot = Rand() % (Slots - Relocs + 1);
+        for (Done = 0; Done < Relocs; Done++)
+            Targets[Done] = Lo + 2 * (Slot + Done);
+        return;
+    }
+
+    if ((Taken = calloc(1, Slots)) == 0)
+        ErrExit("Out of memory");
+
+    while (Done < Relocs)
+    {
+        Slot = Rand() % Slots;
+        Run  = (Spread == SPREAD_CLUSTER) ? CLUSTER : 1;
+        for ( ; (Run > 0) && (Slot < Slots) && (Done < Relocs); Run--, Slot++)
+            if (!Taken[Slot])
+            {
+                Taken[Slot] = 1;
+                Targets[Done++] = Lo + 2 * Slot;
+            }
+    }
+    free(Taken);
+
+    if (Spread == SPREAD_SORTED)
+        qsort(Targets, Relocs, sizeof(DWORD), CompareDWord);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// MakeFile() builds one file and writes it to Name.
+//
+static void MakeFile(const char * Name, int Type)
+{
+    DWORD   Size = ProgSize;
+    DWORD   HdrLength = 0;
+    DWORD   Reserved = 0;
+    DWORD   Lo;
+    DWORD   Hi;
+    DWORD   i;
+    LPBYTE  Header;
+    LPBYTE  Prog;
+    LPDWORD Targets = 0;
+    FILE *  f;
+
+    if (DGROUP != 0)
+        Size = (Size + 15) & ~15L;  // DGROUP needs whole paragraphs
+
+    if (Type == E86HEX_EXE)
+    {
+        HdrLength = (HEADERLEN + 4 * Relocs + 15) & ~15L;
+        if (HdrLength + Size > MAXEXE)
+            ErrExit("EXE files hold at most %lu bytes",
+                    (unsigned long)(MAXEXE - HdrLength));
+    }
+    else if ((Type == E86HEX_COM) && (Size > MAXCOM))
+        ErrExit("COM files hold at most %lu bytes", (unsigned long)MAXCOM);
+    else if (Size > MAXBIN)
+        ErrExit("BIN files of more than %luM are not made",
+                (unsigned long)(MAXBIN >> 20));
+
+    if ((Header = calloc(1, HdrLength + Size)) == 0)
+        ErrExit("Out of memory");
+    Prog = Header + HdrLength;
+
+    FillProgram(Prog, Size);
+
+    if (Vars >= 0)
+        Reserved = LPDHeader(Prog, Size);
+    else if (WantLibSig)
+    {
+        if (Size < sizeof(LibSig))
+            ErrExit("--libsig needs a program of at least %u bytes",
+                    (unsigned)sizeof(LibSig));
+        memcpy(Prog, LibSig, sizeof(LibSig));
+        Reserved = sizeof(LibSig);
+    }
+
+    if (Relocs != 0)
+    {
+        //
+        // Relocatable files may point anywhere past the E86Mon header;
+        // DGROUP ones only from DGROUP up to 32K.
+        //
+        Lo = (Reserved + 1) & ~1L;
+        Hi = Size & ~1L;
+        if (DGROUP != 0)
+        {
+            if (Lo < DGROUP * 16L)
+                Lo = DGROUP * 16L;
+            if (Hi > 0x8000)
+                Hi = 0x8000;
+        }
+        if (Hi < Lo)
+            Hi = Lo;
+
+        if ((Targets = malloc(Relocs * sizeof(DWORD))) == 0)
+            ErrExit("Out of memory");
+        PickTargets(Targets, Lo, Hi);
+
+        //
+        // Entries alternate between normalized segment:offset pairs and
+        // the 64K segments linkers tend to use, so both get converted.
+        //
+        for (i = 0; i < Relocs; i++)
+        {
+            PutWord(Prog + Targets[i], (DGROUP != 0) ? DGROUP :
+                    (WORD)(Rand() % ((Size + 15) >> 4)));
+            if (i & 1)
+            {
+                PutWord(Header + HEADERLEN + 4 * i, (WORD)(Targets[i] & 0xF));
+                PutWord(Header + HEADERLEN + 4 * i + 2,
+                        (WORD)(Targets[i] >> 4));
+            }
+            else
+            {
+                PutWord(Header + HEADERLEN + 4 * i, (WORD)Targets[i]);
+                PutWord(Header + HEADERLEN + 4 * i + 2,
+                        (WORD)((Targets[i] >> 16) << 12));
+            }
+        }
+        free(Targets);
+    }
+
+    if (Type == E86HEX_EXE)
+    {
+        PutWord(Header, 0x5A4D);
+        PutWord(Header + 2, (WORD)((HdrLength + Size) % 512));
+        PutWord(Header + 4, (WORD)((HdrLength + Size + 511) / 512));
+        PutWord(Header + 6, (WORD)Relocs);
+        PutWord(Header + 8, (WORD)(HdrLength / 16));
+        PutWord(Header + 10, 0x10);                     // 256 byte stack
+        PutWord(Header + 12, 0xFFFF);
+        PutWord(Header + 14, (WORD)((Size + 15) >> 4)); // Stack after program
+        PutWord(Header + 16, 0x100);
+        PutWord(Header + 24, HEADERLEN);
+    }
+
+    if ((f = fopen(Name, "wb")) == 0)
+        ErrExit("Cannot create %s", Name);
+    if ((fwrite(Header, 1, HdrLength + Size, f) != HdrLength + Size) ||
+        (fclose(f) != 0))
+        ErrExit("Cannot write %s", Name);
+    free(Header);
+
+    printf("%s: %s, %lu program bytes, %lu relocations", Name,
+           (Type == E86HEX_EXE) ? "EXE" : (Type == E86HEX_COM) ? "COM" : "BIN",
+           (unsigned long)Size, (unsigned long)Relocs);
+    if (Relocs != 0)
+        printf(" (%s)", SpreadNames[Spread]);
+    if (DGROUP != 0)
+        printf(", DGROUP at %04X", DGROUP);
+    if (Vars >= 0)
+        printf(", %d permanent variables", Vars);
+    if (WantLibSig)
+        printf(", library signature");
+    printf("\n");
+}
+
+int main(int argc, char * argv[])
+{
+    char * Name = 0;
+    char * Ext;
+    char   FileName[1024];
+    int    Type;
+    DWORD  n;
+    int    i;
+
+    for (i = 1; i < argc; i++)
+        if (strncmp(argv[i],"--",2) == 0)
+        {
+            if (!ParseOption(argv[i]+2))
+                ShowHelp();
+        }
+        else if (Name == 0)
+            Name = argv[i];
+        else
+            ShowHelp();
+
+    if ((Name == 0) || (strlen(Name) + 5 > sizeof(FileName)))
+        ShowHelp();
+
+    Ext  = strrchr(Name, '.');
+    if ((Ext != 0) && (strchr(Ext, '/') != 0))
+        Ext = 0;
+    Type = FileType;
+    if (Type == E86HEX_AUTO)
+        Type = ((Ext != 0) && (strcasecmp(Ext, ".com") == 0)) ? E86HEX_COM :
+               ((Ext != 0) && (strcasecmp(Ext, ".bin") == 0)) ? E86HEX_BIN :
+               E86HEX_EXE;
+
+    if ((Type != E86HEX_EXE) && ((Relocs != 0) || (DGROUP != 0)))
+        ErrExit("Only EXE files have relocations");
+    if ((DGROUP != 0) && (Relocs == 0))
+        ErrExit("--dgroup needs --relocs");
+    if ((Vars >= 0) && WantLibSig)
+        ErrExit("--lpd and --libsig both go at the start of the program");
+
+    for (n = 0; n < Count; n++)
+    {
+        RandState = Seed + n;
+        if (RandState == 0)
+            RandState = 0x9E3779B9L;
+
+        if (Count == 1)
+            strcpy(FileName, Name);
+        else if (Ext != 0)
+            sprintf(FileName, "%.*s-%03lu%s", (int)(Ext - Name), Name,
+                    (unsigned long)n + 1, Ext);
+        else
+            sprintf(FileName, "%s-%03lu", Name, (unsigned long)n + 1);
+
+        MakeFile(FileName, Type);
+    }
+    return 0;
+}
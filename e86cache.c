@@ -0,0 +1,494 @@
+/******************************************************************************
+ *                                                                            *
+ *     E86CACHE.C                                                             *
+ *                                                                            *
+ *     Content addressed output cache shared by MakeHex and MakeBin.          *
+ *     See E86CACHE.H.                                                        *
+ *                                                                            *
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include "e86cache.h"
+
+#define COPYBUF  0x10000
+
+struct E86CACHE {
+    char            Dir[1024];
+    unsigned long long MaxBytes;
+    pthread_mutex_t Lock;       // Counters, and names of temporary entries
+    unsigned        Hits;
+    unsigned        Misses;
+    unsigned        Stores;
+    unsigned        TmpCount;
+};
+
+//////////////////////////////////////////////////////////////////////////
+// SHA-256, as in FIPS 180-4.
+//
+typedef struct {
+    uint32_t      State[8];
+    uint64_t      Length;       // Bytes hashed so far
+    unsigned char Block[64];
+    unsigned      Used;         // Bytes waiting in Block
+} SHA256;
+
+static const uint32_t ShaK[64] = {
+    0x428a2f98,0x71374491,0xb5c0fbcf,0xe9b5dba5,0x3956c25b,0x59f111f1,
+    0x923f82a4,0xab1c5ed5,0xd807aa98,0x12835b01,0x243185be,0x550c7dc3,
+    0x72be5d74,0x80deb1fe,0x9bdc06a7,0xc19bf174,0xe49b69c1,0xefbe4786,
+    0x0fc19dc6,0x240ca1cc,0x2de92c6f,0x4a7484aa,0x5cb0a9dc,0x76f988da,
+    0x983e5152,0xa831c66d,0xb00327c8,0xbf597fc7,0xc6e00bf3,0xd5a79147,
+    0x06ca6351,0x14292967,0x27b70a85,0x2e1b2138,0x4d2c6dfc,0x53380d13,
+    0x650a7354,0x766a0abb,0x81c2c92e,0x92722c85,0xa2bfe8a1,0xa81a664b,
+    0xc24b8b70,0xc76c51a3,0xd192e819,0xd6990624,0xf40e3585,0x106aa070,
+    0x19a4c116,0x1e376c08,0x2748774c,0x34b0bcb5,0x391c0cb3,0x4ed8aa4a,
+    0x5b9cca4f,0x682e6ff3,0x748f82ee,0x78a5636f,0x84c87814,0x8cc70208,
+    0x90befffa,0xa4506ceb,0xbef9a3f7,0xc67178f2
+};
+
+#define ROR(x,n)  (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void ShaBlock(SHA256 * Sha, const unsigned char * p)
+{
+    uint32_t W[64];
+    uint32_t a, b, c, d, e, f, g, h, t1, t2;
+    int      i;
+
+    for (i = 0; i < 16; i++, p += 4)
+        W[i] = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+               ((uint32_t)p[2] << 8) | p[3];
+    for (; i < 64; i++)
+        W[i] = W[i-16] + (ROR(W[i-15],7) ^ ROR(W[i-15],18) ^ (W[i-15] >> 3))
+             + W[i-7] + (ROR(W[i-2],17) ^ ROR(W[i-2],19) ^ (W[i-2] >> 10));
+
+    a = Sha->State[0]; b = Sha->State[1]; c = Sha->State[2];
+    d = Sha->State[3]; e = Sha->State[4]; f = Sha->State[5];
+    g = Sha->State[6]; h = Sha->State[7];
+
+    for (i = 0; i < 64; i++)
+    {
+        t1 = h + (ROR(e,6) ^ ROR(e,11) ^ ROR(e,25)) + ((e & f) ^ (~e & g))
+               + ShaK[i] + W[i];
+        t2 = (ROR(a,2) ^ ROR(a,13) ^ ROR(a,22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+
+    Sha->State[0] += a; Sha->State[1] += b; Sha->State[2] += c;
+    Sha->State[3] += d; Sha->State[4] += e; Sha->State[5] += f;
+    Sha->State[6] += g; Sha->State[7] += h;
+}
+
+static void ShaInit(SHA256 * Sha)
+{
+    static const uint32_t Initial[8] = {
+        0x6a09e667,0xbb67ae85,0x3c6ef372,0xa54ff53a,
+        0x510e527f,0x9b05688c,0x1f83d9ab,0x5be0cd19
+    };
+
+    memcpy(Sha->State, Initial, sizeof(Initial));
+    Sha->Length = 0;
+    Sha->Used   = 0;
+}
+
+static void ShaUpdate(SHA256 * Sha, const void * Data, size_t Len)
+{
+    const unsigned char * p = Data;
+    size_t                Part;
+
+    Sha->Length += Len;
+    if (Sha->Used != 0)
+    {
+        Part = 64 - Sha->Used;
+        if (Part > Len)
+            Part = Len;
+        memcpy(Sha->Block + Sha->Used, p, Part);
+        Sha->Used += Part;
+        p         += Part;
+        Len       -= Part;
+        if (Sha->Used < 64)
+            return;
+        ShaBlock(Sha, Sha->Block);
+        Sha->Used = 0;
+    }
+
+    for (; Len >= 64; p += 64, Len -= 64)
+        ShaBlock(Sha, p);
+
+    memcpy(Sha->Block, p, Len);
+    Sha->Used = Len;
+}
+
+static void ShaFinal(SHA256 * Sha, char * Hex)
+{
+    static const char Digits[] = "0123456789abcdef";
+    uint64_t          Bits = Sha->Length * 8;
+    unsigned char     Pad[72];
+    unsigned          PadLen = (Sha->Used < 56) ? 56 - Sha->Used
+                                                : 120 - Sha->Used;
+    int               i;
+
+    memset(Pad, 0, sizeof(Pad));
+    Pad[0] = 0x80;
+    for (i = 0; i < 8; i++)
+        Pad[PadLen + i] = (unsigned char)(Bits >> (56 - 8 * i));
+    ShaUpdate(Sha, Pad, PadLen + 8);
+
+    for (i = 0; i < 32; i++)
+    {
+        Hex[2*i]   = Digits[(Sha->State[i/4] >> (28 - 8 * (i%4))) & 0xF];
+        Hex[2*i+1] = Digits[(Sha->State[i/4] >> (24 - 8 * (i%4))) & 0xF];
+    }
+    Hex[64] = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// E86CacheKey() hashes the tool, its options and the input file.  The
+// parts are separated by NULs, so that no two combinations run into
+// the same bytes.
+//
+int E86CacheKey(char * Key, const char * Tool, const char * Params,
+                const char * Input)
+{
+    SHA256        Sha;
+    struct stat   sr;
+    unsigned char Buffer[COPYBUF];
+    void *        Map;
+    ssize_t       Got;
+    int           fd;
+
+    if ((fd = open(Input, O_RDONLY)) < 0)
+        return -1;
+
+    ShaInit(&Sha);
+    ShaUpdate(&Sha, Tool, strlen(Tool) + 1);
+    ShaUpdate(&Sha, Params, strlen(Params) + 1);
+
+    if ((fstat(fd, &sr) == 0) && S_ISREG(sr.st_mode) && (sr.st_size > 0) &&
+        ((Map = mmap(0, sr.st_size, PROT_READ, MAP_PRIVATE, fd, 0))
+             != MAP_FAILED))
+    {
+        ShaUpdate(&Sha, Map, sr.st_size);
+        munmap(Map, sr.st_size);
+    }
+    else
+        while ((Got = read(fd, Buffer, sizeof(Buffer))) != 0)
+        {
+            if (Got < 0 && errno == EINTR)
+                continue;
+            if (Got < 0)
+            {
+                close(fd);
+                return -1;
+            }
+            ShaUpdate(&Sha, Buffer, Got);
+        }
+
+    close(fd);
+    ShaFinal(&Sha, Key);
+    return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// CopyFile() copies Src to a new file Dest.  Returns 0, or -1.
+//
+static int CopyFile(const char * Src, const char * Dest)
+{
+    char    Buffer[COPYBUF];
+    ssize_t Got;
+    int     In;
+    int     Out;
+    int     Result = 0;
+
+    if ((In = open(Src, O_RDONLY)) < 0)
+        return -1;
+    if ((Out = open(Dest, O_WRONLY|O_CREAT|O_TRUNC, 0666)) < 0)
+    {
+        close(In);
+        return -1;
+    }
+
+    while ((Got = read(In, Buffer, sizeof(Buffer))) != 0)
+    {
+        if (Got < 0 && errno == EINTR)
+            continue;
+        if ((Got < 0) || (write(Out, Buffer, Got) != Got))
+        {
+            Result = -1;
+            break;
+        }
+    }
+
+    close(In);
+    if ((close(Out) != 0) || (Result != 0))
+    {
+        unlink(Dest);
+        return -1;
+    }
+    return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// RemoveEntry() deletes an entry directory and the files in it.
+//
+static void RemoveEntry(const char * Path)
+{
+    char            Name[1200];
+    DIR *           Dir;
+    struct dirent * Ent;
+
+    if ((Dir = opendir(Path)) != 0)
+    {
+        while ((Ent = readdir(Dir)) != 0)
+            if (Ent->d_name[0] != '.')
+            {
+                snprintf(Name, sizeof(Name), "%s/%s", Path, Ent->d_name);
+                unlink(Name);
+            }
+        closedir(Dir);
+    }
+    rmdir(Path);
+}
+
+E86CACHE * E86CacheOpen(const char * Dir, unsigned MaxMB)
+{
+    E86CACHE *  Cache;
+    const char *Home;
+    char *      Slash;
+
+    if ((Cache = calloc(1, sizeof(E86CACHE))) == 0)
+        return 0;
+
+    if ((Dir == 0) || (*Dir == 0))
+        Dir = getenv("E86_CACHE");
+    if ((Dir != 0) && (*Dir != 0))
+        snprintf(Cache->Dir, sizeof(Cache->Dir), "%s", Dir);
+    else if ((Home = getenv("HOME")) != 0)
+        snprintf(Cache->Dir, sizeof(Cache->Dir), "%s/.cache/e86mon", Home);
+    else
+        snprintf(Cache->Dir, sizeof(Cache->Dir), ".e86cache");
+
+    if ((MaxMB == 0) && (getenv("E86_CACHE_SIZE") != 0))
+        MaxMB = atoi(getenv("E86_CACHE_SIZE"));
+    if (MaxMB == 0)
+        MaxMB = E86CACHE_DEFSIZE;
+    Cache->MaxBytes = (unsigned long long)MaxMB << 20;
+
+    //
+    // Make the directory, and any missing parents.
+    //
+    for (Slash = Cache->Dir + 1; (Slash = strchr(Slash, '/')) != 0; Slash++)
+    {
+        *Slash = 0;
+        mkdir(Cache->Dir, 0777);
+        *Slash = '/';
+    }
+    mkdir(Cache->Dir, 0777);
+    if (access(Cache->Dir, W_OK) != 0)
+    {
+        free(Cache);
+        return 0;
+    }
+
+    pthread_mutex_init(&Cache->Lock, 0);
+    return Cache;
+}
+
+int E86CacheFetch(E86CACHE * Cache, const char * Key,
+                  const char * const * Files, int Count, char * Note)
+{
+    char    Path[1200];
+    ssize_t Got = -1;
+    int     fd;
+    int     i;
+
+    snprintf(Path, sizeof(Path), "%s/%s/note", Cache->Dir, Key);
+    if ((fd = open(Path, O_RDONLY)) >= 0)
+    {
+        Got = read(fd, Note, E86CACHE_NOTELEN - 1);
+        close(fd);
+    }
+
+    for (i = 0; (Got >= 0) && (i < Count); i++)
+    {
+        snprintf(Path, sizeof(Path), "%s/%s/%d", Cache->Dir, Key, i);
+        if ((unlink(Files[i]) != 0 && errno != ENOENT) ||
+            (CopyFile(Path, Files[i]) != 0))
+            Got = -1;
+    }
+
+    pthread_mutex_lock(&Cache->Lock);
+    if (Got >= 0)
+        Cache->Hits++;
+    else
+        Cache->Misses++;
+    pthread_mutex_unlock(&Cache->Lock);
+
+    if (Got < 0)
+        return 0;
+
+    Note[Got] = 0;
+    snprintf(Path, sizeof(Path), "%s/%s", Cache->Dir, Key);
+    utimes(Path, 0);            // Most recently used
+    return 1;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// E86CacheStore() builds the entry under a temporary name, and renames
+// it into place, so that other processes never see half an entry.  If
+// another got there first, its entry is kept.  The files are copied,
+// not linked: the tools write their outputs in place, and would write
+// through a link into the entry.
+//
+void E86CacheStore(E86CACHE * Cache, const char * Key,
+                   const char * const * Files, int Count, const char * Note)
+{
+    char    Tmp[1100];
+    char    Path[1200];
+    int     fd;
+    int     i;
+    int     Ok;
+
+    pthread_mutex_lock(&Cache->Lock);
+    snprintf(Tmp, sizeof(Tmp), "%s/.tmp-%ld-%u", Cache->Dir, (long)getpid(),
+             Cache->TmpCount++);
+    pthread_mutex_unlock(&Cache->Lock);
+
+    if (mkdir(Tmp, 0777) != 0)
+        return;
+
+    snprintf(Path, sizeof(Path), "%s/note", Tmp);
+    Ok = ((fd = open(Path, O_WRONLY|O_CREAT|O_TRUNC, 0666)) >= 0);
+    if (Ok)
+    {
+        Ok = (write(fd, Note, strlen(Note)) == (ssize_t)strlen(Note));
+        Ok = (close(fd) == 0) && Ok;
+    }
+
+    for (i = 0; Ok && (i < Count); i++)
+    {
+        snprintf(Path, sizeof(Path), "%s/%d", Tmp, i);
+        Ok = (CopyFile(Files[i], Path) == 0);
+    }
+
+    snprintf(Path, sizeof(Path), "%s/%s", Cache->Dir, Key);
+    if (!Ok || (rename(Tmp, Path) != 0))
+        RemoveEntry(Tmp);
+    else
+    {
+        pthread_mutex_lock(&Cache->Lock);
+        Cache->Stores++;
+        pthread_mutex_unlock(&Cache->Lock);
+    }
+}
+
+void E86CacheReport(E86CACHE * Cache, FILE * Out)
+{
+    fprintf(Out, "Cache %s: %u hit(s), %u miss(es).\n", Cache->Dir,
+            Cache->Hits, Cache->Misses);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Eviction.  Entries are sized by the files in them, and the oldest
+// (least recently fetched or stored) go first.
+//
+typedef struct {
+    char   Name[E86CACHE_KEYLEN + 16];
+    time_t Used;
+    unsigned long long Size;
+} ENTRY;
+
+static int CompareEntries(const void * a, const void * b)
+{
+    const ENTRY * Ea = a;
+    const ENTRY * Eb = b;
+
+    return (Ea->Used > Eb->Used) - (Ea->Used < Eb->Used);
+}
+
+static void Evict(E86CACHE * Cache)
+{
+    char            Path[1200];
+    char            File[1500];
+    DIR *           Dir;
+    DIR *           Sub;
+    struct dirent * Ent;
+    struct dirent * SubEnt;
+    struct stat     sr;
+    ENTRY *         Entries = 0;
+    ENTRY *         Grown;
+    unsigned        NumEntries = 0;
+    unsigned        Alloc = 0;
+    unsigned        i;
+    unsigned long long Total = 0;
+
+    if ((Dir = opendir(Cache->Dir)) == 0)
+        return;
+
+    while ((Ent = readdir(Dir)) != 0)
+    {
+        if ((Ent->d_name[0] == '.') || (strlen(Ent->d_name) >= E86CACHE_KEYLEN))
+            continue;
+        snprintf(Path, sizeof(Path), "%s/%s", Cache->Dir, Ent->d_name);
+        if ((stat(Path, &sr) != 0) || !S_ISDIR(sr.st_mode))
+            continue;
+
+        if (NumEntries == Alloc)
+        {
+            Alloc = Alloc ? Alloc * 2 : 256;
+            if ((Grown = realloc(Entries, Alloc * sizeof(ENTRY))) == 0)
+                break;
+            Entries = Grown;
+        }
+        strcpy(Entries[NumEntries].Name, Ent->d_name);
+        Entries[NumEntries].Used = sr.st_mtime;
+        Entries[NumEntries].Size = 0;
+
+        if ((Sub = opendir(Path)) != 0)
+        {
+            while ((SubEnt = readdir(Sub)) != 0)
+            {
+                snprintf(File, sizeof(File), "%s/%s", Path, SubEnt->d_name);
+                if ((SubEnt->d_name[0] != '.') && (stat(File, &sr) == 0))
+                    Entries[NumEntries].Size += sr.st_size;
+            }
+            closedir(Sub);
+        }
+        Total += Entries[NumEntries++].Size;
+    }
+    closedir(Dir);
+
+    if (Total > Cache->MaxBytes)
+    {
+        qsort(Entries, NumEntries, sizeof(ENTRY), CompareEntries);
+        for (i = 0; (i < NumEntries) && (Total > Cache->MaxBytes); i++)
+        {
+            snprintf(Path, sizeof(Path), "%s/%s", Cache->Dir,
+                     Entries[i].Name);
+            RemoveEntry(Path);
+            Total -= Entries[i].Size;
+        }
+    }
+    free(Entries);
+}
+
+void E86CacheClose(E86CACHE * Cache)
+{
+    if (Cache == 0)
+        return;
+    if (Cache->Stores != 0)
+        Evict(Cache);
+    pthread_mutex_destroy(&Cache->Lock);
+    free(Cache);
+}
@@ -0,0 +1,74 @@
+/******************************************************************************
+ *                                                                            *
+ *     E86CACHE.H                                                             *
+ *                                                                            *
+ *     Content addressed output cache shared by MakeHex and MakeBin.  A       *
+ *     conversion is keyed on the SHA-256 of the tool version, its options    *
+ *     and the input bytes; when the key is cached, the outputs are copied    *
+ *     from the cache instead of being made again.  Entries hold private      *
+ *     copies, never links to the outputs, so rewriting an output cannot      *
+ *     change what is cached.                                                 *
+ *                                                                            *
+ *     Each entry is a directory named after the key, holding the output      *
+ *     files and a short note the tool keeps alongside them (the figures it   *
+ *     prints).  Entries are used and evicted least recently used first,      *
+ *     by the modification time of their directory.                           *
+ *                                                                            *
+ *****************************************************************************/
+
+#ifndef E86CACHE_H
+#define E86CACHE_H
+
+#include <stdio.h>
+
+#define E86CACHE_KEYLEN   65          // 64 hex digits and a terminator
+#define E86CACHE_NOTELEN  512
+#define E86CACHE_DEFSIZE  256         // Default size limit, in megabytes
+
+typedef struct E86CACHE E86CACHE;
+
+//////////////////////////////////////////////////////////////////////////
+// E86CacheOpen() opens (creating if need be) the cache in Dir, which
+// is trimmed to MaxMB megabytes when it is closed.  A Dir of 0 means
+// $E86_CACHE, or else ~/.cache/e86mon; a MaxMB of 0 means
+// $E86_CACHE_SIZE, or else E86CACHE_DEFSIZE.  Returns 0 if the
+// directory cannot be used.
+//
+E86CACHE * E86CacheOpen(const char * Dir, unsigned MaxMB);
+
+//////////////////////////////////////////////////////////////////////////
+// E86CacheClose() evicts the least recently used entries until the
+// cache fits its size limit, and frees the cache.
+//
+void E86CacheClose(E86CACHE * Cache);
+
+//////////////////////////////////////////////////////////////////////////
+// E86CacheKey() hashes Tool (name and version), Params (the options
+// which change the output) and the contents of the file Input into Key.
+// Returns 0, or -1 if the input cannot be read.
+//
+int E86CacheKey(char * Key, const char * Tool, const char * Params,
+                const char * Input);
+
+//////////////////////////////////////////////////////////////////////////
+// E86CacheFetch() makes the Count files named in Files out of the entry
+// for Key, and copies its note into Note (NUL terminated).  Returns 1
+// on a hit, or 0 on a miss, in which case the files may be missing.
+//
+int E86CacheFetch(E86CACHE * Cache, const char * Key,
+                  const char * const * Files, int Count, char * Note);
+
+//////////////////////////////////////////////////////////////////////////
+// E86CacheStore() adds the Count files named in Files, and Note, as the
+// entry for Key.  Failing to store only costs a later miss, so nothing
+// is reported.
+//
+void E86CacheStore(E86CACHE * Cache, const char * Key,
+                   const char * const * Files, int Count, const char * Note);
+
+//////////////////////////////////////////////////////////////////////////
+// E86CacheReport() prints the hit and miss counters.
+//
+void E86CacheReport(E86CACHE * Cache, FILE * Out);
+
+#endif
@@ -0,0 +1,2323 @@
+/******************************************************************************
+ *                                                                            *
+ *     E86HEX.C                                                               *
+ *                                                                            *
+ *     libe86hex -- the conversion engine behind MakeHex.  Converts .EXE,     *
+ *     .COM and .BIN images into .HEX files compatible with AMD's EMON        *
+ *     v. 3.30 and above.                                                     *
+ *                                                                            *
+ *     This is the conversion code of MAKEHEX.C, by Pat Maupin, with its      *
+ *     globals gathered into a context so that it can be linked into other    *
+ *     programs and run on several threads at once.                           *
+ *                                                                            *
+ ******************************************************************************
+ *                                                                            *
+ * Copyright 1996, 1997 Advanced Micro Devices, Inc.                          *
+ *                                                                            *
+ * This software is the property of Advanced Micro Devices, Inc  (AMD)  which *
+ * specifically  grants the user the right to modify, use and distribute this *
+ * software provided this notice is not removed or altered.  All other rights *
+ * are reserved by AMD.                                                       *
+ *                                                                            *
+ * AMD MAKES NO WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, WITH REGARD TO THIS *
+ * SOFTWARE.  IN NO EVENT SHALL AMD BE LIABLE FOR INCIDENTAL OR CONSEQUENTIAL *
+ * DAMAGES IN CONNECTION WITH OR ARISING FROM THE FURNISHING, PERFORMANCE, OR *
+ * USE OF THIS SOFTWARE.                                                      *
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <setjmp.h>
+#include <pthread.h>
+#include <time.h>
+#include "e86hex.h"
+#include "hexkern.h"
+
+#define OUTBUFSIZE    0x10000
+#define STREAMBUF     0x10000
+#define STREAMLEN     0xFFFFFFFFL   // Stream length not known until its end
+#define PROGHEAD      0x8002        // Program bytes DGROUP relocations can hit
+#define CHUNKMIN      0x10000L      // Smallest data chunk worth a thread
+#define CHUNKMAX      0x100000L
+#define MAXRECORD     (1 + 2*(1+2+1+255+1) + 1)  // ':' + hex fields + '\n'
+#define BASESPAN      0x110000L     // Linear addresses type 02 records reach
+#define RELOBLOCK     1024          // Relocation entries converted at a time
+#define RECOVERHEAD   (1 + 2*(1+2+1+1) + 1)      // Characters a record adds
+
+//
+// Where the source image came from, which decides how it is released.
+//
+#define SRC_NONE      0
+#define SRC_MAPPED    1
+#define SRC_ALLOCATED 2
+#define SRC_CALLER    3
+#define SRC_STREAM    4
+
+//
+// What a relocatable delta does with each byte of the file.
+//
+#define DELTA_LEAVE   0             // Unchanged, harmless to send again
+#define DELTA_SEND    1
+#define DELTA_PINNED  2             // Unchanged relocated word or entry,
+                                    // which must not be sent again
+
+//
+// ExeHeader structure from Microsoft's MS-DOS programmer's manual,
+// version 5.0
+//
+typedef struct {
+   WORD MagicNumber;
+   WORD BytesLastPg;        // NOTE!  Modulo-512
+   WORD PagesInFile;
+   WORD Relocations;
+   WORD ParsInHdr;
+   WORD ExtraParsNeeded;
+   WORD ExtraParsWanted;
+   WORD InitStackSegment;
+   WORD InitStackOffset;
+   WORD WordXsum;
+   WORD EntryOffset;
+   WORD EntrySegment;
+   WORD ReloTableAddr;
+} ExeHdr;
+
+//
+// E86Mon library extension definition:
+static const struct {
+    WORD    ShortJmp;          // Jump around the rest of this
+    BYTE    Signature[22];
+} LibSig = {0x16EB,"E86Mon Lib Extension 1"};
+
+//
+// The two ASCII hex digits of every byte value.
+//
+static const char HexPairs[] =
+    "000102030405060708090A0B0C0D0E0F"
+    "101112131415161718191A1B1C1D1E1F"
+    "202122232425262728292A2B2C2D2E2F"
+    "303132333435363738393A3B3C3D3E3F"
+    "404142434445464748494A4B4C4D4E4F"
+    "505152535455565758595A5B5C5D5E5F"
+    "606162636465666768696A6B6C6D6E6F"
+    "707172737475767778797A7B7C7D7E7F"
+    "808182838485868788898A8B8C8D8E8F"
+    "909192939495969798999A9B9C9D9E9F"
+    "A0A1A2A3A4A5A6A7A8A9AAABACADAEAF"
+    "B0B1B2B3B4B5B6B7B8B9BABBBCBDBEBF"
+    "C0C1C2C3C4C5C6C7C8C9CACBCCCDCECF"
+    "D0D1D2D3D4D5D6D7D8D9DADBDCDDDEDF"
+    "E0E1E2E3E4E5E6E7E8E9EAEBECEDEEEF"
+    "F0F1F2F3F4F5F6F7F8F9FAFBFCFDFEFF";
+
+//
+// Conversion context.  Everything MakeHex used to keep in globals.
+//
+struct E86HEX {
+    E86HEXOPTIONS Opts;
+
+    jmp_buf Jump;               // Where Fail() returns to
+    int     Error;
+    char    ErrMsg[400];
+
+    LPBYTE  SourceData;         // The whole input file
+    DWORD   SourceLength;
+    int     SourceKind;         // SRC_xxx
+    int     SourceType;         // E86HEX_BIN, _COM, _EXE
+
+    //
+    // Streamed input is read as the conversion goes.  SourceData then
+    // holds StreamHave bytes from input offset StreamBase on, and
+    // SourceLength counts the bytes read so far.  The relocation table
+    // (already converted to linear addresses), and for DGROUP the start
+    // of the program, are copied aside because they are needed after
+    // the window has moved past them.
+    //
+    int     StreamFd;
+    DWORD   StreamBase;
+    DWORD   StreamHave;
+    DWORD   StreamSize;         // Bytes allocated at SourceData
+    DWORD   StreamLength;       // Input length, or STREAMLEN if unknown
+    BOOL    StreamEnd;
+    LPDWORD ReloCopy;
+    LPBYTE  ProgHead;
+
+    LPBYTE  Sidecar;            // Relocation sidecar of a binary conversion
+    DWORD   SidecarLen;
+
+    //
+    // Delta output: what the baseline hex file loads, by linear address,
+    // and the full hex file the delta is cut down from.
+    //
+    LPBYTE  BaseImage;
+    LPBYTE  BaseHave;           // Bitmap of the bytes the baseline loads
+    DWORD   BaseProgLength;     // Its AMD LPD header's program and
+    DWORD   BaseReloEnd;        // relocation block ends, if it has one
+    char *  FullHex;
+    DWORD   UnchangedLines;
+    DWORD   UnchangedChars;
+
+    E86HEXHOOK * Hook;          // Phase timing, if wanted
+    void *  HookUser;
+
+    int     DestFile;           // Output descriptor, or -1 for memory
+    char *  OutBuf;             // Formatted records not yet written
+    DWORD   OutLen;
+    DWORD   OutSize;
+    DWORD   Flushed;            // Characters already written
+
+    BYTE    CheckSum;
+    WORD    OutputAddress;
+    WORD    OutputSegment;
+    WORD    BytesPerLine;
+    DWORD   TotalLines;
+    BYTE    MiscBuffer[MAXRECLEN];
+    WORD    MiscLen;
+
+    //
+    // Fill elision: records made up entirely of a skipped fill value are
+    // left out, and the segment record for a new 64K is held back until
+    // the first record which is actually printed in it.
+    //
+    BOOL    SegPending;
+    DWORD   SkippedBytes;
+    DWORD   SkippedLines;
+    DWORD   SkippedChars;
+};
+
+static void FlushOutput(E86HEX * Ctx);
+
+//////////////////////////////////////////////////////////////////////////
+// Fail() records an error and abandons the current library call.
+//
+static void Fail(E86HEX * Ctx, int Code, const char * s, ...)
+{
+    va_list Args;
+
+    va_start(Args,s);
+    vsnprintf(Ctx->ErrMsg,sizeof(Ctx->ErrMsg),s,Args);
+    va_end(Args);
+
+    Ctx->Error = Code;
+    longjmp(Ctx->Jump,1);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// UnloadFile() releases the source file image.
+//
+static void UnloadFile(E86HEX * Ctx)
+{
+    if (Ctx->SourceKind == SRC_MAPPED)
+        munmap(Ctx->SourceData, Ctx->SourceLength);
+    else if ((Ctx->SourceKind == SRC_ALLOCATED) ||
+             (Ctx->SourceKind == SRC_STREAM))
+        free(Ctx->SourceData);
+
+    Ctx->SourceData   = 0;
+    Ctx->SourceLength = 0;
+    Ctx->SourceKind   = SRC_NONE;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// LoadFile() makes the whole source file available at SourceData.
+// Regular files are mapped; pipes and other streams are read into
+// memory instead.
+//
+static void LoadFile(E86HEX * Ctx, int fd)
+{
+    struct stat sr;
+    DWORD       Alloc = 0;
+    ssize_t     Got;
+    LPBYTE      Grown;
+
+    UnloadFile(Ctx);
+
+    if ((fstat(fd, &sr) == 0) && S_ISREG(sr.st_mode))
+    {
+        if (sr.st_size > 0xFFFFFFFFL)
+            Fail(Ctx, E86HEX_EREAD, "Source file too large");
+        if (sr.st_size == 0)
+            return;
+        Ctx->SourceData = mmap(0, sr.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (Ctx->SourceData != MAP_FAILED)
+        {
+            Ctx->SourceLength = sr.st_size;
+            Ctx->SourceKind   = SRC_MAPPED;
+            return;
+        }
+        Ctx->SourceData = 0;
+    }
+
+    Ctx->SourceKind = SRC_ALLOCATED;
+    for (;;)
+    {
+        if (Ctx->SourceLength == Alloc)
+        {
+            Alloc = Alloc ? Alloc * 2 : 0x10000;
+            if ((Grown = realloc(Ctx->SourceData, Alloc)) == 0)
+                Fail(Ctx, E86HEX_ENOMEM, "Out of memory reading source file");
+            Ctx->SourceData = Grown;
+        }
+        Got = read(fd, Ctx->SourceData + Ctx->SourceLength,
+                   Alloc - Ctx->SourceLength);
+        if (Got < 0 && errno == EINTR)
+            continue;
+        if (Got < 0)
+            Fail(Ctx, E86HEX_EREAD, "File read failed");
+        if (Got == 0)
+            break;
+        Ctx->SourceLength += Got;
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+// StreamRead() reads streamed input until size bytes from offset on are
+// held, or the input ends, and returns how many of them are held.
+// Everything before offset is let go; the stream cannot go back to it.
+// Records already formatted are written out before waiting for input,
+// so the output keeps pace with the input.
+//
+static DWORD StreamRead(E86HEX * Ctx, DWORD offset, DWORD size)
+{
+    DWORD   Drop;
+    DWORD   Grow;
+    ssize_t Got;
+    LPBYTE  Grown;
+
+    if (offset < Ctx->StreamBase)
+        Fail(Ctx, E86HEX_EREAD, "Cannot go back in the input stream");
+
+    while ((Ctx->StreamBase + Ctx->StreamHave < offset + size) &&
+           !Ctx->StreamEnd)
+    {
+        Drop = offset - Ctx->StreamBase;
+        if (Drop > Ctx->StreamHave)
+            Drop = Ctx->StreamHave;
+        if (Drop != 0)
+        {
+            memmove(Ctx->SourceData, Ctx->SourceData + Drop,
+                    Ctx->StreamHave - Drop);
+            Ctx->StreamBase += Drop;
+            Ctx->StreamHave -= Drop;
+        }
+
+        if ((offset == Ctx->StreamBase) && (size > Ctx->StreamSize))
+        {
+            if (Ctx->StreamSize >= 0x80000000L)
+                Fail(Ctx, E86HEX_EREAD, "Source file too large");
+            Grow = (size > Ctx->StreamSize * 2) ? size : Ctx->StreamSize * 2;
+            if ((Grown = realloc(Ctx->SourceData, Grow)) == 0)
+                Fail(Ctx, E86HEX_ENOMEM, "Out of memory reading source file");
+            Ctx->SourceData = Grown;
+            Ctx->StreamSize = Grow;
+        }
+
+        if ((Ctx->DestFile >= 0) && (Ctx->OutLen > 0))
+            FlushOutput(Ctx);
+
+        Got = read(Ctx->StreamFd, Ctx->SourceData + Ctx->StreamHave,
+                   Ctx->StreamSize - Ctx->StreamHave);
+        if (Got < 0 && errno == EINTR)
+            continue;
+        if (Got < 0)
+            Fail(Ctx, E86HEX_EREAD, "File read failed");
+        if (Got == 0)
+            Ctx->StreamEnd = TRUE;
+        Ctx->StreamHave   += Got;
+        Ctx->SourceLength += Got;
+    }
+
+    if (Ctx->StreamBase + Ctx->StreamHave <= offset)
+        return 0;
+    if (Ctx->StreamBase + Ctx->StreamHave - offset < size)
+        return Ctx->StreamBase + Ctx->StreamHave - offset;
+    return size;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// StreamAll() reads the rest of streamed input, for conversions which
+// must know its length before they start, and returns the length.
+// Nothing past the first bytes of the stream has been let go yet.
+//
+static DWORD StreamAll(E86HEX * Ctx)
+{
+    while (!Ctx->StreamEnd)
+        StreamRead(Ctx, 0, Ctx->StreamSize + 1);
+
+    return Ctx->StreamHave;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// ReadFile() returns a pointer to size bytes of the source file,
+// starting at offset.
+//
+static void * ReadFile(E86HEX * Ctx, DWORD offset, DWORD size)
+{
+    if (Ctx->SourceKind == SRC_STREAM)
+    {
+        if (StreamRead(Ctx, offset, size) < size)
+            Fail(Ctx, E86HEX_EREAD, "file read failed");
+        return Ctx->SourceData + (offset - Ctx->StreamBase);
+    }
+
+    if ((offset > Ctx->SourceLength) || (size > Ctx->SourceLength - offset))
+        Fail(Ctx, E86HEX_EREAD, "file read failed");
+
+    return Ctx->SourceData + offset;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// RoundUp() rounds Value up to a multiple of Unit.
+//
+static DWORD RoundUp(DWORD Value, DWORD Unit)
+{
+    return (Value + Unit - 1) / Unit * Unit;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// ReloUnit() returns the size the relocation block is padded to for a
+// given record length: whole records holding whole 4 byte entries.
+//
+static DWORD ReloUnit(WORD RecLen)
+{
+    if ((RecLen & 3) == 0)
+        return RecLen;
+    if ((RecLen & 1) == 0)
+        return RecLen * 2L;
+    return RecLen * 4L;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// E86HexDownloadTime() estimates the seconds E86Mon needs to receive
+// Chars characters in Lines records.  Each character costs ten bit
+// times, and each record LineCost microseconds of monitor processing.
+//
+double E86HexDownloadTime(const E86HEXOPTIONS * Opts,
+                          double Chars, double Lines)
+{
+    return Chars * 10.0 / Opts->Baud + Lines * Opts->LineCost / 1000000.0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// AutoRecordLength() picks the record length with the shortest
+// estimated download for Length bytes of data followed by ReloBytes
+// bytes of relocation entries.
+//
+static WORD AutoRecordLength(E86HEX * Ctx, DWORD Length, DWORD ReloBytes)
+{
+    WORD   RecLen;
+    WORD   Best = BYTESPERLINE;
+    double BestTime = 0;
+    double Lines;
+    double Time;
+    DWORD  Padded;
+
+    for (RecLen = 1; RecLen <= MAXRECLEN; RecLen++)
+    {
+        Padded = ReloBytes ? RoundUp(ReloBytes,ReloUnit(RecLen)) : 0;
+        Lines  = (Length + RecLen - 1) / RecLen + Padded / RecLen
+                 + (Length >> 16);
+        Time   = E86HexDownloadTime(&Ctx->Opts,
+                     Lines * RECORDFRAME + 2.0 * (Length + Padded), Lines);
+        if ((RecLen == 1) || (Time < BestTime))
+        {
+            Best     = RecLen;
+            BestTime = Time;
+        }
+    }
+    return Best;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Phase timing.  PhaseStart() notes where a phase begins, and
+// PhaseEnd() reports it to the hook.  Neither does anything without a
+// hook.
+//
+typedef struct {
+    double Start;
+    DWORD  Out;
+    DWORD  Lines;
+} PHASEMARK;
+
+static double Now(void)
+{
+    struct timespec Time;
+
+    clock_gettime(CLOCK_MONOTONIC, &Time);
+    return Time.tv_sec + Time.tv_nsec / 1e9;
+}
+
+static void PhaseStart(E86HEX * Ctx, PHASEMARK * Mark)
+{
+    if (Ctx->Hook == 0)
+        return;
+    Mark->Start = Now();
+    Mark->Out   = Ctx->Flushed + Ctx->OutLen;
+    Mark->Lines = Ctx->TotalLines;
+}
+
+static void PhaseEnd(E86HEX * Ctx, PHASEMARK * Mark, const char * Phase,
+                     DWORD BytesIn)
+{
+    if (Ctx->Hook == 0)
+        return;
+    Ctx->Hook(Ctx->HookUser, Phase, Mark->Start, Now(), BytesIn,
+              Ctx->Flushed + Ctx->OutLen - Mark->Out,
+              Ctx->TotalLines - Mark->Lines);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// WriteOut() writes Len characters to the destination file.
+//
+static void WriteOut(E86HEX * Ctx, const char * Ptr, DWORD Len)
+{
+    ssize_t Written;
+    double  Start = (Ctx->Hook != 0) ? Now() : 0;
+    DWORD   Total = Len;
+
+    Ctx->Flushed += Len;
+    while (Len > 0)
+    {
+        Written = write(Ctx->DestFile, Ptr, Len);
+        if (Written < 0 && errno == EINTR)
+            continue;
+        if (Written <= 0)
+            Fail(Ctx, E86HEX_EWRITE, "File write failed");
+        Ptr += Written;
+        Len -= Written;
+    }
+
+    if (Ctx->Hook != 0)
+        Ctx->Hook(Ctx->HookUser, "write", Start, Now(), 0, Total, 0);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// FlushOutput() writes the formatted records out to the destination
+// file.  When the output goes to memory it makes room for more instead.
+//
+static void FlushOutput(E86HEX * Ctx)
+{
+    char *  Ptr;
+
+    if (Ctx->DestFile < 0)
+    {
+        if ((Ptr = realloc(Ctx->OutBuf, Ctx->OutSize * 2)) == 0)
+            Fail(Ctx, E86HEX_ENOMEM, "Out of memory");
+        Ctx->OutBuf   = Ptr;
+        Ctx->OutSize *= 2;
+        return;
+    }
+
+    WriteOut(Ctx, Ctx->OutBuf, Ctx->OutLen);
+    Ctx->OutLen = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// PrintByte() prints a byte, and adds it to the line checksum.
+//
+static void PrintByte(E86HEX * Ctx, BYTE what)
+{
+    memcpy(Ctx->OutBuf + Ctx->OutLen, HexPairs + 2 * what, 2);
+    Ctx->OutLen   += 2;
+    Ctx->CheckSum += what;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// PrintWord() prints a word, and adds it to the line checksum.
+//
+static void PrintWord(E86HEX * Ctx, WORD what)
+{
+    PrintByte(Ctx, (BYTE)(what >> 8));
+    PrintByte(Ctx, (BYTE)what);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// PrintDWord() prints a double word, and adds it to the line checksum.
+//
+static void PrintDWord(E86HEX * Ctx, DWORD what)
+{
+    PrintWord(Ctx, (WORD)(what >> 16));
+    PrintWord(Ctx, (WORD)what);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// StartLine() initializes the checksum and prints the start
+//             of a line record
+//
+static void StartLine(E86HEX * Ctx, BYTE DataLen, WORD DataAddr,
+                      BYTE DataType)
+{
+    if (Ctx->OutLen > Ctx->OutSize - MAXRECORD)
+        FlushOutput(Ctx);
+
+    Ctx->CheckSum = 0;
+    Ctx->OutBuf[Ctx->OutLen++] = ':';
+    PrintByte(Ctx, DataLen);
+    PrintWord(Ctx, DataAddr);
+    PrintByte(Ctx, DataType);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// FinishLine() prints the checksum and end of line
+//
+static void FinishLine(E86HEX * Ctx)
+{
+    Ctx->CheckSum = 0 - Ctx->CheckSum;
+    memcpy(Ctx->OutBuf + Ctx->OutLen, HexPairs + 2 * Ctx->CheckSum, 2);
+    Ctx->OutBuf[Ctx->OutLen + 2] = '\n';
+    Ctx->OutLen += 3;
+    Ctx->TotalLines++;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// SegRecord() prints a segment record
+//
+static void SegRecord(E86HEX * Ctx, WORD SegNum)
+{
+    Ctx->SegPending = FALSE;
+    StartLine(Ctx, 2, 0, 2);
+    PrintWord(Ctx, SegNum);
+    FinishLine(Ctx);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// AdvanceAddress() moves the output address on, and prints a segment
+// record when it wraps into the next 64K.
+//
+static void AdvanceAddress(E86HEX * Ctx, WORD Count)
+{
+    DWORD Next = (DWORD)Ctx->OutputAddress + Count;
+
+    Ctx->OutputAddress = (WORD)Next;
+    if (Next >= 0x10000L)
+    {
+        Ctx->OutputSegment += 0x1000;
+        if (Ctx->Opts.SkipFill)
+            Ctx->SegPending = TRUE;
+        else
+            SegRecord(Ctx, Ctx->OutputSegment);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+// DataRecord() prints a entire data record.  Records which would run
+// past the end of the current segment are split at the boundary.
+//
+static void DataRecord(E86HEX * Ctx, LPBYTE Data, BYTE DataLen)
+{
+    WORD Room = 0 - Ctx->OutputAddress;
+
+    if ((Room != 0) && (DataLen > Room))
+    {
+        DataRecord(Ctx, Data, (BYTE)Room);
+        Data    += Room;
+        DataLen -= Room;
+    }
+
+    if (Ctx->SegPending)
+        SegRecord(Ctx, Ctx->OutputSegment);
+
+    StartLine(Ctx, DataLen, Ctx->OutputAddress, 0);
+
+    Ctx->CheckSum += HexEncode(Data, DataLen, Ctx->OutBuf + Ctx->OutLen);
+    Ctx->OutLen   += 2 * DataLen;
+
+    FinishLine(Ctx);
+
+    AdvanceAddress(Ctx, DataLen);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// IsFillRecord() tells whether a record holds nothing but a fill value
+// which --skip-fill asked to leave out.
+//
+static BOOL IsFillRecord(E86HEX * Ctx, LPBYTE Data, BYTE DataLen)
+{
+    int Value = HexUniform(Data, DataLen);
+
+    return ((Value == 0x00) && (Ctx->Opts.SkipFill & E86HEX_SKIP00)) ||
+           ((Value == 0xFF) && (Ctx->Opts.SkipFill & E86HEX_SKIPFF));
+}
+
+static void OutputDataFromFile(E86HEX * Ctx, DWORD FileLoc, DWORD Length);
+
+//////////////////////////////////////////////////////////////////////////
+// OutputText() adds already formatted records to the output.  Text too
+// big for the buffer goes straight to the destination file.
+//
+static void OutputText(E86HEX * Ctx, const char * Text, DWORD Len)
+{
+    DWORD Part;
+
+    if ((Ctx->DestFile >= 0) && (Len >= Ctx->OutSize))
+    {
+        FlushOutput(Ctx);
+        WriteOut(Ctx, Text, Len);
+        return;
+    }
+
+    while (Len > 0)
+    {
+        if (Ctx->OutLen == Ctx->OutSize)
+            FlushOutput(Ctx);
+
+        Part = Ctx->OutSize - Ctx->OutLen;
+        if (Part > Len)
+            Part = Len;
+        memcpy(Ctx->OutBuf + Ctx->OutLen, Text, Part);
+        Ctx->OutLen += Part;
+        Text        += Part;
+        Len         -= Part;
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Parallel formatting.  The data is cut into chunks of whole records,
+// which worker threads format into contexts of their own, starting
+// from the address and segment the sequential code would have reached.
+// The calling thread writes the chunks out in order as they complete.
+// Workers run at most two chunks per thread ahead of the writer.
+//
+typedef struct {
+    E86HEX *        Ctx;
+    DWORD           FileLoc;
+    DWORD           Length;
+    DWORD           ChunkLen;
+    DWORD           Chunks;
+    WORD            StartAddress;   // Output address and segment
+    WORD            StartSegment;   // where the data begins
+    DWORD           Next;       // Next chunk to format
+    DWORD           Written;    // Chunks written out
+    DWORD           Ahead;      // How far Next may run past Written
+    E86HEX **       Done;       // Formatted chunks not yet written
+    BOOL            Failed;
+    pthread_mutex_t Lock;
+    pthread_cond_t  Change;     // A chunk was formatted or written
+} CHUNKJOB;
+
+//////////////////////////////////////////////////////////////////////////
+// FormatChunk() formats one chunk, and returns the context holding the
+// records, or 0 if it ran out of memory.
+//
+static E86HEX * FormatChunk(CHUNKJOB * Job, DWORD Chunk)
+{
+    E86HEX * Ctx = Job->Ctx;
+    E86HEX * W = calloc(1, sizeof(E86HEX));
+    DWORD    Offset = Chunk * Job->ChunkLen;
+    DWORD    Length = Job->Length - Offset;
+    DWORD    Linear = Job->StartAddress + Offset;
+
+    if (Length > Job->ChunkLen)
+        Length = Job->ChunkLen;
+    if (W == 0)
+        return 0;
+
+    //
+    // Only what the data phase uses is taken from the caller's context,
+    // which the writer keeps changing meanwhile.
+    //
+    W->Opts          = Ctx->Opts;
+    W->Opts.Threads  = 1;
+    W->SourceData    = Ctx->SourceData;
+    W->SourceLength  = Ctx->SourceLength;
+    W->SourceKind    = SRC_CALLER;
+    W->BytesPerLine  = Ctx->BytesPerLine;
+    W->DestFile      = -1;
+    W->OutSize       = (Length / Ctx->BytesPerLine + (Length >> 16) + 4) *
+                       (RECORDFRAME + 2 * Ctx->BytesPerLine);
+    W->OutputAddress = (WORD)Linear;
+    W->OutputSegment = Job->StartSegment + (WORD)((Linear >> 16) << 12);
+
+    if ((W->OutBuf = malloc(W->OutSize)) == 0)
+    {
+        free(W);
+        return 0;
+    }
+    if (setjmp(W->Jump) != 0)
+    {
+        free(W->OutBuf);
+        free(W);
+        return 0;
+    }
+
+    OutputDataFromFile(W, Job->FileLoc + Offset, Length);
+    return W;
+}
+
+static void * ChunkWorker(void * Arg)
+{
+    CHUNKJOB * Job = Arg;
+    E86HEX *   W;
+    DWORD      Chunk;
+
+    pthread_mutex_lock(&Job->Lock);
+    for (;;)
+    {
+        while ((Job->Next < Job->Chunks) && !Job->Failed &&
+               (Job->Next >= Job->Written + Job->Ahead))
+            pthread_cond_wait(&Job->Change, &Job->Lock);
+        if ((Job->Next >= Job->Chunks) || Job->Failed)
+            break;
+
+        Chunk = Job->Next++;
+        pthread_mutex_unlock(&Job->Lock);
+        W = FormatChunk(Job, Chunk);
+        pthread_mutex_lock(&Job->Lock);
+
+        if (W == 0)
+            Job->Failed = TRUE;
+        Job->Done[Chunk] = W;
+        pthread_cond_broadcast(&Job->Change);
+    }
+    pthread_mutex_unlock(&Job->Lock);
+    return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// WriteChunk() adds a formatted chunk to the output and takes over the
+// state it ended in.  With fill elision, a segment record the chunk
+// could not know was pending goes in front of its first data record;
+// a chunk whose output starts with a segment record wrapped first, and
+// so printed it itself.
+//
+static void WriteChunk(E86HEX * Ctx, E86HEX * W, WORD StartSegment)
+{
+    if (Ctx->SegPending && (W->OutLen > 0) &&
+        (memcmp(W->OutBuf + 7, "00", 2) == 0))
+        SegRecord(Ctx, StartSegment);
+
+    OutputText(Ctx, W->OutBuf, W->OutLen);
+
+    if ((W->OutLen > 0) || (W->OutputSegment != StartSegment))
+        Ctx->SegPending = W->SegPending;
+    Ctx->TotalLines   += W->TotalLines;
+    Ctx->SkippedBytes += W->SkippedBytes;
+    Ctx->SkippedLines += W->SkippedLines;
+    Ctx->SkippedChars += W->SkippedChars;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// OutputDataParallel() formats Length bytes, a multiple of the record
+// length, with Ctx->Opts.Threads threads.  The output and the state
+// left behind are exactly those of the sequential code.
+//
+static void OutputDataParallel(E86HEX * Ctx, DWORD FileLoc, DWORD Length)
+{
+    CHUNKJOB *  Job = calloc(1, sizeof(CHUNKJOB));
+    pthread_t * Threads = calloc(Ctx->Opts.Threads, sizeof(pthread_t));
+    jmp_buf     Caller;
+    E86HEX *    W;
+    DWORD       Chunk;
+    WORD        NumThreads = 0;
+    WORD        i;
+    BOOL        Complete;
+
+    if ((Job == 0) || (Threads == 0))
+    {
+        free(Job);
+        free(Threads);
+        Fail(Ctx, E86HEX_ENOMEM, "Out of memory");
+    }
+
+    Job->Ctx      = Ctx;
+    Job->FileLoc  = FileLoc;
+    Job->Length   = Length;
+    Job->ChunkLen = Length / (Ctx->Opts.Threads * 4L);
+    if (Job->ChunkLen < CHUNKMIN)
+        Job->ChunkLen = CHUNKMIN;
+    if (Job->ChunkLen > CHUNKMAX)
+        Job->ChunkLen = CHUNKMAX;
+    Job->ChunkLen = RoundUp(Job->ChunkLen, Ctx->BytesPerLine);
+    Job->Chunks   = (Length + Job->ChunkLen - 1) / Job->ChunkLen;
+    Job->Ahead    = Ctx->Opts.Threads * 2L;
+    Job->StartAddress = Ctx->OutputAddress;
+    Job->StartSegment = Ctx->OutputSegment;
+    if ((Job->Done = calloc(Job->Chunks, sizeof(E86HEX *))) == 0)
+    {
+        free(Job);
+        free(Threads);
+        Fail(Ctx, E86HEX_ENOMEM, "Out of memory");
+    }
+
+    pthread_mutex_init(&Job->Lock, 0);
+    pthread_cond_init(&Job->Change, 0);
+    while ((NumThreads < Ctx->Opts.Threads) && (NumThreads < Job->Chunks) &&
+           (pthread_create(&Threads[NumThreads], 0, ChunkWorker, Job) == 0))
+        NumThreads++;
+
+    //
+    // A write error must not leave the workers running, so it is caught
+    // here, and passed on once they have stopped.
+    //
+    memcpy(Caller, Ctx->Jump, sizeof(jmp_buf));
+    //
+    // Workers decide from Written how far ahead they may run, so it is
+    // only changed under the lock, along with the slot it frees.
+    //
+    if ((NumThreads != 0) && (setjmp(Ctx->Jump) == 0))
+        for (;;)
+        {
+            pthread_mutex_lock(&Job->Lock);
+            Chunk = Job->Written;
+            while ((Chunk < Job->Chunks) && (Job->Done[Chunk] == 0) &&
+                   !Job->Failed)
+                pthread_cond_wait(&Job->Change, &Job->Lock);
+            W = (Chunk < Job->Chunks) ? Job->Done[Chunk] : 0;
+            pthread_mutex_unlock(&Job->Lock);
+            if (W == 0)
+                break;
+
+            WriteChunk(Ctx, W, Ctx->OutputSegment);
+            Ctx->OutputAddress = W->OutputAddress;
+            Ctx->OutputSegment = W->OutputSegment;
+
+            pthread_mutex_lock(&Job->Lock);
+            Job->Done[Chunk] = 0;
+            Job->Written++;
+            pthread_cond_broadcast(&Job->Change);
+            pthread_mutex_unlock(&Job->Lock);
+            free(W->OutBuf);
+            free(W);
+        }
+
+    pthread_mutex_lock(&Job->Lock);
+    Complete = (Job->Written == Job->Chunks);
+    Job->Failed = !Complete;
+    pthread_cond_broadcast(&Job->Change);
+    pthread_mutex_unlock(&Job->Lock);
+
+    for (i = 0; i < NumThreads; i++)
+        pthread_join(Threads[i], 0);
+    for (i = 0; i < Job->Chunks; i++)
+        if (Job->Done[i] != 0)
+        {
+            free(Job->Done[i]->OutBuf);
+            free(Job->Done[i]);
+        }
+    pthread_mutex_destroy(&Job->Lock);
+    pthread_cond_destroy(&Job->Change);
+    free(Job->Done);
+    free(Job);
+    free(Threads);
+    memcpy(Ctx->Jump, Caller, sizeof(jmp_buf));
+
+    if (!Complete)
+    {
+        if (Ctx->Error == E86HEX_OK)
+            Fail(Ctx, E86HEX_ENOMEM, "Out of memory");
+        longjmp(Ctx->Jump, 1);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+// OutputDataFromFile() uses DataRecord() to output the bulk of the
+// program data.  The output address is left at the end of the last
+// whole record, which is where relocation records start.  A Length of
+// STREAMLEN runs to the end of streamed input.
+//
+static void OutputDataFromFile(E86HEX * Ctx, DWORD FileLoc, DWORD Length)
+{
+    BYTE RecLen = (BYTE)Ctx->BytesPerLine;
+    BOOL ToEnd = (Length == STREAMLEN);
+    DWORD Start = FileLoc;
+    DWORD Whole;
+    LPBYTE Data;
+
+    if ((Ctx->Opts.Threads > 1) && !ToEnd &&
+        (Ctx->SourceKind != SRC_STREAM) && (Length >= 2 * CHUNKMIN))
+    {
+        Whole = Length - Length % Ctx->BytesPerLine;
+        OutputDataParallel(Ctx, FileLoc, Whole);
+        FileLoc += Whole;
+        Length  -= Whole;
+    }
+
+    while (ToEnd || (Length > 0))
+    {
+        if (ToEnd &&
+            (Length = StreamRead(Ctx, FileLoc, Ctx->BytesPerLine)) == 0)
+            break;
+
+        RecLen = (BYTE)Ctx->BytesPerLine;
+        if (RecLen > Length)
+            RecLen = (BYTE)(Length);
+
+        Data = ReadFile(Ctx, FileLoc, RecLen);
+
+        if ((Ctx->ProgHead != 0) && (FileLoc - Start < PROGHEAD))
+            memcpy(Ctx->ProgHead + (FileLoc - Start), Data,
+                   (FileLoc - Start + RecLen <= PROGHEAD) ?
+                   RecLen : PROGHEAD - (FileLoc - Start));
+
+        if (Ctx->Opts.SkipFill && IsFillRecord(Ctx, Data, RecLen))
+        {
+            AdvanceAddress(Ctx, RecLen);
+            Ctx->SkippedBytes += RecLen;
+            Ctx->SkippedLines++;
+            Ctx->SkippedChars += RECORDFRAME + 2 * RecLen;
+        }
+        else
+            DataRecord(Ctx, Data, RecLen);
+        FileLoc += RecLen;
+        Length -= RecLen;
+    }
+
+    if (RecLen < Ctx->BytesPerLine)
+        AdvanceAddress(Ctx, Ctx->BytesPerLine - RecLen);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// OutputMiscData() uses DataRecord() to output miscellaneous data.
+// Items may straddle records.
+//
+static void OutputMiscData(E86HEX * Ctx, LPBYTE Data, WORD DataLen)
+{
+    WORD Chunk;
+
+    while (DataLen > 0)
+    {
+        Chunk = Ctx->BytesPerLine - Ctx->MiscLen;
+        if (Chunk > DataLen)
+            Chunk = DataLen;
+
+        memcpy(Ctx->MiscBuffer + Ctx->MiscLen, Data, Chunk);
+        Ctx->MiscLen += Chunk;
+        Data         += Chunk;
+        DataLen      -= Chunk;
+
+        if (Ctx->MiscLen == Ctx->BytesPerLine)
+        {
+            DataRecord(Ctx, Ctx->MiscBuffer, (BYTE)Ctx->BytesPerLine);
+            Ctx->MiscLen = 0;
+        }
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+// PadMiscData() repeats a 4 byte fill entry until the miscellaneous
+// data ends on a record boundary.
+//
+static void PadMiscData(E86HEX * Ctx, DWORD Fill)
+{
+    while (Ctx->MiscLen != 0)
+        OutputMiscData(Ctx, (LPBYTE)&Fill, 4);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Relocation table reader.  The table is read RELOBLOCK entries at a
+// time, and each block is converted from segment:offset pairs to linear
+// addresses in one pass, so only a block is held however big the table
+// is.  A streamed table comes from the copy ReadHeader() made instead.
+//
+typedef struct {
+    DWORD   TableAddr;          // File offset of the table
+    DWORD   Count;              // Entries in the table
+    DWORD   Next;               // Next entry to read
+    DWORD   Linear[RELOBLOCK];  // The block last read
+} RELOREADER;
+
+//////////////////////////////////////////////////////////////////////////
+// ReloOpen() sets R up to read the table of eh from the start.
+//
+static void ReloOpen(RELOREADER * R, ExeHdr * eh)
+{
+    R->TableAddr = eh->ReloTableAddr;
+    R->Count     = eh->Relocations;
+    R->Next      = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// ReloRead() reads the next block of the table into R->Linear, and
+// returns how many entries it holds (0 at the end of the table).
+//
+static DWORD ReloRead(E86HEX * Ctx, RELOREADER * R)
+{
+    DWORD Count = R->Count - R->Next;
+
+    if (Count > RELOBLOCK)
+        Count = RELOBLOCK;
+
+    if (Ctx->ReloCopy != 0)
+        memcpy(R->Linear, Ctx->ReloCopy + R->Next, Count * 4);
+    else if (Count != 0)
+        HexReloLinear(R->Linear,
+                      ReadFile(Ctx, R->TableAddr + R->Next * 4, Count * 4),
+                      Count);
+
+    R->Next += Count;
+    return Count;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// RelocationRecord() stores relocation items.  These records
+// *must* appear *after* the actual data records.
+//
+static void RelocationRecords(E86HEX * Ctx, ExeHdr * eh)
+{
+    DWORD   EndProgram = Ctx->OutputSegment * 16L + Ctx->OutputAddress;
+    DWORD   Count;
+    RELOREADER R;
+
+    ReloOpen(&R, eh);
+    while ((Count = ReloRead(Ctx, &R)) != 0)
+        OutputMiscData(Ctx, (LPBYTE)R.Linear, (WORD)(Count * 4));
+
+    PadMiscData(Ctx, EndProgram);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// DGROUPRelocations() stores relocation records for DGROUP only,
+// in a special format, after the main program.  ProgPtr need only hold
+// the first PROGHEAD bytes of the program, as targets must be below 32K.
+//
+static void DGROUPRelocations(E86HEX * Ctx, ExeHdr * eh, LPBYTE ProgPtr,
+                              DWORD ProgLength, WORD BaseSegment)
+{
+    DWORD   DGROUPOffset = 0;
+    DWORD   Count;
+    DWORD   i;
+    WORD TargetValue;
+    DWORD  Relo;
+    RELOREADER R;
+
+    //
+    // The data records may have wrapped into a further segment than
+    // the one ProgLength lies in; if so, go back to it.
+    //
+    Ctx->OutputAddress = (WORD)ProgLength;
+    if (Ctx->OutputSegment != BaseSegment + (WORD)((ProgLength >> 16) << 12))
+    {
+        Ctx->OutputSegment = BaseSegment + (WORD)((ProgLength >> 16) << 12);
+        SegRecord(Ctx, Ctx->OutputSegment);
+    }
+
+    if ((ProgLength & 0xF) != 0)
+        Fail(Ctx, E86HEX_ERELOC, "Relocations only processed if data ends"
+                " on paragraph boundary");
+
+    ReloOpen(&R, eh);
+    while ((Count = ReloRead(Ctx, &R)) != 0)
+        for (i=0; i<Count; i++)
+        {
+            Relo = R.Linear[i];
+            if (Relo > 0x7FFF)
+                Fail(Ctx, E86HEX_ERELOC, "Relocation target > 32K");
+            if (Relo + 2 > ProgLength)
+                Fail(Ctx, E86HEX_ERELOC,
+                     "Relocation target %4X outside program", Relo);
+
+            TargetValue = *((LPWORD)(ProgPtr+Relo));
+            if (TargetValue != 0)
+            {
+                if (DGROUPOffset == 0)
+                    DGROUPOffset = TargetValue;
+                else if (TargetValue != DGROUPOffset)
+                    Fail(Ctx, E86HEX_ERELOC,
+                         "more than one target data segment for relocation");
+            }
+        }
+
+    DGROUPOffset = DGROUPOffset << 4;
+    if (DGROUPOffset == 0)
+        Fail(Ctx, E86HEX_ERELOC, "Cannot tell where DGROUP starts!");
+
+    Relo = eh->Relocations * 4 + 4 - 1;
+    OutputMiscData(Ctx, (LPBYTE)&Relo, 4);
+
+    //
+    // Second pass: each block is rewritten in place and output whole.
+    //
+    ReloOpen(&R, eh);
+    while ((Count = ReloRead(Ctx, &R)) != 0)
+    {
+        for (i=0; i<Count; i++)
+        {
+            Relo = R.Linear[i];
+
+            TargetValue = *((LPWORD)(ProgPtr+Relo));
+
+            if (Relo < DGROUPOffset)
+                Fail(Ctx, E86HEX_ERELOC,
+                     "Attempt to relocate item in code segment at %4X", Relo);
+
+            Relo -= DGROUPOffset;
+            if (TargetValue != 0)
+                Relo += ((DWORD)TargetValue << 16L);
+            R.Linear[i] = Relo;
+        }
+        OutputMiscData(Ctx, (LPBYTE)R.Linear, (WORD)(Count * 4));
+    }
+
+    PadMiscData(Ctx, 0xFFFFFFFFL);
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+// EOFRecord() prints an end of file record
+//
+static void EOFRecord(E86HEX * Ctx)
+{
+    StartLine(Ctx, 0, 0, 1);
+    FinishLine(Ctx);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// JumpRecord() prints a far jump
+//
+static void JumpRecord(E86HEX * Ctx, WORD SrcSeg, WORD SrcOff,
+                       WORD TargetSeg, WORD TargetOff)
+{
+    SegRecord(Ctx, SrcSeg);
+
+    StartLine(Ctx, 5, SrcOff, 0);
+    PrintByte(Ctx, 0xEA);
+    PrintByte(Ctx, (BYTE)TargetOff);
+    PrintByte(Ctx, (BYTE)(TargetOff >> 8));
+    PrintByte(Ctx, (BYTE)TargetSeg);
+    PrintByte(Ctx, (BYTE)(TargetSeg >> 8));
+    FinishLine(Ctx);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// StartAddressRecord() prints the starting address of the hex file
+//
+static void StartAddressRecord(E86HEX * Ctx, WORD Segment, WORD Offset)
+{
+    StartLine(Ctx, 4, 0, 3);
+    PrintWord(Ctx, Segment);
+    PrintWord(Ctx, Offset);
+    FinishLine(Ctx);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// AMDStartRecord() prints a record which identifies this as a
+// proprietary relocatable hex file.  The total number of program
+// paragraphs, and the stack segment/offset are stored in this
+// record, as well as the normal segment identifier.
+//
+static void AMDStartRecord(E86HEX * Ctx, DWORD ProgLength, ExeHdr * eh)
+{
+    DWORD ReloLength;
+
+    char IDString[] = "AMD LPD ";
+    WORD i;
+
+    StartAddressRecord(Ctx, eh->EntrySegment, eh->EntryOffset);
+
+    StartLine(Ctx, 2+8+2+4*4, 0, 2);
+    PrintWord(Ctx, 0);     // Segment offset
+
+    for (i=0;i<8;i++)
+        PrintByte(Ctx, IDString[i]);
+
+    ProgLength = RoundUp(ProgLength, Ctx->BytesPerLine);
+    ReloLength = RoundUp(eh->Relocations * 4L, ReloUnit(Ctx->BytesPerLine));
+
+    PrintWord(Ctx, (WORD)(ProgLength >> 4) + 2 + eh->ExtraParsNeeded);
+    PrintWord(Ctx, eh->InitStackSegment);
+    PrintWord(Ctx, eh->InitStackOffset);
+    PrintDWord(Ctx, ProgLength);
+    PrintDWord(Ctx, ProgLength + ReloLength);
+    PrintDWord(Ctx, ProgLength + ReloLength);
+    FinishLine(Ctx);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Context management.
+//
+void E86HexDefaults(E86HEXOPTIONS * Opts)
+{
+    memset(Opts, 0, sizeof(*Opts));
+    Opts->Relocatable  = TRUE;
+    Opts->RecordLength = BYTESPERLINE;
+    Opts->Baud         = DEFBAUD;
+    Opts->LineCost     = DEFLINECOST;
+    Opts->Threads      = 1;
+}
+
+E86HEX * E86HexCreate(const E86HEXOPTIONS * Opts)
+{
+    E86HEX * Ctx = calloc(1, sizeof(E86HEX));
+
+    if (Ctx == 0)
+        return 0;
+
+    if (Opts != 0)
+        Ctx->Opts = *Opts;
+    else
+        E86HexDefaults(&Ctx->Opts);
+
+    Ctx->DestFile = -1;
+    Ctx->OutSize  = OUTBUFSIZE;
+    if ((Ctx->OutBuf = malloc(Ctx->OutSize)) == 0)
+    {
+        free(Ctx);
+        return 0;
+    }
+    return Ctx;
+}
+
+void E86HexDestroy(E86HEX * Ctx)
+{
+    if (Ctx == 0)
+        return;
+    UnloadFile(Ctx);
+    free(Ctx->ReloCopy);
+    free(Ctx->ProgHead);
+    free(Ctx->Sidecar);
+    free(Ctx->BaseImage);
+    free(Ctx->BaseHave);
+    free(Ctx->FullHex);
+    free(Ctx->OutBuf);
+    free(Ctx);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Input and output.
+//
+int E86HexInputFd(E86HEX * Ctx, int fd, int Type)
+{
+    if (setjmp(Ctx->Jump) != 0)
+        return Ctx->Error;
+
+    LoadFile(Ctx, fd);
+    Ctx->SourceType = Type;
+    return E86HEX_OK;
+}
+
+int E86HexInputFile(E86HEX * Ctx, const char * Name, int Type)
+{
+    int fd;
+    int Result;
+
+    if ((fd = open(Name, O_RDONLY)) < 0)
+    {
+        snprintf(Ctx->ErrMsg, sizeof(Ctx->ErrMsg),
+                 "Cannot open source file %s", Name);
+        return Ctx->Error = E86HEX_EOPEN;
+    }
+    Result = E86HexInputFd(Ctx, fd, Type);
+    close(fd);
+    return Result;
+}
+
+int E86HexInputStream(E86HEX * Ctx, int fd, int Type)
+{
+    struct stat sr;
+    off_t       Pos;
+
+    UnloadFile(Ctx);
+    if ((Ctx->SourceData = malloc(STREAMBUF)) == 0)
+    {
+        snprintf(Ctx->ErrMsg, sizeof(Ctx->ErrMsg), "Out of memory");
+        return Ctx->Error = E86HEX_ENOMEM;
+    }
+
+    Ctx->SourceKind   = SRC_STREAM;
+    Ctx->SourceType   = Type;
+    Ctx->StreamFd     = fd;
+    Ctx->StreamBase   = 0;
+    Ctx->StreamHave   = 0;
+    Ctx->StreamSize   = STREAMBUF;
+    Ctx->StreamEnd    = FALSE;
+    Ctx->StreamLength = STREAMLEN;
+
+    if ((fstat(fd, &sr) == 0) && S_ISREG(sr.st_mode) &&
+        ((Pos = lseek(fd, 0, SEEK_CUR)) >= 0) &&
+        (sr.st_size - Pos < STREAMLEN))
+        Ctx->StreamLength = sr.st_size - Pos;
+    return E86HEX_OK;
+}
+
+int E86HexInputMemory(E86HEX * Ctx, const void * Data, DWORD Length,
+                      int Type)
+{
+    UnloadFile(Ctx);
+    Ctx->SourceData   = (LPBYTE)Data;
+    Ctx->SourceLength = Length;
+    Ctx->SourceKind   = SRC_CALLER;
+    Ctx->SourceType   = Type;
+    return E86HEX_OK;
+}
+
+int E86HexOutputFd(E86HEX * Ctx, int fd)
+{
+    Ctx->DestFile = fd;
+    return E86HEX_OK;
+}
+
+const char * E86HexOutput(E86HEX * Ctx, DWORD * Length)
+{
+    *Length = Ctx->OutLen;
+    return Ctx->OutBuf;
+}
+
+const char * E86HexSidecar(E86HEX * Ctx, DWORD * Length)
+{
+    *Length = Ctx->SidecarLen;
+    return (const char *)Ctx->Sidecar;
+}
+
+void E86HexHook(E86HEX * Ctx, E86HEXHOOK * Hook, void * User)
+{
+    Ctx->Hook     = Hook;
+    Ctx->HookUser = User;
+}
+
+const char * E86HexError(E86HEX * Ctx)
+{
+    return Ctx->ErrMsg;
+}
+
+void E86HexGetStats(E86HEX * Ctx, E86HEXSTATS * Stats)
+{
+    Stats->InputLength  = Ctx->SourceLength;
+    Stats->RecordLength = Ctx->BytesPerLine;
+    Stats->Lines        = Ctx->TotalLines;
+    Stats->Chars        = Ctx->Flushed + Ctx->OutLen;
+    Stats->SkippedBytes = Ctx->SkippedBytes;
+    Stats->SkippedLines = Ctx->SkippedLines;
+    Stats->SkippedChars = Ctx->SkippedChars;
+    Stats->UnchangedLines = Ctx->UnchangedLines;
+    Stats->UnchangedChars = Ctx->UnchangedChars;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// ResetOutput() clears what a previous conversion left in the context.
+//
+static void ResetOutput(E86HEX * Ctx)
+{
+    Ctx->Error         = E86HEX_OK;
+    Ctx->ErrMsg[0]     = 0;
+    Ctx->OutputAddress = 0;
+    Ctx->OutputSegment = 0;
+    Ctx->BytesPerLine  = Ctx->Opts.RecordLength;
+    Ctx->TotalLines    = 0;
+    Ctx->OutLen        = 0;
+    Ctx->Flushed       = 0;
+    Ctx->MiscLen       = 0;
+    Ctx->SegPending    = FALSE;
+    Ctx->SkippedBytes  = 0;
+    Ctx->SkippedLines  = 0;
+    Ctx->SkippedChars  = 0;
+    Ctx->SidecarLen    = 0;
+    Ctx->UnchangedLines = 0;
+    Ctx->UnchangedChars = 0;
+
+    free(Ctx->ReloCopy);
+    free(Ctx->ProgHead);
+    Ctx->ReloCopy = 0;
+    Ctx->ProgHead = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// ReadHeader() fills in eh, either from the EXE header or as a .COM or
+// .BIN file implies, and finds where the program starts and how long it
+// is.  The relocation table of a stream is read and converted now, as
+// the stream cannot come back to it.  The length of a BIN or COM stream
+// is only found out (by reading all of it) if NeedLength is set;
+// otherwise it may be STREAMLEN.
+//
+static void ReadHeader(E86HEX * Ctx, ExeHdr * eh, DWORD * DataPtr,
+                       DWORD * Length, BOOL NeedLength)
+{
+    int       Type = Ctx->SourceType;
+    BOOL      Stream = (Ctx->SourceKind == SRC_STREAM);
+    DWORD     Done;
+    DWORD     Count;
+
+    if (Type == E86HEX_AUTO)
+        Type = (((Stream ? StreamRead(Ctx, 0, 2) : Ctx->SourceLength) >= 2) &&
+                (Ctx->SourceData[0] == 'M') && (Ctx->SourceData[1] == 'Z')) ?
+               E86HEX_EXE : E86HEX_BIN;
+
+    if (Type != E86HEX_EXE)
+    {
+        *DataPtr = 0;
+
+        memset(eh, 0, sizeof(*eh));
+        eh->ExtraParsNeeded  = 0x10;  // Min. .COM stack is 256 bytes
+        eh->InitStackSegment = 0;
+        eh->InitStackOffset  = 0;
+        eh->EntrySegment     = 0;
+        eh->EntryOffset      = 0;
+        eh->Relocations      = 0;
+        if (Type == E86HEX_COM)
+        {
+            eh->EntrySegment -= 0x10;
+            eh->EntryOffset  += 0x100;
+        }
+
+        if (!Stream)
+            *Length = Ctx->SourceLength;
+        else if (Ctx->StreamLength != STREAMLEN)
+            *Length = Ctx->StreamLength;
+        else if (NeedLength)
+            *Length = StreamAll(Ctx);
+        else
+            *Length = STREAMLEN;
+    }
+    else   // .EXE file encountered
+    {
+        memcpy(eh, ReadFile(Ctx, 0, sizeof(*eh)), sizeof(*eh));
+
+        if (eh->MagicNumber != 0x5A4D)
+            Fail(Ctx, E86HEX_EFORMAT, "Invalid EXE signature");
+
+        *Length = eh->PagesInFile*512L-((512-eh->BytesLastPg)%512);
+        if (!Stream && (*Length >  Ctx->SourceLength))
+            Fail(Ctx, E86HEX_EREAD, "File Read Error");
+
+        *DataPtr = eh->ParsInHdr*16;
+
+        *Length -= eh->ParsInHdr*16;
+    }
+
+    if (Stream && (eh->Relocations != 0))
+    {
+        if ((Ctx->ReloCopy = malloc(eh->Relocations * 4L)) == 0)
+            Fail(Ctx, E86HEX_ENOMEM, "Out of memory");
+        for (Done = 0; Done < eh->Relocations; Done += Count)
+        {
+            Count = eh->Relocations - Done;
+            if (Count > RELOBLOCK)
+                Count = RELOBLOCK;
+            HexReloLinear(Ctx->ReloCopy + Done,
+                          ReadFile(Ctx, eh->ReloTableAddr + Done * 4,
+                                   Count * 4),
+                          Count);
+        }
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+// ConvertRecords() converts the input to hex records.
+//
+static int ConvertRecords(E86HEX * Ctx)
+{
+    BOOL      IsLibrary = FALSE;
+    BOOL      Relocatable = Ctx->Opts.Relocatable;
+    DWORD     Length;
+    DWORD     DataPtr;
+    WORD      SegAddress = Relocatable ? 0 : Ctx->Opts.Segment;
+    LPBYTE    ProgPtr = 0;
+
+    ExeHdr    eh;
+    PHASEMARK Mark;
+
+    ResetOutput(Ctx);
+
+    if (setjmp(Ctx->Jump) != 0)
+        return Ctx->Error;
+
+    if (Relocatable && Ctx->Opts.SkipFill)
+        Fail(Ctx, E86HEX_EOPTION, "--skip-fill needs a segment address");
+    if (Ctx->Opts.RecordLength > MAXRECLEN)
+        Fail(Ctx, E86HEX_EOPTION, "Record length above %d", MAXRECLEN);
+
+    //
+    // The length of a stream only matters if it goes in the header
+    // record or decides the record length; then it is read in full.
+    //
+    PhaseStart(Ctx, &Mark);
+    ReadHeader(Ctx, &eh, &DataPtr, &Length,
+               Relocatable || (Ctx->BytesPerLine == 0));
+
+    if (Ctx->BytesPerLine == 0)
+        Ctx->BytesPerLine = AutoRecordLength(Ctx, Length,
+            Relocatable ? eh.Relocations * 4L :
+            eh.Relocations ? eh.Relocations * 4L + 4 : 0);
+
+    if (Relocatable)
+        AMDStartRecord(Ctx, Length, &eh);
+    else
+        SegRecord(Ctx, SegAddress);
+    PhaseEnd(Ctx, &Mark, "header", DataPtr);
+
+    PhaseStart(Ctx, &Mark);
+    IsLibrary = !Relocatable &&
+        (memcmp(&LibSig, ReadFile(Ctx, DataPtr, sizeof(LibSig)),
+                sizeof(LibSig)) == 0);
+
+    Ctx->OutputSegment = SegAddress;
+    eh.EntrySegment   += SegAddress;
+
+    if (!Relocatable && (eh.Relocations != 0))
+    {
+        if (Ctx->SourceKind != SRC_STREAM)
+            ProgPtr = ReadFile(Ctx, DataPtr, Length);
+        else if ((ProgPtr = Ctx->ProgHead = calloc(1, PROGHEAD)) == 0)
+            Fail(Ctx, E86HEX_ENOMEM, "Out of memory");
+    }
+
+    OutputDataFromFile(Ctx, DataPtr, Length);
+    PhaseEnd(Ctx, &Mark, "data",
+             (Length == STREAMLEN) ? Ctx->SourceLength - DataPtr : Length);
+
+    PhaseStart(Ctx, &Mark);
+    if (Relocatable)
+        RelocationRecords(Ctx, &eh);
+    else
+    {
+        if (eh.Relocations != 0)
+            DGROUPRelocations(Ctx, &eh, ProgPtr, Length, SegAddress);
+        if (SegAddress >= 0xF800)
+            JumpRecord(Ctx, 0xFFFF, 0, eh.EntrySegment, eh.EntryOffset);
+        else if (!IsLibrary)
+            StartAddressRecord(Ctx, eh.EntrySegment, eh.EntryOffset);
+    }
+
+    EOFRecord(Ctx);
+    PhaseEnd(Ctx, &Mark, "relocations", eh.Relocations * 4L);
+
+    if (Ctx->DestFile >= 0)
+        FlushOutput(Ctx);
+
+    return E86HEX_OK;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Delta output.  The full hex file is parsed into HEXLINEs, and every
+// data record whose bytes the baseline already loads at the same
+// address is left out.  Segment records are only printed ahead of data
+// records which are kept; all other records are always kept.
+//
+typedef struct {
+    DWORD Offset;           // Where the line starts in the full hex file
+    DWORD Length;           // Characters, with the newline
+    DWORD Linear;           // Load address of a data record
+    BYTE  Type;
+    BYTE  DataLen;
+    WORD  Segment;          // Segment the record loads in
+} HEXLINE;
+
+//////////////////////////////////////////////////////////////////////////
+// HexDigits() returns the value of Count hex digits, or -1 if they are
+// not all hex digits.
+//
+static long HexDigits(const char * Text, int Count)
+{
+    long Value = 0;
+    int  Digit;
+
+    while (Count-- > 0)
+    {
+        Digit = *Text++;
+        if ((Digit >= '0') && (Digit <= '9'))
+            Digit -= '0';
+        else if ((Digit >= 'A') && (Digit <= 'F'))
+            Digit -= 'A' - 10;
+        else if ((Digit >= 'a') && (Digit <= 'f'))
+            Digit -= 'a' - 10;
+        else
+            return -1;
+        Value = (Value << 4) + Digit;
+    }
+    return Value;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// ParseLine() checks the hex record of Len characters (newline and
+// carriage return taken off) at Text, and fills in Line from it.  The
+// segment is updated by type 02 records.  Returns FALSE if it is not a
+// valid record.
+//
+static BOOL ParseLine(const char * Text, DWORD Len, HEXLINE * Line,
+                      WORD * Segment)
+{
+    long  Value;
+    BYTE  Sum = 0;
+    DWORD i;
+
+    if ((Len < 11) || (Text[0] != ':') || ((Len & 1) == 0) ||
+        ((Value = HexDigits(Text + 1, 2)) < 0) || (Len != 11 + 2 * Value))
+        return FALSE;
+
+    for (i = 1; i < Len; i += 2)
+    {
+        if ((Value = HexDigits(Text + i, 2)) < 0)
+            return FALSE;
+        Sum += (BYTE)Value;
+    }
+    if (Sum != 0)
+        return FALSE;
+
+    Line->DataLen = (BYTE)HexDigits(Text + 1, 2);
+    Line->Type    = (BYTE)HexDigits(Text + 7, 2);
+    if ((Line->Type == 2) && (Line->DataLen >= 2))
+        *Segment = (WORD)HexDigits(Text + 9, 4);
+    Line->Segment = *Segment;
+    Line->Linear  = *Segment * 16L + HexDigits(Text + 3, 4);
+    return TRUE;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// RecordByte() returns data byte i of a record.
+//
+static BYTE RecordByte(const char * Text, DWORD i)
+{
+    return (BYTE)HexDigits(Text + 9 + 2 * i, 2);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// LPDLimits() tells whether a record is the AMD LPD header of a
+// relocatable file, and if it is gives where the program and the
+// relocation block end.
+//
+static BOOL LPDLimits(const char * Text, HEXLINE * Line, DWORD * ProgLength,
+                      DWORD * ReloEnd)
+{
+    if ((Line->Type != 2) || (Line->DataLen != 2+8+2+4*4))
+        return FALSE;
+    *ProgLength = HexDigits(Text + 9 + 2*16, 8);
+    *ReloEnd    = HexDigits(Text + 9 + 2*20, 8);
+    return TRUE;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// E86HexBaseline() takes the hex file a delta is made against.  Hex 0
+// drops the baseline.
+//
+int E86HexBaseline(E86HEX * Ctx, const char * Hex, DWORD Length)
+{
+    const char * End = Hex + Length;
+    const char * Text;
+    HEXLINE      Line;
+    WORD         Segment = 0;
+    DWORD        LineNum = 0;
+    DWORD        Len;
+    DWORD        Start;
+    DWORD        Addr;
+    DWORD        i;
+
+    if (Hex == 0)
+    {
+        free(Ctx->BaseImage);
+        free(Ctx->BaseHave);
+        Ctx->BaseImage = Ctx->BaseHave = 0;
+        return E86HEX_OK;
+    }
+
+    if ((Ctx->BaseImage == 0) &&
+        (((Ctx->BaseImage = malloc(BASESPAN)) == 0) ||
+         ((Ctx->BaseHave = malloc(BASESPAN / 8)) == 0)))
+    {
+        E86HexBaseline(Ctx, 0, 0);
+        snprintf(Ctx->ErrMsg, sizeof(Ctx->ErrMsg), "Out of memory");
+        return Ctx->Error = E86HEX_ENOMEM;
+    }
+    memset(Ctx->BaseHave, 0, BASESPAN / 8);
+    Ctx->BaseProgLength = Ctx->BaseReloEnd = 0;
+
+    while (Hex < End)
+    {
+        Text = Hex;
+        LineNum++;
+        while ((Hex < End) && (*Hex != '\n'))
+            Hex++;
+        Len = Hex - Text;
+        if (Hex < End)
+            Hex++;
+        if ((Len > 0) && (Text[Len - 1] == '\r'))
+            Len--;
+        if (Len == 0)
+            continue;
+
+        if (!ParseLine(Text, Len, &Line, &Segment))
+        {
+            E86HexBaseline(Ctx, 0, 0);
+            snprintf(Ctx->ErrMsg, sizeof(Ctx->ErrMsg),
+                     "Baseline line %u is not a valid hex record", LineNum);
+            return Ctx->Error = E86HEX_EFORMAT;
+        }
+
+        //
+        // Data wraps around within its segment.
+        //
+        if (LPDLimits(Text, &Line, &Ctx->BaseProgLength, &Ctx->BaseReloEnd) ||
+            (Line.Type != 0))
+            continue;
+        Start = Line.Linear - Line.Segment * 16L;
+        for (i = 0; i < Line.DataLen; i++)
+        {
+            Addr = Line.Segment * 16L + (WORD)(Start + i);
+            if (Addr < BASESPAN)
+            {
+                Ctx->BaseImage[Addr] = RecordByte(Text, i);
+                Ctx->BaseHave[Addr >> 3] |= 1 << (Addr & 7);
+            }
+        }
+    }
+    return E86HEX_OK;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Unchanged() tells whether the baseline loads the same bytes a data
+// record does.  With --skip-fill, a fill record where the baseline
+// loads nothing counts too, as the fill is assumed to be there already.
+//
+static BOOL Unchanged(E86HEX * Ctx, const char * Text, HEXLINE * Line,
+                      BOOL * Fill)
+{
+    BYTE  Data[MAXRECLEN];
+    DWORD Addr;
+    DWORD Have = 0;
+    DWORD i;
+
+    *Fill = FALSE;
+    for (i = 0; i < Line->DataLen; i++)
+    {
+        Data[i] = RecordByte(Text, i);
+        Addr = Line->Linear + i;
+        if ((Addr < BASESPAN) &&
+            (Ctx->BaseHave[Addr >> 3] & (1 << (Addr & 7))))
+        {
+            if (Ctx->BaseImage[Addr] != Data[i])
+                return FALSE;
+            Have++;
+        }
+    }
+
+    if (Have == Line->DataLen)
+        return TRUE;
+    return *Fill = (Have == 0) && Ctx->Opts.SkipFill &&
+                   IsFillRecord(Ctx, Data, Line->DataLen);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// LoadsOver() tells whether a data record loads any byte marked in the
+// bitmap Map, and if Mark is set marks the bytes it loads.
+//
+static BOOL LoadsOver(LPBYTE Map, HEXLINE * Line, BOOL Mark)
+{
+    BOOL  Over = FALSE;
+    DWORD Addr;
+
+    for (Addr = Line->Linear; Addr < Line->Linear + Line->DataLen; Addr++)
+        if (Addr < BASESPAN)
+        {
+            Over |= (Map[Addr >> 3] >> (Addr & 7)) & 1;
+            if (Mark)
+                Map[Addr >> 3] |= 1 << (Addr & 7);
+        }
+    return Over;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// EntryTarget() returns the word the relocation entry at Entry in Image
+// relocates, or -1 if Have does not hold all of the entry, or it is
+// padding (which points at the end of the program), or its word is not
+// below both ProgLength and Span.
+//
+static long EntryTarget(LPBYTE Image, LPBYTE Have, DWORD Entry,
+                        DWORD ProgLength, DWORD Span)
+{
+    DWORD Target = 0;
+    DWORD i;
+
+    for (i = 4; i > 0; i--)
+    {
+        if (!((Have[(Entry + i - 1) >> 3] >> ((Entry + i - 1) & 7)) & 1))
+            return -1;
+        Target = (Target << 8) + Image[Entry + i - 1];
+    }
+    if ((Target >= ProgLength) || (ProgLength - Target < 2) ||
+        (Target >= Span) || (Span - Target < 2))
+        return -1;
+    return (long)Target;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// CountRelocations() adds one to Count[] for the word each entry of the
+// relocation block from ProgLength to ReloEnd in Image relocates.  A
+// count stops at 255.
+//
+static void CountRelocations(LPBYTE Image, LPBYTE Have, DWORD ProgLength,
+                             DWORD ReloEnd, LPBYTE Count, DWORD Span)
+{
+    DWORD Entry;
+    long  Target;
+
+    for (Entry = ProgLength; Entry + 4 <= ReloEnd; Entry += 4)
+        if (((Target = EntryTarget(Image, Have, Entry, ProgLength, Span)) >= 0)
+            && (Count[Target] < 255))
+            Count[Target]++;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// RelocatableDelta() works out, byte by byte, what of a relocatable hex
+// file must be sent on top of the baseline, and returns it as a map of
+// *Span bytes (the file's load addresses) holding DELTA_LEAVE, _SEND
+// or _PINNED, or 0 if the file has no AMD LPD header.
+//
+// The monitor relocates the word each entry it is sent names.  So a
+// relocated word is right on the board only if it is not sent again
+// and the baseline relocated it as many times as the new file does;
+// otherwise both its bytes are sent, and so is every entry naming it.
+// Those entries are cut out of their records, since the others there
+// would relocate their words a second time.  A word the baseline
+// relocated and the new file does not is sent again, unrelocated.
+// Other bytes are sent if they changed.
+//
+static LPBYTE RelocatableDelta(E86HEX * Ctx, HEXLINE * Lines, DWORD Count,
+                               DWORD * Span)
+{
+    LPBYTE  Map;
+    LPBYTE  Image;
+    LPBYTE  New;
+    LPBYTE  Old;
+    LPBYTE  Have;
+    DWORD   ProgLength = 0;
+    DWORD   ReloEnd = 0;
+    DWORD   Size;
+    DWORD   Addr;
+    DWORD   Top;
+    DWORD   i;
+    long    Target;
+    BOOL    Changed;
+
+    for (i = 0; i < Count; i++)
+        if (LPDLimits(Ctx->FullHex + Lines[i].Offset, &Lines[i], &ProgLength,
+                      &ReloEnd))
+            break;
+    if ((i == Count) || (ProgLength > ReloEnd) || (ReloEnd > BASESPAN))
+        return 0;
+
+    //
+    // Each map has a byte to spare, for the second byte of a word the
+    // baseline relocates at the end of the program.
+    //
+    *Span = ReloEnd;
+    Size  = ReloEnd + 1;
+    if ((Map = calloc(4 * Size + Size / 8 + 1, 1)) == 0)
+        Fail(Ctx, E86HEX_ENOMEM, "Out of memory");
+    Image = Map + Size;
+    New   = Image + Size;
+    Old   = New + Size;
+    Have  = Old + Size;
+
+    for (i = 0; i < Count; i++)
+        if (Lines[i].Type == 0)
+            for (Addr = Lines[i].Linear;
+                 (Addr < Lines[i].Linear + Lines[i].DataLen) &&
+                 (Addr < ReloEnd); Addr++)
+            {
+                Image[Addr] = RecordByte(Ctx->FullHex + Lines[i].Offset,
+                                         Addr - Lines[i].Linear);
+                Have[Addr >> 3] |= 1 << (Addr & 7);
+            }
+
+    CountRelocations(Image, Have, ProgLength, ReloEnd, New, ReloEnd);
+    if (Ctx->BaseProgLength != 0)
+        CountRelocations(Ctx->BaseImage, Ctx->BaseHave, Ctx->BaseProgLength,
+                         (Ctx->BaseReloEnd < BASESPAN) ? Ctx->BaseReloEnd :
+                         BASESPAN, Old, ProgLength + 1);
+
+    for (Addr = 0; Addr < ProgLength; Addr++)
+        if (((Have[Addr >> 3] >> (Addr & 7)) & 1) &&
+            (!((Ctx->BaseHave[Addr >> 3] >> (Addr & 7)) & 1) ||
+             (Ctx->BaseImage[Addr] != Image[Addr])))
+            Map[Addr] = DELTA_SEND;
+    memset(Map + ProgLength, DELTA_PINNED, ReloEnd - ProgLength);
+
+    //
+    // Words which overlap come out differently if their entries come in
+    // another order, so they are always sent.  Sending a word may send a
+    // byte of a word overlapping it, so this goes on until nothing more
+    // is sent.  Only the first byte of a word the baseline relocates at
+    // the end of the program is still in it.
+    //
+    do
+    {
+        Changed = FALSE;
+        for (Addr = 0; Addr < ProgLength; Addr++)
+        {
+            Top = (Addr + 1 < ProgLength) ? Addr + 1 : Addr;
+            if (((New[Addr] | Old[Addr]) != 0) &&
+                ((Map[Addr] != DELTA_SEND) || (Map[Top] != DELTA_SEND)) &&
+                ((New[Addr] != Old[Addr]) || (New[Addr] == 255) ||
+                 (New[Addr + 1] | Old[Addr + 1]) ||
+                 ((Addr > 0) && (New[Addr - 1] | Old[Addr - 1])) ||
+                 (Map[Addr] == DELTA_SEND) || (Map[Top] == DELTA_SEND)))
+            {
+                Map[Addr] = Map[Top] = DELTA_SEND;
+                Changed = TRUE;
+            }
+        }
+    } while (Changed);
+
+    for (Addr = 0; Addr + 1 < ProgLength; Addr++)
+        if ((New[Addr] != 0) && (Map[Addr] != DELTA_SEND))
+            Map[Addr] = Map[Addr + 1] = DELTA_PINNED;
+
+    for (Addr = ProgLength; Addr + 4 <= ReloEnd; Addr += 4)
+        if (((Target = EntryTarget(Image, Have, Addr, ProgLength, ReloEnd)) >= 0)
+            && (Map[Target] == DELTA_SEND))
+            memset(Map + Addr, DELTA_SEND, 4);
+
+    return Map;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// PartRecord() prints Len data bytes of a record, from byte First on,
+// as a record of their own.
+//
+static void PartRecord(E86HEX * Ctx, const char * Text, HEXLINE * Line,
+                       DWORD First, DWORD Len)
+{
+    DWORD i;
+
+    StartLine(Ctx, (BYTE)Len,
+              (WORD)(Line->Linear - Line->Segment * 16L + First), 0);
+    memcpy(Ctx->OutBuf + Ctx->OutLen, Text + 9 + 2 * First, 2 * Len);
+    Ctx->OutLen += 2 * Len;
+    for (i = 0; i < Len; i++)
+        Ctx->CheckSum += RecordByte(Text, First + i);
+    FinishLine(Ctx);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// SendParts() prints the bytes of a data record the delta map marks to
+// be sent, cut into records which leave out the rest.  Gaps are sent
+// again when that is quicker than the record after them, if they are
+// harmless to send.  The segment record is printed first if needed.
+// Returns FALSE if nothing was sent.
+//
+static BOOL SendParts(E86HEX * Ctx, const char * Text, HEXLINE * Line,
+                      LPBYTE Map, DWORD * Printed)
+{
+    LPBYTE Bytes = Map + Line->Linear;
+    DWORD  Len = Line->DataLen;
+    DWORD  First;
+    DWORD  End;
+    DWORD  Next;
+    BOOL   Sent = FALSE;
+
+    for (First = 0; First < Len; First = End)
+    {
+        End = First + 1;
+        if (Bytes[First] != DELTA_SEND)
+            continue;
+
+        for (;;)
+        {
+            while ((End < Len) && (Bytes[End] == DELTA_SEND))
+                End++;
+            for (Next = End; (Next < Len) && (Bytes[Next] == DELTA_LEAVE);
+                 Next++)
+                ;
+            if ((Next == End) || (Next == Len) ||
+                (Bytes[Next] != DELTA_SEND) ||
+                (E86HexDownloadTime(&Ctx->Opts, 2.0 * (Next - End), 0) >=
+                 E86HexDownloadTime(&Ctx->Opts, RECOVERHEAD, 1)))
+                break;
+            End = Next;
+        }
+
+        if (*Printed != Line->Segment)
+            SegRecord(Ctx, Line->Segment);
+        *Printed = Line->Segment;
+        if ((First == 0) && (End == Len))
+        {
+            OutputText(Ctx, Text, Line->Length);
+            Ctx->TotalLines++;
+        }
+        else
+            PartRecord(Ctx, Text, Line, First, End - First);
+        Sent = TRUE;
+    }
+    return Sent;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// DeltaRecords() cuts the full hex file, which ConvertRecords() left in
+// the output buffer, down to what the baseline does not hold, and
+// writes it to the output.
+//
+static int DeltaRecords(E86HEX * Ctx)
+{
+    HEXLINE * volatile Lines = 0;
+    BYTE *  volatile   Send = 0;
+    BYTE *  volatile   Sent = 0;
+    BYTE *  volatile   Map = 0;
+    DWORD   Span = 0;
+    DWORD   Count = 0;
+    DWORD   FullLen = Ctx->OutLen;
+    int     DestFile = Ctx->DestFile;
+    DWORD   Pos;
+    DWORD   i;
+    DWORD   Printed = 0x10000L;     // Segment last printed, if any
+    WORD    Segment = 0;
+    BOOL    Fill;
+    char *  Text;
+    PHASEMARK Mark;
+
+    free(Ctx->FullHex);
+    Ctx->FullHex = Ctx->OutBuf;
+    Ctx->OutSize = OUTBUFSIZE;
+    Ctx->OutLen  = 0;
+    Ctx->Flushed = 0;
+    Ctx->TotalLines = 0;
+    if ((Ctx->OutBuf = malloc(Ctx->OutSize)) == 0)
+    {
+        Ctx->OutBuf  = Ctx->FullHex;
+        Ctx->FullHex = 0;
+        snprintf(Ctx->ErrMsg, sizeof(Ctx->ErrMsg), "Out of memory");
+        return Ctx->Error = E86HEX_ENOMEM;
+    }
+
+    if (setjmp(Ctx->Jump) != 0)
+    {
+        Ctx->DestFile = DestFile;
+        free(Lines);
+        free(Send);
+        free(Sent);
+        free(Map);
+        return Ctx->Error;
+    }
+
+    //
+    // The delta is kept in memory until it is known to be quicker to
+    // send than the full file.
+    //
+    Ctx->DestFile = -1;
+    PhaseStart(Ctx, &Mark);
+    for (Pos = 0; Pos < FullLen; Pos++)
+        Count += (Ctx->FullHex[Pos] == '\n');
+
+    if (((Lines = malloc((Count + 1) * sizeof(HEXLINE))) == 0) ||
+        ((Send = calloc(Count + 1, 1)) == 0))
+        Fail(Ctx, E86HEX_ENOMEM, "Out of memory");
+
+    for (Pos = i = 0; i < Count; i++)
+    {
+        Lines[i].Offset = Pos;
+        Text = memchr(Ctx->FullHex + Pos, '\n', FullLen - Pos);
+        Lines[i].Length = Text + 1 - (Ctx->FullHex + Pos);
+        ParseLine(Ctx->FullHex + Pos, Lines[i].Length - 1, &Lines[i],
+                  &Segment);
+        Pos += Lines[i].Length;
+    }
+
+    //
+    // A relocatable file is cut down byte by byte.  Otherwise a record is
+    // sent if it changed; an absolute file may load the same address
+    // twice (the reset jump over an image running up to the top of
+    // memory), so there a record is also sent if it loads over one sent
+    // before it.
+    //
+    if (Ctx->Opts.Relocatable)
+        Map = RelocatableDelta(Ctx, Lines, Count, &Span);
+    else if ((Sent = calloc(BASESPAN / 8, 1)) == 0)
+        Fail(Ctx, E86HEX_ENOMEM, "Out of memory");
+
+    for (i = 0; i < Count; i++)
+        if ((Lines[i].Type == 0) &&
+            (((Sent != 0) && LoadsOver(Sent, &Lines[i], FALSE)) ||
+             !Unchanged(Ctx, Ctx->FullHex + Lines[i].Offset, &Lines[i],
+                        &Fill)))
+        {
+            Send[i] = 1;
+            if (Sent != 0)
+                LoadsOver(Sent, &Lines[i], TRUE);
+        }
+
+    for (i = 0; i < Count; i++)
+    {
+        Text = Ctx->FullHex + Lines[i].Offset;
+        if ((Lines[i].Type == 2) && (Lines[i].DataLen == 2))
+            continue;
+
+        if ((Lines[i].Type == 0) && (Map != 0) &&
+            (Lines[i].Linear + Lines[i].DataLen <= Span))
+        {
+            if (!SendParts(Ctx, Text, &Lines[i], Map, &Printed))
+            {
+                Ctx->UnchangedLines++;
+                Ctx->UnchangedChars += Lines[i].Length;
+            }
+            continue;
+        }
+
+        if ((Lines[i].Type == 0) && !Send[i])
+        {
+            Unchanged(Ctx, Text, &Lines[i], &Fill);
+            if (Fill)
+            {
+                Ctx->SkippedBytes += Lines[i].DataLen;
+                Ctx->SkippedLines++;
+                Ctx->SkippedChars += Lines[i].Length;
+            }
+            else
+            {
+                Ctx->UnchangedLines++;
+                Ctx->UnchangedChars += Lines[i].Length;
+            }
+            continue;
+        }
+
+        if ((Lines[i].Type == 0) && (Printed != Lines[i].Segment))
+            SegRecord(Ctx, Lines[i].Segment);
+        if ((Lines[i].Type == 0) || (Lines[i].Type == 2))
+            Printed = Lines[i].Segment;
+
+        OutputText(Ctx, Text, Lines[i].Length);
+        Ctx->TotalLines++;
+    }
+
+    //
+    // The full file is a delta too, as it sends every relocated word again
+    // with its entries, so it is sent instead of one which would take
+    // longer (entries a few to a record can).
+    //
+    if (E86HexDownloadTime(&Ctx->Opts, Ctx->OutLen, Ctx->TotalLines) >
+        E86HexDownloadTime(&Ctx->Opts, FullLen, Count))
+    {
+        Text          = Ctx->OutBuf;
+        Ctx->OutBuf   = Ctx->FullHex;
+        Ctx->FullHex  = Text;
+        Ctx->OutLen   = Ctx->OutSize = FullLen;
+        Ctx->TotalLines = Count;
+        Ctx->UnchangedLines = Ctx->UnchangedChars = 0;
+        Ctx->SkippedLines = Ctx->SkippedBytes = Ctx->SkippedChars = 0;
+    }
+
+    free(Lines);
+    free(Send);
+    free(Sent);
+    free(Map);
+    free(Ctx->FullHex);
+    Ctx->FullHex = 0;
+    Ctx->DestFile = DestFile;
+    PhaseEnd(Ctx, &Mark, "delta", FullLen);
+
+    if (Ctx->DestFile >= 0)
+        FlushOutput(Ctx);
+    return E86HEX_OK;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// E86HexConvert() converts the input to hex records, leaving out those
+// the baseline holds if there is one.
+//
+int E86HexConvert(E86HEX * Ctx)
+{
+    int   DestFile = Ctx->DestFile;
+    WORD  SkipFill = Ctx->Opts.SkipFill;
+    int   Result;
+
+    if ((Ctx->BaseImage == 0) || (Ctx->Opts.Relocatable && SkipFill))
+        return ConvertRecords(Ctx);
+
+    //
+    // The full hex file is built in memory, with every fill record in
+    // it, since fill the baseline has overwritten must be sent again.
+    //
+    Ctx->DestFile      = -1;
+    Ctx->Opts.SkipFill = 0;
+    Result = ConvertRecords(Ctx);
+    Ctx->DestFile      = DestFile;
+    Ctx->Opts.SkipFill = SkipFill;
+
+    return (Result == E86HEX_OK) ? DeltaRecords(Ctx) : Result;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// PutWord() and PutDWord() store little endian values in the sidecar.
+//
+static LPBYTE PutWord(LPBYTE Ptr, WORD Value)
+{
+    Ptr[0] = (BYTE)Value;
+    Ptr[1] = (BYTE)(Value >> 8);
+    return Ptr + 2;
+}
+
+static LPBYTE PutDWord(LPBYTE Ptr, DWORD Value)
+{
+    return PutWord(PutWord(Ptr, (WORD)Value), (WORD)(Value >> 16));
+}
+
+//////////////////////////////////////////////////////////////////////////
+// E86HexConvertBinary() writes the program image itself to the output,
+// and builds the relocation sidecar described in e86hex.h.
+//
+int E86HexConvertBinary(E86HEX * Ctx)
+{
+    DWORD     Length;
+    DWORD     DataPtr;
+    DWORD     Done;
+    DWORD     Part;
+    DWORD     ProgLength;
+    DWORD     Count;
+    LPBYTE    Ptr;
+    DWORD     i;
+
+    ExeHdr    eh;
+    RELOREADER R;
+    PHASEMARK Mark;
+
+    ResetOutput(Ctx);
+
+    if (setjmp(Ctx->Jump) != 0)
+        return Ctx->Error;
+
+    PhaseStart(Ctx, &Mark);
+    ReadHeader(Ctx, &eh, &DataPtr, &Length, FALSE);
+    PhaseEnd(Ctx, &Mark, "header", DataPtr);
+
+    PhaseStart(Ctx, &Mark);
+    if (Ctx->SourceKind != SRC_STREAM)
+        OutputText(Ctx, ReadFile(Ctx, DataPtr, Length), Length);
+    else
+        for (Done = 0; Done < Length; Done += Part)
+        {
+            Part = (Length - Done < STREAMBUF) ? Length - Done : STREAMBUF;
+            if (Length == STREAMLEN)
+            {
+                if ((Part = StreamRead(Ctx, DataPtr + Done, Part)) == 0)
+                    break;
+            }
+            OutputText(Ctx, ReadFile(Ctx, DataPtr + Done, Part), Part);
+        }
+
+    if (Length == STREAMLEN)
+        Length = Done;
+
+    if (Ctx->DestFile >= 0)
+        FlushOutput(Ctx);
+    PhaseEnd(Ctx, &Mark, "data", Length);
+
+    PhaseStart(Ctx, &Mark);
+    if ((Ctx->Sidecar = realloc(Ctx->Sidecar,
+             E86HEX_SIDECARHDR + eh.Relocations * 4L)) == 0)
+        Fail(Ctx, E86HEX_ENOMEM, "Out of memory");
+
+    ProgLength = RoundUp(Length, 16);
+
+    memcpy(Ctx->Sidecar, E86HEX_SIDECARSIG, 8);
+    Ptr = PutWord(Ctx->Sidecar + 8,
+                  (WORD)(ProgLength >> 4) + 2 + eh.ExtraParsNeeded);
+    Ptr = PutWord(Ptr, eh.InitStackSegment);
+    Ptr = PutWord(Ptr, eh.InitStackOffset);
+    Ptr = PutWord(Ptr, eh.EntrySegment);
+    Ptr = PutWord(Ptr, eh.EntryOffset);
+    Ptr = PutWord(Ptr, Ctx->Opts.Relocatable ? 0 : Ctx->Opts.Segment);
+    Ptr = PutDWord(Ptr, Length);
+    Ptr = PutDWord(Ptr, ProgLength);
+    Ptr = PutDWord(Ptr, eh.Relocations);
+
+    ReloOpen(&R, &eh);
+    while ((Count = ReloRead(Ctx, &R)) != 0)
+        for (i = 0; i < Count; i++)
+            Ptr = PutDWord(Ptr, R.Linear[i]);
+    Ctx->SidecarLen = Ptr - Ctx->Sidecar;
+    PhaseEnd(Ctx, &Mark, "relocations", eh.Relocations * 4L);
+
+    return E86HEX_OK;
+}
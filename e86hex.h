@@ -0,0 +1,187 @@
+/******************************************************************************
+ *                                                                            *
+ *     E86HEX.H                                                               *
+ *                                                                            *
+ *     Interface to libe86hex, the conversion engine behind MakeHex.          *
+ *                                                                            *
+ *     All state lives in an E86HEX context, so any number of conversions     *
+ *     may run at once on different threads.  Input may be a file or a        *
+ *     memory buffer, output a file descriptor or a memory buffer, and        *
+ *     failures are reported as error codes instead of ending the program.    *
+ *                                                                            *
+ *****************************************************************************/
+
+#ifndef E86HEX_H
+#define E86HEX_H
+
+typedef unsigned int DWORD;     // 32 bits, as on the DOS compilers
+typedef unsigned short WORD;
+typedef unsigned char BYTE;
+
+typedef WORD BOOL;
+
+typedef void *    LPVOID;
+typedef DWORD *   LPDWORD;
+typedef WORD *    LPWORD;
+typedef BYTE *    LPBYTE;
+
+#define FALSE 0
+#define TRUE 1
+
+#define BYTESPERLINE  32    // Default record length
+#define MAXRECLEN     255   // Largest length an Intel hex record can hold
+#define RECORDFRAME   12    // ':', length, address, type, checksum, '\n'
+#define DEFBAUD       19200
+#define DEFLINECOST   1000  // Microseconds E86Mon spends on each record
+
+//
+// Error codes returned by the library.
+//
+#define E86HEX_OK       0
+#define E86HEX_EOPEN    1   // Input or output file could not be opened
+#define E86HEX_EREAD    2   // Input could not be read, or is truncated
+#define E86HEX_EWRITE   3   // Output could not be written
+#define E86HEX_EFORMAT  4   // Input is not a valid executable
+#define E86HEX_ERELOC   5   // Relocations MakeHex cannot process
+#define E86HEX_EOPTION  6   // Options which cannot be used together
+#define E86HEX_ENOMEM   7   // Out of memory
+
+//
+// Input types.
+//
+#define E86HEX_BIN      0   // Raw binary image
+#define E86HEX_COM      1   // DOS .COM image (entry at -10:100)
+#define E86HEX_EXE      2   // MZ executable
+#define E86HEX_AUTO     3   // MZ executable if it has the signature, else BIN
+
+//
+// Fill values --skip-fill may leave out.
+//
+#define E86HEX_SKIP00   1
+#define E86HEX_SKIPFF   2
+
+//
+// Conversion options.  E86HexDefaults() fills in the defaults.
+//
+typedef struct {
+    BOOL  Relocatable;      // E86Mon relocatable format, else absolute
+    WORD  Segment;          // Load segment for absolute mode
+    WORD  RecordLength;     // Data bytes per record, or 0 for automatic
+    DWORD Baud;             // Serial rate assumed by download estimates
+    DWORD LineCost;         // Monitor time per record, in microseconds
+    WORD  SkipFill;         // E86HEX_SKIP00 | E86HEX_SKIPFF
+    WORD  Threads;          // Threads formatting large images (1)
+} E86HEXOPTIONS;
+
+//
+// Results of a conversion.
+//
+typedef struct {
+    DWORD InputLength;      // Bytes in the input file
+    WORD  RecordLength;     // Record length actually used
+    DWORD Lines;            // Records written
+    DWORD Chars;            // Characters written
+    DWORD SkippedBytes;     // Fill bytes left out
+    DWORD SkippedLines;     // Records left out
+    DWORD SkippedChars;     // Characters those records would have taken
+    DWORD UnchangedLines;   // Records a delta left out
+    DWORD UnchangedChars;   // Characters those records would have taken
+} E86HEXSTATS;
+
+typedef struct E86HEX E86HEX;
+
+void     E86HexDefaults(E86HEXOPTIONS * Opts);
+E86HEX * E86HexCreate(const E86HEXOPTIONS * Opts);
+void     E86HexDestroy(E86HEX * Ctx);
+
+//
+// Input.  The file and descriptor forms map regular files, and read
+// anything else into memory.  Memory input is used in place, and must
+// stay valid until the context is destroyed.
+//
+int E86HexInputFile(E86HEX * Ctx, const char * Name, int Type);
+int E86HexInputFd(E86HEX * Ctx, int fd, int Type);
+int E86HexInputMemory(E86HEX * Ctx, const void * Data, DWORD Length,
+                      int Type);
+
+//
+// Streamed input is read while E86HexConvert() runs, and records are
+// written as soon as the input they come from has arrived.  Only the
+// relocation table is held in memory (plus the first 32K of the program
+// for an absolute conversion with DGROUP relocations), except that a
+// BIN or COM stream of unknown length is read in full when its length
+// is needed up front: in relocatable mode, or with automatic record
+// length.  A stream can be converted once.
+//
+int E86HexInputStream(E86HEX * Ctx, int fd, int Type);
+
+//
+// Output.  Without an output descriptor the hex file is built in memory
+// and returned by E86HexOutput().
+//
+int E86HexOutputFd(E86HEX * Ctx, int fd);
+const char * E86HexOutput(E86HEX * Ctx, DWORD * Length);
+
+int E86HexConvert(E86HEX * Ctx);
+
+//
+// Delta output.  Once E86HexBaseline() has been given the hex file the
+// board was last loaded from, E86HexConvert() leaves out every data
+// record whose bytes the baseline loads at the same address, and the
+// segment records nothing is left to need.  Header, start and end
+// records are always kept.  A relocatable file is cut byte by byte:
+// changed bytes go out in records of their own, and a relocated word
+// whose bytes or relocations changed goes with just the entries naming
+// it, so that nothing is relocated twice or left unrelocated.  A delta
+// which would take longer to download than the full file is replaced by
+// it, so at worst, when most words and relocations change, the full
+// file is sent.  The full hex file is built in memory first.
+//
+int E86HexBaseline(E86HEX * Ctx, const char * Hex, DWORD Length);
+
+//
+// E86HexConvertBinary() writes the program image, exactly as the data
+// records would carry it, to the output in place of hex records, and
+// builds a relocation sidecar which E86HexSidecar() returns.  The
+// sidecar is little endian:
+//
+//   Offset  Size
+//      0      8   E86HEX_SIDECARSIG
+//      8      2   Paragraphs to allocate, worked out as in the AMD LPD
+//                 record but with the image rounded to a paragraph
+//     10      2   Initial SS, relative to the load segment
+//     12      2   Initial SP
+//     14      2   Entry CS, relative to the load segment
+//     16      2   Entry IP
+//     18      2   Load segment, or 0 for a relocatable image
+//     20      4   Image length
+//     24      4   Image length rounded up to a paragraph
+//     28      4   Number of relocations
+//     32    4*n   Relocations, as offsets from the start of the image
+//                 of the words that get the load segment added
+//
+#define E86HEX_SIDECARSIG  "E86RELO1"
+#define E86HEX_SIDECARHDR  32
+
+int          E86HexConvertBinary(E86HEX * Ctx);
+const char * E86HexSidecar(E86HEX * Ctx, DWORD * Length);
+
+//
+// Phase timing.  With a hook set, a conversion calls it as each phase
+// ends: "header", "data", "relocations" (and "delta"), plus "write"
+// for each write to the output descriptor, which falls inside the
+// others.  Start and End are CLOCK_MONOTONIC seconds; BytesIn is the
+// input the phase used, BytesOut the characters it made.
+//
+typedef void E86HEXHOOK(void * User, const char * Phase, double Start,
+                        double End, DWORD BytesIn, DWORD BytesOut,
+                        DWORD Records);
+
+void E86HexHook(E86HEX * Ctx, E86HEXHOOK * Hook, void * User);
+
+const char * E86HexError(E86HEX * Ctx);
+void         E86HexGetStats(E86HEX * Ctx, E86HEXSTATS * Stats);
+double       E86HexDownloadTime(const E86HEXOPTIONS * Opts,
+                                double Chars, double Lines);
+
+#endif
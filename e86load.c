@@ -0,0 +1,561 @@
+/******************************************************************************
+ *                                                                            *
+ *     E86LOAD.C                                                              *
+ *                                                                            *
+ *     Loads relocatable hex files on the host as E86Mon loads them on a      *
+ *     board, so that builds can be checked without downloading them.        *
+ *                                                                            *
+ *     For each load segment asked for, the paragraphs the AMD LPD record     *
+ *     gives are allocated there, the program is placed at its start and      *
+ *     the load segment is added to every word the relocation block names.    *
+ *     Entry and stack come out as the registers the program is started       *
+ *     with.  The relocation records are received into memory after the       *
+ *     program, as they are addressed, so they too must fit in RAM; memory    *
+ *     the program does not load is left as zero.                             *
+ *                                                                            *
+ *     A load fails if it would run past the top of RAM, if the program      *
+ *     does not fit its allocation, if the entry point is outside the         *
+ *     program or the stack outside the allocation, or if a segment it        *
+ *     relocates (or starts with) wraps past 1M.                              *
+ *                                                                            *
+ *     Files are read on a pool of threads, then every file is loaded at      *
+ *     every segment, spread over the pool again.  One line is printed for    *
+ *     each load, in the order the files and segments were given.             *
+ *                                                                            *
+ *     Usage: e86load [options] <file, directory or @list>...                 *
+ *                                                                            *
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "e86lpd.h"
+#include "hexkern.h"
+#include "e86trace.h"
+
+#define NAMELEN     1024
+#define MAXSEGMENTS 0x10000
+#define DEFSEGMENT  0x1000
+#define DEFTOP      0x10000L    // Paragraph RAM ends at: all of the 1M
+
+//
+// Reasons a load fails, as bits in LOAD.Problems.
+//
+#define BADTOP      1
+#define BADALLOC    2
+#define BADENTRY    4
+#define BADSTACK    8
+#define BADWRAP     16
+
+static const char * const Problems[] = {
+    "loads past the top of RAM",
+    "program is bigger than its allocation",
+    "entry point is outside the program",
+    "stack is outside the allocation",
+    "a segment wraps past 1M",
+};
+
+typedef struct {
+    char *  Name;
+    E86LPD  Lpd;
+    BOOL    Good;
+} INPUT;
+
+typedef struct {
+    WORD    CS;
+    WORD    SS;
+    DWORD   End;                // Paragraph after the allocation
+    DWORD   Wraps;              // Relocated words which wrapped
+    unsigned long Sum;          // Byte sum of the allocation
+    WORD    Problems;
+} LOAD;
+
+INPUT * Inputs = 0;
+int     NumInputs = 0;
+int     MaxInputs = 0;
+LOAD *  Loads = 0;
+WORD *  Segments = 0;
+DWORD   NumSegments = 0;
+DWORD   NextJobIndex = 0;
+DWORD   NumJobs = 0;
+pthread_mutex_t JobLock = PTHREAD_MUTEX_INITIALIZER;
+
+DWORD  Top = DEFTOP;
+BOOL   MakeImage = FALSE;
+BOOL   Quiet = FALSE;
+char * OutDir = 0;
+DWORD  NumThreads = 0;
+BOOL   ShowStats = FALSE;
+char * TraceName = 0;
+
+//////////////////////////////////////////////////////////////////////////
+// ErrExit() shows an error message and exits.
+//
+static void ErrExit(const char * s, ...)
+{
+    va_list ap;
+
+    va_start(ap, s);
+    fputs("e86load: ", stderr);
+    vfprintf(stderr, s, ap);
+    fputc('\n', stderr);
+    va_end(ap);
+    exit(2);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// ShowHelp() lists the options.
+//
+static void ShowHelp(void)
+{
+    printf(
+"\nUsage: e86load [options] <file, directory or @list>...\n\n"
+"    Loads relocatable (AMD LPD) hex files made by MakeHex the way E86Mon\n"
+"    does, at each load segment given, and prints the registers the\n"
+"    program starts with and whether the load is good.  A directory\n"
+"    stands for the .hex files in it, and @<file> for the inputs listed\n"
+"    in <file>.\n\n"
+"    --segment=<list> Load segments, in hex: a comma separated list of\n"
+"                     segments and <first>-<last>[/<step>] ranges (1000)\n"
+"    --top=<seg>      Paragraph where RAM ends, in hex (10000)\n"
+"    --image          Write each allocation, relocated, to\n"
+"                     <name>_<segment>.mem\n"
+"    --dir=<dir>      Write files into <dir>, not next to the input\n"
+"    --quiet          Only print the loads which fail\n"
+"    --threads=<n>    Worker threads (default one per CPU)\n"
+"    --stats          Show how long each phase took\n"
+"    --trace=<file>   Write each phase to <file> as Chrome trace events\n\n");
+    exit(2);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// AddSegments() adds the segments in a --segment list.  Returns FALSE if
+// the list cannot be read.
+//
+static BOOL AddSegments(const char * List)
+{
+    DWORD  First;
+    DWORD  Last;
+    DWORD  Step;
+    DWORD  Seg;
+    char * End;
+
+    for (;;)
+    {
+        First = Last = strtoul(List, &End, 16);
+        Step  = 1;
+        if (End == List)
+            return FALSE;
+        if (*End == '-')
+        {
+            List = End + 1;
+            Last = strtoul(List, &End, 16);
+            if (End == List)
+                return FALSE;
+            if (*End == '/')
+            {
+                List = End + 1;
+                Step = strtoul(List, &End, 16);
+                if ((End == List) || (Step == 0))
+                    return FALSE;
+            }
+        }
+        if ((First > 0xFFFF) || (Last > 0xFFFF) || (Last < First))
+            return FALSE;
+
+        for (Seg = First; Seg <= Last; Seg += Step)
+        {
+            if (NumSegments == MAXSEGMENTS)
+                return FALSE;
+            Segments[NumSegments++] = (WORD)Seg;
+        }
+
+        if (*End == 0)
+            return TRUE;
+        if (*End != ',')
+            return FALSE;
+        List = End + 1;
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+// AddFile() adds a file to load.
+//
+static void AddFile(const char * Name)
+{
+    if (NumInputs == MaxInputs)
+    {
+        MaxInputs = MaxInputs ? MaxInputs * 2 : 64;
+        if ((Inputs = realloc(Inputs, MaxInputs * sizeof(INPUT))) == 0)
+            ErrExit("Out of memory");
+    }
+    memset(&Inputs[NumInputs], 0, sizeof(INPUT));
+    if ((Inputs[NumInputs++].Name = strdup(Name)) == 0)
+        ErrExit("Out of memory");
+}
+
+//////////////////////////////////////////////////////////////////////////
+// CompareNames() orders directory entries for qsort().
+//
+static int CompareNames(const void * a, const void * b)
+{
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// AddInput() adds a file, the .hex files in a directory, or the inputs
+// named one per line in @<file>.
+//
+static void AddInput(const char * Arg)
+{
+    struct stat     st;
+    DIR *           d;
+    struct dirent * de;
+    FILE *          List;
+    char **         Names = 0;
+    int             NumNames = 0;
+    char            Line[NAMELEN + 2];
+    char *          End;
+    char *          Ext;
+    int             i;
+
+    if (Arg[0] == '@')
+    {
+        if ((List = fopen(Arg + 1, "r")) == 0)
+            ErrExit("Cannot open response file %s", Arg + 1);
+        while (fgets(Line, sizeof(Line), List) != 0)
+        {
+            End = Line + strlen(Line);
+            while ((End > Line) && isspace((BYTE)End[-1]))
+                *(--End) = 0;
+            if (Line[0] != 0)
+                AddInput(Line);
+        }
+        fclose(List);
+    }
+    else if ((stat(Arg, &st) == 0) && S_ISDIR(st.st_mode))
+    {
+        if ((d = opendir(Arg)) == 0)
+            ErrExit("Cannot read directory %s", Arg);
+        while ((de = readdir(d)) != 0)
+            if (((Ext = strrchr(de->d_name, '.')) != 0) &&
+                (strcasecmp(Ext, ".hex") == 0))
+            {
+                if ((Names = realloc(Names, (NumNames + 1) * sizeof(char *)))
+                        == 0)
+                    ErrExit("Out of memory");
+                Names[NumNames++] = strdup(de->d_name);
+            }
+        closedir(d);
+
+        qsort(Names, NumNames, sizeof(char *), CompareNames);
+        for (i = 0; i < NumNames; i++)
+        {
+            snprintf(Line, sizeof(Line), "%s/%s", Arg, Names[i]);
+            AddFile(Line);
+            free(Names[i]);
+        }
+        free(Names);
+    }
+    else
+        AddFile(Arg);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// WriteMemory() writes the allocation a load made to
+// <name>_<segment>.mem.  Returns FALSE if it cannot.
+//
+static BOOL WriteMemory(INPUT * In, WORD Seg, LPBYTE Memory, DWORD Length)
+{
+    char         Name[NAMELEN];
+    const char * Base = strrchr(In->Name, '/');
+    const char * Dot;
+    int          Len;
+    FILE *       f;
+    BOOL         Good;
+
+    Base = Base ? Base + 1 : In->Name;
+    Dot  = strrchr(Base, '.');
+    Len  = Dot ? Dot - Base : (int)strlen(Base);
+
+    if (OutDir != 0)
+        snprintf(Name, sizeof(Name), "%s/%.*s_%04X.mem", OutDir, Len, Base,
+                 Seg);
+    else
+        snprintf(Name, sizeof(Name), "%.*s_%04X.mem",
+                 (int)(Base - In->Name + Len), In->Name, Seg);
+
+    if ((f = fopen(Name, "wb")) == 0)
+        return FALSE;
+    Good = (fwrite(Memory, 1, Length, f) == Length);
+    return (fclose(f) == 0) && Good;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Load() loads a file at segment Seg, in Memory, which holds *Size
+// bytes and is made bigger if need be.
+//
+static void Load(INPUT * In, WORD Seg, LOAD * l, LPBYTE * Memory,
+                 DWORD * Size)
+{
+    E86LPD * Lpd = &In->Lpd;
+    DWORD    Alloc = (DWORD)Lpd->Paragraphs << 4;
+    DWORD    Length = (Alloc > Lpd->ImageLength) ? Alloc : Lpd->ImageLength;
+    DWORD    Loaded = (Length > Lpd->ReloEnd) ? Length : Lpd->ReloEnd;
+    DWORD    StackTop;
+    DWORD    Relo;
+    DWORD    Value;
+    DWORD    i;
+    LPBYTE   m;
+
+    l->CS  = (WORD)(Seg + Lpd->EntrySegment);
+    l->SS  = (WORD)(Seg + Lpd->StackSegment);
+    l->End = Seg + (DWORD)Lpd->Paragraphs;
+
+    if (((DWORD)Seg << 4) + Loaded > (Top << 4))
+        l->Problems |= BADTOP;
+    if (Lpd->ImageLength > Alloc)
+        l->Problems |= BADALLOC;
+    if (((DWORD)Lpd->EntrySegment << 4) + Lpd->EntryOffset >=
+            Lpd->ImageLength)
+        l->Problems |= BADENTRY;
+    StackTop = ((DWORD)Lpd->StackSegment << 4) +
+               (Lpd->StackOffset ? Lpd->StackOffset : 0x10000L);
+    if (StackTop > Alloc)
+        l->Problems |= BADSTACK;
+    if ((Seg + (DWORD)Lpd->EntrySegment > 0xFFFF) ||
+        (Seg + (DWORD)Lpd->StackSegment > 0xFFFF))
+        l->Problems |= BADWRAP;
+
+    if (Length > *Size)
+    {
+        free(*Memory);
+        if ((*Memory = malloc(Length)) == 0)
+            ErrExit("Out of memory");
+        *Size = Length;
+    }
+    m = *Memory;
+    memcpy(m, Lpd->Memory, Lpd->ImageLength);
+    memset(m + Lpd->ImageLength, 0, Length - Lpd->ImageLength);
+
+    for (i = 0; i < Lpd->Relocations; i++)
+    {
+        Relo  = E86LpdRelocation(Lpd, i);
+        Value = (m[Relo] | (m[Relo + 1] << 8)) + Seg;
+        if (Value > 0xFFFF)
+            l->Wraps++;
+        m[Relo]     = (BYTE)Value;
+        m[Relo + 1] = (BYTE)(Value >> 8);
+    }
+    if (l->Wraps != 0)
+        l->Problems |= BADWRAP;
+
+    l->Sum = HexSum(m, Alloc);
+
+    if (MakeImage && !WriteMemory(In, Seg, m, Alloc))
+        ErrExit("Cannot write the image of %s at %04X", In->Name, Seg);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// NextJob() hands out the next job number, or returns FALSE when they
+// have all been taken.
+//
+static BOOL NextJob(DWORD * Job)
+{
+    pthread_mutex_lock(&JobLock);
+    *Job = NextJobIndex++;
+    pthread_mutex_unlock(&JobLock);
+    return *Job < NumJobs;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Reader() reads input files until none are left.
+//
+static void * Reader(void * Arg)
+{
+    DWORD  Job;
+    double Start;
+
+    while (NextJob(&Job))
+    {
+        Start = E86TraceNow();
+        Inputs[Job].Good = (E86LpdRead(&Inputs[Job].Lpd, Inputs[Job].Name)
+                            == 0);
+        E86TracePhase("read", Inputs[Job].Name, Start, E86TraceNow(),
+                      Inputs[Job].Lpd.TextLength,
+                      Inputs[Job].Lpd.ImageLength,
+                      Inputs[Job].Lpd.Relocations);
+    }
+    return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Loader() makes loads until none are left.  Job n is file
+// n / NumSegments at segment n % NumSegments, so that the segments of a
+// big file are spread over the threads as well.
+//
+static void * Loader(void * Arg)
+{
+    LPBYTE Memory = 0;
+    DWORD  Size = 0;
+    DWORD  Job;
+    INPUT * In;
+    double Start;
+
+    while (NextJob(&Job))
+    {
+        In = &Inputs[Job / NumSegments];
+        if (!In->Good)
+            continue;
+        Start = E86TraceNow();
+        Load(In, Segments[Job % NumSegments], &Loads[Job], &Memory, &Size);
+        E86TracePhase("load", In->Name, Start, E86TraceNow(),
+                      In->Lpd.ImageLength, (DWORD)In->Lpd.Paragraphs << 4,
+                      In->Lpd.Relocations);
+    }
+    free(Memory);
+    return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// RunPool() runs Fn on NumThreads threads (the calling one among them)
+// over Jobs jobs.
+//
+static void RunPool(void * (* Fn)(void *), DWORD Jobs)
+{
+    pthread_t * Threads;
+    DWORD       n = (NumThreads < Jobs) ? NumThreads : Jobs;
+    DWORD       i;
+
+    NextJobIndex = 0;
+    NumJobs      = Jobs;
+    if ((Threads = calloc(n + 1, sizeof(pthread_t))) == 0)
+        ErrExit("Out of memory");
+    for (i = 1; i < n; i++)
+        if (pthread_create(&Threads[i], 0, Fn, 0) != 0)
+            ErrExit("Cannot start worker thread");
+    Fn(0);
+    for (i = 1; i < n; i++)
+        pthread_join(Threads[i], 0);
+    free(Threads);
+}
+
+int main(int argc, char * argv[])
+{
+    char * End;
+    DWORD  Failures = 0;
+    DWORD  Good = 0;
+    DWORD  Job;
+    LOAD * l;
+    int    i;
+    int    p;
+
+    if ((Segments = malloc(MAXSEGMENTS * sizeof(WORD))) == 0)
+        ErrExit("Out of memory");
+
+    for (i = 1; i < argc; i++)
+        if (strncmp(argv[i], "--", 2) != 0)
+            AddInput(argv[i]);
+        else if (strncmp(argv[i], "--segment=", 10) == 0)
+        {
+            if (!AddSegments(argv[i] + 10))
+                ShowHelp();
+        }
+        else if (strncmp(argv[i], "--top=", 6) == 0)
+        {
+            Top = strtoul(argv[i] + 6, &End, 16);
+            if ((*End != 0) || (Top == 0) || (Top > DEFTOP))
+                ShowHelp();
+        }
+        else if (strcmp(argv[i], "--image") == 0)
+            MakeImage = TRUE;
+        else if ((strncmp(argv[i], "--dir=", 6) == 0) && (argv[i][6] != 0))
+            OutDir = argv[i] + 6;
+        else if (strcmp(argv[i], "--quiet") == 0)
+            Quiet = TRUE;
+        else if (strncmp(argv[i], "--threads=", 10) == 0)
+        {
+            NumThreads = strtoul(argv[i] + 10, &End, 10);
+            if ((*End != 0) || (NumThreads == 0))
+                ShowHelp();
+        }
+        else if (strcmp(argv[i], "--stats") == 0)
+            ShowStats = TRUE;
+        else if ((strncmp(argv[i], "--trace=", 8) == 0) && (argv[i][8] != 0))
+            TraceName = argv[i] + 8;
+        else
+            ShowHelp();
+
+    if (NumInputs == 0)
+        ShowHelp();
+    if (NumSegments == 0)
+        Segments[NumSegments++] = DEFSEGMENT;
+
+    if ((ShowStats || (TraceName != 0)) &&
+        (E86TraceOpen(TraceName, ShowStats) != 0))
+        ErrExit("Cannot create trace file %s", TraceName);
+
+    if (NumThreads == 0)
+        NumThreads = sysconf(_SC_NPROCESSORS_ONLN);
+    if ((NumThreads < 1) || (NumThreads > 0x10000))
+        NumThreads = 1;
+
+    if ((Loads = calloc((size_t)NumInputs * NumSegments, sizeof(LOAD))) == 0)
+        ErrExit("Out of memory");
+
+    RunPool(Reader, NumInputs);
+    RunPool(Loader, NumInputs * NumSegments);
+
+    if (!Quiet)
+        printf("# file\tsegment\tcs:ip\tss:sp\tend\tsum\tresult\n");
+    for (i = 0; i < NumInputs; i++)
+    {
+        if (!Inputs[i].Good)
+        {
+            fprintf(stderr, "%s: %s\n", Inputs[i].Name, Inputs[i].Lpd.Error);
+            Failures += NumSegments;
+            continue;
+        }
+        for (Job = 0; Job < NumSegments; Job++)
+        {
+            l = &Loads[i * NumSegments + Job];
+            if (l->Problems != 0)
+                Failures++;
+            else
+                Good++;
+            if (Quiet && (l->Problems == 0))
+                continue;
+
+            printf("%s\t%04X\t%04X:%04X\t%04X:%04X\t%05X\t%lX\t",
+                   Inputs[i].Name, Segments[Job], l->CS,
+                   Inputs[i].Lpd.EntryOffset, l->SS,
+                   Inputs[i].Lpd.StackOffset, l->End, l->Sum);
+            if (l->Problems == 0)
+                printf("ok\n");
+            else
+            {
+                for (p = 0; p < (int)(sizeof(Problems) / sizeof(Problems[0]));
+                     p++)
+                    if (l->Problems & (1 << p))
+                        printf("%s%s", (l->Problems & ((1 << p) - 1)) ?
+                               "; " : "", Problems[p]);
+                if (l->Wraps != 0)
+                    printf(" (%u relocations)", l->Wraps);
+                printf("\n");
+            }
+        }
+        E86LpdFree(&Inputs[i].Lpd);
+    }
+    printf("# %d files, %u loads good, %u failed\n", NumInputs, Good,
+           Failures);
+
+    E86TraceClose(stdout);
+    return Failures ? 1 : 0;
+}
@@ -0,0 +1,268 @@
+/******************************************************************************
+ *                                                                            *
+ *     E86LPD.C                                                               *
+ *                                                                            *
+ *     Reader for relocatable (AMD LPD) hex files; see E86LPD.H.              *
+ *                                                                            *
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "e86lpd.h"
+#include "hexkern.h"
+
+#define MAXBYTES    (5 + 255)   // Length, address, type, data, checksum
+#define LPDLENGTH   (2 + 8 + 2 + 4 * 4)
+
+//////////////////////////////////////////////////////////////////////////
+// Fail() records why a file could not be read.  Returns FALSE, so
+// that callers can return it.
+//
+static BOOL Fail(E86LPD * Lpd, DWORD Line, const char * s, ...)
+{
+    va_list ap;
+    int     n = 0;
+
+    if (Line != 0)
+        n = snprintf(Lpd->Error, sizeof(Lpd->Error), "line %u: ", Line);
+    va_start(ap, s);
+    vsnprintf(Lpd->Error + n, sizeof(Lpd->Error) - n, s, ap);
+    va_end(ap);
+    return FALSE;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Little and big endian fields.  Hex records hold big endian words; the
+// memory they load is little endian.
+//
+static WORD GetWord(const BYTE * p)
+{
+    return (WORD)((p[0] << 8) | p[1]);
+}
+
+static DWORD GetDWord(const BYTE * p)
+{
+    return ((DWORD)GetWord(p) << 16) | GetWord(p + 2);
+}
+
+static DWORD GetLE(const BYTE * p)
+{
+    return p[0] | (p[1] << 8) | ((DWORD)p[2] << 16) | ((DWORD)p[3] << 24);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Parse() loads the records of a hex file into Lpd->Memory, and fills in
+// the values the header and start records give.  Returns FALSE if the
+// file is not a good relocatable hex file.
+//
+static BOOL Parse(E86LPD * Lpd, const char * Text, DWORD Length)
+{
+    BYTE         Bytes[MAXBYTES];
+    const char * Rec;
+    const char * NewLine;
+    DWORD        Pos = 0;
+    DWORD        Line = 0;
+    DWORD        Len;
+    DWORD        Count;
+    DWORD        Base = 0;
+    DWORD        Wraps = 0;
+    DWORD        Addr;
+    DWORD        End;
+    DWORD        Loaded = 0;
+    BOOL         Ended = FALSE;
+    BYTE         Sum;
+
+    while (Pos < Length)
+    {
+        Line++;
+        Rec = Text + Pos;
+        if ((NewLine = memchr(Rec, '\n', Length - Pos)) != 0)
+        {
+            Len  = NewLine - Rec;
+            Pos += Len + 1;
+        }
+        else
+        {
+            Len = Length - Pos;
+            Pos = Length;
+        }
+        if ((Len > 0) && (Rec[Len - 1] == '\r'))
+            Len--;
+        if (Len == 0)
+            continue;
+
+        if ((Rec[0] != ':') || (Len < 11) || (((Len - 1) & 1) != 0) ||
+            ((Count = (Len - 1) / 2) > MAXBYTES))
+            return Fail(Lpd, Line, "not a hex record");
+        if (HexDecode(Rec + 1, Count, Bytes, &Sum) != 2 * Count)
+            return Fail(Lpd, Line, "bad hex digit");
+        if ((Bytes[0] != Count - 5) || (Sum != 0))
+            return Fail(Lpd, Line, "bad record length or checksum");
+
+        Addr = GetWord(Bytes + 1);
+        switch (Bytes[3])
+        {
+            case 0:
+                if (Lpd->Memory == 0)
+                    return Fail(Lpd, Line, "no AMD LPD header; not a "
+                                "relocatable hex file");
+                Addr += Base;
+                End   = Addr + Bytes[0];
+                if (End > Lpd->ReloEnd)
+                    return Fail(Lpd, Line, "data at %X, past the end of the "
+                                "relocations", Addr);
+                memcpy(Lpd->Memory + Addr, Bytes + 4, Bytes[0]);
+
+                if (Addr < Lpd->ProgLength)
+                {
+                    if (End > Lpd->ProgLength)
+                        End = Lpd->ProgLength;
+                    if (End > Lpd->ImageLength)
+                        Lpd->ImageLength = End;
+                    Loaded += End - Addr;
+                }
+                if (Bytes[0] > Lpd->RecordLength)
+                    Lpd->RecordLength = Bytes[0];
+                break;
+
+            case 1:
+                Ended = TRUE;
+                Pos = Length;
+                break;
+
+            case 2:
+                if ((Bytes[0] == LPDLENGTH) &&
+                    (memcmp(Bytes + 6, "AMD LPD ", 8) == 0))
+                {
+                    if (Lpd->Memory != 0)
+                        return Fail(Lpd, Line, "second AMD LPD header");
+                    Lpd->Paragraphs   = GetWord(Bytes + 14);
+                    Lpd->StackSegment = GetWord(Bytes + 16);
+                    Lpd->StackOffset  = GetWord(Bytes + 18);
+                    Lpd->ProgLength   = GetDWord(Bytes + 20);
+                    Lpd->ReloEnd      = GetDWord(Bytes + 24);
+                    if ((Lpd->ReloEnd < Lpd->ProgLength) ||
+                        (Lpd->ReloEnd > E86LPD_MAXLOAD) ||
+                        (((Lpd->ReloEnd - Lpd->ProgLength) & 3) != 0))
+                        return Fail(Lpd, Line, "bad AMD LPD header");
+                    if ((Lpd->Memory = calloc(1, Lpd->ReloEnd + 1)) == 0)
+                        return Fail(Lpd, Line, "out of memory");
+                }
+                else if (Bytes[0] != 2)
+                    return Fail(Lpd, Line, "bad segment record");
+                Addr = (DWORD)GetWord(Bytes + 4) << 4;
+                if (Addr + Wraps * E86LPD_WRAP < Base)
+                    Wraps++;
+                Base = Addr + Wraps * E86LPD_WRAP;
+                break;
+
+            case 3:
+                if (Bytes[0] != 4)
+                    return Fail(Lpd, Line, "bad start record");
+                Lpd->EntrySegment = GetWord(Bytes + 4);
+                Lpd->EntryOffset  = GetWord(Bytes + 6);
+                break;
+
+            default:
+                return Fail(Lpd, Line, "record type %02X in a relocatable file",
+                            Bytes[3]);
+        }
+    }
+
+    if (Lpd->Memory == 0)
+        return Fail(Lpd, 0, "no AMD LPD header; not a relocatable hex file");
+    if (!Ended)
+        return Fail(Lpd, 0, "no end of file record");
+
+    Lpd->Unloaded = (Loaded < Lpd->ImageLength) ? Lpd->ImageLength - Loaded : 0;
+    return TRUE;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// FindRelocations() counts the relocations, leaving out the padding at
+// the end of the block, and checks they all lie inside the image.
+//
+static BOOL FindRelocations(E86LPD * Lpd)
+{
+    DWORD n = (Lpd->ReloEnd - Lpd->ProgLength) / 4;
+    DWORD i;
+    DWORD Relo;
+
+    while ((n > 0) && (GetLE(Lpd->Memory + Lpd->ProgLength + 4 * (n - 1)) ==
+                       (Lpd->ProgLength & (E86LPD_WRAP - 1))))
+        n--;
+
+    for (i = 0; i < n; i++)
+    {
+        Relo = GetLE(Lpd->Memory + Lpd->ProgLength + 4 * i);
+        if (Relo + 2 > Lpd->ImageLength)
+            return Fail(Lpd, 0, "relocation %u at %X is outside the %X byte "
+                        "image", i, Relo, Lpd->ImageLength);
+    }
+    if (n > 0xFFFF)
+        return Fail(Lpd, 0, "%u relocations, more than an EXE can hold", n);
+
+    Lpd->Relocations = n;
+    return TRUE;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Entry points.
+//
+int E86LpdParse(E86LPD * Lpd, const char * Text, DWORD Length)
+{
+    memset(Lpd, 0, sizeof(E86LPD));
+    Lpd->TextLength = Length;
+    return (Parse(Lpd, Text, Length) && FindRelocations(Lpd)) ? 0 : -1;
+}
+
+int E86LpdRead(E86LPD * Lpd, const char * Name)
+{
+    struct stat st;
+    char *      Text;
+    int         fd;
+    int         Result;
+
+    memset(Lpd, 0, sizeof(E86LPD));
+    if ((fd = open(Name, O_RDONLY)) < 0)
+    {
+        Fail(Lpd, 0, "cannot open");
+        return -1;
+    }
+    if ((fstat(fd, &st) != 0) || !S_ISREG(st.st_mode) ||
+        (st.st_size == 0) || (st.st_size >= 0xFFFFFFFFL) ||
+        ((Text = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0))
+             == MAP_FAILED))
+    {
+        close(fd);
+        Fail(Lpd, 0, "cannot read");
+        return -1;
+    }
+    close(fd);
+
+    Result = E86LpdParse(Lpd, Text, st.st_size);
+    munmap(Text, st.st_size);
+    return Result;
+}
+
+DWORD E86LpdRelocation(const E86LPD * Lpd, DWORD i)
+{
+    return GetLE(Lpd->Memory + Lpd->ProgLength + 4 * i);
+}
+
+WORD E86LpdExtra(const E86LPD * Lpd)
+{
+    return (WORD)(Lpd->Paragraphs - (WORD)(Lpd->ProgLength >> 4) - 2);
+}
+
+void E86LpdFree(E86LPD * Lpd)
+{
+    free(Lpd->Memory);
+    Lpd->Memory = 0;
+}
@@ -0,0 +1,78 @@
+/******************************************************************************
+ *                                                                            *
+ *     E86LPD.H                                                               *
+ *                                                                            *
+ *     Reader for the relocatable hex files MakeHex writes for E86Mon,        *
+ *     shared by hexunpack and e86load.  A file is loaded into memory as      *
+ *     the monitor receives it: the program from address 0, followed by the   *
+ *     relocation block the AMD LPD header record describes.                  *
+ *                                                                            *
+ *     The header record gives the stack, the paragraphs to allocate and      *
+ *     where the program and the relocation block end.  The program image     *
+ *     ends with the last byte the data records load below the relocation     *
+ *     block, as relocatable files are not padded.  The block holds one       *
+ *     linear address per relocation, padded out to whole records with the    *
+ *     address the program ends at, which no relocation can have.  Segment    *
+ *     records only reach 1M, so a program bigger than that is followed by    *
+ *     counting the times they wrap.                                          *
+ *                                                                            *
+ *****************************************************************************/
+
+#ifndef E86LPD_H
+#define E86LPD_H
+
+#include "e86hex.h"
+
+#define E86LPD_MAXLOAD  0x4000000L  // Largest program + relocations accepted
+#define E86LPD_WRAP     0x100000L   // Where segment records wrap
+#define E86LPD_ERRLEN   160
+
+typedef struct {
+    WORD    Paragraphs;         // From the AMD LPD record
+    WORD    StackSegment;
+    WORD    StackOffset;
+    WORD    EntrySegment;
+    WORD    EntryOffset;
+    WORD    RecordLength;       // Longest data record
+    DWORD   ProgLength;         // Program, rounded up to whole records
+    DWORD   ReloEnd;            // End of the relocation block
+    DWORD   ImageLength;
+    DWORD   Unloaded;           // Image bytes no record loaded
+    DWORD   Relocations;
+    DWORD   TextLength;         // Characters in the hex file
+    LPBYTE  Memory;             // Program and relocation block
+    char    Error[E86LPD_ERRLEN];
+} E86LPD;
+
+//////////////////////////////////////////////////////////////////////////
+// E86LpdParse() reads the Length characters of a hex file at Text into
+// Lpd, and checks that every relocation lies inside the image.  Returns
+// 0, or -1 with the reason (and line, if there is one) in Lpd->Error.
+// Lpd->Memory is allocated either way; E86LpdFree() frees it.
+//
+int E86LpdParse(E86LPD * Lpd, const char * Text, DWORD Length);
+
+//////////////////////////////////////////////////////////////////////////
+// E86LpdRead() maps the hex file Name and parses it as E86LpdParse()
+// does, with "cannot open" or "cannot read" as further errors.
+//
+int E86LpdRead(E86LPD * Lpd, const char * Name);
+
+//////////////////////////////////////////////////////////////////////////
+// E86LpdRelocation() returns relocation i, as the offset from the start
+// of the image of the word which gets the load segment added.
+//
+DWORD E86LpdRelocation(const E86LPD * Lpd, DWORD i);
+
+//////////////////////////////////////////////////////////////////////////
+// E86LpdExtra() works the EXE's minimum extra allocation back out of
+// the paragraphs the AMD LPD record asks for.
+//
+WORD E86LpdExtra(const E86LPD * Lpd);
+
+//////////////////////////////////////////////////////////////////////////
+// E86LpdFree() frees the memory a file was loaded into.
+//
+void E86LpdFree(E86LPD * Lpd);
+
+#endif
@@ -0,0 +1,339 @@
+/******************************************************************************
+ *                                                                            *
+ *     E86MAP.C                                                               *
+ *                                                                            *
+ *     Sparse map of what an Intel hex file loads; see E86MAP.H.              *
+ *                                                                            *
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "e86map.h"
+#include "hexkern.h"
+
+#define MAXBYTES    (5 + 255)   // Length, address, type, data, checksum
+#define LPDLENGTH   (2 + 8 + 2 + 4 * 4)
+
+//////////////////////////////////////////////////////////////////////////
+// Fail() records why a file could not be read.  Returns FALSE, so that
+// callers can return it.
+//
+static BOOL Fail(E86MAP * m, DWORD Line, const char * s, ...)
+{
+    va_list ap;
+    int     n = 0;
+
+    if (Line != 0)
+        n = snprintf(m->Error, sizeof(m->Error), "line %u: ", Line);
+    va_start(ap, s);
+    vsnprintf(m->Error + n, sizeof(m->Error) - n, s, ap);
+    va_end(ap);
+    return FALSE;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// GetWord() and GetDWord() read the big endian fields hex records hold.
+//
+static WORD GetWord(const BYTE * p)
+{
+    return (WORD)((p[0] << 8) | p[1]);
+}
+
+static DWORD GetDWord(const BYTE * p)
+{
+    return ((DWORD)GetWord(p) << 16) | GetWord(p + 2);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// AddRange() notes Length bytes loaded at linear address Start, which
+// are at Offset in m->Data.  They extend the last range when they
+// follow on from it in both, as they do in files MakeHex writes.
+//
+static BOOL AddRange(E86MAP * m, DWORD Start, DWORD Length, DWORD Offset)
+{
+    E86RANGE * Last = m->NumRanges ? &m->Ranges[m->NumRanges - 1] : 0;
+
+    if (Length == 0)
+        return TRUE;
+    if ((Last != 0) && (Last->End == Start) &&
+        (Last->Offset + (Last->End - Last->Start) == Offset))
+    {
+        Last->End += Length;
+        return TRUE;
+    }
+
+    if (m->NumRanges == m->MaxRanges)
+    {
+        m->MaxRanges = m->MaxRanges ? 2 * m->MaxRanges : 64;
+        if ((Last = realloc(m->Ranges, m->MaxRanges * sizeof(E86RANGE)))
+                == 0)
+            return FALSE;
+        m->Ranges = Last;
+    }
+    m->Ranges[m->NumRanges].Start  = Start;
+    m->Ranges[m->NumRanges].End    = Start + Length;
+    m->Ranges[m->NumRanges].Offset = Offset;
+    m->NumRanges++;
+    return TRUE;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// CompareRange() orders ranges by start address for qsort(), and those
+// which start together in the order of the file.
+//
+static int CompareRange(const void * a, const void * b)
+{
+    const E86RANGE * x = a;
+    const E86RANGE * y = b;
+
+    if (x->Start != y->Start)
+        return (x->Start > y->Start) - (x->Start < y->Start);
+    return (x->Offset > y->Offset) - (x->Offset < y->Offset);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// IndexRanges() sorts the ranges, unless the file loaded them in order,
+// and makes them disjoint.  Where records load over each other, the
+// one which starts later wins, or for the same start the later one in
+// the file: its bytes are copied over those of the range it overlaps.
+//
+static void IndexRanges(E86MAP * m)
+{
+    E86RANGE * r = m->Ranges;
+    DWORD   i;
+    DWORD   n = 0;
+    DWORD   Over;
+
+    for (i = 1; i < m->NumRanges; i++)
+        if (r[i].Start < r[i - 1].End)
+            break;
+    if (i == m->NumRanges)
+        return;
+
+    qsort(r, m->NumRanges, sizeof(E86RANGE), CompareRange);
+    for (i = 1; i < m->NumRanges; i++)
+    {
+        if (r[i].Start < r[n].End)
+        {
+            Over = ((r[i].End < r[n].End) ? r[i].End : r[n].End) -
+                   r[i].Start;
+            memcpy(m->Data + r[n].Offset + (r[i].Start - r[n].Start),
+                   m->Data + r[i].Offset, Over);
+            m->Overlap  += Over;
+            r[i].Start  += Over;
+            r[i].Offset += Over;
+            if (r[i].Start == r[i].End)
+                continue;
+        }
+        r[++n] = r[i];
+    }
+    m->NumRanges = n + 1;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Parse() decodes the records of a hex file into its map.  Returns
+// FALSE, with the error recorded, at the first bad record.
+//
+static BOOL Parse(E86MAP * m, const char * Text, DWORD Length)
+{
+    BYTE         Bytes[MAXBYTES];
+    const char * Rec;
+    const char * NewLine;
+    DWORD        Pos = 0;
+    DWORD        Line = 0;
+    DWORD        Len;
+    DWORD        Count;
+    DWORD        Done;
+    DWORD        Base = 0;
+    DWORD        Wraps = 0;
+    DWORD        Addr;
+    BYTE         Sum;
+    BOOL         Ended = FALSE;
+
+    //
+    // The data cannot be longer than half the text.
+    //
+    if ((m->Data = malloc(Length / 2 + 1)) == 0)
+        return Fail(m, 0, "out of memory");
+
+    while (Pos < Length)
+    {
+        Line++;
+        Rec = Text + Pos;
+        if ((NewLine = memchr(Rec, '\n', Length - Pos)) != 0)
+        {
+            Len  = NewLine - Rec;
+            Pos += Len + 1;
+        }
+        else
+        {
+            Len = Length - Pos;
+            Pos = Length;
+        }
+        if ((Len > 0) && (Rec[Len - 1] == '\r'))
+            Len--;
+        if (Len == 0)
+            continue;
+
+        if ((Rec[0] != ':') || (Len < 11) || (((Len - 1) & 1) != 0) ||
+            ((Count = (Len - 1) / 2) > MAXBYTES))
+            return Fail(m, Line, "not a hex record");
+        if (HexDecode(Rec + 1, Count, Bytes, &Sum) != 2 * Count)
+            return Fail(m, Line, "bad hex digit");
+        if ((Bytes[0] != Count - 5) || (Sum != 0))
+            return Fail(m, Line, "bad record length or checksum");
+
+        Addr = GetWord(Bytes + 1);
+        switch (Bytes[3])
+        {
+            case 0:
+                //
+                // Within a segment the offset wraps around at 64K.
+                //
+                memcpy(m->Data + m->DataLength, Bytes + 4, Bytes[0]);
+                Done = (Addr + Bytes[0] > 0x10000L) ? 0x10000L - Addr :
+                                                      Bytes[0];
+                if (!AddRange(m, Base + Addr, Done, m->DataLength) ||
+                    !AddRange(m, Base, Bytes[0] - Done,
+                              m->DataLength + Done))
+                    return Fail(m, Line, "out of memory");
+                m->DataLength += Bytes[0];
+                break;
+
+            case 1:
+                Ended = TRUE;
+                Pos = Length;
+                break;
+
+            case 2:
+                if ((Bytes[0] == LPDLENGTH) &&
+                    (memcmp(Bytes + 6, "AMD LPD ", 8) == 0))
+                {
+                    if (m->Relocatable)
+                        return Fail(m, Line, "second AMD LPD header");
+                    m->Relocatable      = TRUE;
+                    m->Lpd.Paragraphs   = GetWord(Bytes + 14);
+                    m->Lpd.StackSegment = GetWord(Bytes + 16);
+                    m->Lpd.StackOffset  = GetWord(Bytes + 18);
+                    m->Lpd.ProgLength   = GetDWord(Bytes + 20);
+                    m->Lpd.ReloEnd      = GetDWord(Bytes + 24);
+                    if ((m->Lpd.ReloEnd < m->Lpd.ProgLength) ||
+                        (m->Lpd.ReloEnd > E86LPD_MAXLOAD) ||
+                        (((m->Lpd.ReloEnd - m->Lpd.ProgLength) & 3) != 0))
+                        return Fail(m, Line, "bad AMD LPD header");
+                }
+                else if (Bytes[0] != 2)
+                    return Fail(m, Line, "bad segment record");
+
+                //
+                // Relocatable files are written in address order, and
+                // their segment records wrap at 1M; see E86LPD.H.
+                //
+                Addr = (DWORD)GetWord(Bytes + 4) << 4;
+                if (m->Relocatable && (Addr + Wraps * E86LPD_WRAP < Base))
+                    Wraps++;
+                Base = Addr + Wraps * E86LPD_WRAP;
+                break;
+
+            case 3:
+                if (Bytes[0] != 4)
+                    return Fail(m, Line, "bad start record");
+                m->HaveStart    = TRUE;
+                m->StartSegment = GetWord(Bytes + 4);
+                m->StartOffset  = GetWord(Bytes + 6);
+                break;
+
+            case 4:
+                if (Bytes[0] != 2)
+                    return Fail(m, Line, "bad linear address record");
+                Base = (DWORD)GetWord(Bytes + 4) << 16;
+                break;
+
+            case 5:
+                if (Bytes[0] != 4)
+                    return Fail(m, Line, "bad linear start record");
+                m->HaveLinearStart = TRUE;
+                m->LinearStart     = GetDWord(Bytes + 4);
+                break;
+
+            default:
+                return Fail(m, Line, "unknown record type %02X", Bytes[3]);
+        }
+    }
+
+    if (!Ended)
+        return Fail(m, 0, "no end of file record");
+    IndexRanges(m);
+    return TRUE;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Entry points.
+//
+int E86MapParse(E86MAP * Map, const char * Text, DWORD Length)
+{
+    memset(Map, 0, sizeof(E86MAP));
+    Map->TextLength = Length;
+    return Parse(Map, Text, Length) ? 0 : -1;
+}
+
+int E86MapRead(E86MAP * Map, const char * Name)
+{
+    struct stat st;
+    char *      Text;
+    int         fd;
+    int         Result;
+
+    memset(Map, 0, sizeof(E86MAP));
+    if ((fd = open(Name, O_RDONLY)) < 0)
+    {
+        Fail(Map, 0, "cannot open");
+        return -1;
+    }
+    if ((fstat(fd, &st) != 0) || !S_ISREG(st.st_mode) ||
+        (st.st_size == 0) || (st.st_size >= 0xFFFFFFFFL) ||
+        ((Text = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0))
+             == MAP_FAILED))
+    {
+        close(fd);
+        Fail(Map, 0, "cannot read");
+        return -1;
+    }
+    close(fd);
+
+    Result = E86MapParse(Map, Text, st.st_size);
+    munmap(Text, st.st_size);
+    return Result;
+}
+
+const E86RANGE * E86MapFind(const E86MAP * Map, DWORD Addr)
+{
+    DWORD Low = 0;
+    DWORD High = Map->NumRanges;
+    DWORD Mid;
+
+    while (Low < High)
+    {
+        Mid = (Low + High) / 2;
+        if (Map->Ranges[Mid].End <= Addr)
+            Low = Mid + 1;
+        else
+            High = Mid;
+    }
+    return &Map->Ranges[Low];
+}
+
+void E86MapFree(E86MAP * Map)
+{
+    free(Map->Ranges);
+    free(Map->Data);
+    Map->Ranges    = 0;
+    Map->NumRanges = 0;
+    Map->Data      = 0;
+}
@@ -0,0 +1,74 @@
+/******************************************************************************
+ *                                                                            *
+ *     E86MAP.H                                                               *
+ *                                                                            *
+ *     Sparse map of what an Intel hex file loads, shared by hexdiff and      *
+ *     hexmerge.  The data records are decoded into one buffer in the order   *
+ *     of the file, and indexed by a sorted list of disjoint intervals of     *
+ *     linear addresses, each pointing at the bytes it holds.  Records which  *
+ *     follow on from each other share an interval, so a file MakeHex wrote   *
+ *     has about one interval for each stretch it loads.                      *
+ *                                                                            *
+ *     The records MakeHex writes are understood (00 to 03, and the AMD LPD   *
+ *     header, read as E86LPD.H describes), and the 04 and 05 records of      *
+ *     other tools.  Within a segment the offset wraps around at 64K.         *
+ *                                                                            *
+ *****************************************************************************/
+
+#ifndef E86MAP_H
+#define E86MAP_H
+
+#include "e86lpd.h"
+
+typedef struct {
+    DWORD   Start;
+    DWORD   End;                // One past the last byte
+    DWORD   Offset;             // Of the first byte in E86MAP.Data
+} E86RANGE;
+
+typedef struct {
+    E86RANGE * Ranges;
+    DWORD   NumRanges;
+    DWORD   MaxRanges;
+    LPBYTE  Data;               // Record data, in the order of the file
+    DWORD   DataLength;
+    DWORD   TextLength;         // Characters in the hex file
+    DWORD   Overlap;            // Bytes loaded more than once
+    BOOL    HaveStart;
+    WORD    StartSegment;
+    WORD    StartOffset;
+    BOOL    HaveLinearStart;
+    DWORD   LinearStart;
+    BOOL    Relocatable;
+    E86LPD  Lpd;                // AMD LPD header fields, if Relocatable
+    char    Error[E86LPD_ERRLEN];
+} E86MAP;
+
+//////////////////////////////////////////////////////////////////////////
+// E86MapParse() decodes the Length characters of a hex file at Text
+// into Map.  Where records load over each other, the one which starts
+// later wins, or for the same start the later one in the file, and the
+// bytes lost are counted in Map->Overlap.  Returns 0, or -1 with the
+// reason (and line, if there is one) in Map->Error.  E86MapFree() frees
+// the map either way.
+//
+int E86MapParse(E86MAP * Map, const char * Text, DWORD Length);
+
+//////////////////////////////////////////////////////////////////////////
+// E86MapRead() maps the hex file Name and parses it as E86MapParse()
+// does, with "cannot open" or "cannot read" as further errors.
+//
+int E86MapRead(E86MAP * Map, const char * Name);
+
+//////////////////////////////////////////////////////////////////////////
+// E86MapFind() returns the first interval which ends after Addr, by
+// binary search of the index, or one past the last if none does.
+//
+const E86RANGE * E86MapFind(const E86MAP * Map, DWORD Addr);
+
+//////////////////////////////////////////////////////////////////////////
+// E86MapFree() frees the data and index of a map.
+//
+void E86MapFree(E86MAP * Map);
+
+#endif
@@ -0,0 +1,173 @@
+/******************************************************************************
+ *                                                                            *
+ *     E86TRACE.C                                                             *
+ *                                                                            *
+ *     Phase timing and Chrome trace export shared by MakeHex, MakeBin and    *
+ *     EditMon.  See E86TRACE.H.                                              *
+ *                                                                            *
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "e86trace.h"
+
+#define MAXPHASES  32
+#define PHASENAME  24
+
+typedef struct {
+    char               Name[PHASENAME];
+    unsigned long      Count;
+    double             Time;
+    unsigned long long BytesIn;
+    unsigned long long BytesOut;
+    unsigned long long Records;
+} PHASETOTAL;
+
+static pthread_mutex_t TraceLock = PTHREAD_MUTEX_INITIALIZER;
+static int             TraceStarted = 0;
+static int             TraceStats = 0;
+static FILE *          TraceFile = 0;
+static unsigned long   TraceEvents = 0;
+static double          TraceStart;
+static PHASETOTAL      Totals[MAXPHASES];
+static int             NumTotals = 0;
+static int             NextThread = 1;
+static __thread int    ThreadId = 0;
+
+int E86TraceOpen(const char * File, int Stats)
+{
+    if ((File != 0) && ((TraceFile = fopen(File, "w")) == 0))
+        return -1;
+
+    TraceStart   = E86TraceNow();
+    TraceStats   = Stats;
+    TraceStarted = 1;
+    if (TraceFile != 0)
+        fputs("[\n", TraceFile);
+    return 0;
+}
+
+int E86TraceOn(void)
+{
+    return TraceStarted;
+}
+
+double E86TraceNow(void)
+{
+    struct timespec Now;
+
+    clock_gettime(CLOCK_MONOTONIC, &Now);
+    return Now.tv_sec + Now.tv_nsec / 1e9;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// PutString() writes a JSON string.
+//
+static void PutString(FILE * f, const char * s)
+{
+    fputc('"', f);
+    for (; *s != 0; s++)
+        if ((*s == '"') || (*s == '\\'))
+            fprintf(f, "\\%c", *s);
+        else if ((unsigned char)*s < ' ')
+            fprintf(f, "\\u%04x", (unsigned char)*s);
+        else
+            fputc(*s, f);
+    fputc('"', f);
+}
+
+void E86TracePhase(const char * Phase, const char * Input, double Start,
+                   double End, unsigned long long BytesIn,
+                   unsigned long long BytesOut, unsigned long Records)
+{
+    PHASETOTAL * Total = 0;
+    int          i;
+
+    if (!TraceStarted)
+        return;
+
+    pthread_mutex_lock(&TraceLock);
+
+    if (ThreadId == 0)
+        ThreadId = NextThread++;
+
+    if (TraceStats)
+    {
+        for (i = 0; (i < NumTotals) && (Total == 0); i++)
+            if (strncmp(Totals[i].Name, Phase, PHASENAME - 1) == 0)
+                Total = &Totals[i];
+        if ((Total == 0) && (NumTotals < MAXPHASES))
+        {
+            Total = &Totals[NumTotals++];
+            strncpy(Total->Name, Phase, PHASENAME - 1);
+        }
+        if (Total != 0)
+        {
+            Total->Count++;
+            Total->Time     += End - Start;
+            Total->BytesIn  += BytesIn;
+            Total->BytesOut += BytesOut;
+            Total->Records  += Records;
+        }
+    }
+
+    if (TraceFile != 0)
+    {
+        fprintf(TraceFile, "%s{\"name\":", TraceEvents++ ? ",\n" : "");
+        PutString(TraceFile, Phase);
+        fprintf(TraceFile, ",\"cat\":\"e86\",\"ph\":\"X\",\"ts\":%.3f,"
+                "\"dur\":%.3f,\"pid\":%d,\"tid\":%d,\"args\":{",
+                (Start - TraceStart) * 1e6, (End - Start) * 1e6,
+                (int)getpid(), ThreadId);
+        if (Input != 0)
+        {
+            fputs("\"input\":", TraceFile);
+            PutString(TraceFile, Input);
+            fputc(',', TraceFile);
+        }
+        fprintf(TraceFile, "\"bytes_in\":%llu,\"bytes_out\":%llu,"
+                "\"records\":%lu}}", BytesIn, BytesOut, Records);
+    }
+
+    pthread_mutex_unlock(&TraceLock);
+}
+
+void E86TraceClose(FILE * Out)
+{
+    PHASETOTAL * Total;
+    double       Bytes;
+    int          i;
+
+    if (!TraceStarted)
+        return;
+
+    if (TraceStats)
+    {
+        fprintf(Out, "\n%-12s %7s %11s %13s %13s %10s %9s\n", "Phase",
+                "Count", "Wall ms", "Bytes in", "Bytes out", "Records",
+                "MB/s");
+        for (i = 0; i < NumTotals; i++)
+        {
+            Total = &Totals[i];
+            Bytes = (Total->BytesIn > Total->BytesOut) ?
+                    Total->BytesIn : Total->BytesOut;
+            fprintf(Out, "%-12s %7lu %11.3f %13llu %13llu %10llu %9.1f\n",
+                    Total->Name, Total->Count, Total->Time * 1e3,
+                    Total->BytesIn, Total->BytesOut, Total->Records,
+                    (Total->Time > 0) ? Bytes / Total->Time / 1e6 : 0.0);
+        }
+        fprintf(Out, "%-12s %7s %11.3f\n\n", "total", "",
+                (E86TraceNow() - TraceStart) * 1e3);
+    }
+
+    if (TraceFile != 0)
+    {
+        fputs("\n]\n", TraceFile);
+        fclose(TraceFile);
+        TraceFile = 0;
+    }
+    TraceStarted = 0;
+}
@@ -0,0 +1,57 @@
+/******************************************************************************
+ *                                                                            *
+ *     E86TRACE.H                                                             *
+ *                                                                            *
+ *     Phase timing shared by MakeHex, MakeBin and EditMon.  Each phase of    *
+ *     the work (header parsing, data records, relocations, writes, ...) is   *
+ *     reported with its wall time, the bytes it read and wrote and the       *
+ *     records it made.  --stats totals the phases up on exit; --trace        *
+ *     writes every phase as a Chrome trace event, so that a run can be       *
+ *     opened in chrome://tracing or Perfetto.                                *
+ *                                                                            *
+ *     The trace is a JSON array of "X" (complete) events, written as the     *
+ *     phases end.  A run which stops on an error leaves the array without    *
+ *     its closing bracket, which trace viewers accept.                       *
+ *                                                                            *
+ *****************************************************************************/
+
+#ifndef E86TRACE_H
+#define E86TRACE_H
+
+#include <stdio.h>
+
+//////////////////////////////////////////////////////////////////////////
+// E86TraceOpen() starts timing.  Phases are written as trace events to
+// File unless it is 0, and totalled up for E86TraceClose() if Stats is
+// set.  Returns 0, or -1 if File cannot be created.
+//
+int E86TraceOpen(const char * File, int Stats);
+
+//////////////////////////////////////////////////////////////////////////
+// E86TraceOn() tells whether timing was started, so that callers need
+// not time anything when it was not.
+//
+int E86TraceOn(void);
+
+//////////////////////////////////////////////////////////////////////////
+// E86TraceNow() returns the time in seconds, from a clock which only
+// counts forward.
+//
+double E86TraceNow(void);
+
+//////////////////////////////////////////////////////////////////////////
+// E86TracePhase() records a phase which ran from Start to End (as
+// E86TraceNow() gave them) on the calling thread.  Input names what it
+// worked on, and may be 0.  Safe to call from several threads.
+//
+void E86TracePhase(const char * Phase, const char * Input, double Start,
+                   double End, unsigned long long BytesIn,
+                   unsigned long long BytesOut, unsigned long Records);
+
+//////////////////////////////////////////////////////////////////////////
+// E86TraceClose() prints the phase totals to Out if --stats asked for
+// them, and finishes the trace file.
+//
+void E86TraceClose(FILE * Out);
+
+#endif
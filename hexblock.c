@@ -0,0 +1,429 @@
+/******************************************************************************
+ *                                                                            *
+ *     HEXBLOCK.C                                                             *
+ *                                                                            *
+ *     Rewrites an Intel hex file with a different record length, most        *
+ *     often to turn the 16 byte records of older tools into the longer      *
+ *     ones MakeHex writes, which E86Mon downloads faster.                    *
+ *                                                                            *
+ *     The file is streamed: records are read in order, and the data of       *
+ *     those which follow on from each other is gathered into records of      *
+ *     the new length as it arrives.  Every other record (segment, start,     *
+ *     extended address, the AMD LPD header, end of file) is copied           *
+ *     through unchanged and in its place, so the data before it is written   *
+ *     out first; the file loads exactly what it did, in the same order.      *
+ *     No record runs past offset FFFF of its segment.                        *
+ *                                                                            *
+ *     A relocatable file keeps the program length and relocation block end   *
+ *     its AMD LPD header gives, and no record holds both program and         *
+ *     relocation bytes, so the block starts a record as it did before and    *
+ *     E86Mon still finds its entries where the header says.                  *
+ *                                                                            *
+ *     Usage: hexblock [options] <file>                                       *
+ *                                                                            *
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include "e86hex.h"
+#include "hexkern.h"
+#include "e86trace.h"
+
+#define MAXBYTES    (5 + MAXRECLEN) // Length, address, type, data, checksum
+#define LPDLENGTH   (2 + 8 + 2 + 4 * 4)
+#define SEGWRAP     0x100000L       // Where segment records wrap
+#define READSIZE    (1L << 20)
+#define MAXLINE     (1 + 2 * MAXBYTES)
+
+typedef struct {
+    FILE *  Out;
+    const char * Eol;           // Line ending of the input's first record
+    BYTE    Data[MAXRECLEN];    // Data gathered for the next record
+    DWORD   Len;
+    DWORD   Start;              // Linear address of Data[0]
+    WORD    Offset;             // Its offset in the segment
+    DWORD   Base;               // Linear address of offset 0
+    DWORD   Wraps;              // Times segment records wrapped past 1M
+    BOOL    Relocatable;
+    DWORD   ProgLength;         // From the AMD LPD record
+    BOOL    Ended;
+    DWORD   Line;
+    DWORD   Bytes;              // Data bytes
+    DWORD   LinesIn;
+    DWORD   CharsIn;
+    DWORD   LinesOut;
+    DWORD   CharsOut;
+} BLOCKER;
+
+E86HEXOPTIONS Opts;             // Record length, and download estimate rates
+char * OutName = 0;
+BOOL   ShowStats = FALSE;
+char * TraceName = 0;
+FILE * Msgs;
+
+static const char HexDigits[] = "0123456789ABCDEF";
+
+//////////////////////////////////////////////////////////////////////////
+// ErrExit() shows an error message and exits.
+//
+static void ErrExit(const char * s, ...)
+{
+    va_list ap;
+
+    va_start(ap, s);
+    fputs("hexblock: ", stderr);
+    vfprintf(stderr, s, ap);
+    fputc('\n', stderr);
+    va_end(ap);
+    exit(2);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// ShowHelp() lists the options.
+//
+static void ShowHelp(void)
+{
+    printf(
+"\nUsage: hexblock [options] <file>\n\n"
+"    Rewrites an Intel hex file (- for standard input) with records of a\n"
+"    new length.  Data which follows on is joined across the records it\n"
+"    came in; all other records, and the layout of a relocatable file,\n"
+"    are kept as they were.\n\n"
+"    --record=<n>     Data bytes per record, 1 to 255 (32)\n"
+"    --output=<file>  Write to <file>, not standard output\n"
+"    --baud=<n>       Baud rate for the download estimates (19200)\n"
+"    --line-cost=<n>  Monitor time per record, in microseconds (1000)\n"
+"    --stats          Show how long each phase took\n"
+"    --trace=<file>   Write each phase to <file> as Chrome trace events\n\n");
+    exit(2);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// ParseDecimal() parses decimal numbers. Only returns TRUE if no non-decimal
+// characters are encountered.
+//
+static BOOL ParseDecimal(const char * t, DWORD * Value)
+{
+    *Value = 0;
+
+    if (*t == 0)
+        return FALSE;
+    while ((*t >= '0') && (*t <= '9'))
+        *Value = *Value * 10 + *(t++) - '0';
+
+    return (*t == 0);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Fail() reports a bad input record and exits.
+//
+static void Fail(BLOCKER * b, const char * Why)
+{
+    ErrExit("line %u: %s", b->Line, Why);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// PutByte() prints a byte as two hex digits at Dst.
+//
+static char * PutByte(char * Dst, BYTE Value)
+{
+    Dst[0] = HexDigits[Value >> 4];
+    Dst[1] = HexDigits[Value & 0xF];
+    return Dst + 2;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// PutLine() writes Len characters of a record and the line ending.
+//
+static void PutLine(BLOCKER * b, const char * Text, DWORD Len)
+{
+    fwrite(Text, 1, Len, b->Out);
+    fputs(b->Eol, b->Out);
+    b->LinesOut++;
+    b->CharsOut += Len + strlen(b->Eol);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Flush() writes the data gathered so far as one record.
+//
+static void Flush(BLOCKER * b)
+{
+    char   Line[MAXLINE];
+    char * p = Line;
+    BYTE   Sum;
+
+    if (b->Len == 0)
+        return;
+
+    Sum = (BYTE)(b->Len + (b->Offset >> 8) + b->Offset);
+    *(p++) = ':';
+    p = PutByte(p, (BYTE)b->Len);
+    p = PutByte(p, (BYTE)(b->Offset >> 8));
+    p = PutByte(p, (BYTE)b->Offset);
+    p = PutByte(p, 0);
+    Sum += HexEncode(b->Data, b->Len, p);
+    p = PutByte(p + 2 * b->Len, (BYTE)(0 - Sum));
+    PutLine(b, Line, p - Line);
+    b->Len = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// AddData() gathers Count bytes, loaded from Offset on, none of them
+// past offset FFFF.  A record is written whenever the next byte does not
+// follow on, the record is full, it reaches the end of the segment, or
+// it reaches the relocation block.
+//
+static void AddData(BLOCKER * b, WORD Offset, const BYTE * Src, DWORD Count)
+{
+    DWORD Linear = b->Base + Offset;
+    DWORD Room;
+
+    b->Bytes += Count;
+    while (Count > 0)
+    {
+        if ((b->Len != 0) && (Linear != b->Start + b->Len))
+            Flush(b);
+        if (b->Len == 0)
+        {
+            b->Start  = Linear;
+            b->Offset = Offset;
+        }
+
+        Room = Opts.RecordLength - b->Len;
+        if (Room > 0x10000L - b->Offset - b->Len)
+            Room = 0x10000L - b->Offset - b->Len;
+        if (b->Relocatable && (b->Start < b->ProgLength) &&
+            (Room > b->ProgLength - b->Start - b->Len))
+            Room = b->ProgLength - b->Start - b->Len;
+        if (Room == 0)
+        {
+            Flush(b);
+            continue;
+        }
+
+        if (Room > Count)
+            Room = Count;
+        memcpy(b->Data + b->Len, Src, Room);
+        b->Len += Room;
+        Linear += Room;
+        Offset += Room;
+        Src    += Room;
+        Count  -= Room;
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Record() handles one record of Len characters, without its line
+// ending.
+//
+static void Record(BLOCKER * b, const char * Rec, DWORD Len)
+{
+    BYTE  Bytes[MAXBYTES];
+    DWORD Count;
+    DWORD First;
+    DWORD Seg;
+    WORD  Addr;
+    BYTE  Sum;
+    BOOL  Cr = FALSE;
+
+    b->Line++;
+    if ((Len > 0) && (Rec[Len - 1] == '\r'))
+    {
+        Len--;
+        Cr = TRUE;
+    }
+    if ((Len == 0) || b->Ended)
+        return;
+
+    if ((Rec[0] != ':') || (Len < 11) || (((Len - 1) & 1) != 0) ||
+        ((Count = (Len - 1) / 2) > MAXBYTES))
+        Fail(b, "not a hex record");
+    if (HexDecode(Rec + 1, Count, Bytes, &Sum) != 2 * Count)
+        Fail(b, "bad hex digit");
+    if ((Bytes[0] != Count - 5) || (Sum != 0))
+        Fail(b, "bad record length or checksum");
+
+    b->LinesIn++;
+    b->CharsIn += Len + Cr + 1;
+    if (b->Eol == 0)
+        b->Eol = Cr ? "\r\n" : "\n";
+
+    Addr = (WORD)((Bytes[1] << 8) | Bytes[2]);
+    if (Bytes[3] == 0)
+    {
+        //
+        // Data past offset FFFF wraps to the start of the segment.
+        //
+        First = 0x10000L - Addr;
+        if (First > Bytes[0])
+            First = Bytes[0];
+        AddData(b, Addr, Bytes + 4, First);
+        if (First < Bytes[0])
+            AddData(b, 0, Bytes + 4 + First, Bytes[0] - First);
+        return;
+    }
+
+    Flush(b);
+    switch (Bytes[3])
+    {
+        case 1:
+            b->Ended = TRUE;
+            break;
+
+        case 2:
+            if ((Bytes[0] == LPDLENGTH) &&
+                (memcmp(Bytes + 6, "AMD LPD ", 8) == 0))
+            {
+                b->Relocatable = TRUE;
+                b->ProgLength  = ((DWORD)Bytes[20] << 24) |
+                                 ((DWORD)Bytes[21] << 16) |
+                                 (Bytes[22] << 8) | Bytes[23];
+            }
+            else if (Bytes[0] != 2)
+                Fail(b, "bad segment record");
+
+            //
+            // Segment records only reach 1M; past that, a relocatable
+            // file is followed by counting the times they wrap.
+            //
+            Seg = (DWORD)((Bytes[4] << 8) | Bytes[5]) << 4;
+            if (b->Relocatable && (Seg + b->Wraps * SEGWRAP < b->Base))
+                b->Wraps++;
+            b->Base = Seg + (b->Relocatable ? b->Wraps * SEGWRAP : 0);
+            break;
+
+        case 4:
+            if (Bytes[0] != 2)
+                Fail(b, "bad extended linear address record");
+            b->Base = (DWORD)((Bytes[4] << 8) | Bytes[5]) << 16;
+            break;
+    }
+    PutLine(b, Rec, Len);
+}
+
+int main(int argc, char * argv[])
+{
+    BLOCKER b;
+    FILE *  In = 0;
+    char *  InName = 0;
+    char *  Buf;
+    char *  NewLine;
+    DWORD   Have = 0;
+    DWORD   Used;
+    DWORD   Got;
+    double  Start;
+    double  Before;
+    double  After;
+    int     i;
+
+    E86HexDefaults(&Opts);
+    Msgs = stdout;
+
+    for (i = 1; i < argc; i++)
+        if ((strncmp(argv[i], "--", 2) != 0) || (strcmp(argv[i], "-") == 0))
+        {
+            if (InName != 0)
+                ShowHelp();
+            InName = argv[i];
+        }
+        else if (strncmp(argv[i], "--record=", 9) == 0)
+        {
+            DWORD Value;
+
+            if (!ParseDecimal(argv[i] + 9, &Value) || (Value < 1) ||
+                (Value > MAXRECLEN))
+                ShowHelp();
+            Opts.RecordLength = (WORD)Value;
+        }
+        else if ((strncmp(argv[i], "--output=", 9) == 0) &&
+                 (argv[i][9] != 0))
+            OutName = argv[i] + 9;
+        else if (strncmp(argv[i], "--baud=", 7) == 0)
+        {
+            if (!ParseDecimal(argv[i] + 7, &Opts.Baud) || (Opts.Baud == 0))
+                ShowHelp();
+        }
+        else if (strncmp(argv[i], "--line-cost=", 12) == 0)
+        {
+            if (!ParseDecimal(argv[i] + 12, &Opts.LineCost))
+                ShowHelp();
+        }
+        else if (strcmp(argv[i], "--stats") == 0)
+            ShowStats = TRUE;
+        else if ((strncmp(argv[i], "--trace=", 8) == 0) && (argv[i][8] != 0))
+            TraceName = argv[i] + 8;
+        else
+            ShowHelp();
+
+    if (InName == 0)
+        ShowHelp();
+    if (OutName == 0)
+        Msgs = stderr;
+
+    if ((ShowStats || (TraceName != 0)) &&
+        (E86TraceOpen(TraceName, ShowStats) != 0))
+        ErrExit("Cannot create trace file %s", TraceName);
+
+    if (strcmp(InName, "-") == 0)
+        In = stdin;
+    else if ((In = fopen(InName, "rb")) == 0)
+        ErrExit("Cannot open %s", InName);
+
+    memset(&b, 0, sizeof(b));
+    if (OutName == 0)
+        b.Out = stdout;
+    else if ((b.Out = fopen(OutName, "wb")) == 0)
+        ErrExit("Cannot create %s", OutName);
+    setvbuf(b.Out, 0, _IOFBF, READSIZE);
+    if ((Buf = malloc(READSIZE + MAXLINE + 2)) == 0)
+        ErrExit("Out of memory");
+
+    //
+    // Records are handled as whole lines arrive; the part of a line at
+    // the end of the buffer is moved to the front for the next read.
+    //
+    Start = E86TraceNow();
+    while ((Got = fread(Buf + Have, 1, READSIZE, In)) != 0)
+    {
+        Have += Got;
+        for (Used = 0; (NewLine = memchr(Buf + Used, '\n', Have - Used)) != 0;
+             Used = NewLine + 1 - Buf)
+            Record(&b, Buf + Used, NewLine - (Buf + Used));
+        if (Have - Used > MAXLINE + 1)
+        {
+            b.Line++;
+            Fail(&b, "not a hex record");
+        }
+        memmove(Buf, Buf + Used, Have - Used);
+        Have -= Used;
+    }
+    if (ferror(In))
+        ErrExit("Cannot read %s", InName);
+    if (Have != 0)
+        Record(&b, Buf, Have);
+    if (!b.Ended)
+        ErrExit("%s: no end of file record", InName);
+    if (b.Eol == 0)
+        b.Eol = "\n";
+    Flush(&b);
+
+    if ((fflush(b.Out) != 0) || ferror(b.Out) ||
+        ((b.Out != stdout) && (fclose(b.Out) != 0)))
+        ErrExit("Cannot write %s", OutName ? OutName : "standard output");
+    E86TracePhase("reblock", InName, Start, E86TraceNow(), b.CharsIn,
+                  b.CharsOut, b.LinesOut);
+
+    Before = E86HexDownloadTime(&Opts, b.CharsIn, b.LinesIn);
+    After  = E86HexDownloadTime(&Opts, b.CharsOut, b.LinesOut);
+    fprintf(Msgs, "%s: %u data bytes, %u records (%u chars) in, %u records "
+            "(%u chars) out.\n", InName, b.Bytes, b.LinesIn, b.CharsIn,
+            b.LinesOut, b.CharsOut);
+    fprintf(Msgs, "Estimated download time at %u baud, %u byte records: "
+            "%.1f seconds, was %.1f.\n", Opts.Baud, Opts.RecordLength,
+            After, Before);
+
+    E86TraceClose(Msgs);
+    return 0;
+}
@@ -0,0 +1,509 @@
+/******************************************************************************
+ *                                                                            *
+ *     HEXCHECK.C                                                             *
+ *                                                                            *
+ *     Validates Intel hex files before they are flashed.  Every record is    *
+ *     decoded and its checksum checked, and the records MakeHex writes are   *
+ *     understood: data (00), end of file (01), segment (02), start address   *
+ *     (03) and the AMD LPD header of relocatable files, which is a long      *
+ *     segment record.  The extended linear address (04) and linear start     *
+ *     (05) records other tools write are accepted too.                       *
+ *                                                                            *
+ *     A good file is summed up with the address ranges its data covers;      *
+ *     for a bad one the first error is given as file:line:column, as         *
+ *     compilers do.  Lines may end in LF or CRLF.                            *
+ *                                                                            *
+ *     Usage: hexcheck [options] <file>...                                    *
+ *                                                                            *
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "e86hex.h"
+#include "hexkern.h"
+#include "e86trace.h"
+
+#define MAXBYTES    (5 + 255)   // Length, address, type, data, checksum
+#define LPDLENGTH   (2 + 8 + 2 + 4 * 4)
+#define EOFCHAR     0x1A        // DOS end of file, allowed after the end
+#define MAXTYPES    6
+
+typedef struct {
+    DWORD Start;
+    DWORD End;                  // One past the last byte
+} RANGE;
+
+typedef struct {
+    const char * Name;
+    DWORD   Line;               // Where the first error is
+    DWORD   Column;
+    char    Error[160];
+    DWORD   Records[MAXTYPES];
+    DWORD   DataBytes;
+    DWORD   CRLFLines;
+    DWORD   LFLines;
+    RANGE * Ranges;
+    DWORD   NumRanges;
+    DWORD   MaxRanges;
+    DWORD   Overlap;            // Bytes loaded more than once
+    BOOL    HaveStart;
+    WORD    StartSegment;
+    WORD    StartOffset;
+    BOOL    HaveLinearStart;
+    DWORD   LinearStart;
+    BOOL    HaveLPD;
+    BYTE    LPD[LPDLENGTH];
+} CHECK;
+
+BOOL   Quiet = FALSE;
+BOOL   ShowStats = FALSE;
+char * TraceName = 0;
+
+//////////////////////////////////////////////////////////////////////////
+// ShowHelp() lists the options.
+//
+static void ShowHelp(void)
+{
+    printf(
+"\nUsage: hexcheck [options] <file>...\n\n"
+"    Checks Intel hex files record by record, and shows the address\n"
+"    ranges each one loads, or the first error as file:line:column.\n"
+"    A file name of - reads standard input.  The exit status is 1 if\n"
+"    any file is bad.\n\n"
+"    --quiet          Only show errors\n"
+"    --stats          Show how long each phase took\n"
+"    --trace=<file>   Write each phase to <file> as Chrome trace events\n\n");
+    exit(2);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Fail() records the first error found in a file.  Returns FALSE, so
+// that callers can return it.
+//
+static BOOL Fail(CHECK * c, DWORD Line, DWORD Column, const char * s, ...)
+{
+    va_list ap;
+
+    c->Line   = Line;
+    c->Column = Column;
+    va_start(ap, s);
+    vsnprintf(c->Error, sizeof(c->Error), s, ap);
+    va_end(ap);
+    return FALSE;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// AddRange() notes Length bytes loaded from linear address Start on,
+// extending the last range when they follow on from it, as they
+// usually do.
+//
+static BOOL AddRange(CHECK * c, DWORD Start, DWORD Length)
+{
+    RANGE * Last = c->NumRanges ? &c->Ranges[c->NumRanges - 1] : 0;
+
+    if (Length == 0)
+        return TRUE;
+    if ((Last != 0) && (Last->End == Start))
+    {
+        Last->End += Length;
+        return TRUE;
+    }
+
+    if (c->NumRanges == c->MaxRanges)
+    {
+        c->MaxRanges = c->MaxRanges ? 2 * c->MaxRanges : 64;
+        if ((Last = realloc(c->Ranges, c->MaxRanges * sizeof(RANGE))) == 0)
+            return FALSE;
+        c->Ranges = Last;
+    }
+    c->Ranges[c->NumRanges].Start = Start;
+    c->Ranges[c->NumRanges].End   = Start + Length;
+    c->NumRanges++;
+    return TRUE;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// CompareRange() orders ranges by start address for qsort().
+//
+static int CompareRange(const void * a, const void * b)
+{
+    DWORD x = ((const RANGE *)a)->Start;
+    DWORD y = ((const RANGE *)b)->Start;
+
+    return (x > y) - (x < y);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// MergeRanges() sorts the ranges and joins those which touch, counting
+// the bytes which load over others.
+//
+static void MergeRanges(CHECK * c)
+{
+    DWORD i;
+    DWORD n = 0;
+    DWORD End;
+
+    if (c->NumRanges == 0)
+        return;
+
+    qsort(c->Ranges, c->NumRanges, sizeof(RANGE), CompareRange);
+    for (i = 1; i < c->NumRanges; i++)
+    {
+        if (c->Ranges[i].Start <= c->Ranges[n].End)
+        {
+            End = c->Ranges[i].End;
+            if (End > c->Ranges[n].End)
+            {
+                c->Overlap += c->Ranges[n].End - c->Ranges[i].Start;
+                c->Ranges[n].End = End;
+            }
+            else
+                c->Overlap += End - c->Ranges[i].Start;
+        }
+        else
+            c->Ranges[++n] = c->Ranges[i];
+    }
+    c->NumRanges = n + 1;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// GetWord() and GetDWord() read the big endian fields hex records hold.
+//
+static WORD GetWord(const BYTE * p)
+{
+    return (WORD)((p[0] << 8) | p[1]);
+}
+
+static DWORD GetDWord(const BYTE * p)
+{
+    return ((DWORD)GetWord(p) << 16) | GetWord(p + 2);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// CheckText() checks the Length characters of a hex file at Text.
+// Returns FALSE, with the error recorded in c, at the first error.
+//
+static BOOL CheckText(CHECK * c, const char * Text, DWORD Length)
+{
+    BYTE         Bytes[MAXBYTES];
+    const char * Rec;
+    const char * NewLine;
+    DWORD        Pos = 0;
+    DWORD        Line = 0;
+    DWORD        Len;
+    DWORD        Count;
+    DWORD        Done;
+    DWORD        Base = 0;
+    DWORD        Addr;
+    BYTE         Sum;
+    BYTE         Type;
+    BOOL         SeenEOF = FALSE;
+
+    while (Pos < Length)
+    {
+        Line++;
+        Rec = Text + Pos;
+        if ((NewLine = memchr(Rec, '\n', Length - Pos)) != 0)
+        {
+            Len  = NewLine - Rec;
+            Pos += Len + 1;
+            if ((Len > 0) && (Rec[Len - 1] == '\r'))
+            {
+                Len--;
+                c->CRLFLines++;
+            }
+            else
+                c->LFLines++;
+        }
+        else
+        {
+            Len = Length - Pos;
+            Pos = Length;
+        }
+
+        if (SeenEOF)
+        {
+            if ((Len == 0) || ((Len == 1) && (Rec[0] == EOFCHAR)))
+                continue;
+            return Fail(c, Line, 1, "text after the end of file record");
+        }
+
+        if ((Len == 0) || (Rec[0] != ':'))
+            return Fail(c, Line, 1, "record does not start with ':'");
+        if (Len < 1 + 2 * 5)
+            return Fail(c, Line, Len + 1, "record is too short");
+        if (((Len - 1) & 1) != 0)
+            return Fail(c, Line, Len, "odd number of hex digits");
+        if ((Count = (Len - 1) / 2) > MAXBYTES)
+            return Fail(c, Line, 2 * MAXBYTES + 2, "record is too long");
+
+        if ((Done = HexDecode(Rec + 1, Count, Bytes, &Sum)) != 2 * Count)
+            return Fail(c, Line, Done + 2, (Rec[Done + 1] == '\r') ?
+                        "carriage return inside a record" :
+                        "'%c' is not a hex digit", Rec[Done + 1]);
+
+        if (Bytes[0] != Count - 5)
+            return Fail(c, Line, 2, "record length %02X, but %u data bytes",
+                        Bytes[0], Count - 5);
+        if (Sum != 0)
+            return Fail(c, Line, Len - 1, "checksum %02X, should be %02X",
+                        Bytes[Count - 1], (BYTE)(Bytes[Count - 1] - Sum));
+
+        Type = Bytes[3];
+        Addr = GetWord(Bytes + 1);
+        switch (Type)
+        {
+            case 0:
+                //
+                // Within a segment the offset wraps around at 64K.
+                //
+                if (Addr + Bytes[0] > 0x10000L)
+                {
+                    Done = 0x10000L - Addr;
+                    if (!AddRange(c, Base + Addr, Done) ||
+                        !AddRange(c, Base, Bytes[0] - Done))
+                        return Fail(c, Line, 1, "out of memory");
+                }
+                else if (!AddRange(c, Base + Addr, Bytes[0]))
+                    return Fail(c, Line, 1, "out of memory");
+                c->DataBytes += Bytes[0];
+                break;
+
+            case 1:
+                if (Bytes[0] != 0)
+                    return Fail(c, Line, 2, "end of file record with data");
+                SeenEOF = TRUE;
+                break;
+
+            case 2:
+                if ((Bytes[0] == LPDLENGTH) &&
+                    (memcmp(Bytes + 6, "AMD LPD ", 8) == 0))
+                {
+                    if (c->HaveLPD)
+                        return Fail(c, Line, 1, "second AMD LPD header");
+                    c->HaveLPD = TRUE;
+                    memcpy(c->LPD, Bytes + 4, LPDLENGTH);
+                }
+                else if (Bytes[0] != 2)
+                    return Fail(c, Line, 2, "segment record of %u bytes",
+                                Bytes[0]);
+                Base = (DWORD)GetWord(Bytes + 4) << 4;
+                break;
+
+            case 3:
+                if (Bytes[0] != 4)
+                    return Fail(c, Line, 2, "start record of %u bytes",
+                                Bytes[0]);
+                c->HaveStart    = TRUE;
+                c->StartSegment = GetWord(Bytes + 4);
+                c->StartOffset  = GetWord(Bytes + 6);
+                break;
+
+            case 4:
+                if (Bytes[0] != 2)
+                    return Fail(c, Line, 2,
+                                "linear address record of %u bytes", Bytes[0]);
+                Base = (DWORD)GetWord(Bytes + 4) << 16;
+                break;
+
+            case 5:
+                if (Bytes[0] != 4)
+                    return Fail(c, Line, 2, "linear start record of %u bytes",
+                                Bytes[0]);
+                c->HaveLinearStart = TRUE;
+                c->LinearStart     = GetDWord(Bytes + 4);
+                break;
+
+            default:
+                return Fail(c, Line, 8, "unknown record type %02X", Type);
+        }
+        c->Records[Type]++;
+    }
+
+    if (!SeenEOF)
+        return Fail(c, Line + 1, 1, "no end of file record");
+    return TRUE;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Report() prints what was found in a good file.
+//
+static void Report(CHECK * c)
+{
+    DWORD Total = 0;
+    DWORD i;
+
+    for (i = 0; i < MAXTYPES; i++)
+        Total += c->Records[i];
+
+    printf("%s: OK, %u records (%u data, %u segment, %u start, %u end), "
+           "%u data bytes, %s\n", c->Name, Total, c->Records[0],
+           c->Records[2] + c->Records[4], c->Records[3] + c->Records[5],
+           c->Records[1], c->DataBytes,
+           !c->CRLFLines ? "LF" : c->LFLines ? "mixed line ends" : "CRLF");
+
+    if (c->HaveLPD)
+        printf("    AMD LPD header: %u paragraphs, stack %04X:%04X, "
+               "program %X bytes, relocations to %X, end %X\n",
+               GetWord(c->LPD + 10), GetWord(c->LPD + 12),
+               GetWord(c->LPD + 14), GetDWord(c->LPD + 16),
+               GetDWord(c->LPD + 20), GetDWord(c->LPD + 24));
+    if (c->HaveStart)
+        printf("    Start address %04X:%04X\n", c->StartSegment,
+               c->StartOffset);
+    if (c->HaveLinearStart)
+        printf("    Start address %08X\n", c->LinearStart);
+
+    for (i = 0; i < c->NumRanges; i++)
+        printf("    %05X-%05X  %u bytes\n", c->Ranges[i].Start,
+               c->Ranges[i].End - 1, c->Ranges[i].End - c->Ranges[i].Start);
+    if (c->Overlap != 0)
+        printf("    %u bytes are loaded more than once\n", c->Overlap);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// ReadAll() reads all of fd into memory, for input which cannot be
+// mapped.  Returns 0 if out of memory or on a read error.
+//
+static char * ReadAll(int fd, DWORD * Length)
+{
+    char *  Text = 0;
+    char *  New;
+    DWORD   Size = 0;
+    ssize_t n;
+
+    *Length = 0;
+    for (;;)
+    {
+        if (*Length == Size)
+        {
+            Size = Size ? 2 * Size : 0x10000L;
+            if ((New = realloc(Text, Size)) == 0)
+                break;
+            Text = New;
+        }
+        if ((n = read(fd, Text + *Length, Size - *Length)) == 0)
+            return Text;
+        if (n < 0)
+            break;
+        *Length += n;
+    }
+    free(Text);
+    return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// CheckFile() checks one file, and prints the outcome.  Returns FALSE
+// if it is bad or cannot be read.
+//
+static BOOL CheckFile(const char * Name)
+{
+    CHECK       c;
+    struct stat st;
+    char *      Text = 0;
+    DWORD       Length = 0;
+    BOOL        Mapped = FALSE;
+    BOOL        Good;
+    int         fd;
+    double      Start = E86TraceNow();
+    DWORD       Records = 0;
+    DWORD       i;
+
+    memset(&c, 0, sizeof(c));
+    c.Name = Name;
+
+    if (strcmp(Name, "-") == 0)
+        fd = 0;
+    else if ((fd = open(Name, O_RDONLY)) < 0)
+    {
+        fprintf(stderr, "%s: cannot open\n", Name);
+        return FALSE;
+    }
+
+    if ((fd != 0) && (fstat(fd, &st) == 0) && S_ISREG(st.st_mode) &&
+        (st.st_size > 0) && (st.st_size < 0xFFFFFFFFL))
+    {
+        Length = st.st_size;
+        Text   = mmap(0, Length, PROT_READ, MAP_PRIVATE, fd, 0);
+        Mapped = (Text != MAP_FAILED);
+        if (!Mapped)
+            Text = 0;
+    }
+    if (!Mapped)
+        Text = ReadAll(fd, &Length);
+    if (fd != 0)
+        close(fd);
+    if (Text == 0)
+    {
+        fprintf(stderr, "%s: cannot read\n", Name);
+        return FALSE;
+    }
+    E86TracePhase("read", Name, Start, E86TraceNow(), Length, 0, 0);
+
+    Start = E86TraceNow();
+    Good  = CheckText(&c, Text, Length);
+    MergeRanges(&c);
+    for (i = 0; i < MAXTYPES; i++)
+        Records += c.Records[i];
+    E86TracePhase("check", Name, Start, E86TraceNow(), Length, 0, Records);
+
+    if (!Good)
+        fprintf(stderr, "%s:%u:%u: %s\n", Name, c.Line, c.Column, c.Error);
+    else if (!Quiet)
+        Report(&c);
+
+    if (Mapped)
+        munmap(Text, Length);
+    else
+        free(Text);
+    free(c.Ranges);
+    return Good;
+}
+
+int main(int argc, char * argv[])
+{
+    int Files = 0;
+    int Bad = 0;
+    int i;
+
+    for (i = 1; i < argc; i++)
+        if (strncmp(argv[i], "--", 2) == 0)
+        {
+            if (strcmp(argv[i], "--quiet") == 0)
+                Quiet = TRUE;
+            else if (strcmp(argv[i], "--stats") == 0)
+                ShowStats = TRUE;
+            else if ((strncmp(argv[i], "--trace=", 8) == 0) &&
+                     (argv[i][8] != 0))
+                TraceName = argv[i] + 8;
+            else
+                ShowHelp();
+        }
+        else
+            Files++;
+
+    if (Files == 0)
+        ShowHelp();
+
+    if ((ShowStats || (TraceName != 0)) &&
+        (E86TraceOpen(TraceName, ShowStats) != 0))
+    {
+        fprintf(stderr, "hexcheck: cannot create trace file %s\n",
+                TraceName);
+        return 2;
+    }
+
+    for (i = 1; i < argc; i++)
+        if (strncmp(argv[i], "--", 2) != 0)
+            if (!CheckFile(argv[i]))
+                Bad++;
+
+    E86TraceClose(stdout);
+    return Bad ? 1 : 0;
+}
@@ -0,0 +1,496 @@
+/******************************************************************************
+ *                                                                            *
+ *     HEXDIFF.C                                                              *
+ *                                                                            *
+ *     Compares two Intel hex files by what they load, not by their text,     *
+ *     so that record length, record order and segment records make no        *
+ *     difference.  Each file is decoded into a sparse map of the address     *
+ *     space, as E86MAP.H describes: a sorted list of intervals, each         *
+ *     pointing at the bytes it holds.  The two lists are then walked         *
+ *     together, once, and the byte ranges which changed, were added or       *
+ *     were removed are reported.                                             *
+ *                                                                            *
+ *     Relocatable (AMD LPD) files are read as E86LPD.H describes as well.    *
+ *     Their header fields and relocation lists are compared on their own,    *
+ *     and the relocation block is left out of the byte comparison, so that   *
+ *     one more relocation shows as such rather than as a block of changed    *
+ *     bytes.  Start addresses are compared for every kind of file.           *
+ *                                                                            *
+ *     As with diff, the exit status is 0 if the files load the same, 1 if    *
+ *     they differ and 2 if one of them cannot be read.                       *
+ *                                                                            *
+ *     Usage: hexdiff [options] <old> <new>                                   *
+ *                                                                            *
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "e86map.h"
+#include "hexkern.h"
+#include "e86trace.h"
+
+#define MAXSHOWN    16          // Bytes --bytes shows of a range
+
+//
+// Kinds of difference, for Emit().
+//
+#define CHANGED     0
+#define ADDED       1
+#define REMOVED     2
+
+typedef struct {
+    const char * Name;
+    E86MAP  Map;
+    LPDWORD Relocs;             // Sorted, if Map.Relocatable
+} HEXFILE;
+
+typedef struct {
+    int     Kind;
+    DWORD   Start;
+    DWORD   End;
+} RUN;
+
+HEXFILE Maps[2];
+RUN    Pending = { -1, 0, 0 };
+DWORD  Runs[3];
+DWORD  RunBytes[3];
+
+BOOL   Brief = FALSE;
+BOOL   ShowBytes = FALSE;
+BOOL   ShowStats = FALSE;
+char * TraceName = 0;
+
+static const char * const KindNames[] = { "changed", "added", "removed" };
+
+//////////////////////////////////////////////////////////////////////////
+// ShowHelp() lists the options.
+//
+static void ShowHelp(void)
+{
+    printf(
+"\nUsage: hexdiff [options] <old> <new>\n\n"
+"    Compares what two Intel hex files load, whatever their record length,\n"
+"    record order or segment records, and lists the byte ranges which\n"
+"    changed, were added or were removed.  For relocatable (AMD LPD) files\n"
+"    the header fields and relocations are compared too.  The exit status\n"
+"    is 0 if they load the same, 1 if not, and 2 on an error.\n\n"
+"    --brief          Only show the totals\n"
+"    --bytes          Show the old and new bytes of each range\n"
+"    --stats          Show how long each phase took\n"
+"    --trace=<file>   Write each phase to <file> as Chrome trace events\n\n");
+    exit(2);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// CompareReloc() orders relocations for qsort().
+//
+static int CompareReloc(const void * a, const void * b)
+{
+    DWORD x = *(const DWORD *)a;
+    DWORD y = *(const DWORD *)b;
+
+    return (x > y) - (x < y);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// SplitRelocations() takes the relocation block of a relocatable file
+// out of its map, and reads the relocations from it as E86LPD.H
+// describes: bytes no record loaded count as zero, and the padding at
+// the end is dropped.  The image ends where the map then does.
+//
+static BOOL SplitRelocations(HEXFILE * f)
+{
+    E86MAP * Map = &f->Map;
+    E86LPD * Lpd = &Map->Lpd;
+    DWORD    Count = (Lpd->ReloEnd - Lpd->ProgLength) / 4;
+    E86RANGE * r;
+    LPBYTE   Block;
+    LPBYTE   p;
+    DWORD    Start;
+    DWORD    End;
+    DWORD    i;
+
+    if (((Block = calloc(Count + 1, 4)) == 0) ||
+        ((f->Relocs = malloc((Count + 1) * sizeof(DWORD))) == 0))
+    {
+        strcpy(Map->Error, "out of memory");
+        return FALSE;
+    }
+
+    for (i = E86MapFind(Map, Lpd->ProgLength) - Map->Ranges;
+         (i < Map->NumRanges) && (Map->Ranges[i].Start < Lpd->ReloEnd); i++)
+    {
+        r     = &Map->Ranges[i];
+        Start = (r->Start > Lpd->ProgLength) ? r->Start : Lpd->ProgLength;
+        End   = (r->End < Lpd->ReloEnd) ? r->End : Lpd->ReloEnd;
+        memcpy(Block + (Start - Lpd->ProgLength),
+               Map->Data + r->Offset + (Start - r->Start), End - Start);
+    }
+
+    for (i = 0, p = Block; i < Count; i++, p += 4)
+        f->Relocs[i] = p[0] | (p[1] << 8) | ((DWORD)p[2] << 16) |
+                       ((DWORD)p[3] << 24);
+    free(Block);
+    while ((Count > 0) &&
+           (f->Relocs[Count - 1] == (Lpd->ProgLength & (E86LPD_WRAP - 1))))
+        Count--;
+    Lpd->Relocations = Count;
+    qsort(f->Relocs, Count, sizeof(DWORD), CompareReloc);
+
+    while ((Map->NumRanges > 0) &&
+           (Map->Ranges[Map->NumRanges - 1].Start >= Lpd->ProgLength))
+        Map->NumRanges--;
+    if (Map->NumRanges > 0)
+    {
+        r = &Map->Ranges[Map->NumRanges - 1];
+        if (r->End > Lpd->ProgLength)
+            r->End = Lpd->ProgLength;
+        Lpd->ImageLength = r->End;
+    }
+    return TRUE;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// ReadMap() reads a hex file into its map.  Runs on a thread of its own
+// for the old file.
+//
+static void * ReadMap(void * Arg)
+{
+    HEXFILE * f = Arg;
+    double    Start = E86TraceNow();
+
+    if ((E86MapRead(&f->Map, f->Name) == 0) &&
+        (!f->Map.Relocatable || SplitRelocations(f)))
+        E86TracePhase("parse", f->Name, Start, E86TraceNow(),
+                      f->Map.TextLength, f->Map.DataLength,
+                      f->Map.NumRanges);
+    return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// ShowRange() prints the bytes a file loads from Start on, up to
+// MAXSHOWN of them, for --bytes.
+//
+static void ShowRange(char Sign, const HEXFILE * f, DWORD Start, DWORD End)
+{
+    const E86RANGE * r = E86MapFind(&f->Map, Start);
+    DWORD            i;
+
+    printf("  %c", Sign);
+    for (i = Start; (i < End) && (i < Start + MAXSHOWN); i++)
+    {
+        while (r->End <= i)
+            r++;
+        printf(" %02X", f->Map.Data[r->Offset + (i - r->Start)]);
+    }
+    printf("%s\n", (End - Start > MAXSHOWN) ? " ..." : "");
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Flush() prints the pending run.
+//
+static void Flush(void)
+{
+    if (Pending.Kind < 0)
+        return;
+
+    Runs[Pending.Kind]++;
+    RunBytes[Pending.Kind] += Pending.End - Pending.Start;
+    if (!Brief)
+    {
+        printf("%-8s %08X-%08X (%u bytes)\n", KindNames[Pending.Kind],
+               Pending.Start, Pending.End - 1, Pending.End - Pending.Start);
+        if (ShowBytes && (Pending.Kind != ADDED))
+            ShowRange('-', &Maps[0], Pending.Start, Pending.End);
+        if (ShowBytes && (Pending.Kind != REMOVED))
+            ShowRange('+', &Maps[1], Pending.Start, Pending.End);
+    }
+    Pending.Kind = -1;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Emit() adds Start to End to the pending run if it is of the same kind
+// and follows on from it, or else prints the pending run and starts
+// another.
+//
+static void Emit(int Kind, DWORD Start, DWORD End)
+{
+    if ((Pending.Kind == Kind) && (Pending.End == Start))
+    {
+        Pending.End = End;
+        return;
+    }
+    Flush();
+    Pending.Kind  = Kind;
+    Pending.Start = Start;
+    Pending.End   = End;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// CompareBytes() emits the runs of changed bytes between the Length
+// bytes at Old and New, which load from Start on.  Equal stretches are
+// skipped a block at a time.
+//
+static void CompareBytes(const BYTE * Old, const BYTE * New, DWORD Length,
+                         DWORD Start)
+{
+    DWORD i = 0;
+    DWORD j;
+
+    while (i < Length)
+    {
+        while ((i + 64 <= Length) && (memcmp(Old + i, New + i, 64) == 0))
+            i += 64;
+        while ((i < Length) && (Old[i] == New[i]))
+            i++;
+        if (i == Length)
+            break;
+
+        for (j = i + 1; (j < Length) && (Old[j] != New[j]); j++)
+            ;
+        Emit(CHANGED, Start + i, Start + j);
+        i = j;
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+// DiffMaps() walks the two maps together, from the lowest address up,
+// emitting what changed, what only the new one loads and what only the
+// old one does.
+//
+static void DiffMaps(HEXFILE * a, HEXFILE * b)
+{
+    DWORD      i = 0;
+    DWORD      j = 0;
+    DWORD      At = 0;
+    DWORD      AStart;
+    DWORD      BStart;
+    DWORD      End;
+    E86RANGE * ra;
+    E86RANGE * rb;
+
+    for (;;)
+    {
+        while ((i < a->Map.NumRanges) && (a->Map.Ranges[i].End <= At))
+            i++;
+        while ((j < b->Map.NumRanges) && (b->Map.Ranges[j].End <= At))
+            j++;
+        if ((i == a->Map.NumRanges) && (j == b->Map.NumRanges))
+            break;
+
+        ra = (i < a->Map.NumRanges) ? &a->Map.Ranges[i] : 0;
+        rb = (j < b->Map.NumRanges) ? &b->Map.Ranges[j] : 0;
+        AStart = ra ? ((ra->Start > At) ? ra->Start : At) : 0xFFFFFFFFL;
+        BStart = rb ? ((rb->Start > At) ? rb->Start : At) : 0xFFFFFFFFL;
+
+        if (ra && rb && (AStart == BStart))
+        {
+            End = (ra->End < rb->End) ? ra->End : rb->End;
+            CompareBytes(a->Map.Data + ra->Offset + (AStart - ra->Start),
+                         b->Map.Data + rb->Offset + (BStart - rb->Start),
+                         End - AStart, AStart);
+            At = End;
+        }
+        else if (ra && (AStart < BStart))
+        {
+            End = (ra->End < BStart) ? ra->End : BStart;
+            Emit(REMOVED, AStart, End);
+            At = End;
+        }
+        else
+        {
+            End = (ra && (AStart < rb->End)) ? AStart : rb->End;
+            Emit(ADDED, BStart, End);
+            At = End;
+        }
+    }
+    Flush();
+}
+
+//////////////////////////////////////////////////////////////////////////
+// DiffRelocations() merges the two sorted relocation lists, printing
+// those only one of them has.  Returns how many differ.
+//
+static DWORD DiffRelocations(HEXFILE * a, HEXFILE * b)
+{
+    DWORD i = 0;
+    DWORD j = 0;
+    DWORD Added = 0;
+    DWORD Removed = 0;
+    DWORD na = a->Map.Relocatable ? a->Map.Lpd.Relocations : 0;
+    DWORD nb = b->Map.Relocatable ? b->Map.Lpd.Relocations : 0;
+
+    while ((i < na) || (j < nb))
+        if ((j == nb) || ((i < na) && (a->Relocs[i] < b->Relocs[j])))
+        {
+            if (!Brief)
+                printf("-reloc   %08X\n", a->Relocs[i]);
+            Removed++;
+            i++;
+        }
+        else if ((i == na) || (b->Relocs[j] < a->Relocs[i]))
+        {
+            if (!Brief)
+                printf("+reloc   %08X\n", b->Relocs[j]);
+            Added++;
+            j++;
+        }
+        else
+        {
+            i++;
+            j++;
+        }
+
+    if (Brief && (Added + Removed != 0))
+        printf("relocations: %u added, %u removed\n", Added, Removed);
+    return Added + Removed;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// DiffText() prints a header field which changed.  Returns 1 if it did.
+//
+static int DiffText(const char * Field, const char * Old, const char * New)
+{
+    if (strcmp(Old, New) == 0)
+        return 0;
+    if (!Brief)
+        printf("%-8s %s %s -> %s\n", "header", Field, Old, New);
+    return 1;
+}
+
+static int DiffField(const char * Field, DWORD Old, DWORD New)
+{
+    char OldText[16];
+    char NewText[16];
+
+    sprintf(OldText, "%X", Old);
+    sprintf(NewText, "%X", New);
+    return DiffText(Field, OldText, NewText);
+}
+
+static int DiffAddress(const char * Field, BOOL HaveOld, DWORD Old,
+                       BOOL HaveNew, DWORD New)
+{
+    char OldText[16] = "none";
+    char NewText[16] = "none";
+
+    if (HaveOld)
+        sprintf(OldText, "%04X:%04X", Old >> 16, Old & 0xFFFF);
+    if (HaveNew)
+        sprintf(NewText, "%04X:%04X", New >> 16, New & 0xFFFF);
+    return DiffText(Field, OldText, NewText);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// DiffHeaders() compares the kind of file, the start addresses and, for
+// relocatable files, what the AMD LPD header says of the program.  The
+// lengths it holds are rounded up to whole records, so the image length
+// and extra paragraphs are compared in their place.  Returns how many
+// differ.
+//
+static int DiffHeaders(HEXFILE * a, HEXFILE * b)
+{
+    char OldLinear[16] = "none";
+    char NewLinear[16] = "none";
+    int  n;
+
+    n = DiffText("kind", a->Map.Relocatable ? "relocatable" : "absolute",
+                 b->Map.Relocatable ? "relocatable" : "absolute");
+    n += DiffAddress("start", a->Map.HaveStart,
+                     ((DWORD)a->Map.StartSegment << 16) | a->Map.StartOffset,
+                     b->Map.HaveStart,
+                     ((DWORD)b->Map.StartSegment << 16) | b->Map.StartOffset);
+    if (a->Map.HaveLinearStart)
+        sprintf(OldLinear, "%08X", a->Map.LinearStart);
+    if (b->Map.HaveLinearStart)
+        sprintf(NewLinear, "%08X", b->Map.LinearStart);
+    n += DiffText("linear start", OldLinear, NewLinear);
+
+    if (a->Map.Relocatable && b->Map.Relocatable)
+    {
+        n += DiffField("image length", a->Map.Lpd.ImageLength,
+                       b->Map.Lpd.ImageLength);
+        n += DiffField("extra paragraphs", E86LpdExtra(&a->Map.Lpd),
+                       E86LpdExtra(&b->Map.Lpd));
+        n += DiffAddress("stack", TRUE,
+                         ((DWORD)a->Map.Lpd.StackSegment << 16) |
+                         a->Map.Lpd.StackOffset, TRUE,
+                         ((DWORD)b->Map.Lpd.StackSegment << 16) |
+                         b->Map.Lpd.StackOffset);
+    }
+    return n;
+}
+
+int main(int argc, char * argv[])
+{
+    pthread_t Thread;
+    BOOL      Threaded;
+    int       Files = 0;
+    int       Headers;
+    DWORD     Relocs;
+    double    Start;
+    int       i;
+
+    for (i = 1; i < argc; i++)
+        if ((strncmp(argv[i], "--", 2) != 0) && (Files < 2))
+            Maps[Files++].Name = argv[i];
+        else if (strcmp(argv[i], "--brief") == 0)
+            Brief = TRUE;
+        else if (strcmp(argv[i], "--bytes") == 0)
+            ShowBytes = TRUE;
+        else if (strcmp(argv[i], "--stats") == 0)
+            ShowStats = TRUE;
+        else if ((strncmp(argv[i], "--trace=", 8) == 0) && (argv[i][8] != 0))
+            TraceName = argv[i] + 8;
+        else
+            ShowHelp();
+
+    if (Files != 2)
+        ShowHelp();
+
+    if ((ShowStats || (TraceName != 0)) &&
+        (E86TraceOpen(TraceName, ShowStats) != 0))
+    {
+        fprintf(stderr, "hexdiff: cannot create trace file %s\n", TraceName);
+        return 2;
+    }
+
+    Threaded = (pthread_create(&Thread, 0, ReadMap, &Maps[0]) == 0);
+    if (!Threaded)
+        ReadMap(&Maps[0]);
+    ReadMap(&Maps[1]);
+    if (Threaded)
+        pthread_join(Thread, 0);
+
+    for (i = 0; i < 2; i++)
+        if (Maps[i].Map.Error[0] != 0)
+        {
+            fprintf(stderr, "%s: %s\n", Maps[i].Name, Maps[i].Map.Error);
+            return 2;
+        }
+    for (i = 0; i < 2; i++)
+        if (Maps[i].Map.Overlap != 0)
+            fprintf(stderr, "%s: %u bytes loaded more than once; the record "
+                    "which starts later is used\n", Maps[i].Name, Maps[i].Map.Overlap);
+
+    Start = E86TraceNow();
+    if (!Brief)
+        printf("--- %s\n+++ %s\n", Maps[0].Name, Maps[1].Name);
+    Headers = DiffHeaders(&Maps[0], &Maps[1]);
+    DiffMaps(&Maps[0], &Maps[1]);
+    Relocs = DiffRelocations(&Maps[0], &Maps[1]);
+    E86TracePhase("diff", 0, Start, E86TraceNow(),
+                  Maps[0].Map.DataLength + Maps[1].Map.DataLength, 0,
+                  Runs[CHANGED] + Runs[ADDED] + Runs[REMOVED]);
+
+    printf("%u bytes changed in %u ranges, %u added in %u, %u removed in "
+           "%u; %u relocations and %d header fields differ\n",
+           RunBytes[CHANGED], Runs[CHANGED], RunBytes[ADDED], Runs[ADDED],
+           RunBytes[REMOVED], Runs[REMOVED], Relocs, Headers);
+
+    E86TraceClose(stdout);
+    return (Headers || Relocs || Runs[CHANGED] || Runs[ADDED] ||
+            Runs[REMOVED]) ? 1 : 0;
+}
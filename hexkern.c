@@ -0,0 +1,866 @@
+/******************************************************************************
+ *                                                                            *
+ *     HEXKERN.C                                                              *
+ *                                                                            *
+ *     Data conversion kernels shared by the E86Mon utilities.                *
+ *                                                                            *
+ *     Each kernel exists as a portable C loop and, when compiled for x86     *
+ *     with GCC or clang, as SSE2, AVX2 and AVX-512 versions.  The best       *
+ *     version the CPU supports is chosen the first time a kernel is used.    *
+ *                                                                            *
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "hexkern.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HEXKERN_X86 1
+#include <immintrin.h>
+#endif
+
+typedef unsigned char (*ENCODEFN)(const unsigned char *, unsigned, char *);
+typedef int (*UNIFORMFN)(const unsigned char *, unsigned);
+typedef unsigned (*DECODEFN)(const char *, unsigned, unsigned char *,
+                             unsigned char *);
+typedef void (*SPLITFN)(const unsigned char *, unsigned, unsigned char *,
+                        unsigned char *, unsigned long *);
+typedef void (*INTERLEAVEFN)(const unsigned char *, const unsigned char *,
+                             unsigned, unsigned char *);
+
+static const char HexDigits[] = "0123456789ABCDEF";
+
+//////////////////////////////////////////////////////////////////////////
+// Portable versions.
+//
+static unsigned char EncodeScalar(const unsigned char * Src, unsigned Len,
+                                  char * Dst)
+{
+    unsigned char Sum = 0;
+
+    for ( ; Len > 0; Len--)
+    {
+        *(Dst++) = HexDigits[*Src >> 4];
+        *(Dst++) = HexDigits[*Src & 0xF];
+        Sum += *(Src++);
+    }
+    return Sum;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// NotHex() tells whether c is not a hex digit, without branching.  The
+// value of a hex digit is its low nibble, plus 9 for a letter.
+//
+static unsigned NotHex(char c)
+{
+    return ((unsigned char)(c - '0') >= 10) &
+           ((unsigned char)((c | 0x20) - 'a') >= 6);
+}
+
+#define HEXVALUE(c)  (((c) & 0xF) + 9 * (((c) >> 6) & 1))
+
+static unsigned DecodeScalar(const char * Src, unsigned Len,
+                             unsigned char * Dst, unsigned char * Sum)
+{
+    unsigned char s = 0;
+    unsigned      Bad = 0;
+    unsigned      i;
+
+    for (i = 0; i < Len; i++)
+    {
+        Bad |= NotHex(Src[2 * i]) | NotHex(Src[2 * i + 1]);
+        s   += (Dst[i] = (unsigned char)((HEXVALUE(Src[2 * i]) << 4) +
+                                         HEXVALUE(Src[2 * i + 1])));
+    }
+
+    //
+    // Bad input is rare, so it is only looked for once something is
+    // known to be wrong.
+    //
+    if (Bad)
+    {
+        for (i = 0; !NotHex(Src[i]); i++)
+            ;
+        for (s = 0, Len = 0; Len < i / 2; Len++)
+            s += Dst[Len];
+    }
+    else
+        i = 2 * Len;
+
+    *Sum = s;
+    return i;
+}
+
+static int UniformScalar(const unsigned char * Src, unsigned Len)
+{
+    unsigned i;
+
+    if (Len == 0)
+        return -1;
+    for (i = 1; i < Len; i++)
+        if (Src[i] != Src[0])
+            return -1;
+    return Src[0];
+}
+
+static void SplitScalar(const unsigned char * Src, unsigned Len,
+                        unsigned char * Even, unsigned char * Odd,
+                        unsigned long * Sums)
+{
+    for ( ; Len > 0; Len--, Src += 2)
+    {
+        Sums[0] += (*(Even++) = Src[0]);
+        Sums[1] += (*(Odd++)  = Src[1]);
+    }
+}
+
+static void InterleaveScalar(const unsigned char * Even,
+                             const unsigned char * Odd, unsigned Len,
+                             unsigned char * Dst)
+{
+    for ( ; Len > 0; Len--, Dst += 2)
+    {
+        Dst[0] = *(Even++);
+        Dst[1] = *(Odd++);
+    }
+}
+
+#ifdef HEXKERN_X86
+
+//////////////////////////////////////////////////////////////////////////
+// SSE2 versions.  Nibbles are turned into ASCII by adding '0', plus 7
+// more for the nibbles above 9, and the byte sum comes from PSADBW.
+//
+__attribute__((target("sse2")))
+static __m128i NibblesToAscii128(__m128i n)
+{
+    __m128i Letter = _mm_and_si128(_mm_cmpgt_epi8(n, _mm_set1_epi8(9)),
+                                   _mm_set1_epi8('A' - '0' - 10));
+    return _mm_add_epi8(_mm_add_epi8(n, _mm_set1_epi8('0')), Letter);
+}
+
+__attribute__((target("sse2")))
+static unsigned char EncodeSSE2(const unsigned char * Src, unsigned Len,
+                                char * Dst)
+{
+    __m128i Mask = _mm_set1_epi8(0x0F);
+    __m128i Sum  = _mm_setzero_si128();
+
+    for ( ; Len >= 16; Len -= 16, Src += 16, Dst += 32)
+    {
+        __m128i v  = _mm_loadu_si128((const __m128i *)Src);
+        __m128i Hi = NibblesToAscii128(_mm_and_si128(_mm_srli_epi16(v, 4),
+                                                     Mask));
+        __m128i Lo = NibblesToAscii128(_mm_and_si128(v, Mask));
+
+        _mm_storeu_si128((__m128i *)Dst,        _mm_unpacklo_epi8(Hi, Lo));
+        _mm_storeu_si128((__m128i *)(Dst + 16), _mm_unpackhi_epi8(Hi, Lo));
+        Sum = _mm_add_epi64(Sum, _mm_sad_epu8(v, _mm_setzero_si128()));
+    }
+
+    Sum = _mm_add_epi64(Sum, _mm_srli_si128(Sum, 8));
+    return (unsigned char)(_mm_cvtsi128_si32(Sum) +
+                           EncodeScalar(Src, Len, Dst));
+}
+
+//
+// Digits are decoded by subtracting '0', and letters by folding them to
+// lower case and subtracting 'a'; a character is valid if either result
+// is in range, which signed compares can tell as nothing above 0x7F
+// lands in range.  The nibble pairs are then merged within 16 bit words
+// and packed down to bytes.
+//
+__attribute__((target("sse2")))
+static __m128i AsciiToNibbles128(__m128i c, __m128i * Valid)
+{
+    __m128i d = _mm_sub_epi8(c, _mm_set1_epi8('0'));
+    __m128i l = _mm_sub_epi8(_mm_or_si128(c, _mm_set1_epi8(0x20)),
+                             _mm_set1_epi8('a'));
+    __m128i Digit  = _mm_and_si128(_mm_cmpgt_epi8(d, _mm_set1_epi8(-1)),
+                                   _mm_cmplt_epi8(d, _mm_set1_epi8(10)));
+    __m128i Letter = _mm_and_si128(_mm_cmpgt_epi8(l, _mm_set1_epi8(-1)),
+                                   _mm_cmplt_epi8(l, _mm_set1_epi8(6)));
+
+    *Valid = _mm_or_si128(Digit, Letter);
+    return _mm_or_si128(_mm_and_si128(Digit, d),
+                        _mm_and_si128(Letter,
+                                      _mm_add_epi8(l, _mm_set1_epi8(10))));
+}
+
+__attribute__((target("sse2")))
+static __m128i PairNibbles128(__m128i n)
+{
+    return _mm_or_si128(_mm_and_si128(_mm_slli_epi16(n, 4),
+                                      _mm_set1_epi16(0x00F0)),
+                        _mm_srli_epi16(n, 8));
+}
+
+__attribute__((target("sse2")))
+static unsigned DecodeSSE2(const char * Src, unsigned Len,
+                           unsigned char * Dst, unsigned char * Sum)
+{
+    __m128i  Total = _mm_setzero_si128();
+    __m128i  Va;
+    __m128i  Vb;
+    unsigned Done = 0;
+    unsigned Tail;
+
+    for ( ; Len >= 16; Len -= 16, Src += 32, Dst += 16, Done += 32)
+    {
+        __m128i a = AsciiToNibbles128(_mm_loadu_si128((const __m128i *)Src),
+                                      &Va);
+        __m128i b = AsciiToNibbles128(
+                        _mm_loadu_si128((const __m128i *)(Src + 16)), &Vb);
+        __m128i v;
+
+        // A block with a bad character is left to the scalar loop
+        if (_mm_movemask_epi8(_mm_and_si128(Va, Vb)) != 0xFFFF)
+            break;
+
+        v = _mm_packus_epi16(PairNibbles128(a), PairNibbles128(b));
+        _mm_storeu_si128((__m128i *)Dst, v);
+        Total = _mm_add_epi64(Total, _mm_sad_epu8(v, _mm_setzero_si128()));
+    }
+
+    //
+    // A short tail after a full block is decoded by one more block which
+    // overlaps the last, leaving the bytes already summed out of the sum.
+    //
+    if ((Len > 0) && (Len < 16) && (Done != 0))
+    {
+        __m128i a = AsciiToNibbles128(
+                        _mm_loadu_si128((const __m128i *)(Src + 2 * Len - 32)),
+                        &Va);
+        __m128i b = AsciiToNibbles128(
+                        _mm_loadu_si128((const __m128i *)(Src + 2 * Len - 16)),
+                        &Vb);
+        __m128i v;
+        __m128i New = _mm_cmpgt_epi8(
+                          _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7,
+                                        8, 9, 10, 11, 12, 13, 14, 15),
+                          _mm_set1_epi8((char)(15 - Len)));
+
+        if (_mm_movemask_epi8(_mm_and_si128(Va, Vb)) == 0xFFFF)
+        {
+            v = _mm_packus_epi16(PairNibbles128(a), PairNibbles128(b));
+            _mm_storeu_si128((__m128i *)(Dst + Len - 16), v);
+            Total = _mm_add_epi64(Total,
+                        _mm_sad_epu8(_mm_and_si128(v, New),
+                                     _mm_setzero_si128()));
+            Done += 2 * Len;
+            Len   = 0;
+        }
+    }
+
+    Total = _mm_add_epi64(Total, _mm_srli_si128(Total, 8));
+    Tail  = DecodeScalar(Src, Len, Dst, Sum);
+    *Sum += (unsigned char)_mm_cvtsi128_si32(Total);
+    return Done + Tail;
+}
+
+__attribute__((target("sse2")))
+static int UniformSSE2(const unsigned char * Src, unsigned Len)
+{
+    __m128i First;
+    unsigned i;
+
+    if (Len < 16)
+        return UniformScalar(Src, Len);
+
+    First = _mm_set1_epi8((char)Src[0]);
+    for (i = 0; i + 16 <= Len; i += 16)
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(
+                _mm_loadu_si128((const __m128i *)(Src + i)), First)) != 0xFFFF)
+            return -1;
+
+    // The tail is checked with one more, overlapping, load.
+    if ((i < Len) && (_mm_movemask_epi8(_mm_cmpeq_epi8(
+            _mm_loadu_si128((const __m128i *)(Src + Len - 16)), First))
+            != 0xFFFF))
+        return -1;
+    return Src[0];
+}
+
+//
+// Total128() adds up the two 64 bit sums PSADBW leaves in v.
+//
+__attribute__((target("sse2")))
+static unsigned long Total128(__m128i v)
+{
+    unsigned long long q[2];
+
+    _mm_storeu_si128((__m128i *)q, v);
+    return (unsigned long)(q[0] + q[1]);
+}
+
+//
+// The lanes are split by masking (even) or shifting (odd) the 16 bit
+// words down to their low bytes and packing those; PACKUSWB cannot
+// saturate, as every word is below 256.
+//
+__attribute__((target("sse2")))
+static void SplitSSE2(const unsigned char * Src, unsigned Len,
+                      unsigned char * Even, unsigned char * Odd,
+                      unsigned long * Sums)
+{
+    __m128i Mask    = _mm_set1_epi16(0x00FF);
+    __m128i EvenSum = _mm_setzero_si128();
+    __m128i OddSum  = _mm_setzero_si128();
+
+    for ( ; Len >= 16; Len -= 16, Src += 32, Even += 16, Odd += 16)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i *)Src);
+        __m128i b = _mm_loadu_si128((const __m128i *)(Src + 16));
+        __m128i e = _mm_packus_epi16(_mm_and_si128(a, Mask),
+                                     _mm_and_si128(b, Mask));
+        __m128i o = _mm_packus_epi16(_mm_srli_epi16(a, 8),
+                                     _mm_srli_epi16(b, 8));
+
+        _mm_storeu_si128((__m128i *)Even, e);
+        _mm_storeu_si128((__m128i *)Odd,  o);
+        EvenSum = _mm_add_epi64(EvenSum, _mm_sad_epu8(e, _mm_setzero_si128()));
+        OddSum  = _mm_add_epi64(OddSum,  _mm_sad_epu8(o, _mm_setzero_si128()));
+    }
+
+    Sums[0] += Total128(EvenSum);
+    Sums[1] += Total128(OddSum);
+    SplitScalar(Src, Len, Even, Odd, Sums);
+}
+
+__attribute__((target("sse2")))
+static void InterleaveSSE2(const unsigned char * Even,
+                           const unsigned char * Odd, unsigned Len,
+                           unsigned char * Dst)
+{
+    for ( ; Len >= 16; Len -= 16, Even += 16, Odd += 16, Dst += 32)
+    {
+        __m128i e = _mm_loadu_si128((const __m128i *)Even);
+        __m128i o = _mm_loadu_si128((const __m128i *)Odd);
+
+        _mm_storeu_si128((__m128i *)Dst,        _mm_unpacklo_epi8(e, o));
+        _mm_storeu_si128((__m128i *)(Dst + 16), _mm_unpackhi_epi8(e, o));
+    }
+    InterleaveScalar(Even, Odd, Len, Dst);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// AVX2 versions.  The byte unpacks work within 128 bit lanes, so the
+// two halves are put back in order with a lane permute.
+//
+__attribute__((target("avx2")))
+static __m256i NibblesToAscii256(__m256i n)
+{
+    __m256i Letter = _mm256_and_si256(
+                         _mm256_cmpgt_epi8(n, _mm256_set1_epi8(9)),
+                         _mm256_set1_epi8('A' - '0' - 10));
+    return _mm256_add_epi8(_mm256_add_epi8(n, _mm256_set1_epi8('0')), Letter);
+}
+
+__attribute__((target("avx2")))
+static unsigned char EncodeAVX2(const unsigned char * Src, unsigned Len,
+                                char * Dst)
+{
+    __m256i Mask = _mm256_set1_epi8(0x0F);
+    __m256i Sum  = _mm256_setzero_si256();
+    __m128i Sum128;
+
+    for ( ; Len >= 32; Len -= 32, Src += 32, Dst += 64)
+    {
+        __m256i v  = _mm256_loadu_si256((const __m256i *)Src);
+        __m256i Hi = NibblesToAscii256(
+                         _mm256_and_si256(_mm256_srli_epi16(v, 4), Mask));
+        __m256i Lo = NibblesToAscii256(_mm256_and_si256(v, Mask));
+        __m256i a  = _mm256_unpacklo_epi8(Hi, Lo);
+        __m256i b  = _mm256_unpackhi_epi8(Hi, Lo);
+
+        _mm256_storeu_si256((__m256i *)Dst,
+                            _mm256_permute2x128_si256(a, b, 0x20));
+        _mm256_storeu_si256((__m256i *)(Dst + 32),
+                            _mm256_permute2x128_si256(a, b, 0x31));
+        Sum = _mm256_add_epi64(Sum, _mm256_sad_epu8(v,
+                                                    _mm256_setzero_si256()));
+    }
+
+    Sum128 = _mm_add_epi64(_mm256_castsi256_si128(Sum),
+                           _mm256_extracti128_si256(Sum, 1));
+    Sum128 = _mm_add_epi64(Sum128, _mm_srli_si128(Sum128, 8));
+
+    //
+    // EncodeSSE2() is not VEX encoded, and running it with the upper
+    // halves of the registers dirty costs more than the whole record.
+    //
+    _mm256_zeroupper();
+    return (unsigned char)(_mm_cvtsi128_si32(Sum128) +
+                           EncodeSSE2(Src, Len, Dst));
+}
+
+__attribute__((target("avx2")))
+static __m256i AsciiToNibbles256(__m256i c, __m256i * Valid)
+{
+    __m256i d = _mm256_sub_epi8(c, _mm256_set1_epi8('0'));
+    __m256i l = _mm256_sub_epi8(_mm256_or_si256(c, _mm256_set1_epi8(0x20)),
+                                _mm256_set1_epi8('a'));
+    __m256i Digit  = _mm256_andnot_si256(
+                         _mm256_cmpgt_epi8(_mm256_setzero_si256(), d),
+                         _mm256_cmpgt_epi8(_mm256_set1_epi8(10), d));
+    __m256i Letter = _mm256_andnot_si256(
+                         _mm256_cmpgt_epi8(_mm256_setzero_si256(), l),
+                         _mm256_cmpgt_epi8(_mm256_set1_epi8(6), l));
+
+    *Valid = _mm256_or_si256(Digit, Letter);
+    return _mm256_or_si256(_mm256_and_si256(Digit, d),
+                           _mm256_and_si256(Letter,
+                               _mm256_add_epi8(l, _mm256_set1_epi8(10))));
+}
+
+__attribute__((target("avx2")))
+static __m256i PairNibbles256(__m256i n)
+{
+    return _mm256_or_si256(_mm256_and_si256(_mm256_slli_epi16(n, 4),
+                                            _mm256_set1_epi16(0x00F0)),
+                           _mm256_srli_epi16(n, 8));
+}
+
+//
+// The pack works within 128 bit lanes, so a qword permute puts the
+// bytes back in order.
+//
+__attribute__((target("avx2")))
+static unsigned DecodeAVX2(const char * Src, unsigned Len,
+                           unsigned char * Dst, unsigned char * Sum)
+{
+    __m256i  Total = _mm256_setzero_si256();
+    __m256i  Va;
+    __m256i  Vb;
+    __m128i  Total128;
+    unsigned Done = 0;
+    unsigned Tail;
+
+    for ( ; Len >= 32; Len -= 32, Src += 64, Dst += 32, Done += 64)
+    {
+        __m256i a = AsciiToNibbles256(
+                        _mm256_loadu_si256((const __m256i *)Src), &Va);
+        __m256i b = AsciiToNibbles256(
+                        _mm256_loadu_si256((const __m256i *)(Src + 32)), &Vb);
+        __m256i v;
+
+        if ((unsigned)_mm256_movemask_epi8(_mm256_and_si256(Va, Vb))
+                != 0xFFFFFFFFu)
+            break;
+
+        v = _mm256_permute4x64_epi64(
+                _mm256_packus_epi16(PairNibbles256(a), PairNibbles256(b)),
+                0xD8);
+        _mm256_storeu_si256((__m256i *)Dst, v);
+        Total = _mm256_add_epi64(Total,
+                                 _mm256_sad_epu8(v, _mm256_setzero_si256()));
+    }
+
+    // The tail is done as in DecodeSSE2()
+    if ((Len > 0) && (Len < 32) && (Done != 0))
+    {
+        __m256i a = AsciiToNibbles256(
+                        _mm256_loadu_si256((const __m256i *)
+                                           (Src + 2 * Len - 64)), &Va);
+        __m256i b = AsciiToNibbles256(
+                        _mm256_loadu_si256((const __m256i *)
+                                           (Src + 2 * Len - 32)), &Vb);
+        __m256i v;
+        __m256i New = _mm256_cmpgt_epi8(
+                          _mm256_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7,
+                                           8, 9, 10, 11, 12, 13, 14, 15,
+                                           16, 17, 18, 19, 20, 21, 22, 23,
+                                           24, 25, 26, 27, 28, 29, 30, 31),
+                          _mm256_set1_epi8((char)(31 - Len)));
+
+        if ((unsigned)_mm256_movemask_epi8(_mm256_and_si256(Va, Vb))
+                == 0xFFFFFFFFu)
+        {
+            v = _mm256_permute4x64_epi64(
+                    _mm256_packus_epi16(PairNibbles256(a), PairNibbles256(b)),
+                    0xD8);
+            _mm256_storeu_si256((__m256i *)(Dst + Len - 32), v);
+            Total = _mm256_add_epi64(Total,
+                        _mm256_sad_epu8(_mm256_and_si256(v, New),
+                                        _mm256_setzero_si256()));
+            Done += 2 * Len;
+            Len   = 0;
+        }
+    }
+
+    Total128 = _mm_add_epi64(_mm256_castsi256_si128(Total),
+                             _mm256_extracti128_si256(Total, 1));
+    Total128 = _mm_add_epi64(Total128, _mm_srli_si128(Total128, 8));
+
+    _mm256_zeroupper();     // See EncodeAVX2()
+    Tail = DecodeSSE2(Src, Len, Dst, Sum);
+    *Sum += (unsigned char)_mm_cvtsi128_si32(Total128);
+    return Done + Tail;
+}
+
+__attribute__((target("avx2")))
+static int UniformAVX2(const unsigned char * Src, unsigned Len)
+{
+    __m256i First;
+    unsigned i;
+
+    if (Len < 32)
+        return UniformSSE2(Src, Len);
+
+    First = _mm256_set1_epi8((char)Src[0]);
+    for (i = 0; i + 32 <= Len; i += 32)
+        if ((unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(
+                _mm256_loadu_si256((const __m256i *)(Src + i)), First))
+                != 0xFFFFFFFFu)
+            return -1;
+
+    if ((i < Len) && ((unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(
+            _mm256_loadu_si256((const __m256i *)(Src + Len - 32)), First))
+            != 0xFFFFFFFFu))
+        return -1;
+    return Src[0];
+}
+
+//
+// The packs work within 128 bit lanes too, leaving the quarters of each
+// result in the order 0 2 1 3; a qword permute puts them back.
+//
+__attribute__((target("avx2")))
+static void SplitAVX2(const unsigned char * Src, unsigned Len,
+                      unsigned char * Even, unsigned char * Odd,
+                      unsigned long * Sums)
+{
+    __m256i Mask    = _mm256_set1_epi16(0x00FF);
+    __m256i EvenSum = _mm256_setzero_si256();
+    __m256i OddSum  = _mm256_setzero_si256();
+
+    for ( ; Len >= 32; Len -= 32, Src += 64, Even += 32, Odd += 32)
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i *)Src);
+        __m256i b = _mm256_loadu_si256((const __m256i *)(Src + 32));
+        __m256i e = _mm256_permute4x64_epi64(
+                        _mm256_packus_epi16(_mm256_and_si256(a, Mask),
+                                            _mm256_and_si256(b, Mask)), 0xD8);
+        __m256i o = _mm256_permute4x64_epi64(
+                        _mm256_packus_epi16(_mm256_srli_epi16(a, 8),
+                                            _mm256_srli_epi16(b, 8)), 0xD8);
+
+        _mm256_storeu_si256((__m256i *)Even, e);
+        _mm256_storeu_si256((__m256i *)Odd,  o);
+        EvenSum = _mm256_add_epi64(EvenSum,
+                                   _mm256_sad_epu8(e, _mm256_setzero_si256()));
+        OddSum  = _mm256_add_epi64(OddSum,
+                                   _mm256_sad_epu8(o, _mm256_setzero_si256()));
+    }
+
+    Sums[0] += Total128(_mm_add_epi64(_mm256_castsi256_si128(EvenSum),
+                               _mm256_extracti128_si256(EvenSum, 1)));
+    Sums[1] += Total128(_mm_add_epi64(_mm256_castsi256_si128(OddSum),
+                               _mm256_extracti128_si256(OddSum, 1)));
+    SplitSSE2(Src, Len, Even, Odd, Sums);
+}
+
+__attribute__((target("avx2")))
+static void InterleaveAVX2(const unsigned char * Even,
+                           const unsigned char * Odd, unsigned Len,
+                           unsigned char * Dst)
+{
+    for ( ; Len >= 32; Len -= 32, Even += 32, Odd += 32, Dst += 64)
+    {
+        __m256i e = _mm256_loadu_si256((const __m256i *)Even);
+        __m256i o = _mm256_loadu_si256((const __m256i *)Odd);
+        __m256i a = _mm256_unpacklo_epi8(e, o);
+        __m256i b = _mm256_unpackhi_epi8(e, o);
+
+        _mm256_storeu_si256((__m256i *)Dst,
+                            _mm256_permute2x128_si256(a, b, 0x20));
+        _mm256_storeu_si256((__m256i *)(Dst + 32),
+                            _mm256_permute2x128_si256(a, b, 0x31));
+    }
+    InterleaveSSE2(Even, Odd, Len, Dst);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// AVX-512 versions (AVX512F + AVX512BW).  A two-source qword permute
+// restores the order of the four 128 bit lanes after the unpacks.
+//
+__attribute__((target("avx512f,avx512bw")))
+static unsigned char EncodeAVX512(const unsigned char * Src, unsigned Len,
+                                  char * Dst)
+{
+    __m512i Mask  = _mm512_set1_epi8(0x0F);
+    __m512i Nine  = _mm512_set1_epi8(9);
+    __m512i Zero  = _mm512_set1_epi8('0');
+    __m512i Alpha = _mm512_set1_epi8('A' - '0' - 10);
+    __m512i Idx0  = _mm512_set_epi64(11, 10, 3, 2, 9, 8, 1, 0);
+    __m512i Idx1  = _mm512_set_epi64(15, 14, 7, 6, 13, 12, 5, 4);
+    __m512i Sum   = _mm512_setzero_si512();
+
+    for ( ; Len >= 64; Len -= 64, Src += 64, Dst += 128)
+    {
+        __m512i v  = _mm512_loadu_si512((const void *)Src);
+        __m512i Hi = _mm512_and_si512(_mm512_srli_epi16(v, 4), Mask);
+        __m512i Lo = _mm512_and_si512(v, Mask);
+        __m512i a, b;
+
+        Hi = _mm512_add_epi8(_mm512_add_epi8(Hi, Zero),
+                 _mm512_maskz_mov_epi8(_mm512_cmpgt_epi8_mask(Hi, Nine),
+                                       Alpha));
+        Lo = _mm512_add_epi8(_mm512_add_epi8(Lo, Zero),
+                 _mm512_maskz_mov_epi8(_mm512_cmpgt_epi8_mask(Lo, Nine),
+                                       Alpha));
+        a  = _mm512_unpacklo_epi8(Hi, Lo);
+        b  = _mm512_unpackhi_epi8(Hi, Lo);
+
+        _mm512_storeu_si512((void *)Dst, _mm512_permutex2var_epi64(a, Idx0, b));
+        _mm512_storeu_si512((void *)(Dst + 64),
+                            _mm512_permutex2var_epi64(a, Idx1, b));
+        Sum = _mm512_add_epi64(Sum, _mm512_sad_epu8(v,
+                                                    _mm512_setzero_si512()));
+    }
+
+    return (unsigned char)(_mm512_reduce_add_epi64(Sum) +
+                           EncodeAVX2(Src, Len, Dst));
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static int UniformAVX512(const unsigned char * Src, unsigned Len)
+{
+    __m512i First;
+    unsigned i;
+
+    if (Len < 64)
+        return UniformAVX2(Src, Len);
+
+    First = _mm512_set1_epi8((char)Src[0]);
+    for (i = 0; i + 64 <= Len; i += 64)
+        if (_mm512_cmpneq_epi8_mask(_mm512_loadu_si512((const void *)(Src + i)),
+                                    First) != 0)
+            return -1;
+
+    if ((i < Len) &&
+        (_mm512_cmpneq_epi8_mask(_mm512_loadu_si512((const void *)
+                                     (Src + Len - 64)), First) != 0))
+        return -1;
+    return Src[0];
+}
+
+#endif  // HEXKERN_X86
+
+//////////////////////////////////////////////////////////////////////////
+// Dispatch tables, indexed by kernel level.
+//
+static const ENCODEFN EncodeFns[] = {
+    EncodeScalar,
+#ifdef HEXKERN_X86
+    EncodeSSE2,
+    EncodeAVX2,
+    EncodeAVX512,
+#endif
+};
+
+static const UNIFORMFN UniformFns[] = {
+    UniformScalar,
+#ifdef HEXKERN_X86
+    UniformSSE2,
+    UniformAVX2,
+    UniformAVX512,
+#endif
+};
+
+//
+// Decoding has no AVX-512 version of its own; records are too short for
+// one to pay.
+//
+static const DECODEFN DecodeFns[] = {
+    DecodeScalar,
+#ifdef HEXKERN_X86
+    DecodeSSE2,
+    DecodeAVX2,
+    DecodeAVX2,
+#endif
+};
+
+//
+// Nor have the lane kernels, which are bound by memory well before AVX2
+// runs out.
+//
+static const SPLITFN SplitFns[] = {
+    SplitScalar,
+#ifdef HEXKERN_X86
+    SplitSSE2,
+    SplitAVX2,
+    SplitAVX2,
+#endif
+};
+
+static const INTERLEAVEFN InterleaveFns[] = {
+    InterleaveScalar,
+#ifdef HEXKERN_X86
+    InterleaveSSE2,
+    InterleaveAVX2,
+    InterleaveAVX2,
+#endif
+};
+
+static const char * const KernelNames[] = {
+    "scalar", "sse2", "avx2", "avx512"
+};
+
+//
+// The level is chosen once, under pthread_once(), as the first call may
+// come from any of several threads at the same time.
+//
+static pthread_once_t Chosen = PTHREAD_ONCE_INIT;
+static int       Level = -1;
+static ENCODEFN  Encode;
+static UNIFORMFN Uniform;
+static DECODEFN  Decode;
+static SPLITFN   Split;
+static INTERLEAVEFN Interleave;
+
+//////////////////////////////////////////////////////////////////////////
+// CpuLevel() returns the highest kernel level this CPU can run.
+//
+static int CpuLevel(void)
+{
+#ifdef HEXKERN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+        return HEXKERN_AVX512;
+    if (__builtin_cpu_supports("avx2"))
+        return HEXKERN_AVX2;
+    if (__builtin_cpu_supports("sse2"))
+        return HEXKERN_SSE2;
+#endif
+    return HEXKERN_SCALAR;
+}
+
+static int SetLevel(int Wanted)
+{
+    int Max = CpuLevel();
+
+    if (Wanted > Max)
+        Wanted = Max;
+    if (Wanted < HEXKERN_SCALAR)
+        Wanted = HEXKERN_SCALAR;
+
+    Encode  = EncodeFns[Wanted];
+    Uniform = UniformFns[Wanted];
+    Decode  = DecodeFns[Wanted];
+    Split   = SplitFns[Wanted];
+    Interleave = InterleaveFns[Wanted];
+    Level   = Wanted;
+    return Level;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// ChooseLevel() picks the level the first time a kernel is used.
+//
+static void ChooseLevel(void)
+{
+    const char * Env;
+    int          Wanted = HEXKERN_AVX512;
+    int          i;
+
+    if ((Env = getenv("E86_HEXKERN")) != 0)
+        for (i = HEXKERN_SCALAR; i <= HEXKERN_AVX512; i++)
+            if (strcmp(Env, KernelNames[i]) == 0)
+                Wanted = i;
+
+    SetLevel(Wanted);
+}
+
+int HexSetKernelLevel(int Wanted)
+{
+    pthread_once(&Chosen, ChooseLevel);
+    return SetLevel(Wanted);
+}
+
+int HexKernelLevel(void)
+{
+    pthread_once(&Chosen, ChooseLevel);
+    return Level;
+}
+
+const char * HexKernelName(int Which)
+{
+    if ((Which < HEXKERN_SCALAR) || (Which > HEXKERN_AVX512))
+        return "unknown";
+    return KernelNames[Which];
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Public entry points.
+//
+unsigned char HexEncode(const unsigned char * Src, unsigned Len, char * Dst)
+{
+    pthread_once(&Chosen, ChooseLevel);
+    return Encode(Src, Len, Dst);
+}
+
+unsigned HexDecode(const char * Src, unsigned Len, unsigned char * Dst,
+                   unsigned char * Sum)
+{
+    pthread_once(&Chosen, ChooseLevel);
+    return Decode(Src, Len, Dst, Sum);
+}
+
+int HexUniform(const unsigned char * Src, unsigned Len)
+{
+    pthread_once(&Chosen, ChooseLevel);
+    return Uniform(Src, Len);
+}
+
+void HexSplitLanes(const unsigned char * Src, unsigned Len,
+                   unsigned char * Even, unsigned char * Odd,
+                   unsigned long * Sums)
+{
+    pthread_once(&Chosen, ChooseLevel);
+    Sums[0] = 0;
+    Sums[1] = 0;
+    Split(Src, Len, Even, Odd, Sums);
+}
+
+void HexInterleave(const unsigned char * Even, const unsigned char * Odd,
+                   unsigned Len, unsigned char * Dst)
+{
+    pthread_once(&Chosen, ChooseLevel);
+    Interleave(Even, Odd, Len, Dst);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Kernels which only have a portable version.
+//
+unsigned long HexDeinterleave(const unsigned char * Src, unsigned Stride,
+                              unsigned Len, unsigned char * Dst)
+{
+    unsigned long Sum = 0;
+
+    for ( ; Len > 0; Len--)
+    {
+        Sum += (*(Dst++) = *Src);
+        Src += Stride;
+    }
+    return Sum;
+}
+
+unsigned long HexSum(const unsigned char * Src, unsigned Len)
+{
+    unsigned long Sum = 0;
+
+    for ( ; Len > 0; Len--)
+        Sum += *(Src++);
+    return Sum;
+}
+
+void HexReloLinear(unsigned int * Dst, const unsigned char * Src,
+                   unsigned Count)
+{
+    unsigned i;
+
+    for (i = 0; i < Count; i++, Src += 4)
+        Dst[i] = ((unsigned)Src[3] << 12) + ((unsigned)Src[2] << 4) +
+                 ((Src[1] << 8) | Src[0]);
+}
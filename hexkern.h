@@ -0,0 +1,101 @@
+/******************************************************************************
+ *                                                                            *
+ *     HEXKERN.H                                                              *
+ *                                                                            *
+ *     Data conversion kernels shared by the E86Mon utilities.  Every         *
+ *     kernel has a portable C version and, on x86, SIMD versions which       *
+ *     are selected at run time according to the capabilities of the CPU.     *
+ *                                                                            *
+ *****************************************************************************/
+
+#ifndef HEXKERN_H
+#define HEXKERN_H
+
+//
+// Kernel levels, in increasing order of preference.
+//
+#define HEXKERN_SCALAR  0
+#define HEXKERN_SSE2    1
+#define HEXKERN_AVX2    2
+#define HEXKERN_AVX512  3
+
+//////////////////////////////////////////////////////////////////////////
+// HexEncode() converts Len bytes at Src into 2*Len upper case ASCII hex
+// digits at Dst, and returns the 8 bit sum of the bytes (the contribution
+// of the data to an Intel hex record checksum).
+//
+unsigned char HexEncode(const unsigned char * Src, unsigned Len, char * Dst);
+
+//////////////////////////////////////////////////////////////////////////
+// HexDecode() converts the 2*Len ASCII hex digits (of either case) at Src
+// into Len bytes at Dst, and stores the 8 bit sum of the bytes in Sum.
+// Returns 2*Len, or the offset of the first character which is not a hex
+// digit, in which case only the bytes before it are summed, and Dst may
+// hold anything from there on.
+//
+unsigned HexDecode(const char * Src, unsigned Len, unsigned char * Dst,
+                   unsigned char * Sum);
+
+//////////////////////////////////////////////////////////////////////////
+// HexUniform() returns the value of the bytes at Src if all Len of them
+// are the same, or -1 if they are not (or Len is 0).
+//
+int HexUniform(const unsigned char * Src, unsigned Len);
+
+//////////////////////////////////////////////////////////////////////////
+// HexDeinterleave() copies every Stride'th byte of Src, starting with the
+// first, to Len bytes at Dst (the bytes of one ROM of a set Stride wide),
+// and returns the sum of the bytes copied.
+//
+unsigned long HexDeinterleave(const unsigned char * Src, unsigned Stride,
+                              unsigned Len, unsigned char * Dst);
+
+//////////////////////////////////////////////////////////////////////////
+// HexSplitLanes() splits Len 16 bit words at Src into their low bytes at
+// Even and their high bytes at Odd (the two ROMs of a 16 bit pair), and
+// stores the sums of the bytes of each in Sums[0] and Sums[1].
+//
+void HexSplitLanes(const unsigned char * Src, unsigned Len,
+                   unsigned char * Even, unsigned char * Odd,
+                   unsigned long * Sums);
+
+//////////////////////////////////////////////////////////////////////////
+// HexInterleave() undoes HexSplitLanes(), putting Len bytes from Even and
+// Len from Odd back together as 2*Len bytes at Dst.
+//
+void HexInterleave(const unsigned char * Even, const unsigned char * Odd,
+                   unsigned Len, unsigned char * Dst);
+
+//////////////////////////////////////////////////////////////////////////
+// HexSum() returns the sum of the Len bytes at Src.
+//
+unsigned long HexSum(const unsigned char * Src, unsigned Len);
+
+//////////////////////////////////////////////////////////////////////////
+// HexReloLinear() converts Count little endian offset:segment entries of
+// an MZ relocation table at Src to linear addresses at Dst.
+//
+void HexReloLinear(unsigned int * Dst, const unsigned char * Src,
+                   unsigned Count);
+
+//////////////////////////////////////////////////////////////////////////
+// HexKernelLevel() returns the level the kernels run at.  The level is
+// picked from the CPU features on first use, and may be lowered with
+// the E86_HEXKERN environment variable (scalar, sse2, avx2, avx512).
+//
+int HexKernelLevel(void);
+
+//////////////////////////////////////////////////////////////////////////
+// HexSetKernelLevel() forces a kernel level, clamped to what the CPU
+// supports, and returns the level actually selected.  It is meant for
+// benchmarks and tests, and must not race with kernels running on other
+// threads; the level picked on first use needs no such care.
+//
+int HexSetKernelLevel(int Level);
+
+//////////////////////////////////////////////////////////////////////////
+// HexKernelName() returns a printable name for a kernel level.
+//
+const char * HexKernelName(int Level);
+
+#endif
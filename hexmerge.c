@@ -0,0 +1,554 @@
+/******************************************************************************
+ *                                                                            *
+ *     HEXMERGE.C                                                             *
+ *                                                                            *
+ *     Merges absolute hex files, such as E86Mon built for F800 with its      *
+ *     reset vector and the applications and library extensions which go      *
+ *     into the same flash, into one file.                                    *
+ *                                                                            *
+ *     Each input is decoded into a sparse map (see E86MAP.H), on a pool of   *
+ *     threads.  The intervals of all the maps are then swept once, from      *
+ *     the lowest address up, and wherever two inputs load the same bytes     *
+ *     it is reported.  Overlaps holding different bytes are errors unless    *
+ *     --overlap says which input wins; those holding the same bytes are      *
+ *     only noted.  The work is linear in the bytes loaded, apart from the    *
+ *     sorting of intervals, of which there are few.                          *
+ *                                                                            *
+ *     The merged file uses records as long as the record length allows, a   *
+ *     segment record only where the next byte is out of reach of the last    *
+ *     one, and each as high as it can go, so as few as possible are          *
+ *     needed.  Above 1M extended linear address records are used instead.   *
+ *     One start address record is kept, from the first input with one.       *
+ *                                                                            *
+ *     Usage: hexmerge [options] <file>...                                    *
+ *                                                                            *
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "e86map.h"
+#include "hexkern.h"
+#include "e86trace.h"
+
+#define MAXREC      255         // Largest record length, and the default
+#define SEGWINDOW   0x10000L    // Bytes a segment or linear base reaches
+#define MAXLINE     (1 + 2 * (5 + MAXREC) + 1)
+
+//
+// What to do when inputs load different bytes at the same address.
+//
+#define OVERLAPERROR 0
+#define OVERLAPFIRST 1
+#define OVERLAPLAST  2
+
+typedef struct {
+    const char * Name;
+    E86MAP  Map;
+} INPUT;
+
+typedef struct {
+    DWORD   Start;
+    DWORD   End;
+    int     Input;
+    LPBYTE  Data;               // Byte at Start
+} PIECE;
+
+typedef struct {
+    DWORD   Start;
+    DWORD   End;
+    int     First;              // The inputs which overlap
+    int     Second;
+    BOOL    Same;               // With the same bytes
+} OVERLAP;
+
+INPUT *   Inputs = 0;
+int       NumInputs = 0;
+PIECE *   Pieces = 0;           // Intervals of every input, by start
+DWORD     NumPieces = 0;
+PIECE *   Out = 0;              // What the merged file loads, by start
+DWORD     NumOut = 0;
+OVERLAP * Overlaps = 0;
+DWORD     NumOverlaps = 0;
+DWORD     MaxOverlaps = 0;
+int       NextJobIndex = 0;
+pthread_mutex_t JobLock = PTHREAD_MUTEX_INITIALIZER;
+
+int    Policy = OVERLAPERROR;
+DWORD  RecordLength = MAXREC;
+BOOL   Linear = FALSE;
+char * OutName = 0;
+DWORD  NumThreads = 0;
+BOOL   ShowStats = FALSE;
+char * TraceName = 0;
+FILE * Msgs;
+
+static const char HexDigits[] = "0123456789ABCDEF";
+
+//////////////////////////////////////////////////////////////////////////
+// ErrExit() shows an error message and exits.
+//
+static void ErrExit(const char * s, ...)
+{
+    va_list ap;
+
+    va_start(ap, s);
+    fputs("hexmerge: ", stderr);
+    vfprintf(stderr, s, ap);
+    fputc('\n', stderr);
+    va_end(ap);
+    exit(2);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// ShowHelp() lists the options.
+//
+static void ShowHelp(void)
+{
+    printf(
+"\nUsage: hexmerge [options] <file>...\n\n"
+"    Merges absolute hex files into one, with as few records as it can,\n"
+"    and reports the addresses more than one of them loads.  The exit\n"
+"    status is 1 if inputs load different bytes at the same address and\n"
+"    --overlap does not say which to keep; nothing is written then.\n\n"
+"    --output=<file>  Write the merged file to <file>, not standard output\n"
+"    --overlap=first  Keep the bytes of the input named first\n"
+"    --overlap=last   Keep the bytes of the input named last\n"
+"    --record=<n>     Data bytes per record, 1 to 255 (255)\n"
+"    --linear         Use extended linear address records, not segment\n"
+"                     records, whatever the addresses\n"
+"    --threads=<n>    Worker threads (default one per CPU)\n"
+"    --stats          Show how long each phase took\n"
+"    --trace=<file>   Write each phase to <file> as Chrome trace events\n\n");
+    exit(2);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Reader() reads inputs until none are left.
+//
+static void * Reader(void * Arg)
+{
+    int    Job;
+    double Start;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&JobLock);
+        Job = NextJobIndex++;
+        pthread_mutex_unlock(&JobLock);
+        if (Job >= NumInputs)
+            return 0;
+
+        Start = E86TraceNow();
+        if (E86MapRead(&Inputs[Job].Map, Inputs[Job].Name) == 0)
+            E86TracePhase("read", Inputs[Job].Name, Start, E86TraceNow(),
+                          Inputs[Job].Map.TextLength,
+                          Inputs[Job].Map.DataLength,
+                          Inputs[Job].Map.NumRanges);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+// ComparePiece() orders pieces by start address for qsort(), and those
+// which start together by input.
+//
+static int ComparePiece(const void * a, const void * b)
+{
+    const PIECE * x = a;
+    const PIECE * y = b;
+
+    if (x->Start != y->Start)
+        return (x->Start > y->Start) - (x->Start < y->Start);
+    return x->Input - y->Input;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// NoteOverlap() records that inputs First and Second both load Start to
+// End, joining it to the last overlap noted when it follows on.
+//
+static void NoteOverlap(int First, int Second, BOOL Same, DWORD Start,
+                        DWORD End)
+{
+    OVERLAP * Last = NumOverlaps ? &Overlaps[NumOverlaps - 1] : 0;
+
+    if ((Last != 0) && (Last->First == First) && (Last->Second == Second) &&
+        (Last->Same == Same) && (Last->End == Start))
+    {
+        Last->End = End;
+        return;
+    }
+
+    if (NumOverlaps == MaxOverlaps)
+    {
+        MaxOverlaps = MaxOverlaps ? 2 * MaxOverlaps : 16;
+        if ((Overlaps = realloc(Overlaps, MaxOverlaps * sizeof(OVERLAP)))
+                == 0)
+            ErrExit("Out of memory");
+    }
+    Overlaps[NumOverlaps].Start  = Start;
+    Overlaps[NumOverlaps].End    = End;
+    Overlaps[NumOverlaps].First  = First;
+    Overlaps[NumOverlaps].Second = Second;
+    Overlaps[NumOverlaps].Same   = Same;
+    NumOverlaps++;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// AddOut() adds Start to End of a piece to what the merged file loads.
+//
+static void AddOut(const PIECE * p, DWORD Start, DWORD End)
+{
+    PIECE * Last = NumOut ? &Out[NumOut - 1] : 0;
+
+    if ((Last != 0) && (Last->Input == p->Input) && (Last->End == Start) &&
+        (Last->Data + (Last->End - Last->Start) ==
+         p->Data + (Start - p->Start)))
+    {
+        Last->End = End;
+        return;
+    }
+    Out[NumOut].Start = Start;
+    Out[NumOut].End   = End;
+    Out[NumOut].Input = p->Input;
+    Out[NumOut].Data  = p->Data + (Start - p->Start);
+    NumOut++;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Merge() sweeps the pieces of all the inputs from the lowest address
+// up.  Between one place where a piece starts or ends and the next, the
+// same pieces are active; one of them is kept, and the others compared
+// with it.  Few pieces are ever active at once, so they are kept in a
+// short list.
+//
+static void Merge(void)
+{
+    PIECE ** Active;
+    DWORD    NumActive = 0;
+    DWORD    Next = 0;          // Next piece to become active
+    DWORD    At = 0;
+    DWORD    End;
+    DWORD    i;
+    PIECE *  Keep;
+
+    if (((Active = malloc((NumPieces + 1) * sizeof(PIECE *))) == 0) ||
+        ((Out = malloc((2 * NumPieces + 1) * sizeof(PIECE))) == 0))
+        ErrExit("Out of memory");
+
+    qsort(Pieces, NumPieces, sizeof(PIECE), ComparePiece);
+
+    while ((Next < NumPieces) || (NumActive != 0))
+    {
+        if (NumActive == 0)
+            At = Pieces[Next].Start;
+        while ((Next < NumPieces) && (Pieces[Next].Start == At))
+            Active[NumActive++] = &Pieces[Next++];
+
+        //
+        // The inputs were added in order, so the active list is by input.
+        //
+        End  = (Next < NumPieces) ? Pieces[Next].Start : 0xFFFFFFFFL;
+        Keep = Active[0];
+        for (i = 0; i < NumActive; i++)
+        {
+            if (Active[i]->End < End)
+                End = Active[i]->End;
+            if ((Policy == OVERLAPLAST) ? (Active[i]->Input > Keep->Input) :
+                                          (Active[i]->Input < Keep->Input))
+                Keep = Active[i];
+        }
+
+        AddOut(Keep, At, End);
+        for (i = 0; i < NumActive; i++)
+            if (Active[i] != Keep)
+                NoteOverlap((Keep->Input < Active[i]->Input) ? Keep->Input :
+                                                               Active[i]->Input,
+                            (Keep->Input < Active[i]->Input) ?
+                                Active[i]->Input : Keep->Input,
+                            memcmp(Keep->Data + (At - Keep->Start),
+                                   Active[i]->Data + (At - Active[i]->Start),
+                                   End - At) == 0,
+                            At, End);
+
+        At = End;
+        for (i = 0; i < NumActive; )
+            if (Active[i]->End <= At)
+                memmove(&Active[i], &Active[i + 1],
+                        (--NumActive - i) * sizeof(PIECE *));
+            else
+                i++;
+    }
+    free(Active);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// PutByte() prints a byte as two hex digits at Dst.
+//
+static char * PutByte(char * Dst, BYTE Value)
+{
+    Dst[0] = HexDigits[Value >> 4];
+    Dst[1] = HexDigits[Value & 0xF];
+    return Dst + 2;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// PutRecord() writes a record of Len data bytes.  Returns the number of
+// records written, so that callers can count them.
+//
+static DWORD PutRecord(FILE * f, BYTE Type, WORD Addr, const BYTE * Data,
+                       DWORD Len)
+{
+    char   Line[MAXLINE + 1];
+    char * p = Line;
+    BYTE   Sum = (BYTE)(Len + (Addr >> 8) + Addr + Type);
+
+    *(p++) = ':';
+    p = PutByte(p, (BYTE)Len);
+    p = PutByte(p, (BYTE)(Addr >> 8));
+    p = PutByte(p, (BYTE)Addr);
+    p = PutByte(p, Type);
+    Sum += HexEncode(Data, Len, p);
+    p = PutByte(p + 2 * Len, (BYTE)(0 - Sum));
+    *(p++) = '\n';
+    fwrite(Line, 1, p - Line, f);
+    return 1;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// WriteMerged() writes what the merged file loads, and the start
+// records.  Records run on across pieces which follow each other.
+// Returns the number of records written.
+//
+static DWORD WriteMerged(FILE * f, E86MAP * Start, E86MAP * LinearStart)
+{
+    BYTE  Rec[MAXREC];
+    BYTE  Word[4];
+    DWORD Records = 0;
+    DWORD Base = 0;             // Reached from offset 0 of the last record
+    DWORD i = 0;
+    DWORD At;
+    DWORD Len;
+    DWORD Room;
+    DWORD n;
+
+    At = NumOut ? Out[0].Start : 0;
+    while (i < NumOut)
+    {
+        if ((At < Base) || (At - Base >= SEGWINDOW))
+        {
+            Base = Linear ? (At & ~(SEGWINDOW - 1)) : (At & ~0xFL);
+            Word[0] = (BYTE)(Base >> (Linear ? 24 : 12));
+            Word[1] = (BYTE)(Base >> (Linear ? 16 : 4));
+            Records += PutRecord(f, Linear ? 4 : 2, 0, Word, 2);
+        }
+
+        Room = SEGWINDOW - (At - Base);
+        if (Room > RecordLength)
+            Room = RecordLength;
+        for (Len = 0; (Len < Room) && (i < NumOut) && (Out[i].Start <= At);
+             Len += n)
+        {
+            n = Out[i].End - At;
+            if (n > Room - Len)
+                n = Room - Len;
+            memcpy(Rec + Len, Out[i].Data + (At - Out[i].Start), n);
+            if ((At += n) == Out[i].End)
+                i++;
+        }
+        Records += PutRecord(f, 0, (WORD)(At - Len - Base), Rec, Len);
+        if ((i < NumOut) && (At < Out[i].Start))
+            At = Out[i].Start;
+    }
+
+    if (Start != 0)
+    {
+        Word[0] = (BYTE)(Start->StartSegment >> 8);
+        Word[1] = (BYTE)Start->StartSegment;
+        Word[2] = (BYTE)(Start->StartOffset >> 8);
+        Word[3] = (BYTE)Start->StartOffset;
+        Records += PutRecord(f, 3, 0, Word, 4);
+    }
+    if (LinearStart != 0)
+    {
+        Word[0] = (BYTE)(LinearStart->LinearStart >> 24);
+        Word[1] = (BYTE)(LinearStart->LinearStart >> 16);
+        Word[2] = (BYTE)(LinearStart->LinearStart >> 8);
+        Word[3] = (BYTE)LinearStart->LinearStart;
+        Records += PutRecord(f, 5, 0, Word, 4);
+    }
+    return Records + PutRecord(f, 1, 0, 0, 0);
+}
+
+int main(int argc, char * argv[])
+{
+    pthread_t * Threads;
+    E86MAP *    Start = 0;
+    E86MAP *    LinearStart = 0;
+    E86MAP *    m;
+    FILE *      f;
+    char *      End;
+    DWORD       Conflicts = 0;
+    DWORD       Bytes = 0;
+    DWORD       Records;
+    DWORD       n;
+    double      Time;
+    int         i;
+    DWORD       j;
+
+    Msgs = stdout;
+    if ((Inputs = calloc(argc, sizeof(INPUT))) == 0)
+        ErrExit("Out of memory");
+
+    for (i = 1; i < argc; i++)
+        if (strncmp(argv[i], "--", 2) != 0)
+            Inputs[NumInputs++].Name = argv[i];
+        else if ((strncmp(argv[i], "--output=", 9) == 0) &&
+                 (argv[i][9] != 0))
+            OutName = argv[i] + 9;
+        else if (strcmp(argv[i], "--overlap=first") == 0)
+            Policy = OVERLAPFIRST;
+        else if (strcmp(argv[i], "--overlap=last") == 0)
+            Policy = OVERLAPLAST;
+        else if (strncmp(argv[i], "--record=", 9) == 0)
+        {
+            RecordLength = strtoul(argv[i] + 9, &End, 10);
+            if ((*End != 0) || (RecordLength < 1) || (RecordLength > MAXREC))
+                ShowHelp();
+        }
+        else if (strcmp(argv[i], "--linear") == 0)
+            Linear = TRUE;
+        else if (strncmp(argv[i], "--threads=", 10) == 0)
+        {
+            NumThreads = strtoul(argv[i] + 10, &End, 10);
+            if ((*End != 0) || (NumThreads == 0))
+                ShowHelp();
+        }
+        else if (strcmp(argv[i], "--stats") == 0)
+            ShowStats = TRUE;
+        else if ((strncmp(argv[i], "--trace=", 8) == 0) && (argv[i][8] != 0))
+            TraceName = argv[i] + 8;
+        else
+            ShowHelp();
+
+    if (NumInputs == 0)
+        ShowHelp();
+    if (OutName == 0)
+        Msgs = stderr;
+
+    if ((ShowStats || (TraceName != 0)) &&
+        (E86TraceOpen(TraceName, ShowStats) != 0))
+        ErrExit("Cannot create trace file %s", TraceName);
+
+    if (NumThreads == 0)
+        NumThreads = sysconf(_SC_NPROCESSORS_ONLN);
+    if ((NumThreads < 1) || (NumThreads > (DWORD)NumInputs))
+        NumThreads = NumInputs;
+    if ((Threads = calloc(NumThreads, sizeof(pthread_t))) == 0)
+        ErrExit("Out of memory");
+    for (j = 1; j < NumThreads; j++)
+        if (pthread_create(&Threads[j], 0, Reader, 0) != 0)
+            ErrExit("Cannot start worker thread");
+    Reader(0);
+    for (j = 1; j < NumThreads; j++)
+        pthread_join(Threads[j], 0);
+
+    //
+    // Check every input, and gather their intervals.
+    //
+    for (i = 0; i < NumInputs; i++)
+    {
+        m = &Inputs[i].Map;
+        if (m->Error[0] != 0)
+            ErrExit("%s: %s", Inputs[i].Name, m->Error);
+        if (m->Relocatable)
+            ErrExit("%s: relocatable (AMD LPD) files cannot be merged; "
+                    "convert the EXE with a segment address", Inputs[i].Name);
+        if (m->Overlap != 0)
+            fprintf(stderr, "hexmerge: %s: %u bytes loaded more than once; "
+                    "the record which starts later is used\n",
+                    Inputs[i].Name, m->Overlap);
+        if (m->HaveStart)
+        {
+            if (Start == 0)
+                Start = m;
+            else if ((m->StartSegment != Start->StartSegment) ||
+                     (m->StartOffset != Start->StartOffset))
+                fprintf(stderr, "hexmerge: %s: start address %04X:%04X "
+                        "left out; %04X:%04X is kept\n", Inputs[i].Name,
+                        m->StartSegment, m->StartOffset,
+                        Start->StartSegment, Start->StartOffset);
+        }
+        if (m->HaveLinearStart)
+        {
+            if (LinearStart == 0)
+                LinearStart = m;
+            else if (m->LinearStart != LinearStart->LinearStart)
+                fprintf(stderr, "hexmerge: %s: linear start address %08X "
+                        "left out; %08X is kept\n", Inputs[i].Name,
+                        m->LinearStart, LinearStart->LinearStart);
+        }
+        NumPieces += m->NumRanges;
+    }
+
+    if ((Pieces = malloc((NumPieces + 1) * sizeof(PIECE))) == 0)
+        ErrExit("Out of memory");
+    for (i = 0, n = 0; i < NumInputs; i++)
+        for (j = 0; j < Inputs[i].Map.NumRanges; j++, n++)
+        {
+            Pieces[n].Start = Inputs[i].Map.Ranges[j].Start;
+            Pieces[n].End   = Inputs[i].Map.Ranges[j].End;
+            Pieces[n].Input = i;
+            Pieces[n].Data  = Inputs[i].Map.Data +
+                              Inputs[i].Map.Ranges[j].Offset;
+        }
+
+    Time = E86TraceNow();
+    Merge();
+    for (j = 0; j < NumOut; j++)
+    {
+        Bytes += Out[j].End - Out[j].Start;
+        if (Out[j].End > 0x100000L)
+            Linear = TRUE;
+    }
+    E86TracePhase("merge", 0, Time, E86TraceNow(), Bytes, 0, NumPieces);
+
+    for (j = 0; j < NumOverlaps; j++)
+    {
+        if (!Overlaps[j].Same && (Policy == OVERLAPERROR))
+            Conflicts++;
+        fprintf(stderr, "hexmerge: %s and %s both load %08X-%08X, %s\n",
+                Inputs[Overlaps[j].First].Name,
+                Inputs[Overlaps[j].Second].Name, Overlaps[j].Start,
+                Overlaps[j].End - 1, Overlaps[j].Same ? "the same bytes" :
+                (Policy == OVERLAPERROR) ? "with different bytes" :
+                (Policy == OVERLAPFIRST) ? "the first one's bytes kept" :
+                                           "the last one's bytes kept");
+    }
+    if (Conflicts != 0)
+    {
+        fprintf(stderr, "hexmerge: %u overlaps with different bytes; "
+                "nothing written\n", Conflicts);
+        return 1;
+    }
+
+    Time = E86TraceNow();
+    if (OutName == 0)
+        f = stdout;
+    else if ((f = fopen(OutName, "w")) == 0)
+        ErrExit("Cannot create %s", OutName);
+    setvbuf(f, 0, _IOFBF, 1 << 20);
+    Records = WriteMerged(f, Start, LinearStart);
+    if ((fflush(f) != 0) || ferror(f) || ((f != stdout) && (fclose(f) != 0)))
+        ErrExit("Cannot write %s", OutName ? OutName : "standard output");
+    E86TracePhase("write", OutName, Time, E86TraceNow(), Bytes, 0, Records);
+
+    fprintf(Msgs, "%d files merged: %u bytes in %u records%s%s.\n",
+            NumInputs, Bytes, Records, OutName ? ", written to " : "",
+            OutName ? OutName : "");
+
+    E86TraceClose(Msgs);
+    return 0;
+}
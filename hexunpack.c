@@ -0,0 +1,454 @@
+/******************************************************************************
+ *                                                                            *
+ *     HEXUNPACK.C                                                            *
+ *                                                                            *
+ *     Turns relocatable hex files, as MakeHex writes them for E86Mon, back   *
+ *     into their program image, entry and stack values and relocation        *
+ *     list, for archived files whose EXEs are gone.                          *
+ *                                                                            *
+ *     Files are read as E86LPD.H describes, and each gets a line in a tab    *
+ *     separated index on stdout.  The image can also be written with a       *
+ *     relocation sidecar in the format MakeHex --binary uses, and the        *
+ *     program rebuilt as an EXE which MakeHex converts back into the same    *
+ *     hex file.  Files are unpacked on a pool of threads, and the index is   *
+ *     printed in the order given.                                            *
+ *                                                                            *
+ *     Usage: hexunpack [options] <file, directory or @list>...               *
+ *                                                                            *
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "e86lpd.h"
+#include "e86trace.h"
+
+#define NAMELEN     1024
+#define HEADERLEN   0x1C        // MZ header fields before the table
+#define MAXEXE      (0xFFFFL * 512)
+
+typedef struct {
+    char *  Name;
+    E86LPD  Lpd;                // Lpd.Error is empty if it was unpacked
+} UNPACKED;
+
+UNPACKED * Jobs = 0;
+int        NumJobs = 0;
+int        MaxJobs = 0;
+int        NextJobIndex = 0;
+pthread_mutex_t JobLock = PTHREAD_MUTEX_INITIALIZER;
+
+BOOL   MakeImage = FALSE;
+BOOL   MakeExe = FALSE;
+char * OutDir = 0;
+DWORD  NumThreads = 0;
+BOOL   ShowStats = FALSE;
+char * TraceName = 0;
+
+//////////////////////////////////////////////////////////////////////////
+// ErrExit() shows an error message and exits.
+//
+static void ErrExit(const char * s, ...)
+{
+    va_list ap;
+
+    va_start(ap, s);
+    fputs("hexunpack: ", stderr);
+    vfprintf(stderr, s, ap);
+    fputc('\n', stderr);
+    va_end(ap);
+    exit(2);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// ShowHelp() lists the options.
+//
+static void ShowHelp(void)
+{
+    printf(
+"\nUsage: hexunpack [options] <file, directory or @list>...\n\n"
+"    Unpacks relocatable (AMD LPD) hex files made by MakeHex into their\n"
+"    program image, entry and stack values and relocations, and prints a\n"
+"    tab separated index line for each.  A directory stands for the .hex\n"
+"    files in it, and @<file> for the inputs listed in <file>.\n\n"
+"    --image          Write <name>.img and its relocation sidecar\n"
+"                     <name>.rel, as MakeHex --binary does\n"
+"    --exe            Write <name>.exe, which MakeHex (with the record\n"
+"                     length in the index) converts back to the same hex\n"
+"    --dir=<dir>      Write files into <dir>, not next to the input\n"
+"    --threads=<n>    Worker threads (default one per CPU)\n"
+"    --stats          Show how long each phase took\n"
+"    --trace=<file>   Write each phase to <file> as Chrome trace events\n\n");
+    exit(2);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Fail() records why a file could not be unpacked.  Returns FALSE, so
+// that callers can return it.
+//
+static BOOL Fail(UNPACKED * u, const char * s, ...)
+{
+    va_list ap;
+
+    va_start(ap, s);
+    vsnprintf(u->Lpd.Error, sizeof(u->Lpd.Error), s, ap);
+    va_end(ap);
+    return FALSE;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Little endian fields, for the sidecar and the EXE.
+//
+static LPBYTE PutWord(LPBYTE Ptr, WORD Value)
+{
+    Ptr[0] = (BYTE)Value;
+    Ptr[1] = (BYTE)(Value >> 8);
+    return Ptr + 2;
+}
+
+static LPBYTE PutDWord(LPBYTE Ptr, DWORD Value)
+{
+    return PutWord(PutWord(Ptr, (WORD)Value), (WORD)(Value >> 16));
+}
+
+//////////////////////////////////////////////////////////////////////////
+// OutputName() builds the name of an output file: the input's base name
+// with extension Ext, in OutDir if one was given.
+//
+static void OutputName(char * Out, const char * Name, const char * Ext)
+{
+    const char * Base = strrchr(Name, '/');
+    const char * Dot;
+    int          Len;
+
+    Base = Base ? Base + 1 : Name;
+    Dot  = strrchr(Base, '.');
+    Len  = Dot ? Dot - Base : (int)strlen(Base);
+
+    if (OutDir != 0)
+        snprintf(Out, NAMELEN, "%s/%.*s%s", OutDir, Len, Base, Ext);
+    else
+        snprintf(Out, NAMELEN, "%.*s%s", (int)(Base - Name + Len), Name, Ext);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// WriteFile() writes Count buffers to a new file.  Returns FALSE, with
+// the error recorded, if it cannot.
+//
+static BOOL WriteFile(UNPACKED * u, const char * Name, int Count, ...)
+{
+    va_list      ap;
+    FILE *       f;
+    const void * Data;
+    DWORD        Length;
+    BOOL         Good = TRUE;
+
+    if ((f = fopen(Name, "wb")) == 0)
+        return Fail(u, "cannot create %s", Name);
+
+    va_start(ap, Count);
+    while (Count-- > 0)
+    {
+        Data   = va_arg(ap, const void *);
+        Length = va_arg(ap, DWORD);
+        if ((Length != 0) && (fwrite(Data, 1, Length, f) != Length))
+            Good = FALSE;
+    }
+    va_end(ap);
+
+    if ((fclose(f) != 0) || !Good)
+        return Fail(u, "cannot write %s", Name);
+    return TRUE;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// WriteSidecar() writes the image and the relocation sidecar laid out
+// in e86hex.h.
+//
+static BOOL WriteSidecar(UNPACKED * u)
+{
+    char   Name[NAMELEN];
+    LPBYTE Sidecar;
+    LPBYTE Ptr;
+    DWORD  Rounded = (u->Lpd.ImageLength + 15) & ~15L;
+    DWORD  i;
+    BOOL   Good;
+
+    OutputName(Name, u->Name, ".img");
+    if (!WriteFile(u, Name, 1, u->Lpd.Memory, u->Lpd.ImageLength))
+        return FALSE;
+
+    if ((Sidecar = malloc(E86HEX_SIDECARHDR + 4 * u->Lpd.Relocations)) == 0)
+        return Fail(u, "out of memory");
+
+    memcpy(Sidecar, E86HEX_SIDECARSIG, 8);
+    Ptr = PutWord(Sidecar + 8,
+                  (WORD)(Rounded >> 4) + 2 + E86LpdExtra(&u->Lpd));
+    Ptr = PutWord(Ptr, u->Lpd.StackSegment);
+    Ptr = PutWord(Ptr, u->Lpd.StackOffset);
+    Ptr = PutWord(Ptr, u->Lpd.EntrySegment);
+    Ptr = PutWord(Ptr, u->Lpd.EntryOffset);
+    Ptr = PutWord(Ptr, 0);
+    Ptr = PutDWord(Ptr, u->Lpd.ImageLength);
+    Ptr = PutDWord(Ptr, Rounded);
+    Ptr = PutDWord(Ptr, u->Lpd.Relocations);
+    for (i = 0; i < u->Lpd.Relocations; i++)
+        Ptr = PutDWord(Ptr, E86LpdRelocation(&u->Lpd, i));
+
+    OutputName(Name, u->Name, ".rel");
+    Good = WriteFile(u, Name, 1, Sidecar, (DWORD)(Ptr - Sidecar));
+    free(Sidecar);
+    return Good;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// WriteExe() rebuilds an EXE holding the image, with a relocation table
+// of the same linear addresses.  Each goes in as a 64K segment and an
+// offset in it, which MakeHex turns back into the same address.
+//
+static BOOL WriteExe(UNPACKED * u)
+{
+    char   Name[NAMELEN];
+    LPBYTE Header;
+    LPBYTE Ptr;
+    DWORD  HdrLength = (HEADERLEN + 4 * u->Lpd.Relocations + 15) & ~15L;
+    DWORD  Total = HdrLength + u->Lpd.ImageLength;
+    DWORD  Relo;
+    DWORD  i;
+    BOOL   Good;
+
+    if (Total > MAXEXE)
+        return Fail(u, "image too big for an EXE");
+    if ((Header = calloc(1, HdrLength)) == 0)
+        return Fail(u, "out of memory");
+
+    Ptr = PutWord(Header, 0x5A4D);
+    Ptr = PutWord(Ptr, (WORD)(Total % 512));
+    Ptr = PutWord(Ptr, (WORD)((Total + 511) / 512));
+    Ptr = PutWord(Ptr, (WORD)u->Lpd.Relocations);
+    Ptr = PutWord(Ptr, (WORD)(HdrLength / 16));
+    Ptr = PutWord(Ptr, E86LpdExtra(&u->Lpd));
+    Ptr = PutWord(Ptr, 0xFFFF);
+    Ptr = PutWord(Ptr, u->Lpd.StackSegment);
+    Ptr = PutWord(Ptr, u->Lpd.StackOffset);
+    Ptr = PutWord(Ptr, 0);
+    Ptr = PutWord(Ptr, u->Lpd.EntryOffset);
+    Ptr = PutWord(Ptr, u->Lpd.EntrySegment);
+    Ptr = PutWord(Ptr, HEADERLEN);
+    Ptr = PutWord(Ptr, 0);                      // Overlay number
+
+    for (i = 0; i < u->Lpd.Relocations; i++)
+    {
+        Relo = E86LpdRelocation(&u->Lpd, i);
+        Ptr  = PutWord(Ptr, (WORD)Relo);
+        Ptr  = PutWord(Ptr, (WORD)((Relo >> 16) << 12));
+    }
+
+    OutputName(Name, u->Name, ".exe");
+    Good = WriteFile(u, Name, 2, Header, HdrLength, u->Lpd.Memory,
+                     u->Lpd.ImageLength);
+    free(Header);
+    return Good;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Unpack() unpacks one file, and writes the files asked for.
+//
+static void Unpack(UNPACKED * u)
+{
+    double Start = E86TraceNow();
+
+    if (E86LpdRead(&u->Lpd, u->Name) == 0)
+    {
+        E86TracePhase("parse", u->Name, Start, E86TraceNow(),
+                      u->Lpd.TextLength, u->Lpd.ImageLength,
+                      u->Lpd.Relocations);
+        Start = E86TraceNow();
+        if ((MakeImage || MakeExe) &&
+            (!MakeImage || WriteSidecar(u)) && (!MakeExe || WriteExe(u)))
+            E86TracePhase("write", u->Name, Start, E86TraceNow(), 0,
+                          u->Lpd.ImageLength, 0);
+    }
+    E86LpdFree(&u->Lpd);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// AddJob() adds a file to unpack.
+//
+static void AddJob(const char * Name)
+{
+    if (NumJobs == MaxJobs)
+    {
+        MaxJobs = MaxJobs ? MaxJobs * 2 : 64;
+        if ((Jobs = realloc(Jobs, MaxJobs * sizeof(UNPACKED))) == 0)
+            ErrExit("Out of memory");
+    }
+    memset(&Jobs[NumJobs], 0, sizeof(UNPACKED));
+    if ((Jobs[NumJobs++].Name = strdup(Name)) == 0)
+        ErrExit("Out of memory");
+}
+
+//////////////////////////////////////////////////////////////////////////
+// CompareNames() orders directory entries for qsort().
+//
+static int CompareNames(const void * a, const void * b)
+{
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// AddInput() adds a file, the .hex files in a directory, or the inputs
+// named one per line in @<file>.
+//
+static void AddInput(const char * Arg)
+{
+    struct stat     st;
+    DIR *           d;
+    struct dirent * de;
+    FILE *          List;
+    char **         Names = 0;
+    int             NumNames = 0;
+    char            Line[NAMELEN + 2];
+    char *          End;
+    char *          Ext;
+    int             i;
+
+    if (Arg[0] == '@')
+    {
+        if ((List = fopen(Arg + 1, "r")) == 0)
+            ErrExit("Cannot open response file %s", Arg + 1);
+        while (fgets(Line, sizeof(Line), List) != 0)
+        {
+            End = Line + strlen(Line);
+            while ((End > Line) && isspace((BYTE)End[-1]))
+                *(--End) = 0;
+            if (Line[0] != 0)
+                AddInput(Line);
+        }
+        fclose(List);
+    }
+    else if ((stat(Arg, &st) == 0) && S_ISDIR(st.st_mode))
+    {
+        if ((d = opendir(Arg)) == 0)
+            ErrExit("Cannot read directory %s", Arg);
+        while ((de = readdir(d)) != 0)
+            if (((Ext = strrchr(de->d_name, '.')) != 0) &&
+                (strcasecmp(Ext, ".hex") == 0))
+            {
+                if ((Names = realloc(Names, (NumNames + 1) * sizeof(char *)))
+                        == 0)
+                    ErrExit("Out of memory");
+                Names[NumNames++] = strdup(de->d_name);
+            }
+        closedir(d);
+
+        qsort(Names, NumNames, sizeof(char *), CompareNames);
+        for (i = 0; i < NumNames; i++)
+        {
+            snprintf(Line, sizeof(Line), "%s/%s", Arg, Names[i]);
+            AddJob(Line);
+            free(Names[i]);
+        }
+        free(Names);
+    }
+    else
+        AddJob(Arg);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Worker() unpacks jobs until none are left.  Files take about as long
+// as they are big, and there are many, so a shared counter spreads them
+// well enough.
+//
+static void * Worker(void * Arg)
+{
+    int Job;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&JobLock);
+        Job = NextJobIndex++;
+        pthread_mutex_unlock(&JobLock);
+        if (Job >= NumJobs)
+            return 0;
+        Unpack(&Jobs[Job]);
+    }
+}
+
+int main(int argc, char * argv[])
+{
+    pthread_t * Threads;
+    char *      End;
+    int         Failures = 0;
+    int         i;
+
+    for (i = 1; i < argc; i++)
+        if (strncmp(argv[i], "--", 2) != 0)
+            AddInput(argv[i]);
+        else if (strcmp(argv[i], "--image") == 0)
+            MakeImage = TRUE;
+        else if (strcmp(argv[i], "--exe") == 0)
+            MakeExe = TRUE;
+        else if ((strncmp(argv[i], "--dir=", 6) == 0) && (argv[i][6] != 0))
+            OutDir = argv[i] + 6;
+        else if (strncmp(argv[i], "--threads=", 10) == 0)
+        {
+            NumThreads = strtoul(argv[i] + 10, &End, 10);
+            if ((*End != 0) || (NumThreads == 0))
+                ShowHelp();
+        }
+        else if (strcmp(argv[i], "--stats") == 0)
+            ShowStats = TRUE;
+        else if ((strncmp(argv[i], "--trace=", 8) == 0) && (argv[i][8] != 0))
+            TraceName = argv[i] + 8;
+        else
+            ShowHelp();
+
+    if (NumJobs == 0)
+        ShowHelp();
+
+    if ((ShowStats || (TraceName != 0)) &&
+        (E86TraceOpen(TraceName, ShowStats) != 0))
+        ErrExit("Cannot create trace file %s", TraceName);
+
+    if (NumThreads == 0)
+        NumThreads = sysconf(_SC_NPROCESSORS_ONLN);
+    if ((NumThreads < 1) || (NumThreads > 0x10000))
+        NumThreads = 1;
+    if (NumThreads > (DWORD)NumJobs)
+        NumThreads = NumJobs;
+
+    if ((Threads = calloc(NumThreads, sizeof(pthread_t))) == 0)
+        ErrExit("Out of memory");
+    for (i = 1; i < (int)NumThreads; i++)
+        if (pthread_create(&Threads[i], 0, Worker, 0) != 0)
+            ErrExit("Cannot start worker thread");
+    Worker(0);
+    for (i = 1; i < (int)NumThreads; i++)
+        pthread_join(Threads[i], 0);
+
+    printf("# file\timage\trelocs\tentry\tstack\textra\trecord\tunloaded\n");
+    for (i = 0; i < NumJobs; i++)
+        if (Jobs[i].Lpd.Error[0] != 0)
+        {
+            fprintf(stderr, "%s: %s\n", Jobs[i].Name, Jobs[i].Lpd.Error);
+            Failures++;
+        }
+        else
+            printf("%s\t%u\t%u\t%04X:%04X\t%04X:%04X\t%u\t%u\t%u\n",
+                   Jobs[i].Name, Jobs[i].Lpd.ImageLength, Jobs[i].Lpd.Relocations,
+                   Jobs[i].Lpd.EntrySegment, Jobs[i].Lpd.EntryOffset,
+                   Jobs[i].Lpd.StackSegment, Jobs[i].Lpd.StackOffset,
+                   E86LpdExtra(&Jobs[i].Lpd), Jobs[i].Lpd.RecordLength,
+                   Jobs[i].Lpd.Unloaded);
+
+    E86TraceClose(stdout);
+    return Failures ? 1 : 0;
+}
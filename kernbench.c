@@ -0,0 +1,239 @@
+/******************************************************************************
+ *                                                                            *
+ *     KERNBENCH.C                                                            *
+ *                                                                            *
+ *     Times the data kernels the E86Mon utilities spend their time in,       *
+ *     each on its own, over buffers from 1K to 16M:                          *
+ *                                                                            *
+ *       hex           32 byte data records as DataRecord() prints them:      *
+ *                     HexEncode() of the data, the record fields and the     *
+ *                     checksum                                               *
+ *       decode        HexDecode() of the buffer's worth of hex digits        *
+ *       deinterleave  MakeBin's split of an image into the two ROMs of a     *
+ *                     16 bit pair: HexSplitLanes() of both lanes             *
+ *       interleave    the pair put back together: HexInterleave()            *
+ *       checksum      HexSum() of the buffer                                 *
+ *       relocs        HexReloLinear() of a relocation table of that size     *
+ *                                                                            *
+ *     Kernels with SIMD versions are timed at every level the CPU runs.      *
+ *     Each figure is the best of several batches of calls, so that small     *
+ *     buffers are not swamped by the clock.                                  *
+ *                                                                            *
+ *     Output is one line per kernel, level and size, in whitespace           *
+ *     separated columns under a header; lines starting with '#' describe     *
+ *     the build and may be skipped by whatever reads the figures.            *
+ *                                                                            *
+ *     Usage: kernbench [<megabytes per figure>]                              *
+ *                                                                            *
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "hexkern.h"
+
+#define MINSIZE     0x400L      // 1K
+#define MAXSIZE     0x1000000L  // 16M
+#define BATCHBYTES  0x100000L   // Bytes handled between clock readings
+#define MINBATCHES  3
+#define DEFMB       64
+#define RECORDLEN   32          // As BYTESPERLINE in E86HEX.H
+#define RECORDTEXT  (1 + 2 * (1 + 2 + 1 + RECORDLEN + 1) + 1)
+
+typedef void BENCHFN(unsigned long Size);
+
+static unsigned char * Src;
+static char *          Text;        // Src as hex digits
+static unsigned char * Dst;
+static unsigned char * Dst2;
+static volatile unsigned long Sink;
+
+static const char HexDigits[] = "0123456789ABCDEF";
+
+//////////////////////////////////////////////////////////////////////////
+// PutByte() prints a byte as two hex digits at Dst.
+//
+static char * PutByte(char * Dst, unsigned char Value)
+{
+    Dst[0] = HexDigits[Value >> 4];
+    Dst[1] = HexDigits[Value & 0xF];
+    return Dst + 2;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// The kernels, each handling Size bytes of input.
+//
+static void BenchHex(unsigned long Size)
+{
+    char *          Out = (char *)Dst;
+    unsigned long   i;
+    unsigned        Len;
+    unsigned char   Sum;
+
+    for (i = 0; i < Size; i += Len)
+    {
+        Len = (Size - i < RECORDLEN) ? (unsigned)(Size - i) : RECORDLEN;
+        Sum = (unsigned char)(Len + (i >> 8) + i);
+        *(Out++) = ':';
+        Out = PutByte(Out, (unsigned char)Len);
+        Out = PutByte(Out, (unsigned char)(i >> 8));
+        Out = PutByte(Out, (unsigned char)i);
+        Out = PutByte(Out, 0);
+        Sum += HexEncode(Src + i, Len, Out);
+        Out = PutByte(Out + 2 * Len, (unsigned char)(0 - Sum));
+        *(Out++) = '\n';
+    }
+    Sink += Out - (char *)Dst;
+}
+
+static void BenchDecode(unsigned long Size)
+{
+    unsigned char Sum;
+
+    Sink += HexDecode(Text, Size, Dst, &Sum) + Sum;
+}
+
+static void BenchDeinterleave(unsigned long Size)
+{
+    unsigned long Sums[2];
+
+    HexSplitLanes(Src, Size / 2, Dst, Dst2, Sums);
+    Sink += Sums[0] + Sums[1];
+}
+
+static void BenchInterleave(unsigned long Size)
+{
+    HexInterleave(Src, Src + Size / 2, Size / 2, Dst);
+    Sink += Dst[0];
+}
+
+static void BenchChecksum(unsigned long Size)
+{
+    Sink += HexSum(Src, Size);
+}
+
+static void BenchRelocs(unsigned long Size)
+{
+    HexReloLinear((unsigned int *)Dst, Src, Size / 4);
+    Sink += ((unsigned int *)Dst)[0];
+}
+
+static const struct {
+    const char * Name;
+    BENCHFN *    Fn;
+    int          Levels;        // Has SIMD versions to time
+} Kernels[] = {
+    { "hex",          BenchHex,          1 },
+    { "decode",       BenchDecode,       1 },
+    { "deinterleave", BenchDeinterleave, 1 },
+    { "interleave",   BenchInterleave,   1 },
+    { "checksum",     BenchChecksum,     0 },
+    { "relocs",       BenchRelocs,       0 },
+};
+
+//////////////////////////////////////////////////////////////////////////
+// Now() returns the time in seconds.
+//
+static double Now(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Bench() times Fn on Size bytes, in batches of at least BATCHBYTES,
+// until Total bytes have been handled, and prints the best batch.
+//
+static void Bench(const char * Kernel, const char * Level, BENCHFN * Fn,
+                  unsigned long Size, unsigned long Total)
+{
+    unsigned long Calls = (BATCHBYTES + Size - 1) / Size;
+    unsigned long Batches = Total / (Calls * Size);
+    unsigned long b;
+    unsigned long c;
+    double        Start;
+    double        Time;
+    double        Best = -1;
+
+    if (Batches < MINBATCHES)
+        Batches = MINBATCHES;
+
+    Fn(Size);                   // Warm the caches and page in the buffers
+    for (b = 0; b < Batches; b++)
+    {
+        Start = Now();
+        for (c = 0; c < Calls; c++)
+            Fn(Size);
+        Time = Now() - Start;
+        if ((Best < 0) || (Time < Best))
+            Best = Time;
+    }
+
+    printf("%-12s %-6s %9lu %7lu %10.1f %9.4f\n", Kernel, Level, Size,
+           Calls * Batches, Calls * Size / Best / 1e6,
+           Best * 1e9 / (Calls * Size));
+    fflush(stdout);
+}
+
+int main(int argc, char * argv[])
+{
+    int           MB = (argc > 1) ? atoi(argv[1]) : DEFMB;
+    int           Top;
+    int           Level;
+    int           k;
+    unsigned long Size;
+    unsigned long i;
+    unsigned long Seed = 12345;
+
+    if (MB < 1)
+    {
+        fprintf(stderr, "Usage: kernbench [<megabytes per figure>]\n");
+        return 1;
+    }
+
+    Src  = malloc(MAXSIZE);
+    Dst  = malloc(MAXSIZE / RECORDLEN * RECORDTEXT + RECORDTEXT);
+    Dst2 = malloc(MAXSIZE / 2);
+    Text = malloc(2 * MAXSIZE);
+    if ((Src == 0) || (Dst == 0) || (Dst2 == 0) || (Text == 0))
+    {
+        fprintf(stderr, "kernbench: out of memory\n");
+        return 2;
+    }
+
+    for (i = 0; i < MAXSIZE; i++)
+    {
+        Seed = Seed * 1103515245 + 12345;
+        Src[i] = (unsigned char)(Seed >> 16);
+    }
+    HexEncode(Src, MAXSIZE, Text);
+
+    Top = HexSetKernelLevel(HEXKERN_AVX512);
+
+#ifdef __VERSION__
+    printf("# compiler %s\n", __VERSION__);
+#endif
+    printf("# best kernel level %s\n", HexKernelName(Top));
+    printf("%-12s %-6s %9s %7s %10s %9s\n", "kernel", "level", "bytes",
+           "calls", "MB/s", "ns/byte");
+
+    for (k = 0; k < (int)(sizeof(Kernels) / sizeof(Kernels[0])); k++)
+        for (Level = Kernels[k].Levels ? HEXKERN_SCALAR : Top; Level <= Top;
+             Level++)
+        {
+            HexSetKernelLevel(Level);
+            for (Size = MINSIZE; Size <= MAXSIZE; Size *= 4)
+                Bench(Kernels[k].Name,
+                      Kernels[k].Levels ? HexKernelName(Level) : "c",
+                      Kernels[k].Fn, Size, MB * 0x100000L);
+        }
+
+    free(Src);
+    free(Dst);
+    free(Dst2);
+    free(Text);
+    return 0;
+}
@@ -0,0 +1,316 @@
+/******************************************************************************
+ *                                                                            *
+ *     KERNCHECK.C                                                            *
+ *                                                                            *
+ *     Checks the data kernels at every level the CPU runs against plain      *
+ *     C references written the way the tools used to do the work: hex        *
+ *     digits from a table, as PrintByte() prints them, and byte at a time    *
+ *     loops for the rest.  Lengths and alignments are random, and cover     *
+ *     every length up to a few SIMD blocks, so that the vector loops and     *
+ *     the scalar tails after them are both run.  Buffers are surrounded      *
+ *     by guard bytes, which no kernel may change.                            *
+ *                                                                            *
+ *     Prints one line per level, and the first few failures in full.        *
+ *     The exit status is 0 if every check passed, 1 if not.                  *
+ *                                                                            *
+ *     Usage: kerncheck [<seed>]                                              *
+ *                                                                            *
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hexkern.h"
+
+#define MAXLEN      1100        // Longest buffer checked
+#define ALIGNS      64          // Offsets tried from an aligned buffer
+#define ROUNDS      3000        // Random lengths per kernel and level
+#define GUARD       64
+#define GUARDBYTE   0xA5
+#define MAXREPORTS  10
+
+static unsigned long Seed = 12345;
+static unsigned long Checks = 0;
+static unsigned long Failures = 0;
+
+static const char HexDigits[] = "0123456789ABCDEF";
+
+//////////////////////////////////////////////////////////////////////////
+// Random() returns a pseudo-random number below Limit.
+//
+static unsigned Random(unsigned Limit)
+{
+    Seed = Seed * 1103515245 + 12345;
+    return (unsigned)((Seed >> 16) % Limit);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// RandomLength() returns a length up to Max, most often a short one so
+// that the vector tails get most of the attention.
+//
+static unsigned RandomLength(unsigned Max)
+{
+    return Random(4) ? Random(Max < 200 ? Max + 1 : 200) : Random(Max + 1);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Check() counts a check, and reports it if it failed.
+//
+static void Check(int Good, const char * Kernel, int Level, unsigned Len,
+                  unsigned Align, const char * What)
+{
+    Checks++;
+    if (Good)
+        return;
+    if (++Failures <= MAXREPORTS)
+        printf("FAIL %s at level %s, length %u, offset %u: %s\n", Kernel,
+               HexKernelName(Level), Len, Align, What);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Guarded() tells whether the GUARD bytes either side of Len bytes at p
+// still hold the guard value.
+//
+static int Guarded(const unsigned char * p, unsigned Len)
+{
+    unsigned i;
+
+    for (i = 1; i <= GUARD; i++)
+        if ((p[-(int)i] != GUARDBYTE) || (p[Len + i - 1] != GUARDBYTE))
+            return 0;
+    return 1;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Buffers.  Src holds random bytes; Text the same as hex digits, in
+// random case.  The others are outputs, refilled with the guard value
+// before each call.
+//
+static unsigned char SrcBuf[2 * MAXLEN + ALIGNS + 2 * GUARD];
+static char          TextBuf[2 * MAXLEN + ALIGNS + 2 * GUARD];
+static unsigned char OutBuf[2 * MAXLEN + ALIGNS + 2 * GUARD];
+static unsigned char Out2Buf[2 * MAXLEN + ALIGNS + 2 * GUARD];
+static unsigned char RefBuf[2 * MAXLEN];
+static unsigned char Ref2Buf[2 * MAXLEN];
+
+static unsigned char * Out(unsigned Align)
+{
+    memset(OutBuf, GUARDBYTE, sizeof(OutBuf));
+    return OutBuf + GUARD + Align;
+}
+
+static unsigned char * Out2(unsigned Align)
+{
+    memset(Out2Buf, GUARDBYTE, sizeof(Out2Buf));
+    return Out2Buf + GUARD + Align;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// The kernels, each checked on one random length and alignment.
+//
+static void CheckEncode(int Level)
+{
+    unsigned        Len   = RandomLength(MAXLEN);
+    unsigned        Align = Random(ALIGNS);
+    unsigned char * Src   = SrcBuf + GUARD + Random(ALIGNS);
+    char *          Dst   = (char *)Out(Align);
+    unsigned char   Sum   = 0;
+    unsigned char   Got;
+    unsigned        i;
+
+    for (i = 0; i < Len; i++)
+    {
+        RefBuf[2 * i]     = HexDigits[Src[i] >> 4];
+        RefBuf[2 * i + 1] = HexDigits[Src[i] & 0xF];
+        Sum += Src[i];
+    }
+    Got = HexEncode(Src, Len, Dst);
+    Check(memcmp(Dst, RefBuf, 2 * Len) == 0, "HexEncode", Level, Len, Align,
+          "digits differ from PrintByte()");
+    Check(Got == Sum, "HexEncode", Level, Len, Align, "wrong sum");
+    Check(Guarded((unsigned char *)Dst, 2 * Len), "HexEncode", Level, Len,
+          Align, "wrote outside the output");
+}
+
+static void CheckDecode(int Level)
+{
+    unsigned        Len   = RandomLength(MAXLEN);
+    unsigned        Align = Random(ALIGNS);
+    char *          Text  = TextBuf + GUARD + Random(ALIGNS);
+    unsigned char * Dst   = Out(Align);
+    unsigned        Bad   = 2 * Len;
+    unsigned char   Sum   = 0;
+    unsigned char   GotSum;
+    unsigned        Got;
+    unsigned        i;
+    char            Saved = 0;
+
+    static const char NotHex[] = "g/:@G`\n \xC1";
+
+    for (i = 0; i < Len; i++)
+    {
+        RefBuf[i]       = (unsigned char)Random(256);
+        Text[2 * i]     = HexDigits[RefBuf[i] >> 4];
+        Text[2 * i + 1] = HexDigits[RefBuf[i] & 0xF];
+        if (Random(2) && (Text[2 * i] > '9'))
+            Text[2 * i] |= 0x20;
+        if (Random(2) && (Text[2 * i + 1] > '9'))
+            Text[2 * i + 1] |= 0x20;
+    }
+
+    //
+    // A quarter of the time one character is not a hex digit.
+    //
+    if ((Len > 0) && (Random(4) == 0))
+    {
+        Bad = Random(2 * Len);
+        Saved = Text[Bad];
+        Text[Bad] = NotHex[Random(sizeof(NotHex) - 1)];
+    }
+    for (i = 0; i < Bad / 2; i++)
+        Sum += RefBuf[i];
+
+    Got = HexDecode(Text, Len, Dst, &GotSum);
+    Check(Got == Bad, "HexDecode", Level, Len, Align,
+          "wrong offset of the first bad digit");
+    Check(memcmp(Dst, RefBuf, Bad / 2) == 0, "HexDecode", Level, Len, Align,
+          "bytes differ");
+    Check(GotSum == Sum, "HexDecode", Level, Len, Align, "wrong sum");
+    Check(Guarded(Dst, Len), "HexDecode", Level, Len, Align,
+          "wrote outside the output");
+    if (Bad < 2 * Len)
+        Text[Bad] = Saved;
+}
+
+static void CheckUniform(int Level)
+{
+    unsigned        Len   = RandomLength(MAXLEN);
+    unsigned        Align = Random(ALIGNS);
+    unsigned char * Buf   = Out(Align);
+    int             Value = Random(2) ? 0xFF : (int)Random(256);
+    int             Want  = (Len > 0) ? Value : -1;
+
+    memset(Buf, Value, Len);
+    if ((Len > 1) && Random(2))
+    {
+        Buf[Random(Len)] ^= 1 << Random(8);
+        Want = -1;
+    }
+    Check(HexUniform(Buf, Len) == Want, "HexUniform", Level, Len, Align,
+          "wrong answer");
+}
+
+static void CheckLanes(int Level)
+{
+    unsigned        Len   = RandomLength(MAXLEN);
+    unsigned        Align = Random(ALIGNS);
+    unsigned char * Src   = SrcBuf + GUARD + Random(ALIGNS);
+    unsigned char * Even  = Out(Align);
+    unsigned char * Odd   = Out2(Random(ALIGNS));
+    unsigned long   Sums[2];
+    unsigned long   Want[2] = { 0, 0 };
+    unsigned        i;
+
+    for (i = 0; i < Len; i++)
+    {
+        Want[0] += (RefBuf[i]  = Src[2 * i]);
+        Want[1] += (Ref2Buf[i] = Src[2 * i + 1]);
+    }
+    HexSplitLanes(Src, Len, Even, Odd, Sums);
+    Check((memcmp(Even, RefBuf, Len) == 0) &&
+          (memcmp(Odd, Ref2Buf, Len) == 0), "HexSplitLanes", Level, Len,
+          Align, "lanes differ");
+    Check((Sums[0] == Want[0]) && (Sums[1] == Want[1]), "HexSplitLanes",
+          Level, Len, Align, "wrong sums");
+    Check(Guarded(Even, Len) && Guarded(Odd, Len), "HexSplitLanes", Level,
+          Len, Align, "wrote outside the output");
+
+    //
+    // The inverse must give the source back.
+    //
+    memcpy(RefBuf, Even, Len);
+    memcpy(Ref2Buf, Odd, Len);
+    Even = Out(Random(ALIGNS));
+    HexInterleave(RefBuf, Ref2Buf, Len, Even);
+    Check(memcmp(Even, Src, 2 * Len) == 0, "HexInterleave", Level, Len,
+          Align, "does not undo HexSplitLanes()");
+    Check(Guarded(Even, 2 * Len), "HexInterleave", Level, Len, Align,
+          "wrote outside the output");
+}
+
+static void CheckPortable(int Level)
+{
+    unsigned        Len    = RandomLength(MAXLEN / 4);
+    unsigned        Stride = 1 + Random(4);
+    unsigned        Align  = Random(ALIGNS);
+    unsigned char * Src    = SrcBuf + GUARD + Random(ALIGNS);
+    unsigned char * Dst    = Out(Align);
+    unsigned int    Linear[MAXLEN / 4];
+    unsigned long   Sum = 0;
+    unsigned        i;
+    int             Good = 1;
+
+    for (i = 0; i < Len; i++)
+        Sum += (RefBuf[i] = Src[i * Stride]);
+    Check((HexDeinterleave(Src, Stride, Len, Dst) == Sum) &&
+          (memcmp(Dst, RefBuf, Len) == 0) && Guarded(Dst, Len),
+          "HexDeinterleave", Level, Len, Align, "wrong bytes or sum");
+
+    for (i = 0, Sum = 0; i < Len; i++)
+        Sum += Src[i];
+    Check(HexSum(Src, Len) == Sum, "HexSum", Level, Len, Align, "wrong sum");
+
+    HexReloLinear(Linear, Src, Len / 4);
+    for (i = 0; i < Len / 4; i++)
+        Good &= (Linear[i] == (unsigned)(((Src[4 * i + 3] << 8) |
+                                           Src[4 * i + 2]) << 4) +
+                              ((Src[4 * i + 1] << 8) | Src[4 * i]));
+    Check(Good, "HexReloLinear", Level, Len, Align, "wrong linear address");
+}
+
+int main(int argc, char * argv[])
+{
+    int           Top;
+    int           Level;
+    int           Got;
+    unsigned long Before;
+    unsigned      i;
+
+    if (argc > 1)
+        Seed = strtoul(argv[1], 0, 10);
+
+    memset(SrcBuf, GUARDBYTE, sizeof(SrcBuf));
+    memset(TextBuf, GUARDBYTE, sizeof(TextBuf));
+    for (i = GUARD; i < sizeof(SrcBuf) - GUARD; i++)
+        SrcBuf[i] = (unsigned char)Random(256);
+
+    Top = HexSetKernelLevel(HEXKERN_AVX512);
+    for (Level = HEXKERN_SCALAR; Level <= Top; Level++)
+    {
+        Before = Failures;
+        if ((Got = HexSetKernelLevel(Level)) != Level)
+        {
+            printf("FAIL level %s selected as %s\n", HexKernelName(Level),
+                   HexKernelName(Got));
+            Failures++;
+            continue;
+        }
+
+        for (i = 0; i < ROUNDS; i++)
+        {
+            CheckEncode(Level);
+            CheckDecode(Level);
+            CheckUniform(Level);
+            CheckLanes(Level);
+        }
+        if (Level == HEXKERN_SCALAR)
+            for (i = 0; i < ROUNDS; i++)
+                CheckPortable(Level);
+
+        printf("kerncheck: level %-6s %s\n", HexKernelName(Level),
+               (Failures == Before) ? "passed" : "FAILED");
+    }
+
+    printf("kerncheck: %lu checks, %lu failed\n", Checks, Failures);
+    return (Failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,198 @@
+/******************************************************************************
+ *                                                                            *
+ *     RELOBENCH.C                                                            *
+ *                                                                            *
+ *     Times the relocation stage of libe86hex on synthetic EXE files with    *
+ *     up to the largest relocation table an MZ header can describe.  Each    *
+ *     image is converted with and without its relocations, and the           *
+ *     difference is charged to the relocations.                              *
+ *                                                                            *
+ *     Usage: relobench [<repeats>]                                           *
+ *                                                                            *
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "e86hex.h"
+
+#define HEADERLEN   0x1C        // MZ header fields before the table
+#define DGROUPPARA  0x400       // Paragraph DGROUP starts at, for absolute
+#define DEFREPEATS  20
+
+//////////////////////////////////////////////////////////////////////////
+// PutWord() stores a little endian word.
+//
+static void PutWord(LPBYTE Ptr, WORD Value)
+{
+    Ptr[0] = (BYTE)Value;
+    Ptr[1] = (BYTE)(Value >> 8);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// MakeExe() builds an EXE of ProgLength bytes with Relocations table
+// entries, and returns it (Length set to its size), or 0 if out of
+// memory.  For an absolute conversion (DGROUP set) every entry points
+// into DGROUP below 32K, at a word holding DGROUP's paragraph, as
+// MakeHex requires; otherwise targets are spread over the program.
+// Entries alternate between normalized and unnormalized segment:offset
+// pairs so that both conversions get used.
+//
+static LPBYTE MakeExe(DWORD ProgLength, DWORD Relocations, BOOL DGROUP,
+                      DWORD * Length)
+{
+    DWORD  HdrLength = (HEADERLEN + 4 * Relocations + 15) & ~15L;
+    DWORD  Total = HdrLength + ProgLength;
+    DWORD  Seed = 12345;
+    DWORD  Target;
+    DWORD  i;
+    LPBYTE Exe = calloc(1, Total);
+    LPBYTE Prog = Exe + HdrLength;
+
+    if (Exe == 0)
+        return 0;
+
+    for (i = 0; i < ProgLength; i++)
+    {
+        Seed = Seed * 1103515245 + 12345;
+        Prog[i] = (BYTE)(Seed >> 16);
+    }
+
+    for (i = 0; i < Relocations; i++)
+    {
+        Seed = Seed * 1103515245 + 12345;
+        if (DGROUP)
+        {
+            Target = DGROUPPARA * 16 +
+                     2 * ((Seed >> 8) % ((0x7FFE - DGROUPPARA * 16) / 2));
+            PutWord(Prog + Target, DGROUPPARA);
+        }
+        else
+            Target = (Seed >> 4) % (ProgLength - 1);
+
+        if (i & 1)
+        {
+            PutWord(Exe + HEADERLEN + 4 * i, (WORD)(Target & 0xF));
+            PutWord(Exe + HEADERLEN + 4 * i + 2, (WORD)(Target >> 4));
+        }
+        else
+        {
+            PutWord(Exe + HEADERLEN + 4 * i, (WORD)Target);
+            PutWord(Exe + HEADERLEN + 4 * i + 2, (WORD)((Target >> 16) << 12));
+        }
+    }
+
+    PutWord(Exe, 0x5A4D);
+    PutWord(Exe + 2, (WORD)(Total % 512));
+    PutWord(Exe + 4, (WORD)((Total + 511) / 512));
+    PutWord(Exe + 6, (WORD)Relocations);
+    PutWord(Exe + 8, (WORD)(HdrLength / 16));
+    PutWord(Exe + 10, 0x10);
+    PutWord(Exe + 12, 0xFFFF);
+    PutWord(Exe + 16, 0x100);
+    PutWord(Exe + 24, HEADERLEN);
+
+    *Length = Total;
+    return Exe;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// TimeConvert() converts the image Repeats times, and returns the best
+// time of one conversion in seconds, or -1 if it fails.
+//
+static double TimeConvert(LPBYTE Exe, DWORD Length, BOOL DGROUP,
+                          int Repeats)
+{
+    E86HEXOPTIONS   Opts;
+    E86HEX *        Ctx;
+    struct timespec Start;
+    struct timespec End;
+    double          Best = -1;
+    double          Time;
+    int             i;
+
+    E86HexDefaults(&Opts);
+    Opts.Relocatable = !DGROUP;
+    Opts.Segment     = 0x0800;
+
+    if ((Ctx = E86HexCreate(&Opts)) == 0)
+        return -1;
+
+    for (i = 0; i < Repeats; i++)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &Start);
+        if ((E86HexInputMemory(Ctx, Exe, Length, E86HEX_EXE) != E86HEX_OK) ||
+            (E86HexConvert(Ctx) != E86HEX_OK))
+        {
+            fprintf(stderr, "relobench: %s\n", E86HexError(Ctx));
+            E86HexDestroy(Ctx);
+            return -1;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &End);
+
+        Time = (End.tv_sec - Start.tv_sec) +
+               (End.tv_nsec - Start.tv_nsec) / 1e9;
+        if ((Best < 0) || (Time < Best))
+            Best = Time;
+    }
+
+    E86HexDestroy(Ctx);
+    return Best;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Bench() times one synthetic EXE, and prints a line of results.
+// Returns FALSE if it could not.
+//
+static BOOL Bench(DWORD ProgLength, DWORD Relocations, BOOL DGROUP,
+                  int Repeats)
+{
+    LPBYTE Exe;
+    DWORD  Length;
+    double With;
+    double Without;
+
+    if ((Exe = MakeExe(ProgLength, Relocations, DGROUP, &Length)) == 0)
+        return FALSE;
+
+    With = TimeConvert(Exe, Length, DGROUP, Repeats);
+
+    //
+    // The same image with an empty table.
+    //
+    PutWord(Exe + 6, 0);
+    Without = TimeConvert(Exe, Length, DGROUP, Repeats);
+    free(Exe);
+
+    if ((With < 0) || (Without < 0))
+        return FALSE;
+
+    printf("%-11s %6u %8u %10.3f %10.3f %10.1f\n",
+           DGROUP ? "dgroup" : "relocatable", Relocations, ProgLength,
+           With * 1e3, Without * 1e3,
+           (With > Without) ? (With - Without) * 1e9 / Relocations : 0.0);
+    return TRUE;
+}
+
+int main(int argc, char * argv[])
+{
+    static const DWORD Counts[] = { 1024, 8192, 32768, 65535 };
+    int Repeats = (argc > 1) ? atoi(argv[1]) : DEFREPEATS;
+    int i;
+
+    if (Repeats < 1)
+    {
+        fprintf(stderr, "Usage: relobench [<repeats>]\n");
+        return 1;
+    }
+
+    printf("%-11s %6s %8s %10s %10s %10s\n", "mode", "relocs", "bytes",
+           "ms", "ms-norelo", "ns/reloc");
+
+    for (i = 0; i < (int)(sizeof(Counts) / sizeof(Counts[0])); i++)
+        if (!Bench(0x40000L, Counts[i], FALSE, Repeats) ||
+            !Bench(0x8000L, Counts[i], TRUE, Repeats))
+            return 2;
+    return 0;
+}
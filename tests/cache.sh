@@ -0,0 +1,70 @@
+#
+# --cache: a plain conversion which writes over an output the cache
+# made, or stored, leaves the cached entry alone, so the next cached
+# conversion of the first input still gets the first input's output.
+# Binary output is cached as a pair, and the options are in the key.
+#
+
+. tests/common.sh
+
+echo "cache"
+
+Images="F010_ALL.BIN F010_LOW.BIN F010_HI.BIN F200_ALL.BIN F400_ALL.BIN"
+
+cd "$Tmp"
+unset E86_CACHE
+
+#
+# MakeHex: SECONDS, then TESTMON under the same name without the cache,
+# then SECONDS again.
+#
+cp "$Top/hex_files/SECONDS.EXE" prog.exe
+"$Top/Makehex330" --cache="$Tmp/cache" prog > /dev/null
+cp prog.hex seconds.hex
+cp "$Top/hex_files/TESTMON.EXE" prog.exe
+"$Top/Makehex330" prog > /dev/null
+cp "$Top/hex_files/SECONDS.EXE" prog.exe
+"$Top/Makehex330" --cache="$Tmp/cache" prog | grep Cache |
+    sed "s|$Tmp/||" > out
+cmp -s prog.hex seconds.hex
+status "MakeHex output from the cache" 0 $?
+
+#
+# MakeBin: A, then B without the cache, then A again.
+#
+"$Top/corpusgen" --size=16K --fill=random --seed=1 a.exe > /dev/null
+"$Top/corpusgen" --size=16K --fill=random --seed=2 b.exe > /dev/null
+"$Top/Makebin330" --cache="$Tmp/cache" a > /dev/null
+cksum $Images > a.sums
+"$Top/Makebin330" b > /dev/null
+"$Top/Makebin330" --cache="$Tmp/cache" a | grep Cache |
+    sed "s|$Tmp/||" >> out
+cksum $Images | cmp -s - a.sums
+status "MakeBin images from the cache" 0 $?
+
+#
+# MakeHex --binary: a hit makes both files again, and they are not
+# links to the entry.  A hex file with other options is a miss.
+#
+"$Top/Makehex330" --cache="$Tmp/cache" --binary prog > /dev/null
+mv prog.img first.img
+mv prog.rel first.rel
+"$Top/Makehex330" --cache="$Tmp/cache" --binary prog | grep Cache |
+    sed "s|$Tmp/||" >> out
+cmp -s prog.img first.img && cmp -s prog.rel first.rel
+status "MakeHex image and sidecar from the cache" 0 $?
+ls -l prog.img prog.rel | awk '{ print $2, $NF }' >> out
+"$Top/Makehex330" --cache="$Tmp/cache" --record=16 prog | grep Cache |
+    sed "s|$Tmp/||" >> out
+
+same "hits and misses" out <<'END'
+Cache cache: 1 hit(s), 0 miss(es).
+Cache cache: 1 hit(s), 0 miss(es).
+Cache cache: 1 hit(s), 0 miss(es).
+1 prog.img
+1 prog.rel
+Cache cache: 0 hit(s), 1 miss(es).
+END
+
+cd "$Top"
+finish
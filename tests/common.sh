@@ -0,0 +1,51 @@
+#
+# Shared by the tool tests.  Each test runs from the top of the tree, on
+# the tools make v330 built, with a scratch directory that is removed
+# when it exits.  A test prints one line per check, and exits 1 if any
+# of them failed.
+#
+
+Top=$(pwd)
+Tmp=$(mktemp -d) || exit 2
+trap 'rm -rf "$Tmp"' EXIT
+Failed=0
+
+#
+# pass <what> / fail <what> record the result of a check.
+#
+pass() {
+    echo "  ok    $1"
+}
+
+fail() {
+    echo "  FAIL  $1"
+    Failed=1
+}
+
+#
+# same <what> <file> compares <file> with the text on stdin, and shows
+# the difference if they are not the same.
+#
+same() {
+    if diff -u - "$2" > "$Tmp/diff"; then
+        pass "$1"
+    else
+        fail "$1"
+        cat "$Tmp/diff"
+    fi
+}
+
+#
+# status <what> <expected> <actual> checks an exit status.
+#
+status() {
+    if [ "$2" = "$3" ]; then
+        pass "$1"
+    else
+        fail "$1: exit status $3, expected $2"
+    fi
+}
+
+finish() {
+    exit $Failed
+}
@@ -0,0 +1,72 @@
+#
+# e86load: the samples load at the registers E86Mon gives them, loads
+# that do not fit are failed with the reason, and the memory image at
+# segment 0 is MakeHex --binary's image of the sample's EXE, which the
+# relocations then move by the load segment.
+#
+
+. tests/common.sh
+
+echo "e86load"
+
+./e86load --segment=0,2345,FE00 --image --dir="$Tmp" hex_files \
+    > "$Tmp/out" 2> "$Tmp/errors"
+status "loads past 1M fail" 1 $?
+same "absolute LEDS.HEX is refused" "$Tmp/errors" <<'END'
+hex_files/LEDS.HEX: line 2: no AMD LPD header; not a relocatable hex file
+END
+same "registers and results" "$Tmp/out" <<'END'
+# file	segment	cs:ip	ss:sp	end	sum	result
+hex_files/AMDDHRY.HEX	0000	0000:088E	043C:0800	004BF	13E9DF	ok
+hex_files/AMDDHRY.HEX	2345	2345:088E	2781:0800	02804	13EBE7	ok
+hex_files/AMDDHRY.HEX	FE00	FE00:088E	023C:0800	102BF	13EAD5	loads past the top of RAM; a segment wraps past 1M (4 relocations)
+hex_files/SECONDS.HEX	0000	0000:00AE	0193:0800	00217	A2E97	ok
+hex_files/SECONDS.HEX	2345	2345:00AE	24D8:0800	0255C	A309F	ok
+hex_files/SECONDS.HEX	FE00	FE00:00AE	FF93:0800	10017	A338D	loads past the top of RAM
+hex_files/TESTMON.HEX	0000	0000:13E8	034E:0800	003D1	156BD5	ok
+hex_files/TESTMON.HEX	2345	2345:13E8	2693:0800	02716	156DDD	ok
+hex_files/TESTMON.HEX	FE00	FE00:13E8	014E:0800	101D1	156CCB	loads past the top of RAM; a segment wraps past 1M (4 relocations)
+# 4 files, 6 loads good, 6 failed
+END
+
+./e86load --quiet --top=1100 --segment=1000 hex_files/SECONDS.HEX \
+    > "$Tmp/out"
+same "--top and --quiet" "$Tmp/out" <<'END'
+hex_files/SECONDS.HEX	1000	1000:00AE	1193:0800	01217	A2EE7	loads past the top of RAM
+# 1 files, 0 loads good, 1 failed
+END
+
+cd "$Tmp"
+Good=1
+for Name in AMDDHRY SECONDS TESTMON
+do
+    cp "$Top/hex_files/$Name.EXE" $Name.exe
+    "$Top/Makehex330" --binary $Name > /dev/null
+    cmp -s -n $(wc -c < $Name.img) $Name.img ${Name}_0000.mem || Good=0
+done
+if [ $Good = 1 ]; then
+    pass "images at segment 0"
+else
+    fail "images at segment 0"
+fi
+
+#
+# SECONDS has five relocations, words 0158 or 0000, which become 249D
+# and 2345 at segment 2345; nothing else changes.
+#
+cmp -l SECONDS_0000.mem SECONDS_2345.mem > out
+cd "$Top"
+same "relocated words" "$Tmp/out" <<'END'
+ 189 130 235
+ 190   1  44
+ 395   0 105
+ 396   0  43
+ 425 130 235
+ 426   1  44
+5489 130 235
+5490   1  44
+5685 130 235
+5686   1  44
+END
+
+finish
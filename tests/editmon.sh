@@ -0,0 +1,65 @@
+#
+# EditMon: the permanent variables of a corpusgen E86Mon table are read
+# and set at their 32 bit size, and errors are reported, not crashed
+# on, including the one for a trace file which cannot be created.
+#
+
+. tests/common.sh
+
+echo "EditMon"
+
+"$Top/corpusgen" --size=8K --lpd=3 --seed=2 "$Tmp/mon.exe" > /dev/null
+cp "$Tmp/mon.exe" "$Tmp/old.exe"
+./Editmon330 "$Tmp/mon" > "$Tmp/out"
+status "table read" 0 $?
+./Editmon330 "$Tmp/mon" BAUD 4000000000 >> "$Tmp/out"
+status "variable set" 0 $?
+same "variables" "$Tmp/out" <<'END'
+
+
+Current permanent variable values:
+
+    BAUD       = 19200
+    CPU        = 814
+    VAR2       = 612
+
+
+Current permanent variable values:
+
+    BAUD       = 4000000000
+    CPU        = 814
+    VAR2       = 612
+END
+cmp -l "$Tmp/old.exe" "$Tmp/mon.exe" | awk '{ print $1, $2, $3 }' \
+    > "$Tmp/out"
+same "only its bytes written" "$Tmp/out" <<'END'
+126 113 50
+127 0 153
+128 0 356
+END
+
+./Editmon330 "$Tmp/mon" NOSUCH 1 > "$Tmp/out"
+status "unknown variable" 2 $?
+./Editmon330 "$Tmp/mon" BAUD 12x >> "$Tmp/out"
+status "bad value" 2 $?
+./Editmon330 "$Tmp/missing" >> "$Tmp/out"
+status "missing source file" 2 $?
+./Editmon330 --trace="$Tmp/no/trace.json" "$Tmp/missing" >> "$Tmp/out"
+status "trace file which cannot be created" 2 $?
+sed "s|$Tmp/||" "$Tmp/out" > "$Tmp/errors"
+same "errors" "$Tmp/errors" <<'END'
+
+EditMon Error -- Cannot find variable 'NOSUCH'!
+
+
+EditMon Error -- '12x' is not a valid decimal value
+
+
+EditMon Error -- Cannot open source file missing.exe
+
+
+EditMon Error -- Cannot create trace file no/trace.json
+
+END
+
+finish
@@ -0,0 +1,55 @@
+#
+# hexblock: each sample rewritten with a range of record lengths is
+# still a good hex file, loads the same bytes, and for a relocatable
+# file is loaded and relocated by E86Mon the same way.
+#
+
+. tests/common.sh
+
+echo "hexblock"
+
+for Name in AMDDHRY SECONDS TESTMON LEDS
+do
+    #
+    # The loads of the sample itself, to compare the others with.
+    #
+    Ref="$Tmp/$Name"
+    mkdir "$Ref"
+    [ $Name = LEDS ] ||
+        ./e86load --segment=1000,2345 --image --dir="$Ref" hex_files/$Name.HEX |
+            cut -f2- > "$Ref/loads"
+
+    Good=1
+    for Record in 1 16 64 255
+    do
+        Out="$Tmp/$Name-$Record"
+        mkdir "$Out"
+        ./hexblock --record=$Record --output="$Out/$Name.hex" \
+            hex_files/$Name.HEX > /dev/null &&
+        ./hexcheck --quiet "$Out/$Name.hex" &&
+        ./hexdiff --brief hex_files/$Name.HEX "$Out/$Name.hex" > /dev/null ||
+            Good=0
+        [ $Name = LEDS ] && continue
+
+        ./e86load --segment=1000,2345 --image --dir="$Out" "$Out/$Name.hex" |
+            cut -f2- > "$Out/loads"
+        cmp -s "$Ref/loads" "$Out/loads" &&
+        cmp -s "$Ref/${Name}_1000.mem" "$Out/${Name}_1000.mem" &&
+        cmp -s "$Ref/${Name}_2345.mem" "$Out/${Name}_2345.mem" || Good=0
+    done
+    if [ $Good = 1 ]; then
+        pass "$Name.HEX at 1, 16, 64 and 255 byte records"
+    else
+        fail "$Name.HEX at 1, 16, 64 and 255 byte records"
+    fi
+done
+
+./hexblock --record=64 - < hex_files/LEDS.HEX > "$Tmp/stdin.hex" 2> "$Tmp/out"
+cmp -s "$Tmp/stdin.hex" "$Tmp/LEDS-64/LEDS.hex"
+status "standard input gives the same file" 0 $?
+same "records and download estimate" "$Tmp/out" <<'END'
+-: 444 data bytes, 36 records (1380 chars) in, 15 records (1107 chars) out.
+Estimated download time at 19200 baud, 64 byte records: 0.6 seconds, was 0.8.
+END
+
+finish
@@ -0,0 +1,45 @@
+#
+# hexcheck: the samples are accepted, and each kind of damage is put at
+# the line and column where it is, as file:line:column.
+#
+
+. tests/common.sh
+
+echo "hexcheck"
+
+./hexcheck --quiet hex_files/*.HEX > "$Tmp/out"
+status "samples are good" 0 $?
+
+L=hex_files/LEDS.HEX
+sed '3s/59\r$/58\r/'          $L > "$Tmp/sum.hex"
+sed '3s/^\(:1000\)1/\1G/'     $L > "$Tmp/digit.hex"
+sed '3s/^\(:1000100\)0/\1\r/' $L > "$Tmp/cr.hex"
+sed '4s/^://'                 $L > "$Tmp/colon.hex"
+sed '2s/^:10/:11/'            $L > "$Tmp/length.hex"
+sed '2s/00\r$/0\r/'           $L > "$Tmp/odd.hex"
+sed '1s/.*/:00000007F9\r/'    $L > "$Tmp/type.hex"
+sed '$d'                      $L > "$Tmp/noend.hex"
+
+cd "$Tmp"
+"$Top/hexcheck" --quiet sum.hex digit.hex cr.hex colon.hex length.hex odd.hex \
+    type.hex noend.hex > out 2>&1
+status "damaged files are rejected" 1 $?
+cd "$Top"
+same "error columns" "$Tmp/out" <<'END'
+sum.hex:3:42: checksum 58, should be 59
+digit.hex:3:6: 'G' is not a hex digit
+cr.hex:3:9: carriage return inside a record
+colon.hex:4:1: record does not start with ':'
+length.hex:2:2: record length 11, but 16 data bytes
+odd.hex:2:42: odd number of hex digits
+type.hex:1:8: unknown record type 07
+noend.hex:36:1: no end of file record
+END
+
+tr -d '\r' < $L > "$Tmp/lf.hex"
+./hexcheck "$Tmp/lf.hex" | head -1 | sed 's/.*: //' > "$Tmp/out"
+same "LF line ends" "$Tmp/out" <<'END'
+OK, 36 records (30 data, 4 segment, 1 start, 1 end), 444 data bytes, LF
+END
+
+finish
@@ -0,0 +1,68 @@
+#
+# hexdiff: files which load the same compare equal whatever their record
+# length, and changed, added and removed bytes, header fields and
+# relocations are each listed, with exit status 1.
+#
+
+. tests/common.sh
+
+echo "hexdiff"
+
+#
+# Two bytes changed in a way that leaves the record checksum alone, and
+# a record left out.
+#
+L=hex_files/LEDS.HEX
+sed '2s/^:10000000FAFC/:10000000FBFB/' $L > "$Tmp/changed.hex"
+sed '5d'                               $L > "$Tmp/removed.hex"
+
+cd "$Tmp"
+cp "$Top/hex_files/AMDDHRY.EXE" short.exe
+"$Top/Makehex330" --record=16 short > /dev/null
+"$Top/hexdiff" "$Top/hex_files/AMDDHRY.HEX" short.hex > out
+status "16 byte records load the same as 32" 0 $?
+"$Top/hexdiff" --bytes "$Top/$L" changed.hex > out
+status "changed bytes differ" 1 $?
+"$Top/hexdiff" removed.hex "$Top/$L" >> out
+"$Top/hexdiff" --brief "$Top/$L" removed.hex >> out
+"$Top/hexdiff" nosuch.hex removed.hex 2>> out
+status "missing file is an error" 2 $?
+cd "$Top"
+same "changed, added and removed ranges" "$Tmp/out" <<END
+--- $Top/$L
++++ changed.hex
+changed  000C0000-000C0001 (2 bytes)
+  - FA FC
+  + FB FB
+2 bytes changed in 1 ranges, 0 added in 0, 0 removed in 0; 0 relocations and 0 header fields differ
+--- removed.hex
++++ $Top/$L
+added    000C0030-000C003F (16 bytes)
+0 bytes changed in 0 ranges, 16 added in 1, 0 removed in 0; 0 relocations and 0 header fields differ
+0 bytes changed in 0 ranges, 0 added in 0, 16 removed in 1; 0 relocations and 0 header fields differ
+nosuch.hex: cannot open
+END
+
+./hexdiff hex_files/SECONDS.HEX hex_files/TESTMON.HEX | grep -v '^changed' \
+    > "$Tmp/out"
+same "header fields and relocations" "$Tmp/out" <<'END'
+--- hex_files/SECONDS.HEX
++++ hex_files/TESTMON.HEX
+header   start 0000:00AE -> 0000:13E8
+header   image length 1927 -> 34D5
+header   stack 0193:0800 -> 034E:0800
+added    00001927-000034D4 (7086 bytes)
+-reloc   000000BC
+-reloc   0000018A
+-reloc   000001A8
++reloc   000013F6
++reloc   000014C4
++reloc   000014E2
+-reloc   00001570
+-reloc   00001634
++reloc   000028F0
++reloc   000031E4
+6315 bytes changed in 101 ranges, 7086 added in 1, 0 removed in 0; 10 relocations and 3 header fields differ
+END
+
+finish
@@ -0,0 +1,56 @@
+#
+# hexmerge: LEDS.HEX cut in two merges back into a file which loads the
+# same, in fewer records, with segment or linear addresses; inputs which
+# load different bytes at one address are refused unless --overlap says
+# which to keep.
+#
+
+. tests/common.sh
+
+echo "hexmerge"
+
+L=hex_files/LEDS.HEX
+sed -n '1,25p;36p' $L                  > "$Tmp/low.hex"
+sed -n '26,36p'    $L                  > "$Tmp/high.hex"
+sed '2s/^:10000000FAFC/:10000000FBFB/' $L > "$Tmp/changed.hex"
+
+cd "$Tmp"
+"$Top/hexmerge" --output=merged.hex low.hex high.hex > out
+status "halves merge" 0 $?
+"$Top/hexdiff" --brief "$Top/$L" merged.hex > /dev/null
+status "merged file loads the same" 0 $?
+"$Top/hexcheck" merged.hex | head -1 >> out
+"$Top/hexmerge" --linear --record=16 low.hex high.hex > linear.hex 2>> out
+"$Top/hexdiff" --brief "$Top/$L" linear.hex > /dev/null
+status "linear 16 byte records load the same" 0 $?
+grep -c '^:02000004' linear.hex >> out
+same "records written" out <<'END'
+2 files merged: 444 bytes in 7 records, written to merged.hex.
+merged.hex: OK, 7 records (4 data, 1 segment, 1 start, 1 end), 444 data bytes, LF
+2 files merged: 444 bytes in 32 records.
+1
+END
+
+"$Top/hexmerge" --output=refused.hex low.hex changed.hex 2> out
+status "different bytes at one address are refused" 1 $?
+if [ -f refused.hex ]; then
+    fail "nothing written when refused"
+else
+    pass "nothing written when refused"
+fi
+same "overlaps reported" out <<'END'
+hexmerge: low.hex and changed.hex both load 000C0000-000C0175, with different bytes
+hexmerge: 1 overlaps with different bytes; nothing written
+END
+
+"$Top/hexmerge" --overlap=last --output=last.hex low.hex changed.hex \
+    > /dev/null 2>&1
+"$Top/hexdiff" --brief changed.hex last.hex > /dev/null
+status "--overlap=last keeps the last input's bytes" 0 $?
+"$Top/hexmerge" --overlap=first --output=first.hex low.hex changed.hex \
+    > /dev/null 2>&1
+"$Top/hexdiff" --brief "$Top/$L" first.hex > /dev/null
+status "--overlap=first keeps the first input's bytes" 0 $?
+cd "$Top"
+
+finish
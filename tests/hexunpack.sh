@@ -0,0 +1,43 @@
+#
+# hexunpack: each relocatable sample unpacks to an EXE which MakeHex,
+# with the record length from the index, turns back into the same hex
+# file, and to the image and relocations MakeHex --binary makes from the
+# sample's own EXE.  The samples were written on DOS, so carriage
+# returns are left out of the comparison.
+#
+
+. tests/common.sh
+
+echo "hexunpack"
+
+mkdir "$Tmp/unpacked" "$Tmp/binary"
+./hexunpack --exe --image --dir="$Tmp/unpacked" hex_files > "$Tmp/index" \
+    2> "$Tmp/errors"
+status "absolute LEDS.HEX is refused" 1 $?
+same "error for LEDS.HEX" "$Tmp/errors" <<'END'
+hex_files/LEDS.HEX: line 2: no AMD LPD header; not a relocatable hex file
+END
+
+for Name in AMDDHRY SECONDS TESTMON
+do
+    Record=$(grep "^hex_files/$Name.HEX" "$Tmp/index" | cut -f7)
+    (cd "$Tmp/unpacked" && "$Top/Makehex330" --record=$Record $Name) \
+        > /dev/null
+    tr -d '\r' < hex_files/$Name.HEX > "$Tmp/$Name.hex"
+    if cmp -s "$Tmp/$Name.hex" "$Tmp/unpacked/$Name.hex"; then
+        pass "$Name.HEX -> EXE -> MakeHex"
+    else
+        fail "$Name.HEX -> EXE -> MakeHex"
+    fi
+
+    cp hex_files/$Name.EXE "$Tmp/binary/$Name.exe"
+    (cd "$Tmp/binary" && "$Top/Makehex330" --binary $Name) > /dev/null
+    if cmp -s "$Tmp/binary/$Name.img" "$Tmp/unpacked/$Name.img" &&
+       cmp -s "$Tmp/binary/$Name.rel" "$Tmp/unpacked/$Name.rel"; then
+        pass "$Name.HEX image and relocations"
+    else
+        fail "$Name.HEX image and relocations"
+    fi
+done
+
+finish
@@ -0,0 +1,68 @@
+#
+# MakeBin: the five ROM images made from corpusgen programs in one read,
+# with the 16 bit pairs split into byte lanes and each image padded in
+# one buffer, are the ones the original MakeBin wrote, which are pinned
+# here as cksum values and the checksums MakeBin prints; --verify reads
+# them back.  Programs which do not fit in the boot block, or are an
+# odd number of bytes, are refused before any image is written.
+#
+
+. tests/common.sh
+
+echo "MakeBin"
+
+Images="F010_ALL.BIN F010_LOW.BIN F010_HI.BIN F200_ALL.BIN F400_ALL.BIN"
+
+cd "$Tmp"
+"$Top/corpusgen" --size=30000 --fill=mixed --seed=7 mixed.exe > /dev/null
+"$Top/corpusgen" --size=32752 --fill=random --seed=11 full.exe > /dev/null
+"$Top/corpusgen" --size=32753 large.exe > /dev/null
+"$Top/corpusgen" --size=20001 --fill=random --seed=3 odd.exe > /dev/null
+
+"$Top/Makebin330" --verify mixed > out
+status "mixed program" 0 $?
+cksum $Images >> out
+"$Top/Makebin330" full >> out
+status "program which fills the boot block" 0 $?
+cksum $Images >> out
+same "images" out <<'END'
+File F010_ALL.BIN written successfully, checksum = 1E665FF.
+File F010_LOW.BIN written successfully, checksum = 1F223A1.
+File F010_HI.BIN written successfully, checksum = 1F2425E.
+File F200_ALL.BIN written successfully, checksum = 3E465FF.
+File F400_ALL.BIN written successfully, checksum = 7E065FF.
+Images verified.
+1243186137 131072 F010_ALL.BIN
+955525337 131072 F010_LOW.BIN
+833885707 131072 F010_HI.BIN
+601415284 262144 F200_ALL.BIN
+1877794173 524288 F400_ALL.BIN
+File F010_ALL.BIN written successfully, checksum = 1BE0555.
+File F010_LOW.BIN written successfully, checksum = 1DDFE3E.
+File F010_HI.BIN written successfully, checksum = 1DE0717.
+File F200_ALL.BIN written successfully, checksum = 3BC0555.
+File F400_ALL.BIN written successfully, checksum = 7B80555.
+1425263504 131072 F010_ALL.BIN
+28070290 131072 F010_LOW.BIN
+3555251985 131072 F010_HI.BIN
+1026725437 262144 F200_ALL.BIN
+1896256820 524288 F400_ALL.BIN
+END
+
+rm -f $Images
+"$Top/Makebin330" large > out
+status "program too big for the boot block" 2 $?
+"$Top/Makebin330" odd >> out
+status "odd length program" 2 $?
+ls $Images >> out 2> /dev/null
+same "refused before writing" out <<'END'
+
+MakeBin Error -- Program is 7FF1 bytes, too big for F010_ALL.BIN (at most 7FF0)
+
+
+MakeBin Error -- file read failed
+
+END
+cd "$Top"
+
+finish
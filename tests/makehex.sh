@@ -0,0 +1,416 @@
+#
+# MakeHex on corpusgen programs: where the original MakeHex can convert
+# them, the hex files are the ones it wrote, which are pinned here as
+# cksum values, and every other way of reading, formatting and writing
+# the same program must agree with them.
+#
+
+. tests/common.sh
+
+echo "MakeHex"
+
+cd "$Tmp"
+
+#
+# A relocatable program and an absolute one, both well past the 40 KB
+# window the original read its input through, and a DGROUP program
+# small enough for the original to relocate.  The sums come from the
+# original built with a 32 bit DWORD, as on DOS; with a 64 bit one it
+# walks the relocation table in 8 byte steps.
+#
+"$Top/corpusgen" --size=300K --relocs=5000 --fill=mixed --seed=21 big.exe \
+    > /dev/null
+"$Top/corpusgen" --size=200K --fill=mixed --seed=22 abs.exe > /dev/null
+"$Top/corpusgen" --size=30K --relocs=300 --dgroup=400 --fill=mixed \
+    --seed=24 dgs.exe > /dev/null
+"$Top/corpusgen" --size=100K --relocs=300 --dgroup=400 --fill=mixed \
+    --seed=24 dg.exe > /dev/null
+
+"$Top/Makehex330" big > /dev/null &&
+"$Top/Makehex330" abs 1000 > /dev/null &&
+"$Top/Makehex330" dgs 1000 > /dev/null
+status "mapped conversions" 0 $?
+cksum big.hex abs.hex dgs.hex > out
+same "hex files" out <<'END'
+2053146599 777264 big.hex
+4147020834 486496 abs.hex
+2050515887 75896 dgs.hex
+END
+
+#
+# The original could not relocate DGROUP in an image larger than its
+# window.
+#
+"$Top/Makehex330" dg 1000 > /dev/null &&
+"$Top/hexcheck" --quiet dg.hex
+status "100K DGROUP program" 0 $?
+
+#
+# --record: 1 and 255 byte records load the same bytes and relocations
+# as 32 byte ones.  --record=auto picks a length no fixed one beats.
+#
+Good=1
+for Record in 1 255 auto
+do
+    cp big.exe r$Record.exe
+    "$Top/Makehex330" --record=$Record r$Record > /dev/null &&
+    "$Top/hexcheck" --quiet r$Record.hex &&
+    "$Top/hexdiff" --brief big.hex r$Record.hex > /dev/null || Good=0
+done
+if [ $Good = 1 ]; then
+    pass "1, 255 and auto byte records"
+else
+    fail "1, 255 and auto byte records"
+fi
+
+cp "$Top/hex_files/SECONDS.EXE" seconds.exe
+"$Top/Makehex330" --record=auto seconds | grep Estimated > out
+same "auto record length" out <<'END'
+Estimated download time at 19200 baud, 208 byte records: 7.2 seconds (35 lines).
+END
+Record=1
+while [ $Record -le 255 ]
+do
+    "$Top/Makehex330" --record=$Record seconds | grep Estimated
+    Record=$((Record + 1))
+done | awk '$10 < 7.2 { print }' > out
+same "no fixed length is faster" out < /dev/null
+
+#
+# --skip-fill: only the 4K runs of FF in the absolute program are left
+# out, which filling the gaps from an all-FF image shows, and there are
+# no 00 runs to leave out.  The output is the same on 1 and 8 threads,
+# streamed or not.
+#
+"$Top/corpusgen" --size=200K --fill=ff ff.exe > /dev/null
+"$Top/Makehex330" ff 1000 > /dev/null
+cp abs.exe fill.exe
+"$Top/Makehex330" --skip-fill fill 1000 | grep Fill > out
+"$Top/hexdiff" --brief abs.hex fill.hex >> out
+"$Top/hexmerge" --overlap=first --output=merged.hex fill.hex ff.hex \
+    > /dev/null 2>&1
+"$Top/hexdiff" --brief abs.hex merged.hex >> out
+"$Top/Makehex330" --skip-fill=00 - 1000 < abs.exe > zero.hex 2> /dev/null
+"$Top/hexdiff" --brief abs.hex zero.hex >> out
+same "FF runs left out" out <<'END'
+Fill elision skipped 98304 bytes, saving 3072 lines (233472 characters, 124.7 seconds).
+0 bytes changed in 0 ranges, 0 added in 0, 98304 removed in 17; 0 relocations and 0 header fields differ
+0 bytes changed in 0 ranges, 0 added in 0, 0 removed in 0; 0 relocations and 0 header fields differ
+0 bytes changed in 0 ranges, 0 added in 0, 0 removed in 0; 0 relocations and 0 header fields differ
+END
+
+Good=1
+for Threads in 1 8
+do
+    cp abs.exe fill$Threads.exe
+    "$Top/Makehex330" --skip-fill --threads=$Threads fill$Threads 1000 \
+        > /dev/null
+    cmp -s fill$Threads.hex fill.hex || Good=0
+    "$Top/Makehex330" --skip-fill --threads=$Threads - 1000 < abs.exe \
+        2> /dev/null | cmp -s - fill.hex || Good=0
+done
+if [ $Good = 1 ]; then
+    pass "same on 1 and 8 threads, streamed or not"
+else
+    fail "same on 1 and 8 threads, streamed or not"
+fi
+
+#
+# --batch: a directory converted on 4 threads, one bad file among the
+# rest, and a response file of absolute programs give the same files as
+# converting each on its own.
+#
+mkdir batch listed
+cp big.exe "$Top"/hex_files/*.EXE batch
+echo junk > batch/bad.exe
+cp abs.exe dgs.exe listed
+printf 'listed/abs.exe\nlisted/dgs.exe\n' > list
+"$Top/Makehex330" --batch --threads=4 batch > unsorted
+status "directory with a bad file" 2 $?
+sort unsorted > out
+"$Top/Makehex330" --batch --segment=1000 @list >> out
+status "response file" 0 $?
+same "batch results" out <<'END'
+
+
+4 file(s) converted, 1 failed.
+batch/AMDDHRY.HEX written, 386 lines, 15.6 seconds at 19200 baud.
+batch/SECONDS.HEX written, 206 lines, 8.3 seconds at 19200 baud.
+batch/TESTMON.HEX written, 427 lines, 17.3 seconds at 19200 baud.
+batch/bad.exe: MakeHex Error -- file read failed
+batch/big.hex written, 10232 lines, 415.1 seconds at 19200 baud.
+listed/abs.hex written, 6406 lines, 259.8 seconds at 19200 baud.
+listed/dgs.hex written, 1001 lines, 40.5 seconds at 19200 baud.
+
+2 file(s) converted, 0 failed.
+
+END
+
+Good=1
+for Name in AMDDHRY SECONDS TESTMON
+do
+    cp "$Top/hex_files/$Name.EXE" single.exe
+    "$Top/Makehex330" single > /dev/null
+    cmp -s single.hex batch/$Name.HEX || Good=0
+done
+cmp -s batch/big.hex big.hex &&
+cmp -s listed/abs.hex abs.hex &&
+cmp -s listed/dgs.hex dgs.hex || Good=0
+if [ $Good = 1 ]; then
+    pass "same files as single conversions"
+else
+    fail "same files as single conversions"
+fi
+
+#
+# Streaming: a relocatable, an absolute and a DGROUP program read from
+# a redirected file, a pipe or --fd give the same hex as the mapped
+# file, and so does a BIN image piped in.
+#
+"$Top/corpusgen" --size=20K --seed=5 image.bin > /dev/null
+"$Top/Makehex330" image 2000 > /dev/null
+Good=1
+for Args in "big.exe" "abs.exe 1000" "dgs.exe 1000" "image.bin 2000"
+do
+    set -- $Args
+    Hex=${1%.*}.hex
+    "$Top/Makehex330" - $2 < $1 2> /dev/null | cmp -s - $Hex || Good=0
+    cat $1 | "$Top/Makehex330" - $2 2> /dev/null | cmp -s - $Hex || Good=0
+    "$Top/Makehex330" --fd=3 $2 3< $1 2> /dev/null | cmp -s - $Hex || Good=0
+done
+if [ $Good = 1 ]; then
+    pass "redirected, piped and --fd input"
+else
+    fail "redirected, piped and --fd input"
+fi
+cat big.exe | "$Top/Makehex330" - 2> out > /dev/null
+same "stream report" out <<'END'
+327232 bytes streamed in 10232 lines.
+Estimated download time at 19200 baud, 32 byte records: 415.1 seconds.
+END
+
+#
+# Threads: images past twice the smallest chunk a thread takes are
+# formatted the same on 1, 2 and 8 threads, including with a record
+# length which does not divide the chunks.
+#
+"$Top/corpusgen" --size=512K --relocs=20000 --fill=random --seed=25 \
+    huge.exe > /dev/null
+Good=1
+for Args in "big" "abs 1000" "huge"
+do
+    set -- $Args
+    cp $1.exe threads.exe
+    for Record in 32 7
+    do
+        "$Top/Makehex330" --record=$Record --threads=1 threads $2 > /dev/null
+        mv threads.hex one.hex
+        for Threads in 2 8
+        do
+            "$Top/Makehex330" --record=$Record --threads=$Threads threads $2 \
+                > /dev/null
+            cmp -s threads.hex one.hex || Good=0
+        done
+    done
+done
+if [ $Good = 1 ]; then
+    pass "1, 2 and 8 threads"
+else
+    fail "1, 2 and 8 threads"
+fi
+
+#
+# --binary: the image is the program bytes of the EXE, and the sidecar
+# is its 32 byte header, then the relocation table as linear offsets,
+# in the order of the table.  The 300K program's EXE header is 1252
+# paragraphs, with the table 1Ch bytes in; the absolute program's is 2.
+# Streaming gives the same files, and needs --sidecar.
+#
+cp big.exe binary.exe
+"$Top/Makehex330" --binary binary > /dev/null
+dd if=big.exe bs=16 skip=1252 2> /dev/null | cmp -s - binary.img
+status "relocatable image" 0 $?
+od -An -v -tu2 -j28 -N20000 big.exe |
+    awk '{ for (i = 1; i < NF; i += 2) print $(i + 1) * 16 + $i }' > table
+od -An -v -tu4 -j32 binary.rel | awk '{ for (i = 1; i <= NF; i++) print $i }' |
+    cmp -s - table
+status "relocations" 0 $?
+
+cp abs.exe absbin.exe
+"$Top/Makehex330" --binary absbin 1000 > /dev/null
+dd if=abs.exe bs=16 skip=2 2> /dev/null | cmp -s - absbin.img
+status "absolute image" 0 $?
+od -An -tx1 -N32 binary.rel | awk '{ $1 = $1; print }' > out
+od -An -tx1 absbin.rel | awk '{ $1 = $1; print }' >> out
+same "sidecar headers" out <<'END'
+45 38 36 52 45 4c 4f 31 12 4b 00 4b 00 01 00 00
+00 00 00 00 00 b0 04 00 00 b0 04 00 88 13 00 00
+45 38 36 52 45 4c 4f 31 12 32 00 32 00 01 00 00
+00 00 00 10 00 20 03 00 00 20 03 00 00 00 00 00
+END
+
+"$Top/Makehex330" --binary --sidecar=streamed.rel - < big.exe \
+    > streamed.img 2> /dev/null &&
+cmp -s streamed.img binary.img &&
+cmp -s streamed.rel binary.rel
+status "streamed" 0 $?
+"$Top/Makehex330" --binary - < big.exe > /dev/null 2>&1
+status "streamed without --sidecar" 2 $?
+
+#
+# Relocation tables, read a block of 1024 entries at a time: tables of
+# one entry less, exactly one block and one entry more, and a DGROUP
+# table of a block and a half, give the original's hex files.  The most
+# an EXE can hold, 65535, is too many for the original; its hex file
+# unpacks to the image and sidecar --binary writes, whose relocations
+# are the EXE's table.  Streaming it gives the same hex.
+#
+for Relocs in 1023 1024 1025
+do
+    "$Top/corpusgen" --size=30K --relocs=$Relocs --spread=cluster \
+        --seed=$Relocs relocs$Relocs.exe > /dev/null
+    "$Top/Makehex330" relocs$Relocs > /dev/null
+done
+"$Top/corpusgen" --size=30K --relocs=1500 --dgroup=400 --seed=26 \
+    dgroup.exe > /dev/null
+"$Top/Makehex330" dgroup 1000 > /dev/null
+cksum relocs1023.hex relocs1024.hex relocs1025.hex dgroup.hex > out
+same "block boundaries" out <<'END'
+3277584078 82788 relocs1023.hex
+876814435 82788 relocs1024.hex
+3617168472 82864 relocs1025.hex
+331710264 87296 dgroup.hex
+END
+
+"$Top/corpusgen" --size=160K --relocs=65535 --seed=23 many.exe > /dev/null
+cp many.exe manybin.exe
+mkdir unpacked
+"$Top/Makehex330" many > /dev/null &&
+"$Top/Makehex330" --binary manybin > /dev/null &&
+"$Top/hexunpack" --image --dir=unpacked many.hex > /dev/null &&
+cmp -s unpacked/many.img manybin.img &&
+cmp -s unpacked/many.rel manybin.rel
+status "65535 relocations unpacked" 0 $?
+od -An -v -tu2 -j28 -N262140 many.exe |
+    awk '{ for (i = 1; i < NF; i += 2) print $(i + 1) * 16 + $i }' > table
+od -An -v -tu4 -j32 manybin.rel |
+    awk '{ for (i = 1; i <= NF; i++) print $i }' | cmp -s - table
+status "65535 relocations in the sidecar" 0 $?
+"$Top/Makehex330" - < many.exe 2> /dev/null | cmp -s - many.hex
+status "65535 relocations streamed" 0 $?
+
+#
+# --stats and --trace: the table has a row for each phase, with the
+# bytes and records of the conversion, and the trace is a JSON array of
+# one complete event per line, for a single conversion and for a batch
+# on 4 threads.  Times vary, so only their form is checked.
+#
+Event='\{"name":"[a-z]+","cat":"e86","ph":"X","ts":[0-9]+\.[0-9]{3},'
+Event=$Event'"dur":[0-9]+\.[0-9]{3},"pid":[0-9]+,"tid":[0-9]+,"args":'
+Event=$Event'\{"input":"[^"]*","bytes_in":[0-9]+,"bytes_out":[0-9]+,'
+Event=$Event'"records":[0-9]+\}\}'
+Row='^(Phase .*|[a-z]+ +[0-9]+ +[0-9]+\.[0-9]{3}( +[0-9]+){3} +[0-9.]+|'
+Row=$Row'total +[0-9]+\.[0-9]{3})$'
+
+#
+# trace_ok <file> checks a trace is "[", events each but the last
+# followed by a comma, and "]".
+#
+trace_ok() {
+    [ "$(sed -n '1p' "$1")" = "[" ] &&
+    [ "$(sed -n '$p' "$1")" = "]" ] &&
+    [ $(sed '1d;$d' "$1" | wc -l) -gt 0 ] &&
+    [ $(sed '1d;$d' "$1" | sed '$d' | grep -c -v -E "^$Event,\$") = 0 ] &&
+    sed '1d;$d' "$1" | sed -n '$p' | grep -q -E "^$Event\$"
+}
+
+cp big.exe stats.exe
+"$Top/Makehex330" --stats --trace=stats.json stats > report
+status "--stats --trace" 0 $?
+sed -n '/^Phase/,/^total/p' report > table
+awk 'NR > 1 && $1 != "write" && $1 != "total" { print $1, $2, $4, $5, $6 }' \
+    table > out
+grep -c -v -E "$Row" table >> out
+same "stats table" out <<'END'
+header 1 20032 88 2
+data 1 307200 729664 9604
+relocations 1 20000 47512 626
+convert 1 327232 777264 10232
+0
+END
+
+trace_ok stats.json
+status "trace well formed" 0 $?
+grep '"name":"convert"' stats.json |
+    sed 's/.*"bytes_out":\([0-9]*\),"records":\([0-9]*\).*/\1 \2/' > out
+echo $(wc -c < stats.hex) $(wc -l < stats.hex) | same "trace totals" out
+
+"$Top/Makehex330" --batch --threads=4 --trace=batch.json batch > /dev/null
+trace_ok batch.json
+status "batch trace well formed" 0 $?
+grep -c '"name":"convert"' batch.json > out
+same "one convert event per file" out <<'END'
+4
+END
+
+"$Top/Makehex330" --trace="$Tmp/no/trace.json" stats > out
+status "trace file which cannot be created" 2 $?
+
+#
+# --delta: against the hex file of the program it came from, a
+# relocatable program with two changed bytes and a changed relocated
+# word sends just those, plus the one entry naming the word; a delta
+# which would be slower than the full file is replaced by it.
+#
+"$Top/corpusgen" --size=4K --relocs=16 --spread=sorted --seed=3 old.exe \
+    > /dev/null
+"$Top/Makehex330" old > /dev/null
+
+#
+# The program starts 60h bytes into the EXE.  Change two plain bytes at
+# 800h, and the word at 490h, which the third relocation names.
+#
+cp old.exe new.exe
+printf '\125\252' | dd of=new.exe bs=1 seek=2144 conv=notrunc 2> /dev/null
+printf '\001' | dd of=new.exe bs=1 seek=1264 conv=notrunc 2> /dev/null
+
+"$Top/Makehex330" --delta=old.hex new > out
+status "delta against old.hex" 0 $?
+same "changed byte, word and entry" new.hex <<'END'
+:0400000300000000F9
+:1C0000020000414D44204C5044200112010001000000100000001040000010402B
+:02049000010069
+:0208000055AAF7
+:041008009004000050
+:00000001FF
+END
+"$Top/hexcheck" --quiet new.hex
+status "delta is a good hex file" 0 $?
+grep Delta out > left
+same "records left out" left <<'END'
+Delta against old.hex left out 127 unchanged records (9652 characters, 5.2 seconds).
+END
+
+#
+# 2048 entries naming every word of a 4K program; change every other
+# word.  Its entries would go out one to a record, so the full file,
+# which is faster, is sent instead.  The program starts 2020h bytes in.
+#
+"$Top/corpusgen" --size=4K --relocs=2048 --spread=dense --seed=5 dense.exe \
+    > /dev/null
+"$Top/Makehex330" dense > /dev/null
+cp dense.exe half.exe
+for Word in $(seq 0 4 4092)
+do
+    printf '\356\356' |
+        dd of=half.exe bs=1 seek=$((8224 + Word)) conv=notrunc 2> /dev/null
+done
+cp half.exe full.exe
+"$Top/Makehex330" full > /dev/null
+"$Top/Makehex330" --delta=dense.hex half > out
+status "delta against dense.hex" 0 $?
+cmp -s half.hex full.hex
+status "slower delta replaced by the full file" 0 $?
+
+cd "$Top"
+finish